@@ -67,12 +67,15 @@ static int rdd_aligned_read(RDD_READER *r, unsigned char *buf, unsigned nbyte,
 static int rdd_aligned_tell(RDD_READER *r, rdd_count_t *pos);
 static int rdd_aligned_seek(RDD_READER *r, rdd_count_t pos);
 static int rdd_aligned_close(RDD_READER *r, int recurse);
+static int rdd_aligned_pread(RDD_READER *r, unsigned char *buf, unsigned nbyte,
+			rdd_count_t pos, unsigned *nread);
 
 static RDD_READ_OPS aligned_read_ops = {
 	rdd_aligned_read,
 	rdd_aligned_tell,
 	rdd_aligned_seek,
-	rdd_aligned_close
+	rdd_aligned_close,
+	rdd_aligned_pread
 };
 
 int
@@ -219,6 +222,23 @@ rdd_aligned_read(RDD_READER *self, unsigned char *buf, unsigned nbyte,
 	return RDD_OK;
 }
 
+/* Positional reads are only forwarded if they are fully aligned.
+ */
+static int
+rdd_aligned_pread(RDD_READER *self, unsigned char *buf, unsigned nbyte,
+			rdd_count_t pos, unsigned *nread)
+{
+	RDD_ALIGNED_READER *state = self->state;
+
+	if (MOD_ALIGN(state, (unsigned long) buf) != 0
+	||  MOD_ALIGN(state, nbyte) != 0
+	||  MOD_ALIGN(state, pos) != 0) {
+		return RDD_BADARG;
+	}
+
+	return rdd_reader_pread(state->parent, buf, nbyte, pos, nread);
+}
+
 static int
 rdd_aligned_tell(RDD_READER *self, rdd_count_t *pos)
 {
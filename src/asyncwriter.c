@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2004\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "rdd.h"
+#include "writer.h"
+
+/* An async writer is a fan-out writer (see fanoutwriter.c) with a
+ * single child.  Its input is copied into a ring of buffers, and a
+ * background thread drains the ring into the parent writer.  Small
+ * writes are gathered into a single buffer, so the parent receives
+ * writes of (at most) one buffer at a time.
+ *
+ * If the parent fails, the background thread aborts the ring.  The
+ * next write (or the close) then returns the parent's error code.
+ */
+
+#define ASYNC_NBUF 8
+
+int
+rdd_open_async_writer(RDD_WRITER **self, RDD_WRITER *parent,
+			unsigned queue_bytes)
+{
+	if (self == 0 || parent == 0) {
+		return RDD_BADARG;
+	}
+	if (queue_bytes < ASYNC_NBUF) {
+		return RDD_BADARG;
+	}
+
+	return rdd_open_fanout_writer(self, &parent, 1,
+				ASYNC_NBUF, queue_bytes / ASYNC_NBUF);
+}
@@ -46,11 +46,14 @@
 /** \brief Atomic reader state.
  *
  *  An atomic reader forwards all operations to its parent
- *  in the reader stack, so it only needs to keep track of
- *  that parent.
+ *  in the reader stack.  It caches the parent's file position,
+ *  so that it does not have to ask the parent for its position
+ *  before every read.
  */
 typedef struct _RDD_ATOMIC_READER {
 	RDD_READER *parent;
+	rdd_count_t pos;	/* parent's file position */
+	int         pos_valid;	/* is pos valid? */
 } RDD_ATOMIC_READER;
 
 
@@ -61,12 +64,15 @@ static int rdd_atomic_read(RDD_READER *r, unsigned char *buf, unsigned nbyte,
 static int rdd_atomic_tell(RDD_READER *r, rdd_count_t *pos);
 static int rdd_atomic_seek(RDD_READER *r, rdd_count_t pos);
 static int rdd_atomic_close(RDD_READER *r, int recurse);
+static int rdd_atomic_pread(RDD_READER *r, unsigned char *buf, unsigned nbyte,
+			rdd_count_t pos, unsigned *nread);
 
 static RDD_READ_OPS atomic_read_ops = {
 	rdd_atomic_read,
 	rdd_atomic_tell,
 	rdd_atomic_seek,
-	rdd_atomic_close
+	rdd_atomic_close,
+	rdd_atomic_pread
 };
 
 int
@@ -102,18 +108,20 @@ rdd_atomic_read(RDD_READER *self, unsigned char *buf, unsigned nbyte,
 
 	/* Save current position.
 	 */
-	if ((rc1 = rdd_reader_tell(state->parent, &pos)) != RDD_OK) {
+	if ((rc1 = rdd_atomic_tell(self, &pos)) != RDD_OK) {
 		return rc1;
 	}
 
 	rc2 = rdd_reader_read(state->parent, buf, nbyte, nread);
 	if (rc2 == RDD_OK) {
+		state->pos = pos + *nread;
 		return RDD_OK;
 	}
 
 	/* Error occurred: restore current position.
 	 */
 	if ((rc1 = rdd_reader_seek(state->parent, pos)) != RDD_OK) {
+		state->pos_valid = 0;
 		return rc1;
 	}
 
@@ -124,16 +132,42 @@ static int
 rdd_atomic_tell(RDD_READER *self, rdd_count_t *pos)
 {
 	RDD_ATOMIC_READER *state = self->state;
+	int rc;
+
+	if (!state->pos_valid) {
+		if ((rc = rdd_reader_tell(state->parent, &state->pos)) != RDD_OK) {
+			return rc;
+		}
+		state->pos_valid = 1;
+	}
 
-	return rdd_reader_tell(state->parent, pos);
+	*pos = state->pos;
+	return RDD_OK;
 }
 
 static int
 rdd_atomic_seek(RDD_READER *self, rdd_count_t pos)
+{
+	RDD_ATOMIC_READER *state = self->state;
+	int rc;
+
+	if ((rc = rdd_reader_seek(state->parent, pos)) != RDD_OK) {
+		state->pos_valid = 0;
+		return rc;
+	}
+
+	state->pos = pos;
+	state->pos_valid = 1;
+	return RDD_OK;
+}
+
+static int
+rdd_atomic_pread(RDD_READER *self, unsigned char *buf, unsigned nbyte,
+			rdd_count_t pos, unsigned *nread)
 {
 	RDD_ATOMIC_READER *state = self->state;
 
-	return rdd_reader_seek(state->parent, pos);
+	return rdd_reader_pread(state->parent, buf, nbyte, pos, nread);
 }
 
 static int
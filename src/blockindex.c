@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "rdd.h"
+#include "blockindex.h"
+
+struct _RDD_BLOCKINDEX {
+	int                    fd;
+	unsigned char         *map;		/* the mapped file */
+	size_t                 mapsize;
+	RDD_BLOCKINDEX_HEADER  header;		/* in host byte order */
+	const unsigned char   *records;		/* first digest */
+};
+
+static uint16_t
+swap16(uint16_t n)
+{
+	return (uint16_t) ((n << 8) | (n >> 8));
+}
+
+static uint32_t
+swap32(uint32_t n)
+{
+	return ((n << 24) & 0xff000000)
+	     | ((n <<  8) & 0x00ff0000)
+	     | ((n >>  8) & 0x0000ff00)
+	     | ((n >> 24) & 0x000000ff);
+}
+
+static uint64_t
+swap64(uint64_t n)
+{
+	return ((uint64_t) swap32((uint32_t) n) << 32)
+	     | swap32((uint32_t) (n >> 32));
+}
+
+static void
+swap_header(RDD_BLOCKINDEX_HEADER *hdr)
+{
+	hdr->magic = swap32(hdr->magic);
+	hdr->version = swap16(hdr->version);
+	hdr->algorithm = swap16(hdr->algorithm);
+	hdr->digestsize = swap32(hdr->digestsize);
+	hdr->blocksize = swap32(hdr->blocksize);
+	hdr->offset = swap64(hdr->offset);
+	hdr->imagesize = swap64(hdr->imagesize);
+	hdr->nblock = swap64(hdr->nblock);
+}
+
+/* Checks the header against itself and against the file size.
+ */
+static int
+check_header(RDD_BLOCKINDEX_HEADER *hdr, size_t filesize)
+{
+	if (hdr->magic == swap32(RDD_BLOCKINDEX_MAGIC)) {
+		swap_header(hdr);
+	}
+	if (hdr->magic != RDD_BLOCKINDEX_MAGIC
+	||  hdr->version != RDD_BLOCKINDEX_VERSION
+	||  hdr->algorithm >= RDD_HASH_NALG
+	||  hdr->digestsize != rdd_hash_size((rdd_hash_alg_t) hdr->algorithm)
+	||  hdr->blocksize == 0) {
+		return RDD_ESYNTAX;
+	}
+	if (hdr->nblock != (hdr->imagesize + hdr->blocksize - 1) / hdr->blocksize) {
+		return RDD_ESYNTAX;
+	}
+	if ((filesize - RDD_BLOCKINDEX_HDRSIZE) / hdr->digestsize != hdr->nblock
+	||  (filesize - RDD_BLOCKINDEX_HDRSIZE) % hdr->digestsize != 0) {
+		return RDD_ESYNTAX;
+	}
+	return RDD_OK;
+}
+
+int
+rdd_open_blockindex(RDD_BLOCKINDEX **self, const char *path)
+{
+	RDD_BLOCKINDEX *idx = 0;
+	struct stat info;
+	void *map = MAP_FAILED;
+	int fd = -1;
+	int rc = RDD_OK;
+
+	if (self == 0 || path == 0) {
+		return RDD_BADARG;
+	}
+
+	if ((idx = calloc(1, sizeof(RDD_BLOCKINDEX))) == 0) {
+		return RDD_NOMEM;
+	}
+
+	if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &info) < 0) {
+		rc = RDD_EOPEN;
+		goto error;
+	}
+	if (info.st_size < RDD_BLOCKINDEX_HDRSIZE) {
+		rc = RDD_ESYNTAX;
+		goto error;
+	}
+
+	map = mmap(0, (size_t) info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		rc = RDD_EOPEN;
+		goto error;
+	}
+
+	memcpy(&idx->header, map, sizeof idx->header);
+	if ((rc = check_header(&idx->header, (size_t) info.st_size)) != RDD_OK) {
+		goto error;
+	}
+
+	idx->fd = fd;
+	idx->map = map;
+	idx->mapsize = (size_t) info.st_size;
+	idx->records = idx->map + RDD_BLOCKINDEX_HDRSIZE;
+
+	*self = idx;
+	return RDD_OK;
+
+error:
+	*self = 0;
+	if (map != MAP_FAILED) munmap(map, (size_t) info.st_size);
+	if (fd >= 0) close(fd);
+	free(idx);
+	return rc;
+}
+
+int
+rdd_close_blockindex(RDD_BLOCKINDEX *idx)
+{
+	int rc = RDD_OK;
+
+	if (munmap(idx->map, idx->mapsize) < 0) {
+		rc = RDD_ECLOSE;
+	}
+	if (close(idx->fd) < 0) {
+		rc = RDD_ECLOSE;
+	}
+	free(idx);
+	return rc;
+}
+
+const RDD_BLOCKINDEX_HEADER *
+rdd_blockindex_header(RDD_BLOCKINDEX *idx)
+{
+	return &idx->header;
+}
+
+const unsigned char *
+rdd_blockindex_digest(RDD_BLOCKINDEX *idx, rdd_count_t blocknum)
+{
+	if (blocknum >= idx->header.nblock) {
+		return 0;
+	}
+	return idx->records + blocknum * idx->header.digestsize;
+}
+
+unsigned
+rdd_blockindex_blocksize(RDD_BLOCKINDEX *idx, rdd_count_t blocknum)
+{
+	const RDD_BLOCKINDEX_HEADER *hdr = &idx->header;
+
+	if (blocknum >= hdr->nblock) {
+		return 0;
+	}
+	if (blocknum == hdr->nblock - 1 && hdr->imagesize % hdr->blocksize != 0) {
+		return (unsigned) (hdr->imagesize % hdr->blocksize);
+	}
+	return hdr->blocksize;
+}
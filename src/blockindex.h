@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+
+#ifndef __blockindex_h__
+#define __blockindex_h__
+
+/** @file
+ *  \brief Binary block-digest index files.
+ *
+ *  A block index holds one digest for each block of an image.  It
+ *  starts with a fixed-size header, followed by one fixed-width record
+ *  (the raw digest) per block, so the digest of block \c i lives at
+ *  offset <tt>RDD_BLOCKINDEX_HDRSIZE + i * digestsize</tt>.  Index
+ *  files are written by the block-index filter
+ *  (\c rdd_new_blockindex_filter()) and are mapped into memory for
+ *  reading, so any block can be looked up without parsing.
+ *
+ *  Header fields are stored in the byte order of the host that wrote
+ *  the file; readers on other hosts detect this through the magic
+ *  value and swap the fields.  Digests are byte strings and are never
+ *  swapped.
+ */
+
+#include <stdint.h>
+
+#include "rdd.h"
+#include "hashengine.h"
+
+#define RDD_BLOCKINDEX_MAGIC    0x49424452	/* "RDBI" on little-endian hosts */
+#define RDD_BLOCKINDEX_VERSION  0x0100
+#define RDD_BLOCKINDEX_HDRSIZE  64
+
+typedef struct _RDD_BLOCKINDEX_HEADER {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t algorithm;	/**< an \c rdd_hash_alg_t value */
+	uint32_t digestsize;	/**< record size in bytes */
+	uint32_t blocksize;	/**< bytes per block; the last may be shorter */
+	uint64_t offset;	/**< image offset of block 0 */
+	uint64_t imagesize;	/**< # bytes covered by the index */
+	uint64_t nblock;	/**< # records */
+	uint8_t  reserved[24];
+} RDD_BLOCKINDEX_HEADER;
+
+typedef struct _RDD_BLOCKINDEX RDD_BLOCKINDEX;
+
+/** \brief Opens and maps a block-index file.
+ *  \param idx output value: the index
+ *  \param path the index file
+ *  \return Returns \c RDD_OK on success, \c RDD_EOPEN if the file
+ *  cannot be opened or mapped, and \c RDD_ESYNTAX if it is not a
+ *  block index or if its size does not match its header.
+ */
+int rdd_open_blockindex(RDD_BLOCKINDEX **idx, const char *path);
+
+/** \brief Unmaps and closes a block index.
+ */
+int rdd_close_blockindex(RDD_BLOCKINDEX *idx);
+
+/** \brief Returns the (byte-order corrected) header of an index.
+ */
+const RDD_BLOCKINDEX_HEADER *rdd_blockindex_header(RDD_BLOCKINDEX *idx);
+
+/** \brief Looks up the digest of a block.
+ *  \param idx the index
+ *  \param blocknum the block number, counting from 0
+ *  \return Returns a pointer to the block's digest inside the mapped
+ *  file, or 0 if \c blocknum is out of range.
+ */
+const unsigned char *rdd_blockindex_digest(RDD_BLOCKINDEX *idx,
+		rdd_count_t blocknum);
+
+/** \brief Returns the size of a block in bytes; only the last block
+ *  may be shorter than the block size.  Returns 0 if \c blocknum is
+ *  out of range.
+ */
+unsigned rdd_blockindex_blocksize(RDD_BLOCKINDEX *idx, rdd_count_t blocknum);
+
+/** \brief Reports a block whose digest does not match the index.
+ *  \param blocknum the block number
+ *  \param expected the digest in the index, or 0 if the index has
+ *  no record for \c blocknum
+ *  \param computed the digest of the data, or 0 if the data ended
+ *  before block \c blocknum
+ *  \param mdsize the digest size in bytes
+ *  \param env the environment passed to the verification filter
+ */
+typedef void
+(*rdd_blockindex_error_fun)(rdd_count_t blocknum,
+		const unsigned char *expected, const unsigned char *computed,
+		unsigned mdsize, void *env);
+
+#endif /* __blockindex_h__ */
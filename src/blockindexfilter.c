@@ -0,0 +1,512 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+/*
+ * Block-index filters.  The writing filter stores the digest of every
+ * block in a binary block-index file (see blockindex.h); the records
+ * are collected in a large buffer and written with few write() calls.
+ * The verification filter compares the digest of every block with
+ * the corresponding record of a mapped index.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "rdd.h"
+#include "rdd_internals.h"
+#include "error.h"
+#include "writer.h"
+#include "filter.h"
+#include "outfile.h"
+
+#define BLOCKINDEX_BUFSIZE	(1024 * 1024)	/* bytes */
+
+typedef struct _RDD_BLOCKINDEX_FILTER {
+	RDD_HASH               hash;
+	unsigned               mdsize;
+	RDD_BLOCKINDEX_HEADER  header;
+	char                  *path;
+	int                    fd;
+	unsigned char         *buf;		/* records not yet written */
+	unsigned               nbuf;		/* # bytes in buf */
+} RDD_BLOCKINDEX_FILTER;
+
+typedef struct _RDD_VERIFY_BLOCKINDEX_FILTER {
+	RDD_BLOCKINDEX          *idx;
+	RDD_HASH                 hash;
+	unsigned                 mdsize;
+	rdd_count_t              blocknum;	/* current block */
+	rdd_count_t              end;		/* one past the last block to check */
+	int                      range;		/* check a range of blocks only? */
+	rdd_count_t              num_error;	/* error count */
+	rdd_blockindex_error_fun error_fun;	/* callback function */
+	void                    *error_env;	/* callback environment */
+} RDD_VERIFY_BLOCKINDEX_FILTER;
+
+static int blockindex_input(RDD_FILTER *f,
+			const unsigned char *buf, unsigned nbyte);
+static int blockindex_block(RDD_FILTER *f, unsigned nbyte);
+static int blockindex_close(RDD_FILTER *f);
+static int blockindex_free(RDD_FILTER *f);
+static int blockindex_save(RDD_FILTER *f, FILE *fp);
+static int blockindex_restore(RDD_FILTER *f, FILE *fp);
+static int blockindex_blocks(RDD_FILTER *f,
+			const unsigned char *buf, unsigned nblock);
+
+static int verify_input(RDD_FILTER *f,
+			const unsigned char *buf, unsigned nbyte);
+static int verify_block(RDD_FILTER *f, unsigned nbyte);
+static int verify_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte);
+static int verify_free(RDD_FILTER *f);
+
+static RDD_FILTER_OPS blockindex_ops = {
+	blockindex_input,
+	blockindex_block,
+	blockindex_close,
+	0,
+	blockindex_free,
+	blockindex_save,
+	blockindex_restore,
+	blockindex_blocks
+};
+
+static RDD_FILTER_OPS verify_ops = {
+	verify_input,
+	verify_block,
+	0,	/* close */
+	verify_get_result,
+	verify_free
+};
+
+/* Writes nbyte bytes at the current file position.
+ */
+static int
+write_all(int fd, const unsigned char *buf, size_t nbyte)
+{
+	ssize_t n;
+
+	while (nbyte > 0) {
+		if ((n = write(fd, buf, nbyte)) < 0) {
+			if (errno == EINTR) continue;
+			return RDD_EWRITE;
+		}
+		buf += n;
+		nbyte -= (size_t) n;
+	}
+	return RDD_OK;
+}
+
+static int
+flush_records(RDD_BLOCKINDEX_FILTER *state)
+{
+	int rc;
+
+	if (state->nbuf == 0) {
+		return RDD_OK;
+	}
+	if ((rc = write_all(state->fd, state->buf, state->nbuf)) != RDD_OK) {
+		return rc;
+	}
+	state->nbuf = 0;
+	return RDD_OK;
+}
+
+static int
+write_header(RDD_BLOCKINDEX_FILTER *state)
+{
+	if (pwrite(state->fd, &state->header, sizeof state->header, 0)
+			!= (ssize_t) sizeof state->header) {
+		return RDD_EWRITE;
+	}
+	return RDD_OK;
+}
+
+int
+rdd_new_blockindex_filter(RDD_FILTER **self, rdd_hash_alg_t alg,
+		unsigned blocksize, rdd_count_t offset,
+		const char *outpath, int overwrite)
+{
+	RDD_FILTER *f = 0;
+	RDD_BLOCKINDEX_FILTER *state = 0;
+	int hash_ok = 0;
+	int fd = -1;
+	int rc;
+
+	if (self == 0 || outpath == 0 || alg >= RDD_HASH_NALG) {
+		return RDD_BADARG;
+	}
+
+	rc = rdd_new_filter(&f, &blockindex_ops,
+			sizeof(RDD_BLOCKINDEX_FILTER), blocksize);
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state = (RDD_BLOCKINDEX_FILTER *) f->state;
+	state->fd = -1;
+
+	if ((rc = rdd_hash_init(&state->hash, alg)) != RDD_OK) {
+		goto error;
+	}
+	hash_ok = 1;
+	state->mdsize = rdd_hash_size(alg);
+
+	if ((state->path = malloc(strlen(outpath) + 1)) == 0
+	||  (state->buf = malloc(BLOCKINDEX_BUFSIZE)) == 0) {
+		rc = RDD_NOMEM;
+		goto error;
+	}
+	strcpy(state->path, outpath);
+
+	if ((rc = outfile_open(&fd, outpath, overwrite)) != RDD_OK) {
+		goto error;
+	}
+	state->fd = fd;
+
+	state->header.magic = RDD_BLOCKINDEX_MAGIC;
+	state->header.version = RDD_BLOCKINDEX_VERSION;
+	state->header.algorithm = (uint16_t) alg;
+	state->header.digestsize = state->mdsize;
+	state->header.blocksize = blocksize;
+	state->header.offset = offset;
+	state->header.imagesize = 0;
+	state->header.nblock = 0;
+
+	/* The header is rewritten on close; until then the file size
+	 * does not match the header, which marks the index as incomplete.
+	 */
+	if ((rc = write_header(state)) != RDD_OK) {
+		goto error;
+	}
+	if (lseek(fd, RDD_BLOCKINDEX_HDRSIZE, SEEK_SET) < 0) {
+		rc = RDD_ESEEK;
+		goto error;
+	}
+
+	*self = f;
+	return RDD_OK;
+
+error:
+	*self = 0;
+	if (fd >= 0) close(fd);
+	if (hash_ok) rdd_hash_free(&state->hash);
+	free(state->buf);
+	free(state->path);
+	free(state);
+	free(f);
+	return rc;
+}
+
+static int
+blockindex_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
+{
+	RDD_BLOCKINDEX_FILTER *state = (RDD_BLOCKINDEX_FILTER *) f->state;
+
+	state->header.imagesize += nbyte;
+
+	return rdd_hash_update(&state->hash, buf, nbyte);
+}
+
+/* Appends the digest of the current block to the record buffer.
+ */
+static int
+blockindex_block(RDD_FILTER *f, unsigned nbyte)
+{
+	RDD_BLOCKINDEX_FILTER *state = (RDD_BLOCKINDEX_FILTER *) f->state;
+	int rc;
+
+	if (state->nbuf + state->mdsize > BLOCKINDEX_BUFSIZE) {
+		if ((rc = flush_records(state)) != RDD_OK) {
+			return rc;
+		}
+	}
+	rc = rdd_hash_final(&state->hash, state->buf + state->nbuf);
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state->nbuf += state->mdsize;
+	state->header.nblock++;
+
+	return rdd_hash_reset(&state->hash);
+}
+
+static int
+blockindex_blocks(RDD_FILTER *f, const unsigned char *buf, unsigned nblock)
+{
+	int rc;
+
+	for (; nblock > 0; nblock--) {
+		if ((rc = blockindex_input(f, buf, f->blocksize)) != RDD_OK) {
+			return rc;
+		}
+		if ((rc = blockindex_block(f, f->blocksize)) != RDD_OK) {
+			return rc;
+		}
+		buf += f->blocksize;
+	}
+	return RDD_OK;
+}
+
+static int
+blockindex_close(RDD_FILTER *f)
+{
+	RDD_BLOCKINDEX_FILTER *state = (RDD_BLOCKINDEX_FILTER *) f->state;
+	int rc;
+
+	if ((rc = flush_records(state)) != RDD_OK) {
+		return rc;
+	}
+	if ((rc = write_header(state)) != RDD_OK) {
+		return rc;
+	}
+	outfile_close(state->fd, state->path);
+	state->fd = -1;
+
+	return RDD_OK;
+}
+
+static int
+blockindex_free(RDD_FILTER *f)
+{
+	RDD_BLOCKINDEX_FILTER *state = (RDD_BLOCKINDEX_FILTER *) f->state;
+
+	if (state->fd >= 0) {
+		(void) close(state->fd);
+	}
+	free(state->buf);
+	free(state->path);
+
+	return rdd_hash_free(&state->hash);
+}
+
+/* The saved state consists of the algorithm, the number of records
+ * and bytes so far, and the digest state of the current block.
+ */
+static int
+blockindex_save(RDD_FILTER *f, FILE *fp)
+{
+	RDD_BLOCKINDEX_FILTER *state = (RDD_BLOCKINDEX_FILTER *) f->state;
+	uint32_t alg = state->header.algorithm;
+	int rc;
+
+	if ((rc = flush_records(state)) != RDD_OK) {
+		return rc;
+	}
+	if (fsync(state->fd) < 0) {
+		return RDD_EWRITE;
+	}
+
+	if (fwrite(&alg, sizeof alg, 1, fp) < 1
+	||  fwrite(&state->header.nblock, sizeof state->header.nblock, 1, fp) < 1
+	||  fwrite(&state->header.imagesize, sizeof state->header.imagesize, 1, fp) < 1) {
+		return RDD_EWRITE;
+	}
+	return rdd_hash_save(&state->hash, fp);
+}
+
+static int
+blockindex_restore(RDD_FILTER *f, FILE *fp)
+{
+	RDD_BLOCKINDEX_FILTER *state = (RDD_BLOCKINDEX_FILTER *) f->state;
+	uint64_t nblock, imagesize;
+	off_t size;
+	uint32_t alg;
+	int rc;
+
+	if (fread(&alg, sizeof alg, 1, fp) < 1
+	||  fread(&nblock, sizeof nblock, 1, fp) < 1
+	||  fread(&imagesize, sizeof imagesize, 1, fp) < 1) {
+		return RDD_ESYNTAX;
+	}
+	if (alg != state->header.algorithm) {
+		return RDD_ESYNTAX;
+	}
+	if ((rc = rdd_hash_restore(&state->hash, fp)) != RDD_OK) {
+		return rc;
+	}
+	state->header.nblock = nblock;
+	state->header.imagesize = imagesize;
+	state->nbuf = 0;
+
+	size = (off_t) (RDD_BLOCKINDEX_HDRSIZE + nblock * state->mdsize);
+	if (ftruncate(state->fd, size) < 0) {
+		return RDD_EWRITE;
+	}
+	if (lseek(state->fd, size, SEEK_SET) < 0) {
+		return RDD_ESEEK;
+	}
+	return RDD_OK;
+}
+
+int
+rdd_new_verify_blockindex_filter(RDD_FILTER **self, RDD_BLOCKINDEX *idx,
+		rdd_count_t first, rdd_count_t count,
+		rdd_blockindex_error_fun error_fun, void *error_env)
+{
+	const RDD_BLOCKINDEX_HEADER *hdr;
+	RDD_FILTER *f = 0;
+	RDD_VERIFY_BLOCKINDEX_FILTER *state = 0;
+	int rc;
+
+	if (self == 0 || idx == 0) {
+		return RDD_BADARG;
+	}
+	hdr = rdd_blockindex_header(idx);
+	if (first > hdr->nblock || count > hdr->nblock - first) {
+		return RDD_BADARG;
+	}
+
+	rc = rdd_new_filter(&f, &verify_ops,
+			sizeof(RDD_VERIFY_BLOCKINDEX_FILTER), hdr->blocksize);
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state = (RDD_VERIFY_BLOCKINDEX_FILTER *) f->state;
+
+	rc = rdd_hash_init(&state->hash, (rdd_hash_alg_t) hdr->algorithm);
+	if (rc != RDD_OK) {
+		free(state);
+		free(f);
+		return rc;
+	}
+
+	state->idx = idx;
+	state->mdsize = hdr->digestsize;
+	state->blocknum = first;
+	state->range = first > 0 || count > 0;
+	state->end = count > 0 ? first + count : hdr->nblock;
+	state->num_error = 0;
+	state->error_fun = error_fun;
+	state->error_env = error_env;
+
+	*self = f;
+	return RDD_OK;
+}
+
+static int
+verify_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
+{
+	RDD_VERIFY_BLOCKINDEX_FILTER *state =
+		(RDD_VERIFY_BLOCKINDEX_FILTER *) f->state;
+
+	if (state->blocknum >= state->end) {
+		return RDD_OK;	/* past the range or the index */
+	}
+	return rdd_hash_update(&state->hash, buf, nbyte);
+}
+
+static void
+report_error(RDD_VERIFY_BLOCKINDEX_FILTER *state,
+		const unsigned char *expected, const unsigned char *computed)
+{
+	state->num_error++;
+
+	if (state->error_fun != 0) {
+		(*state->error_fun)(state->blocknum, expected, computed,
+				state->mdsize, state->error_env);
+	}
+}
+
+static int
+verify_block(RDD_FILTER *f, unsigned nbyte)
+{
+	RDD_VERIFY_BLOCKINDEX_FILTER *state =
+		(RDD_VERIFY_BLOCKINDEX_FILTER *) f->state;
+	unsigned char md[EVP_MAX_MD_SIZE];
+	const unsigned char *expected;
+	int rc;
+
+	if (state->blocknum >= state->end) {
+		if (! state->range) {
+			/* The data is longer than the indexed image. */
+			report_error(state, 0, 0);
+		}
+		state->blocknum++;
+		return RDD_OK;
+	}
+
+	if ((rc = rdd_hash_final(&state->hash, md)) != RDD_OK) {
+		return rc;
+	}
+	expected = rdd_blockindex_digest(state->idx, state->blocknum);
+	if (nbyte != rdd_blockindex_blocksize(state->idx, state->blocknum)
+	||  memcmp(md, expected, state->mdsize) != 0) {
+		report_error(state, expected, md);
+	}
+	state->blocknum++;
+
+	return rdd_hash_reset(&state->hash);
+}
+
+/* The result is the number of bad blocks, including indexed blocks
+ * for which there was no data.
+ */
+static int
+verify_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte)
+{
+	RDD_VERIFY_BLOCKINDEX_FILTER *state =
+		(RDD_VERIFY_BLOCKINDEX_FILTER *) f->state;
+
+	if (nbyte < sizeof state->num_error) {
+		return RDD_NOMEM;
+	}
+
+	while (state->blocknum < state->end) {
+		report_error(state, rdd_blockindex_digest(state->idx,
+					state->blocknum), 0);
+		state->blocknum++;
+	}
+
+	memcpy(buf, &state->num_error, sizeof state->num_error);
+
+	return RDD_OK;
+}
+
+static int
+verify_free(RDD_FILTER *f)
+{
+	RDD_VERIFY_BLOCKINDEX_FILTER *state =
+		(RDD_VERIFY_BLOCKINDEX_FILTER *) f->state;
+
+	return rdd_hash_free(&state->hash);
+}
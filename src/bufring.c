@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+/* A ring of aligned buffers that connects one producer thread to
+ * one or more consumer threads.
+ *
+ * Buffers are published in sequence.  Sequence number s lives in
+ * slot s % nbuf.  The producer owns slot (head % nbuf) as long as its
+ * reference count is zero; publishing it sets the count to the number
+ * of consumers.  Each consumer keeps its own tail and decrements the
+ * slot's count when it is done with it.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "rdd.h"
+#include "alignedbuf.h"
+#include "bufring.h"
+
+typedef struct _RDD_BUFRING_SLOT {
+	RDD_ALIGNEDBUF buf;
+	unsigned       nbyte;		/* valid data bytes */
+	unsigned       nref;		/* consumers still using this slot */
+} RDD_BUFRING_SLOT;
+
+struct _RDD_BUFRING {
+	pthread_mutex_t   lock;
+	pthread_cond_t    slot_free;	/* signalled when a slot's nref drops to 0 */
+	pthread_cond_t    slot_full;	/* signalled when a slot is published */
+	unsigned          nbuf;
+	unsigned          bufsize;
+	unsigned          nconsumer;
+	RDD_BUFRING_SLOT *slots;
+	rdd_count_t       head;		/* next sequence number to publish */
+	rdd_count_t      *tail;		/* next sequence number, per consumer */
+	int               eof;
+	int               error;
+};
+
+int
+rdd_new_bufring(RDD_BUFRING **self, unsigned nbuf, unsigned bufsize,
+		unsigned align, unsigned nconsumer)
+{
+	RDD_BUFRING *ring = 0;
+	unsigned i;
+	int rc = RDD_OK;
+
+	if (nbuf == 0 || nconsumer == 0) return RDD_BADARG;
+
+	if ((ring = calloc(1, sizeof(RDD_BUFRING))) == 0) {
+		return RDD_NOMEM;
+	}
+	ring->nbuf = nbuf;
+	ring->bufsize = bufsize;
+	ring->nconsumer = nconsumer;
+
+	if ((ring->slots = calloc(nbuf, sizeof(RDD_BUFRING_SLOT))) == 0) {
+		rc = RDD_NOMEM;
+		goto error;
+	}
+	if ((ring->tail = calloc(nconsumer, sizeof(rdd_count_t))) == 0) {
+		rc = RDD_NOMEM;
+		goto error;
+	}
+	for (i = 0; i < nbuf; i++) {
+		rc = rdd_new_alignedbuf(&ring->slots[i].buf, bufsize, align);
+		if (rc != RDD_OK) {
+			goto error;
+		}
+	}
+
+	pthread_mutex_init(&ring->lock, 0);
+	pthread_cond_init(&ring->slot_free, 0);
+	pthread_cond_init(&ring->slot_full, 0);
+
+	*self = ring;
+	return RDD_OK;
+
+error:
+	*self = 0;
+	if (ring->slots != 0) {
+		for (i = 0; i < nbuf; i++) {
+			if (ring->slots[i].buf.unaligned != 0) {
+				rdd_free_alignedbuf(&ring->slots[i].buf);
+			}
+		}
+		free(ring->slots);
+	}
+	if (ring->tail != 0) free(ring->tail);
+	free(ring);
+	return rc;
+}
+
+int
+rdd_free_bufring(RDD_BUFRING *ring)
+{
+	unsigned i;
+
+	pthread_cond_destroy(&ring->slot_full);
+	pthread_cond_destroy(&ring->slot_free);
+	pthread_mutex_destroy(&ring->lock);
+
+	for (i = 0; i < ring->nbuf; i++) {
+		rdd_free_alignedbuf(&ring->slots[i].buf);
+	}
+	free(ring->slots);
+	free(ring->tail);
+	free(ring);
+
+	return RDD_OK;
+}
+
+unsigned
+rdd_bufring_bufsize(RDD_BUFRING *ring)
+{
+	return ring->bufsize;
+}
+
+int
+rdd_bufring_get_free(RDD_BUFRING *ring, unsigned char **buf)
+{
+	RDD_BUFRING_SLOT *slot = &ring->slots[ring->head % ring->nbuf];
+	int rc;
+
+	pthread_mutex_lock(&ring->lock);
+	while (ring->error == RDD_OK && slot->nref > 0) {
+		pthread_cond_wait(&ring->slot_free, &ring->lock);
+	}
+	rc = ring->error;
+	pthread_mutex_unlock(&ring->lock);
+
+	*buf = rc == RDD_OK ? slot->buf.aligned : 0;
+	return rc;
+}
+
+int
+rdd_bufring_put_full(RDD_BUFRING *ring, unsigned nbyte)
+{
+	RDD_BUFRING_SLOT *slot = &ring->slots[ring->head % ring->nbuf];
+
+	if (nbyte > ring->bufsize) return RDD_BADARG;
+
+	pthread_mutex_lock(&ring->lock);
+	slot->nbyte = nbyte;
+	slot->nref = ring->nconsumer;
+	ring->head++;
+	pthread_cond_broadcast(&ring->slot_full);
+	pthread_mutex_unlock(&ring->lock);
+
+	return RDD_OK;
+}
+
+int
+rdd_bufring_put_eof(RDD_BUFRING *ring)
+{
+	pthread_mutex_lock(&ring->lock);
+	ring->eof = 1;
+	pthread_cond_broadcast(&ring->slot_full);
+	pthread_mutex_unlock(&ring->lock);
+
+	return RDD_OK;
+}
+
+int
+rdd_bufring_wait_empty(RDD_BUFRING *ring)
+{
+	unsigned i;
+	int rc;
+
+	pthread_mutex_lock(&ring->lock);
+	for (i = 0; i < ring->nbuf && ring->error == RDD_OK; ) {
+		if (ring->slots[i].nref > 0) {
+			pthread_cond_wait(&ring->slot_free, &ring->lock);
+		} else {
+			i++;
+		}
+	}
+	rc = ring->error;
+	pthread_mutex_unlock(&ring->lock);
+
+	return rc;
+}
+
+int
+rdd_bufring_get_full(RDD_BUFRING *ring, unsigned consumer,
+		unsigned char **buf, unsigned *nbyte)
+{
+	RDD_BUFRING_SLOT *slot;
+	int rc;
+
+	if (consumer >= ring->nconsumer) return RDD_BADARG;
+
+	*buf = 0;
+	*nbyte = 0;
+
+	pthread_mutex_lock(&ring->lock);
+	while (ring->error == RDD_OK
+	&&     ring->tail[consumer] == ring->head
+	&&     !ring->eof) {
+		pthread_cond_wait(&ring->slot_full, &ring->lock);
+	}
+	rc = ring->error;
+	if (rc == RDD_OK && ring->tail[consumer] != ring->head) {
+		slot = &ring->slots[ring->tail[consumer] % ring->nbuf];
+		*buf = slot->buf.aligned;
+		*nbyte = slot->nbyte;
+	}
+	pthread_mutex_unlock(&ring->lock);
+
+	return rc;
+}
+
+int
+rdd_bufring_put_free(RDD_BUFRING *ring, unsigned consumer)
+{
+	RDD_BUFRING_SLOT *slot;
+
+	if (consumer >= ring->nconsumer) return RDD_BADARG;
+
+	pthread_mutex_lock(&ring->lock);
+	slot = &ring->slots[ring->tail[consumer] % ring->nbuf];
+	ring->tail[consumer]++;
+	if (--slot->nref == 0) {
+		pthread_cond_broadcast(&ring->slot_free);
+	}
+	pthread_mutex_unlock(&ring->lock);
+
+	return RDD_OK;
+}
+
+int
+rdd_bufring_abort(RDD_BUFRING *ring, int rc)
+{
+	pthread_mutex_lock(&ring->lock);
+	if (ring->error == RDD_OK) {
+		ring->error = rc;
+	}
+	pthread_cond_broadcast(&ring->slot_free);
+	pthread_cond_broadcast(&ring->slot_full);
+	pthread_mutex_unlock(&ring->lock);
+
+	return RDD_OK;
+}
+
+int
+rdd_bufring_error(RDD_BUFRING *ring)
+{
+	int rc;
+
+	pthread_mutex_lock(&ring->lock);
+	rc = ring->error;
+	pthread_mutex_unlock(&ring->lock);
+
+	return rc;
+}
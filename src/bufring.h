@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef __bufring_h__
+#define __bufring_h__
+
+/** @file
+ *  \brief Bounded ring of aligned buffers shared between threads.
+ *
+ *  A buffer ring connects one producer thread to one or more consumer
+ *  threads.  The producer fills a free buffer and publishes it; every
+ *  consumer sees every published buffer, in order.  A buffer
+ *  becomes free again when all consumers have released it, so
+ *  the consumers share a single, read-only copy of the data.
+ *  The producer blocks when all buffers are in use and a consumer
+ *  blocks when it has seen all published buffers.
+ */
+
+struct _RDD_BUFRING;
+typedef struct _RDD_BUFRING RDD_BUFRING;
+
+/** \brief Creates a buffer ring.
+ *  \param ring output value: will be set to the new ring.
+ *  \param nbuf the number of buffers in the ring.
+ *  \param bufsize the size in bytes of each buffer.
+ *  \param align the alignment in bytes of each buffer.
+ *  \param nconsumer the number of consumers that must release
+ *  a buffer before the producer can reuse it.
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_BADARG if
+ *  \c nbuf or \c nconsumer is zero.  Returns \c RDD_NOMEM if there is
+ *  insufficient memory.
+ */
+int rdd_new_bufring(RDD_BUFRING **ring, unsigned nbuf, unsigned bufsize,
+		unsigned align, unsigned nconsumer);
+
+/** \brief Deallocates a buffer ring.  No thread may use the ring
+ *  when it is deallocated.
+ *  \return Always returns \c RDD_OK.
+ */
+int rdd_free_bufring(RDD_BUFRING *ring);
+
+/** \brief Returns the size in bytes of each buffer in \c ring.
+ */
+unsigned rdd_bufring_bufsize(RDD_BUFRING *ring);
+
+/** \brief Producer: waits for a free buffer.
+ *  \param ring the buffer ring.
+ *  \param buf output value: will be set to the free buffer.
+ *  \return Returns \c RDD_OK on success.  If the ring has been
+ *  aborted, returns the error code that was passed to
+ *  \c rdd_bufring_abort().
+ */
+int rdd_bufring_get_free(RDD_BUFRING *ring, unsigned char **buf);
+
+/** \brief Producer: publishes the buffer obtained with the last call to
+ *  \c rdd_bufring_get_free().
+ *  \param ring the buffer ring.
+ *  \param nbyte the number of valid data bytes in the buffer.
+ *  \return Returns \c RDD_OK on success.
+ */
+int rdd_bufring_put_full(RDD_BUFRING *ring, unsigned nbyte);
+
+/** \brief Producer: tells the consumers that no more buffers will be
+ *  published.
+ *  \return Returns \c RDD_OK on success.
+ */
+int rdd_bufring_put_eof(RDD_BUFRING *ring);
+
+/** \brief Producer: waits until all consumers have released every
+ *  buffer that has been published.
+ *  \return Returns \c RDD_OK on success, or the error code passed to
+ *  \c rdd_bufring_abort().
+ */
+int rdd_bufring_wait_empty(RDD_BUFRING *ring);
+
+/** \brief Consumer: waits for the next published buffer.
+ *  \param ring the buffer ring.
+ *  \param consumer the consumer's index (0 <= \c consumer < \c nconsumer).
+ *  \param buf output value: the next buffer, or a null pointer if the
+ *  producer has published all its buffers.
+ *  \param nbyte output value: the number of valid bytes in \c buf.
+ *  \return Returns \c RDD_OK on success.  If the ring has been
+ *  aborted, returns the error code that was passed to
+ *  \c rdd_bufring_abort().
+ */
+int rdd_bufring_get_full(RDD_BUFRING *ring, unsigned consumer,
+		unsigned char **buf, unsigned *nbyte);
+
+/** \brief Consumer: releases the buffer obtained with the last call to
+ *  \c rdd_bufring_get_full().
+ *  \return Returns \c RDD_OK on success.
+ */
+int rdd_bufring_put_free(RDD_BUFRING *ring, unsigned consumer);
+
+/** \brief Aborts all threads that use the ring.
+ *
+ *  All threads that are blocked in, or later call, one of the
+ *  get routines return \c rc.  Only the first error code is
+ *  retained.
+ *  \param ring the buffer ring.
+ *  \param rc the error code to report (must not be \c RDD_OK).
+ *  \return Always returns \c RDD_OK.
+ */
+int rdd_bufring_abort(RDD_BUFRING *ring, int rc);
+
+/** \brief Returns the error code passed to \c rdd_bufring_abort(), or
+ *  \c RDD_OK if the ring has not been aborted.
+ */
+int rdd_bufring_error(RDD_BUFRING *ring);
+
+#endif /* __bufring_h__ */
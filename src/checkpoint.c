@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2004\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+/*
+ * A checkpoint file consists of a magic string, a version number,
+ * the checkpoint header fields, and the saved filter set.  All values
+ * are stored in native byte order; a checkpoint is only meant to be
+ * read back on the machine that wrote it.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rdd.h"
+#include "reader.h"
+#include "writer.h"
+#include "filter.h"
+#include "filterset.h"
+#include "copier.h"
+#include "checkpoint.h"
+
+#define CHECKPOINT_MAGIC   "RDDCKPT"
+#define CHECKPOINT_VERSION 1
+
+static int
+write_header(FILE *fp, RDD_CHECKPOINT *cp)
+{
+	uint32_t version = CHECKPOINT_VERSION;
+
+	if (fwrite(CHECKPOINT_MAGIC, sizeof CHECKPOINT_MAGIC, 1, fp) < 1
+	||  fwrite(&version, sizeof version, 1, fp) < 1
+	||  fwrite(&cp->offset, sizeof cp->offset, 1, fp) < 1
+	||  fwrite(&cp->count, sizeof cp->count, 1, fp) < 1
+	||  fwrite(&cp->copied, sizeof cp->copied, 1, fp) < 1) {
+		return RDD_EWRITE;
+	}
+	return RDD_OK;
+}
+
+static int
+read_header(FILE *fp, RDD_CHECKPOINT *cp)
+{
+	char magic[sizeof CHECKPOINT_MAGIC];
+	uint32_t version;
+
+	if (fread(magic, sizeof magic, 1, fp) < 1
+	||  memcmp(magic, CHECKPOINT_MAGIC, sizeof magic) != 0) {
+		return RDD_ESYNTAX;
+	}
+	if (fread(&version, sizeof version, 1, fp) < 1
+	||  version != CHECKPOINT_VERSION) {
+		return RDD_ESYNTAX;
+	}
+	if (fread(&cp->offset, sizeof cp->offset, 1, fp) < 1
+	||  fread(&cp->count, sizeof cp->count, 1, fp) < 1
+	||  fread(&cp->copied, sizeof cp->copied, 1, fp) < 1) {
+		return RDD_ESYNTAX;
+	}
+	return RDD_OK;
+}
+
+int
+rdd_checkpoint_save(const char *path, RDD_CHECKPOINT *cp, RDD_FILTERSET *fset)
+{
+	char *tmppath = 0;
+	FILE *fp = NULL;
+	int rc = RDD_OK;
+
+	if (path == 0 || cp == 0 || fset == 0) {
+		return RDD_BADARG;
+	}
+
+	if ((tmppath = malloc(strlen(path) + 5)) == 0) {
+		return RDD_NOMEM;
+	}
+	sprintf(tmppath, "%s.tmp", path);
+
+	if ((fp = fopen(tmppath, "wb")) == NULL) {
+		rc = RDD_EOPEN;
+		goto done;
+	}
+
+	if ((rc = write_header(fp, cp)) != RDD_OK) {
+		goto done;
+	}
+	if ((rc = rdd_fset_save(fset, fp)) != RDD_OK) {
+		goto done;
+	}
+
+	if (fflush(fp) == EOF || fsync(fileno(fp)) < 0) {
+		rc = RDD_EWRITE;
+		goto done;
+	}
+	if (fclose(fp) == EOF) {
+		fp = NULL;
+		rc = RDD_ECLOSE;
+		goto done;
+	}
+	fp = NULL;
+
+	if (rename(tmppath, path) < 0) {
+		rc = RDD_EWRITE;
+	}
+
+done:
+	if (fp != NULL) {
+		fclose(fp);
+	}
+	if (rc != RDD_OK) {
+		remove(tmppath);
+	}
+	free(tmppath);
+	return rc;
+}
+
+int
+rdd_checkpoint_load(const char *path, RDD_CHECKPOINT *cp, RDD_FILTERSET *fset)
+{
+	FILE *fp;
+	int rc;
+
+	if (path == 0 || cp == 0 || fset == 0) {
+		return RDD_BADARG;
+	}
+
+	if ((fp = fopen(path, "rb")) == NULL) {
+		return errno == ENOENT ? RDD_NOTFOUND : RDD_EOPEN;
+	}
+
+	if ((rc = read_header(fp, cp)) == RDD_OK) {
+		rc = rdd_fset_restore(fset, fp);
+	}
+
+	fclose(fp);
+	return rc;
+}
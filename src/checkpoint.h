@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+
+#ifndef __checkpoint_h__
+#define __checkpoint_h__
+
+/** @file
+ *  \brief Checkpoints of an interrupted copy.
+ *
+ *  A checkpoint records how far a copier got and the state of all
+ *  filters at that point (see \c rdd_fset_save()).  A copy that is
+ *  interrupted can be resumed from its last checkpoint: the caller
+ *  restores the filter set with \c rdd_checkpoint_load() and starts
+ *  a new copier at \c offset + \c copied.nbyte.
+ */
+
+/** \brief Checkpoint header.
+ */
+typedef struct _RDD_CHECKPOINT {
+	rdd_count_t       offset;	/**< input offset of the copy */
+	rdd_count_t       count;	/**< # bytes to copy (or RDD_WHOLE_FILE) */
+	RDD_COPIER_RETURN copied;	/**< copier counters at the checkpoint */
+} RDD_CHECKPOINT;
+
+/** \brief Writes a checkpoint file.
+ *  \param path the name of the checkpoint file
+ *  \param cp the checkpoint header
+ *  \param fset the filter set whose state is saved
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOTFOUND if
+ *  a filter in \c fset cannot save its state.
+ *
+ *  The checkpoint is written to a temporary file, which is synced and
+ *  then renamed to \c path, so \c path always holds a complete
+ *  checkpoint.
+ */
+int rdd_checkpoint_save(const char *path, RDD_CHECKPOINT *cp,
+			RDD_FILTERSET *fset);
+
+/** \brief Reads a checkpoint file and restores a filter set.
+ *  \param path the name of the checkpoint file
+ *  \param cp output value: the checkpoint header
+ *  \param fset the filter set to restore; it must contain the same
+ *  filters as the filter set that was saved
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOTFOUND if
+ *  \c path does not exist.  Returns \c RDD_ESYNTAX if \c path is not
+ *  a checkpoint file or does not match \c fset.
+ */
+int rdd_checkpoint_load(const char *path, RDD_CHECKPOINT *cp,
+			RDD_FILTERSET *fset);
+
+#endif /* __checkpoint_h__ */
@@ -0,0 +1,530 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+/*
+ * Adler32, CRC32, and CRC32C kernels.  The SIMD kernels follow the
+ * well-known designs: CRC32 folds 64-byte blocks with PCLMULQDQ and
+ * finishes with a Barrett reduction (Gopal et al., "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction",
+ * Intel, 2009); Adler32 sums 32-byte blocks with PMADDUBSW/PSADBW and
+ * reduces modulo 65521 at most every 5552 bytes, as zlib does.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "rdd.h"
+#include "checksum.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CHECKSUM_X86_64 1
+#include <immintrin.h>
+#endif
+
+#define ADLER_BASE	65521	/* largest prime smaller than 65536 */
+#define ADLER_NMAX	5552	/* max. # bytes before s2 may overflow */
+
+#define CRC32C_POLY	0x82f63b78	/* Castagnoli, bit-reflected */
+
+typedef uint32_t (*checksum_fun)(uint32_t sum, const unsigned char *buf,
+			size_t nbyte);
+
+typedef void (*checksum_blocks_fun)(uint32_t init, const unsigned char *buf,
+			size_t blocksize, size_t nblock, uint32_t *sums);
+
+typedef struct _CHECKSUM_IMPL {
+	checksum_fun        fun;
+	checksum_blocks_fun blocks;	/* multi-block kernel (optional) */
+	const char         *name;
+} CHECKSUM_IMPL;
+
+static pthread_once_t   init_once = PTHREAD_ONCE_INIT;
+static CHECKSUM_IMPL    portable_adler32;
+static CHECKSUM_IMPL    portable_crc32;
+static CHECKSUM_IMPL    portable_crc32c;
+static CHECKSUM_IMPL    simd_adler32;
+static CHECKSUM_IMPL    simd_crc32;
+static CHECKSUM_IMPL    simd_crc32c;
+static volatile int     use_simd = 1;
+
+static uint32_t crc32c_table[8][256];	/* slicing-by-8 tables */
+
+/* Portable kernels.
+ */
+
+static uint32_t
+zlib_adler32(uint32_t sum, const unsigned char *buf, size_t nbyte)
+{
+	while (nbyte > 0) {
+		unsigned n = nbyte > UINT32_MAX ? UINT32_MAX : (unsigned) nbyte;
+
+		sum = adler32(sum, buf, n);
+		buf += n;
+		nbyte -= n;
+	}
+	return sum;
+}
+
+static uint32_t
+zlib_crc32(uint32_t sum, const unsigned char *buf, size_t nbyte)
+{
+	while (nbyte > 0) {
+		unsigned n = nbyte > UINT32_MAX ? UINT32_MAX : (unsigned) nbyte;
+
+		sum = crc32(sum, buf, n);
+		buf += n;
+		nbyte -= n;
+	}
+	return sum;
+}
+
+static void
+make_crc32c_tables(void)
+{
+	uint32_t crc;
+	unsigned i, k;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (k = 0; k < 8; k++) {
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+		}
+		crc32c_table[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++) {
+		crc = crc32c_table[0][i];
+		for (k = 1; k < 8; k++) {
+			crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+			crc32c_table[k][i] = crc;
+		}
+	}
+}
+
+static uint32_t
+table_crc32c(uint32_t sum, const unsigned char *buf, size_t nbyte)
+{
+	uint32_t crc = ~sum;
+	uint32_t lo, hi;
+
+	while (nbyte > 0 && ((uintptr_t) buf & 7) != 0) {
+		crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+		nbyte--;
+	}
+	while (nbyte >= 8) {
+		/* Little-endian loads, independent of the host byte order. */
+		lo = crc ^ ((uint32_t) buf[0] | (uint32_t) buf[1] << 8
+			| (uint32_t) buf[2] << 16 | (uint32_t) buf[3] << 24);
+		hi = (uint32_t) buf[4] | (uint32_t) buf[5] << 8
+			| (uint32_t) buf[6] << 16 | (uint32_t) buf[7] << 24;
+		crc = crc32c_table[7][lo & 0xff]
+		    ^ crc32c_table[6][(lo >> 8) & 0xff]
+		    ^ crc32c_table[5][(lo >> 16) & 0xff]
+		    ^ crc32c_table[4][lo >> 24]
+		    ^ crc32c_table[3][hi & 0xff]
+		    ^ crc32c_table[2][(hi >> 8) & 0xff]
+		    ^ crc32c_table[1][(hi >> 16) & 0xff]
+		    ^ crc32c_table[0][hi >> 24];
+		buf += 8;
+		nbyte -= 8;
+	}
+	while (nbyte > 0) {
+		crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+		nbyte--;
+	}
+	return ~crc;
+}
+
+#if defined(CHECKSUM_X86_64)
+
+/* CRC32 of nbyte bytes (nbyte >= 64, a multiple of 16) with the
+ * pre- and post-inversion left to the caller.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t
+pclmul_crc32_blocks(uint32_t crc, const unsigned char *buf, size_t nbyte)
+{
+	/* Folding constants for the bit-reflected CRC32 polynomial. */
+	static const uint64_t k1k2[2] __attribute__((aligned(16))) =
+		{ 0x0154442bd4ULL, 0x01c6e41596ULL };
+	static const uint64_t k3k4[2] __attribute__((aligned(16))) =
+		{ 0x01751997d0ULL, 0x00ccaa009eULL };
+	static const uint64_t k5k0[2] __attribute__((aligned(16))) =
+		{ 0x0163cd6124ULL, 0x0000000000ULL };
+	static const uint64_t poly[2] __attribute__((aligned(16))) =
+		{ 0x01db710641ULL, 0x01f7011641ULL };
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+	__m128i mask;
+
+	x1 = _mm_loadu_si128((const __m128i *) (buf + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *) (buf + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *) (buf + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *) (buf + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+	x0 = _mm_load_si128((const __m128i *) k1k2);
+	buf += 64;
+	nbyte -= 64;
+
+	/* Fold four 128-bit lanes in parallel. */
+	while (nbyte >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+			_mm_loadu_si128((const __m128i *) (buf + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+			_mm_loadu_si128((const __m128i *) (buf + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+			_mm_loadu_si128((const __m128i *) (buf + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+			_mm_loadu_si128((const __m128i *) (buf + 0x30)));
+		buf += 64;
+		nbyte -= 64;
+	}
+
+	/* Fold the four lanes into one. */
+	x0 = _mm_load_si128((const __m128i *) k3k4);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	/* Fold the remaining 16-byte blocks. */
+	while (nbyte >= 16) {
+		x2 = _mm_loadu_si128((const __m128i *) buf);
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+		buf += 16;
+		nbyte -= 16;
+	}
+
+	/* Reduce 128 bits to 64 bits. */
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x0 = _mm_loadl_epi64((const __m128i *) k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits. */
+	x0 = _mm_load_si128((const __m128i *) poly);
+	x2 = _mm_and_si128(x1, mask);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, mask);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return (uint32_t) _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t
+pclmul_crc32(uint32_t sum, const unsigned char *buf, size_t nbyte)
+{
+	size_t n;
+
+	if (nbyte >= 64) {
+		n = nbyte & ~(size_t) 15;
+		sum = ~pclmul_crc32_blocks(~sum, buf, n);
+		buf += n;
+		nbyte -= n;
+	}
+	return nbyte > 0 ? zlib_crc32(sum, buf, nbyte) : sum;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t
+sse42_crc32c(uint32_t sum, const unsigned char *buf, size_t nbyte)
+{
+	uint64_t crc = ~sum;
+	uint64_t word;
+
+	while (nbyte > 0 && ((uintptr_t) buf & 7) != 0) {
+		crc = _mm_crc32_u8((uint32_t) crc, *buf++);
+		nbyte--;
+	}
+	while (nbyte >= 8) {
+		memcpy(&word, buf, sizeof word);
+		crc = _mm_crc32_u64(crc, word);
+		buf += 8;
+		nbyte -= 8;
+	}
+	while (nbyte > 0) {
+		crc = _mm_crc32_u8((uint32_t) crc, *buf++);
+		nbyte--;
+	}
+	return ~(uint32_t) crc;
+}
+
+/* CRC32C of nblock blocks, three at a time.  The crc32 instruction
+ * has a latency of three cycles but can start every cycle, so three
+ * independent blocks run at up to three times the speed of one.
+ */
+__attribute__((target("sse4.2")))
+static void
+sse42_crc32c_blocks(uint32_t init, const unsigned char *buf,
+		size_t blocksize, size_t nblock, uint32_t *sums)
+{
+	const unsigned char *p0, *p1, *p2;
+	uint64_t c0, c1, c2;
+	uint64_t w0, w1, w2;
+	size_t nword = blocksize / 8;
+	size_t i;
+
+	for (; nblock >= 3; nblock -= 3) {
+		p0 = buf;
+		p1 = buf + blocksize;
+		p2 = buf + 2 * blocksize;
+		c0 = c1 = c2 = (uint32_t) ~init;
+		for (i = 0; i < nword; i++) {
+			memcpy(&w0, p0, sizeof w0);
+			memcpy(&w1, p1, sizeof w1);
+			memcpy(&w2, p2, sizeof w2);
+			c0 = _mm_crc32_u64(c0, w0);
+			c1 = _mm_crc32_u64(c1, w1);
+			c2 = _mm_crc32_u64(c2, w2);
+			p0 += 8;
+			p1 += 8;
+			p2 += 8;
+		}
+		for (i = nword * 8; i < blocksize; i++) {
+			c0 = _mm_crc32_u8((uint32_t) c0, *p0++);
+			c1 = _mm_crc32_u8((uint32_t) c1, *p1++);
+			c2 = _mm_crc32_u8((uint32_t) c2, *p2++);
+		}
+		*sums++ = ~(uint32_t) c0;
+		*sums++ = ~(uint32_t) c1;
+		*sums++ = ~(uint32_t) c2;
+		buf += 3 * blocksize;
+	}
+	for (; nblock > 0; nblock--) {
+		*sums++ = sse42_crc32c(init, buf, blocksize);
+		buf += blocksize;
+	}
+}
+
+#define ADLER_BLOCK	32	/* bytes per SIMD iteration */
+
+__attribute__((target("ssse3")))
+static uint32_t
+ssse3_adler32(uint32_t sum, const unsigned char *buf, size_t nbyte)
+{
+	uint32_t s1 = sum & 0xffff;
+	uint32_t s2 = sum >> 16;
+	size_t nblock = nbyte / ADLER_BLOCK;
+	unsigned n;
+
+	nbyte -= nblock * ADLER_BLOCK;
+
+	while (nblock > 0) {
+		const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26,
+				25, 24, 23, 22, 21, 20, 19, 18, 17);
+		const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10,
+				9, 8, 7, 6, 5, 4, 3, 2, 1);
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i ones = _mm_set1_epi16(1);
+		__m128i v_ps, v_s1, v_s2;
+
+		n = ADLER_NMAX / ADLER_BLOCK;
+		if (n > nblock) n = (unsigned) nblock;
+		nblock -= n;
+
+		/* v_ps accumulates s1 once per block; every byte of a
+		 * block adds s1 to s2, hence the shift by 5 below.
+		 */
+		v_ps = _mm_set_epi32(0, 0, 0, (int) (s1 * n));
+		v_s2 = _mm_set_epi32(0, 0, 0, (int) s2);
+		v_s1 = _mm_setzero_si128();
+
+		do {
+			const __m128i b1 = _mm_loadu_si128((const __m128i *) buf);
+			const __m128i b2 = _mm_loadu_si128((const __m128i *) (buf + 16));
+
+			v_ps = _mm_add_epi32(v_ps, v_s1);
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b1, zero));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+					_mm_maddubs_epi16(b1, tap1), ones));
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b2, zero));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+					_mm_maddubs_epi16(b2, tap2), ones));
+			buf += ADLER_BLOCK;
+		} while (--n > 0);
+
+		v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+		/* Add the four 32-bit lanes. */
+		v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(2, 3, 0, 1)));
+		v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+		s1 += (uint32_t) _mm_cvtsi128_si32(v_s1);
+		v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+		v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+		s2 = (uint32_t) _mm_cvtsi128_si32(v_s2);
+
+		s1 %= ADLER_BASE;
+		s2 %= ADLER_BASE;
+	}
+
+	/* Fewer than 32 bytes left. */
+	while (nbyte > 0) {
+		s1 += *buf++;
+		s2 += s1;
+		nbyte--;
+	}
+	s1 %= ADLER_BASE;
+	s2 %= ADLER_BASE;
+
+	return (s2 << 16) | s1;
+}
+
+#endif /* CHECKSUM_X86_64 */
+
+static void
+init_impls(void)
+{
+	make_crc32c_tables();
+
+	portable_adler32.fun = zlib_adler32;
+	portable_adler32.name = "zlib";
+	portable_crc32.fun = zlib_crc32;
+	portable_crc32.name = "zlib";
+	portable_crc32c.fun = table_crc32c;
+	portable_crc32c.name = "slicing-by-8 table";
+
+	simd_adler32 = portable_adler32;
+	simd_crc32 = portable_crc32;
+	simd_crc32c = portable_crc32c;
+
+#if defined(CHECKSUM_X86_64)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3")) {
+		simd_adler32.fun = ssse3_adler32;
+		simd_adler32.name = "SSSE3";
+	}
+	if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+		simd_crc32.fun = pclmul_crc32;
+		simd_crc32.name = "PCLMULQDQ";
+	}
+	if (__builtin_cpu_supports("sse4.2")) {
+		simd_crc32c.fun = sse42_crc32c;
+		simd_crc32c.blocks = sse42_crc32c_blocks;
+		simd_crc32c.name = "SSE4.2";
+	}
+#endif
+}
+
+static const CHECKSUM_IMPL *
+get_impl(rdd_checksum_algorithm_t alg)
+{
+	pthread_once(&init_once, init_impls);
+
+	switch (alg) {
+	case RDD_ADLER32: return use_simd ? &simd_adler32 : &portable_adler32;
+	case RDD_CRC32:   return use_simd ? &simd_crc32 : &portable_crc32;
+	case RDD_CRC32C:  return use_simd ? &simd_crc32c : &portable_crc32c;
+	}
+	return 0;
+}
+
+rdd_checksum_t
+rdd_checksum_init(rdd_checksum_algorithm_t alg)
+{
+	return alg == RDD_ADLER32 ? 1 : 0;
+}
+
+rdd_checksum_t
+rdd_checksum_update(rdd_checksum_algorithm_t alg, rdd_checksum_t sum,
+		const unsigned char *buf, size_t nbyte)
+{
+	const CHECKSUM_IMPL *impl = get_impl(alg);
+
+	if (impl == 0 || nbyte == 0) {
+		return sum;
+	}
+	return (*impl->fun)(sum, buf, nbyte);
+}
+
+void
+rdd_checksum_blocks(rdd_checksum_algorithm_t alg,
+		const unsigned char *buf, size_t blocksize, size_t nblock,
+		rdd_checksum_t *sums)
+{
+	const CHECKSUM_IMPL *impl = get_impl(alg);
+	rdd_checksum_t init = rdd_checksum_init(alg);
+	size_t i;
+
+	if (impl == 0) {
+		return;
+	}
+	if (impl->blocks != 0) {
+		(*impl->blocks)(init, buf, blocksize, nblock, sums);
+		return;
+	}
+	for (i = 0; i < nblock; i++) {
+		sums[i] = blocksize > 0 ? (*impl->fun)(init, buf, blocksize) : init;
+		buf += blocksize;
+	}
+}
+
+void
+rdd_checksum_use_simd(int enable)
+{
+	use_simd = enable;
+}
+
+const char *
+rdd_checksum_impl_name(rdd_checksum_algorithm_t alg)
+{
+	const CHECKSUM_IMPL *impl = get_impl(alg);
+
+	return impl == 0 ? "unknown" : impl->name;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+
+#ifndef __checksum_h__
+#define __checksum_h__
+
+/** @file
+ *  \brief Block checksum kernels with run-time CPU dispatch.
+ *
+ *  The checksum filters compute Adler32, CRC32, and CRC32C values
+ *  through these routines.  On x86-64 CPUs that support them, CRC32
+ *  uses carry-less multiplication (PCLMULQDQ), CRC32C uses the SSE4.2
+ *  crc32 instruction, and Adler32 uses SSSE3.  Other CPUs use zlib's
+ *  adler32() and crc32() and a table-driven CRC32C.  Both variants
+ *  produce identical values.
+ */
+
+#include <stddef.h>
+
+#include "rdd.h"
+
+/** \brief Returns the checksum of the empty string.
+ */
+rdd_checksum_t rdd_checksum_init(rdd_checksum_algorithm_t alg);
+
+/** \brief Updates a running checksum.
+ *  \param alg the checksum algorithm
+ *  \param sum the checksum of the data so far
+ *  \param buf the new data
+ *  \param nbyte the number of bytes in \c buf
+ *  \return Returns the checksum of the old data followed by \c buf.
+ *
+ *  For CRC32 and Adler32 the result is the same as that of zlib's
+ *  crc32() and adler32().
+ */
+rdd_checksum_t rdd_checksum_update(rdd_checksum_algorithm_t alg,
+		rdd_checksum_t sum, const unsigned char *buf, size_t nbyte);
+
+/** \brief Computes the checksums of a run of equal-sized blocks.
+ *  \param alg the checksum algorithm
+ *  \param buf the data: \c nblock blocks of \c blocksize bytes each
+ *  \param blocksize the block size in bytes
+ *  \param nblock the number of blocks
+ *  \param sums receives the checksum of each block
+ *
+ *  Some kernels work on several blocks at a time, which is much
+ *  faster than one rdd_checksum_update() call per block when
+ *  blocks are small.
+ */
+void rdd_checksum_blocks(rdd_checksum_algorithm_t alg,
+		const unsigned char *buf, size_t blocksize, size_t nblock,
+		rdd_checksum_t *sums);
+
+/** \brief Enables or disables the SIMD kernels.
+ *  \param enable 0 selects the portable code; any other value selects
+ *  the fastest code the CPU supports (the default)
+ *
+ *  This routine exists mainly for testing and benchmarking.
+ */
+void rdd_checksum_use_simd(int enable);
+
+/** \brief Describes the code that computes an algorithm's checksums.
+ *  \return Returns a static string, for example "PCLMULQDQ".
+ */
+const char *rdd_checksum_impl_name(rdd_checksum_algorithm_t alg);
+
+#endif /* __checksum_h__ */
@@ -54,7 +54,6 @@ static char copyright[] =
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
-#include <zlib.h>
 
 #include "rdd.h"
 #include "rdd_internals.h"
@@ -62,6 +61,7 @@ static char copyright[] =
 #include "writer.h"
 #include "filter.h"
 #include "filterset.h"
+#include "checksum.h"
 #include "outfile.h"
 
 
@@ -81,26 +81,28 @@ static int checksum_input(RDD_FILTER *f,
 static int checksum_block(RDD_FILTER *f, unsigned nbyte);
 static int checksum_close(RDD_FILTER *f);
 static int checksum_free(RDD_FILTER *f);
+static int checksum_save(RDD_FILTER *f, FILE *fp);
+static int checksum_restore(RDD_FILTER *f, FILE *fp);
+static int checksum_blocks(RDD_FILTER *f,
+			const unsigned char *buf, unsigned nblock);
 
 static RDD_FILTER_OPS checksum_ops = {
 	checksum_input,
 	checksum_block,
 	checksum_close,
 	0,
-	checksum_free
+	checksum_free,
+	checksum_save,
+	checksum_restore,
+	checksum_blocks
 };
 
+#define CHECKSUM_BATCH	1024	/* max. # checksums per fwrite() */
+
 static void
 reset_checksum(RDD_CHECKSUM_BLOCKFILTER *state)
 {
-	switch (state->algorithm) {
-	case RDD_ADLER32:
-		state->checksum = adler32(0, NULL, 0);
-		break;
-	case RDD_CRC32:
-		state->checksum = crc32(0, NULL, 0);
-		break;
-	}
+	state->checksum = rdd_checksum_init(state->algorithm);
 }
 
 static void
@@ -123,14 +125,8 @@ checksum_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
 {
 	RDD_CHECKSUM_BLOCKFILTER *state = (RDD_CHECKSUM_BLOCKFILTER *) f->state;
 
-	switch (state->algorithm) {
-	case RDD_ADLER32:
-		state->checksum = adler32(state->checksum, buf, nbyte);
-		break;
-	case RDD_CRC32:
-		state->checksum = crc32(state->checksum, buf, nbyte);
-		break;
-	}
+	state->checksum = rdd_checksum_update(state->algorithm,
+				state->checksum, buf, nbyte);
 
 	return RDD_OK;
 }
@@ -149,6 +145,29 @@ checksum_block(RDD_FILTER *f, unsigned pos)
 	return RDD_OK;
 }
 
+/* Checksums a run of whole blocks and writes the checksums with
+ * one fwrite() per batch.
+ */
+static int
+checksum_blocks(RDD_FILTER *f, const unsigned char *buf, unsigned nblock)
+{
+	RDD_CHECKSUM_BLOCKFILTER *state = (RDD_CHECKSUM_BLOCKFILTER *) f->state;
+	rdd_checksum_t sums[CHECKSUM_BATCH];
+	unsigned n;
+
+	while (nblock > 0) {
+		n = nblock < CHECKSUM_BATCH ? nblock : CHECKSUM_BATCH;
+		rdd_checksum_blocks(state->algorithm, buf, f->blocksize, n, sums);
+		if (fwrite(sums, sizeof sums[0], n, state->fp) < n) {
+			return RDD_EWRITE;
+		}
+		buf += (size_t) n * f->blocksize;
+		nblock -= n;
+	}
+
+	return RDD_OK;
+}
+
 static int
 checksum_close(RDD_FILTER *f)
 {
@@ -171,6 +190,63 @@ checksum_free(RDD_FILTER *f)
 	return RDD_OK;
 }
 
+/* The saved state consists of the algorithm, the running checksum,
+ * and the size of the checksum file.
+ */
+static int
+checksum_save(RDD_FILTER *f, FILE *fp)
+{
+	RDD_CHECKSUM_BLOCKFILTER *state = (RDD_CHECKSUM_BLOCKFILTER *) f->state;
+	uint32_t alg = state->algorithm;
+	rdd_count_t size;
+	off_t pos;
+
+	if (fflush(state->fp) == EOF || fsync(fileno(state->fp)) < 0) {
+		return RDD_EWRITE;
+	}
+	if ((pos = ftello(state->fp)) < 0) {
+		return RDD_ETELL;
+	}
+	size = (rdd_count_t) pos;
+
+	if (fwrite(&alg, sizeof alg, 1, fp) < 1
+	||  fwrite(&state->checksum, sizeof state->checksum, 1, fp) < 1
+	||  fwrite(&size, sizeof size, 1, fp) < 1) {
+		return RDD_EWRITE;
+	}
+	return RDD_OK;
+}
+
+static int
+checksum_restore(RDD_FILTER *f, FILE *fp)
+{
+	RDD_CHECKSUM_BLOCKFILTER *state = (RDD_CHECKSUM_BLOCKFILTER *) f->state;
+	rdd_checksum_t checksum;
+	rdd_count_t size;
+	uint32_t alg;
+
+	if (fread(&alg, sizeof alg, 1, fp) < 1
+	||  fread(&checksum, sizeof checksum, 1, fp) < 1
+	||  fread(&size, sizeof size, 1, fp) < 1) {
+		return RDD_ESYNTAX;
+	}
+	if (alg != (uint32_t) state->algorithm) {
+		return RDD_ESYNTAX;
+	}
+	state->checksum = checksum;
+
+	if (fflush(state->fp) == EOF) {
+		return RDD_EWRITE;
+	}
+	if (ftruncate(fileno(state->fp), (off_t) size) < 0) {
+		return RDD_EWRITE;
+	}
+	if (fseeko(state->fp, (off_t) size, SEEK_SET) < 0) {
+		return RDD_ESEEK;
+	}
+	return RDD_OK;
+}
+
 static int
 new_checksum_blockfilter(RDD_FILTER **self, rdd_checksum_algorithm_t alg,
 		unsigned blocksize, const char *outpath, int overwrite)
@@ -190,7 +266,7 @@ new_checksum_blockfilter(RDD_FILTER **self, rdd_checksum_algorithm_t alg,
 		return RDD_BADARG;
 	}
 
-	if (alg != RDD_ADLER32 && alg != RDD_CRC32){
+	if (alg != RDD_ADLER32 && alg != RDD_CRC32 && alg != RDD_CRC32C){
 		return RDD_BADARG;
 	}
 
@@ -249,3 +325,11 @@ rdd_new_crc32_blockfilter(RDD_FILTER **f,
 	return new_checksum_blockfilter(f, RDD_CRC32,
 					blocksize, outpath, overwrite);
 }
+
+int
+rdd_new_crc32c_blockfilter(RDD_FILTER **f,
+		unsigned blocksize, const char *outpath, int overwrite)
+{
+	return new_checksum_blockfilter(f, RDD_CRC32C,
+					blocksize, outpath, overwrite);
+}
@@ -81,6 +81,9 @@ typedef void (*rdd_substhandler_t)(rdd_count_t offset, unsigned nbyte,
 /** \brief Progress callback type.
  */
 typedef int (*rdd_proghandler_t)(rdd_count_t ncopied, rdd_count_t nsubstituted, void *env);
+/** \brief Checkpoint callback type.
+ */
+typedef int (*rdd_ckpthandler_t)(RDD_COPIER_RETURN *state, void *env);
 
 /** \brief Simple copier configuration parameters.
  */
@@ -102,6 +105,9 @@ typedef struct _RDD_ROBUST_PARAMS {
 	void                *substenv;    /**< substitution callback environment */
 	rdd_proghandler_t    progressfun; /**< progress callback */
 	void                *progressenv; /**< progress callback environment */
+	rdd_ckpthandler_t    checkpointfun; /**< checkpoint callback (optional) */
+	void                *checkpointenv; /**< checkpoint callback environment */
+	rdd_count_t          checkpointlen; /**< call \c checkpointfun every \c checkpointlen bytes */
 } RDD_ROBUST_PARAMS;
 
 /* Constructors
@@ -160,11 +166,118 @@ int rdd_new_simple_copier(RDD_COPIER **c, RDD_SIMPLE_PARAMS *params);
  *  read errors occur. A robust copier will enter a retry phase when
  *  a read fails. In that phase it reduces the amount of data it reads
  *  at a time and it will retry reads that fail.
+ *
+ *  If \c params->checkpointfun is set, the copier calls it each time
+ *  at least \c params->checkpointlen bytes have been copied since the
+ *  previous call.  Each call happens at a block boundary, after the
+ *  filters have processed all data copied so far, so the callback may
+ *  save the state of the filter set (see \c rdd_fset_save()).  The
+ *  callback receives the copier's counters so far.  If it returns
+ *  anything but \c RDD_OK, the copier stops and returns that value.
+ *  A copy is resumed by restoring the filter state and creating a new
+ *  copier that starts at \c offset + \c state->nbyte.  A pipelined
+ *  copier handles checkpoints in the same way.
  */
 int rdd_new_robust_copier(RDD_COPIER **c,
 		rdd_count_t offset, rdd_count_t count,
 		RDD_ROBUST_PARAMS *params);
 
+/** \brief Creates a new pipelined copier.
+ *  \param c output value: will be set to a pointer to the new pipelined copier object.
+ *  \param offset byte offset; where to start copying
+ *  \param count the maximum number of bytes to copy
+ *  \param params the copier's error-handling parameters
+ *  \param nbuf the number of blocks that can be in transit between
+ *  the read stage and the filter stage; must be at least 2.
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOMEM if there
+ *  is insufficient memory to create the object.  Returns \c RDD_BADARG
+ *  if \c nbuf is less than 2.
+ *
+ *  A pipelined copier handles read errors exactly like a robust
+ *  copier (see \c rdd_new_robust_copier()), but it does not wait
+ *  for the filters before it reads the next block.  The calling thread
+ *  reads blocks into a ring of \c nbuf sector-aligned buffers of
+ *  \c params->maxblocklen bytes each; a second thread pushes these
+ *  blocks, in order, through the filter set.  The input is
+ *  therefore read at the speed of the slower of the two stages
+ *  rather than at the speed of their sum.
+ *
+ *  Progress, read-error, and substitution callbacks are called
+ *  from the thread that calls \c rdd_copy_exec().  Filters are called
+ *  from the filter thread, except for their close routines, which
+ *  are called from the calling thread after the filter thread has
+ *  finished.
+ */
+int rdd_new_pipelined_copier(RDD_COPIER **c,
+		rdd_count_t offset, rdd_count_t count,
+		RDD_ROBUST_PARAMS *params, unsigned nbuf);
+
+/** \brief Creates a new region copier.
+ *  \param c output value: will be set to a pointer to the new region copier object.
+ *  \param offset byte offset; where to start copying
+ *  \param count the number of bytes to copy; must be known
+ *  \param params the copier's error-handling parameters
+ *  \param nworker the number of worker threads that read the input
+ *  \param stripelen the number of bytes that a worker reads at a time
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOMEM if there
+ *  is insufficient memory to create the object.  Returns \c RDD_BADARG
+ *  if \c nworker or \c stripelen is zero or if \c count equals
+ *  \c RDD_WHOLE_FILE.
+ *
+ *  A region copier cuts the input segment into stripes of \c stripelen
+ *  bytes and hands these stripes, in turn, to \c nworker worker threads.
+ *  The workers read their stripes concurrently, with positional reads
+ *  (see \c rdd_reader_pread()); each stripe is copied by a robust
+ *  copier, so read errors are handled as described for
+ *  \c rdd_new_robust_copier().  The calling thread pushes the stripes
+ *  through the filter set in input order, so the filters see exactly
+ *  the same data stream as with a robust copier.  At most
+ *  2 * \c nworker stripes are buffered.
+ *
+ *  The reader that is passed to \c rdd_copy_exec() must implement
+ *  positional reads.  Read-error and substitution callbacks are called
+ *  from the worker threads, one at a time, with absolute input
+ *  offsets.  The progress callback is called from the calling thread.
+ */
+int rdd_new_region_copier(RDD_COPIER **c,
+		rdd_count_t offset, rdd_count_t count,
+		RDD_ROBUST_PARAMS *params, unsigned nworker, unsigned stripelen);
+
+/** \brief Creates a new rescue copier.
+ *  \param c output value: will be set to a pointer to the new rescue copier object.
+ *  \param offset byte offset; where to start copying
+ *  \param count the number of bytes to copy; must be known
+ *  \param params the copier's error-handling parameters
+ *  \param mappath the name of the rescue map file
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOMEM if there
+ *  is insufficient memory to create the object.  Returns \c RDD_BADARG
+ *  if \c count equals \c RDD_WHOLE_FILE or if \c mappath is null.
+ *
+ *  A rescue copier reads the input segment in several passes.  The
+ *  first pass reads everything it can with blocks of
+ *  \c params->maxblocklen bytes and skips ahead, by an increasing
+ *  distance, after each read error.  Later passes read the failed and
+ *  skipped ranges forward, then trim the bad ranges backward with
+ *  blocks of \c params->minblocklen bytes, and finally retry the bad
+ *  ranges \c params->nretry times.
+ *
+ *  The state of each byte range is kept in a text file, the rescue
+ *  map, and the rescued data is kept in a working image named
+ *  \c mappath with ".data" appended.  Both are saved regularly.
+ *  If the map file already exists when \c rdd_copy_exec() is called,
+ *  the copier resumes the rescue that the map describes; the map must
+ *  describe the same \c offset and \c count.
+ *
+ *  After the last pass, the working image is pushed through the filter
+ *  set in input order, so the filters see the same data stream as with
+ *  a robust copier; bad ranges are replaced by zeroes.  If the progress
+ *  callback returns \c RDD_ABORTED during a pass, the map is saved and
+ *  \c rdd_copy_exec() returns \c RDD_ABORTED without pushing any data.
+ */
+int rdd_new_rescue_copier(RDD_COPIER **c,
+		rdd_count_t offset, rdd_count_t count,
+		RDD_ROBUST_PARAMS *params, const char *mappath);
+
 /* Generic routines
  */
 
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef __dedup_h__
+#define __dedup_h__
+
+/** @file
+ *  \brief Block-level deduplication: statistics and file formats.
+ *
+ *  The dedup block filter (\c rdd_new_dedup_blockfilter()) keys every
+ *  block by the first \c RDD_DEDUP_KEYSIZE bytes of its SHA-256
+ *  digest and looks the key up in an open-addressing hash table of
+ *  bounded size.  It counts duplicate blocks and can write a dedup
+ *  image, which consists of two files:
+ *
+ *  - a data file that holds every unique block once, in order of
+ *    first appearance;
+ *  - a map file: an \c RDD_DEDUP_MAP_HEADER followed by one 64-bit
+ *    record per image block, the number of the data-file block that
+ *    holds its contents.  Block \c n of the data file starts at
+ *    offset <tt>n * blocksize</tt>; only the last image block may be
+ *    shorter than the block size.
+ *
+ *  A dedup reader (\c rdd_open_dedup_reader()) restores the image
+ *  from these two files.
+ *
+ *  The table can be kept in a persistent index file, so that later
+ *  acquisitions recognize blocks that were seen before.  The index is
+ *  an \c RDD_DEDUP_INDEX_HEADER followed by \c nkey keys.  It only
+ *  affects the statistics (\c nknown): a block that is found in the
+ *  index but not earlier in the same image is still stored in the
+ *  data file, because each data file must be self-contained.
+ *
+ *  All header fields and records are stored in the byte order of
+ *  the host that wrote the file.
+ */
+
+#include <stdint.h>
+
+#include "rdd.h"
+
+#define RDD_DEDUP_INDEX_MAGIC	0x58444452	/* "RDDX" on little-endian hosts */
+#define RDD_DEDUP_MAP_MAGIC	0x4d444452	/* "RDDM" on little-endian hosts */
+#define RDD_DEDUP_VERSION	0x0100
+#define RDD_DEDUP_KEYSIZE	16		/* bytes of SHA-256 per key */
+
+typedef struct _RDD_DEDUP_INDEX_HEADER {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t keysize;	/**< \c RDD_DEDUP_KEYSIZE */
+	uint32_t blocksize;
+	uint32_t reserved;
+	uint64_t nkey;		/**< # keys that follow the header */
+} RDD_DEDUP_INDEX_HEADER;
+
+typedef struct _RDD_DEDUP_MAP_HEADER {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t reserved;
+	uint32_t blocksize;
+	uint32_t reserved2;
+	uint64_t imagesize;	/**< # bytes in the image */
+	uint64_t nblock;	/**< # map records */
+	uint64_t nunique;	/**< # blocks in the data file */
+} RDD_DEDUP_MAP_HEADER;
+
+/** Result of the dedup block filter (see \c rdd_filter_get_result()).
+ */
+typedef struct _RDD_DEDUP_STATS {
+	rdd_count_t nblock;	/**< # blocks seen */
+	rdd_count_t nunique;	/**< # blocks stored in the data file */
+	rdd_count_t nduplicate;	/**< # repeats of an earlier block of this image */
+	rdd_count_t nknown;	/**< # new blocks found in the persistent index */
+	rdd_count_t nuntracked;	/**< # new blocks that did not fit in the table */
+	rdd_count_t ntable;	/**< # keys in the table */
+	rdd_count_t capacity;	/**< max. # keys in the table */
+} RDD_DEDUP_STATS;
+
+#endif /* __dedup_h__ */
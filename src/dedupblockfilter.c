@@ -0,0 +1,574 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+/*
+ * Dedup block filter.  Every block is keyed by a prefix of its
+ * SHA-256 digest.  The keys live in a power-of-two sized table with
+ * linear probing; the table size is derived from a memory budget and
+ * never grows, so memory use stays bounded however large the input
+ * is.  Once the table is 3/4 full, new keys are no longer inserted;
+ * such blocks are counted as untracked and stored as unique blocks.
+ *
+ * A table slot holds the key and a reference: 0 for an empty slot,
+ * KNOWN_REF for a key that was loaded from a persistent index but has
+ * not been seen in this image yet, and otherwise the number of the
+ * data-file block that holds the contents, plus one.  A KNOWN_REF
+ * block is counted as known and then stored like a new block: the
+ * data file must hold every block of the image, so the index only
+ * affects the statistics.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "rdd.h"
+#include "rdd_internals.h"
+#include "writer.h"
+#include "filter.h"
+#include "outfile.h"
+#include "hashengine.h"
+#include "dedup.h"
+
+#define DEDUP_BUFSIZE	(1024 * 1024)	/* map records buffered (bytes) */
+#define KNOWN_REF	UINT64_MAX
+
+typedef struct _DEDUP_SLOT {
+	unsigned char key[RDD_DEDUP_KEYSIZE];
+	uint64_t      ref;
+} DEDUP_SLOT;
+
+typedef struct _RDD_DEDUP_FILTER {
+	RDD_HASH              hash;
+	DEDUP_SLOT           *table;
+	uint64_t              mask;		/* # slots - 1 */
+	rdd_count_t           limit;		/* max. # keys in the table */
+	RDD_DEDUP_STATS       stats;
+	rdd_count_t           imagesize;
+
+	char                 *indexpath;	/* persistent index or 0 */
+	int                   overwrite;
+
+	unsigned char        *block;		/* current block (dedup output only) */
+	RDD_WRITER           *data;		/* data file writer or 0 */
+	char                 *mappath;
+	int                   mapfd;
+	uint64_t             *records;		/* map records not yet written */
+	unsigned              nrecord;
+} RDD_DEDUP_FILTER;
+
+static int dedup_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte);
+static int dedup_block(RDD_FILTER *f, unsigned nbyte);
+static int dedup_close(RDD_FILTER *f);
+static int dedup_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte);
+static int dedup_free(RDD_FILTER *f);
+static int dedup_blocks(RDD_FILTER *f, const unsigned char *buf, unsigned nblock);
+
+static RDD_FILTER_OPS dedup_ops = {
+	dedup_input,
+	dedup_block,
+	dedup_close,
+	dedup_get_result,
+	dedup_free,
+	0,	/* save */
+	0,	/* restore */
+	dedup_blocks
+};
+
+/* Finds the slot for key: either the slot that holds it or the
+ * empty slot where it belongs.
+ */
+static DEDUP_SLOT *
+lookup(RDD_DEDUP_FILTER *state, const unsigned char *key)
+{
+	uint64_t h;
+	DEDUP_SLOT *slot;
+
+	/* The key is part of a cryptographic digest, so its first
+	 * bytes are as good a hash value as any.
+	 */
+	memcpy(&h, key, sizeof h);
+	for (h &= state->mask; ; h = (h + 1) & state->mask) {
+		slot = &state->table[h];
+		if (slot->ref == 0
+		||  memcmp(slot->key, key, RDD_DEDUP_KEYSIZE) == 0) {
+			return slot;
+		}
+	}
+}
+
+/* Sizes the table: the largest power of two that fits in memsize
+ * bytes.
+ */
+static int
+alloc_table(RDD_DEDUP_FILTER *state, rdd_count_t memsize)
+{
+	uint64_t nslot = 16;
+
+	while (nslot * 2 * sizeof(DEDUP_SLOT) <= memsize) {
+		nslot *= 2;
+	}
+	if ((state->table = calloc(nslot, sizeof(DEDUP_SLOT))) == 0) {
+		return RDD_NOMEM;
+	}
+	state->mask = nslot - 1;
+	state->limit = nslot / 4 * 3;
+	state->stats.capacity = state->limit;
+	return RDD_OK;
+}
+
+static int
+read_all(FILE *fp, void *buf, size_t nbyte)
+{
+	return fread(buf, nbyte, 1, fp) == 1 ? RDD_OK : RDD_EREAD;
+}
+
+/* Loads the keys of a persistent index.  A missing index is not an
+ * error: it is created when the filter is closed.  Keys beyond the
+ * table limit are dropped.
+ */
+static int
+load_index(RDD_DEDUP_FILTER *state, unsigned blocksize)
+{
+	RDD_DEDUP_INDEX_HEADER hdr;
+	unsigned char key[RDD_DEDUP_KEYSIZE];
+	DEDUP_SLOT *slot;
+	uint64_t i;
+	FILE *fp;
+	int rc = RDD_OK;
+
+	if ((fp = fopen(state->indexpath, "rb")) == 0) {
+		return errno == ENOENT ? RDD_OK : RDD_EOPEN;
+	}
+	if ((rc = read_all(fp, &hdr, sizeof hdr)) != RDD_OK) {
+		rc = RDD_ESYNTAX;
+		goto done;
+	}
+	if (hdr.magic != RDD_DEDUP_INDEX_MAGIC
+	||  hdr.version != RDD_DEDUP_VERSION
+	||  hdr.keysize != RDD_DEDUP_KEYSIZE) {
+		rc = RDD_ESYNTAX;
+		goto done;
+	}
+	if (hdr.blocksize != blocksize) {
+		rc = RDD_BADARG;
+		goto done;
+	}
+	for (i = 0; i < hdr.nkey; i++) {
+		if ((rc = read_all(fp, key, sizeof key)) != RDD_OK) {
+			rc = RDD_ESYNTAX;
+			goto done;
+		}
+		if (state->stats.ntable >= state->limit) {
+			break;
+		}
+		slot = lookup(state, key);
+		if (slot->ref == 0) {
+			memcpy(slot->key, key, sizeof key);
+			slot->ref = KNOWN_REF;
+			state->stats.ntable++;
+		}
+	}
+
+done:
+	fclose(fp);
+	return rc;
+}
+
+/* Writes all keys to the persistent index.  The index is written
+ * to a temporary file that replaces the old index when complete.
+ */
+static int
+save_index(RDD_DEDUP_FILTER *state, unsigned blocksize)
+{
+	RDD_DEDUP_INDEX_HEADER hdr;
+	char *tmppath = 0;
+	uint64_t i;
+	FILE *fp = 0;
+	int rc = RDD_OK;
+
+	if ((tmppath = malloc(strlen(state->indexpath) + 5)) == 0) {
+		return RDD_NOMEM;
+	}
+	sprintf(tmppath, "%s.tmp", state->indexpath);
+
+	if ((fp = fopen(tmppath, "wb")) == 0) {
+		rc = RDD_EOPEN;
+		goto error;
+	}
+	memset(&hdr, 0, sizeof hdr);
+	hdr.magic = RDD_DEDUP_INDEX_MAGIC;
+	hdr.version = RDD_DEDUP_VERSION;
+	hdr.keysize = RDD_DEDUP_KEYSIZE;
+	hdr.blocksize = blocksize;
+	hdr.nkey = state->stats.ntable;
+	if (fwrite(&hdr, sizeof hdr, 1, fp) != 1) {
+		rc = RDD_EWRITE;
+		goto error;
+	}
+	for (i = 0; i <= state->mask; i++) {
+		if (state->table[i].ref == 0) continue;
+		if (fwrite(state->table[i].key, RDD_DEDUP_KEYSIZE, 1, fp) != 1) {
+			rc = RDD_EWRITE;
+			goto error;
+		}
+	}
+	if (fflush(fp) != 0 || fsync(fileno(fp)) < 0) {
+		rc = RDD_EWRITE;
+		goto error;
+	}
+	if (fclose(fp) != 0) {
+		fp = 0;
+		rc = RDD_ECLOSE;
+		goto error;
+	}
+	fp = 0;
+	if (rename(tmppath, state->indexpath) < 0) {
+		rc = RDD_EWRITE;
+		goto error;
+	}
+	free(tmppath);
+	return RDD_OK;
+
+error:
+	if (fp != 0) fclose(fp);
+	unlink(tmppath);
+	free(tmppath);
+	return rc;
+}
+
+static int
+write_all(int fd, const unsigned char *buf, size_t nbyte)
+{
+	ssize_t n;
+
+	while (nbyte > 0) {
+		if ((n = write(fd, buf, nbyte)) < 0) {
+			if (errno == EINTR) continue;
+			return RDD_EWRITE;
+		}
+		buf += n;
+		nbyte -= (size_t) n;
+	}
+	return RDD_OK;
+}
+
+static int
+flush_records(RDD_DEDUP_FILTER *state)
+{
+	int rc;
+
+	rc = write_all(state->mapfd, (unsigned char *) state->records,
+			state->nrecord * sizeof state->records[0]);
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state->nrecord = 0;
+	return RDD_OK;
+}
+
+static int
+write_map_header(RDD_DEDUP_FILTER *state, unsigned blocksize)
+{
+	RDD_DEDUP_MAP_HEADER hdr;
+
+	memset(&hdr, 0, sizeof hdr);
+	hdr.magic = RDD_DEDUP_MAP_MAGIC;
+	hdr.version = RDD_DEDUP_VERSION;
+	hdr.blocksize = blocksize;
+	hdr.imagesize = state->imagesize;
+	hdr.nblock = state->stats.nblock;
+	hdr.nunique = state->stats.nunique;
+	if (pwrite(state->mapfd, &hdr, sizeof hdr, 0) != (ssize_t) sizeof hdr) {
+		return RDD_EWRITE;
+	}
+	return RDD_OK;
+}
+
+static int
+copy_path(char **copy, const char *path)
+{
+	if (path == 0) {
+		*copy = 0;
+		return RDD_OK;
+	}
+	if ((*copy = malloc(strlen(path) + 1)) == 0) {
+		return RDD_NOMEM;
+	}
+	strcpy(*copy, path);
+	return RDD_OK;
+}
+
+int
+rdd_new_dedup_blockfilter(RDD_FILTER **self, unsigned blocksize,
+		rdd_count_t memsize, const char *indexpath,
+		const char *datapath, const char *mappath, int overwrite)
+{
+	RDD_FILTER *f = 0;
+	RDD_DEDUP_FILTER *state = 0;
+	int hash_ok = 0;
+	int rc;
+
+	if (self == 0 || blocksize == 0 || (datapath == 0) != (mappath == 0)) {
+		return RDD_BADARG;
+	}
+
+	rc = rdd_new_filter(&f, &dedup_ops, sizeof(RDD_DEDUP_FILTER), blocksize);
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state = (RDD_DEDUP_FILTER *) f->state;
+	state->mapfd = -1;
+	state->overwrite = overwrite;
+
+	if ((rc = rdd_hash_init(&state->hash, RDD_HASH_SHA256)) != RDD_OK) {
+		goto error;
+	}
+	hash_ok = 1;
+
+	if ((rc = alloc_table(state, memsize)) != RDD_OK
+	||  (rc = copy_path(&state->indexpath, indexpath)) != RDD_OK
+	||  (rc = copy_path(&state->mappath, mappath)) != RDD_OK) {
+		goto error;
+	}
+	if (indexpath != 0 && (rc = load_index(state, blocksize)) != RDD_OK) {
+		goto error;
+	}
+
+	if (datapath != 0) {
+		if ((state->block = malloc(blocksize)) == 0
+		||  (state->records = malloc(DEDUP_BUFSIZE)) == 0) {
+			rc = RDD_NOMEM;
+			goto error;
+		}
+		if ((rc = outfile_open(&state->mapfd, mappath, overwrite)) != RDD_OK) {
+			goto error;
+		}
+		if ((rc = write_map_header(state, blocksize)) != RDD_OK) {
+			goto error;
+		}
+		if (lseek(state->mapfd, sizeof(RDD_DEDUP_MAP_HEADER), SEEK_SET) < 0) {
+			rc = RDD_ESEEK;
+			goto error;
+		}
+		rc = rdd_open_safe_writer(&state->data, datapath, overwrite);
+		if (rc != RDD_OK) {
+			goto error;
+		}
+	}
+
+	*self = f;
+	return RDD_OK;
+
+error:
+	*self = 0;
+	if (state->mapfd >= 0) close(state->mapfd);
+	if (hash_ok) rdd_hash_free(&state->hash);
+	free(state->records);
+	free(state->block);
+	free(state->mappath);
+	free(state->indexpath);
+	free(state->table);
+	free(state);
+	free(f);
+	return rc;
+}
+
+/* Handles one block, given its digest and (for dedup output) its
+ * contents.
+ */
+static int
+dedup_put(RDD_DEDUP_FILTER *state, const unsigned char *md,
+		const unsigned char *buf, unsigned nbyte, unsigned blocksize)
+{
+	DEDUP_SLOT *slot = 0;
+	uint64_t ref;
+	int rc;
+
+	state->stats.nblock++;
+	state->imagesize += nbyte;
+
+	/* A short last block is always stored as is. */
+	if (nbyte == blocksize) {
+		slot = lookup(state, md);
+		if (slot->ref != 0 && slot->ref != KNOWN_REF) {
+			state->stats.nduplicate++;
+			ref = slot->ref - 1;
+			goto put_record;
+		}
+		if (slot->ref == KNOWN_REF) {
+			state->stats.nknown++;
+		} else if (state->stats.ntable < state->limit) {
+			memcpy(slot->key, md, RDD_DEDUP_KEYSIZE);
+			state->stats.ntable++;
+		} else {
+			state->stats.nuntracked++;
+			slot = 0;
+		}
+	}
+
+	/* A new block: store it. */
+	ref = state->stats.nunique++;
+	if (slot != 0) {
+		slot->ref = ref + 1;
+	}
+	if (state->data != 0) {
+		if ((rc = rdd_writer_write(state->data, buf, nbyte)) != RDD_OK) {
+			return rc;
+		}
+	}
+
+put_record:
+	if (state->records == 0) {
+		return RDD_OK;
+	}
+	if (state->nrecord * sizeof state->records[0] >= DEDUP_BUFSIZE) {
+		if ((rc = flush_records(state)) != RDD_OK) {
+			return rc;
+		}
+	}
+	state->records[state->nrecord++] = ref;
+	return RDD_OK;
+}
+
+static int
+dedup_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
+{
+	RDD_DEDUP_FILTER *state = (RDD_DEDUP_FILTER *) f->state;
+
+	if (state->block != 0) {
+		memcpy(state->block + f->pos, buf, nbyte);
+	}
+	return rdd_hash_update(&state->hash, buf, nbyte);
+}
+
+static int
+dedup_block(RDD_FILTER *f, unsigned nbyte)
+{
+	RDD_DEDUP_FILTER *state = (RDD_DEDUP_FILTER *) f->state;
+	unsigned char md[SHA256_DIGEST_LENGTH];
+	int rc;
+
+	if ((rc = rdd_hash_final(&state->hash, md)) != RDD_OK
+	||  (rc = rdd_hash_reset(&state->hash)) != RDD_OK) {
+		return rc;
+	}
+	return dedup_put(state, md, state->block, nbyte, f->blocksize);
+}
+
+static int
+dedup_blocks(RDD_FILTER *f, const unsigned char *buf, unsigned nblock)
+{
+	RDD_DEDUP_FILTER *state = (RDD_DEDUP_FILTER *) f->state;
+	unsigned char md[SHA256_DIGEST_LENGTH];
+	int rc;
+
+	for (; nblock > 0; nblock--, buf += f->blocksize) {
+		if ((rc = rdd_hash_update(&state->hash, buf, f->blocksize)) != RDD_OK
+		||  (rc = rdd_hash_final(&state->hash, md)) != RDD_OK
+		||  (rc = rdd_hash_reset(&state->hash)) != RDD_OK) {
+			return rc;
+		}
+		rc = dedup_put(state, md, buf, f->blocksize, f->blocksize);
+		if (rc != RDD_OK) {
+			return rc;
+		}
+	}
+	return RDD_OK;
+}
+
+static int
+dedup_close(RDD_FILTER *f)
+{
+	RDD_DEDUP_FILTER *state = (RDD_DEDUP_FILTER *) f->state;
+	int rc;
+
+	if (state->data != 0) {
+		if ((rc = flush_records(state)) != RDD_OK
+		||  (rc = write_map_header(state, f->blocksize)) != RDD_OK) {
+			return rc;
+		}
+		outfile_close(state->mapfd, state->mappath);
+		state->mapfd = -1;
+
+		rc = rdd_writer_close(state->data);
+		state->data = 0;
+		if (rc != RDD_OK) {
+			return rc;
+		}
+	}
+	if (state->indexpath != 0) {
+		return save_index(state, f->blocksize);
+	}
+	return RDD_OK;
+}
+
+static int
+dedup_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte)
+{
+	RDD_DEDUP_FILTER *state = (RDD_DEDUP_FILTER *) f->state;
+
+	if (nbyte < sizeof(RDD_DEDUP_STATS)) {
+		return RDD_ESPACE;
+	}
+	memcpy(buf, &state->stats, sizeof(RDD_DEDUP_STATS));
+	return RDD_OK;
+}
+
+static int
+dedup_free(RDD_FILTER *f)
+{
+	RDD_DEDUP_FILTER *state = (RDD_DEDUP_FILTER *) f->state;
+
+	if (state->mapfd >= 0) {
+		(void) close(state->mapfd);
+	}
+	free(state->records);
+	free(state->block);
+	free(state->mappath);
+	free(state->indexpath);
+	free(state->table);
+
+	return rdd_hash_free(&state->hash);
+}
@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+/*
+ * Dedup reader.  Rebuilds the image that a dedup block filter stored
+ * as a data file and a map file (see dedup.h).  The reader looks up
+ * the map record of each image block and reads the block from the
+ * data file with pread(), so it supports positional reads and cheap
+ * seeks.  Map records are read through stdio; sequential reads
+ * therefore cost one fread() per block and no seeks on the map file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "rdd.h"
+#include "reader.h"
+#include "dedup.h"
+
+typedef struct _RDD_DEDUP_READER {
+	int         fd;		/* data file */
+	FILE       *map;	/* map file */
+	unsigned    blocksize;
+	rdd_count_t imagesize;
+	rdd_count_t nblock;
+	rdd_count_t nunique;
+	rdd_count_t mapnext;	/* image block of the next map record */
+	rdd_count_t pos;
+} RDD_DEDUP_READER;
+
+
+/* Forward declarations
+ */
+static int rdd_dedup_read(RDD_READER *r, unsigned char *buf, unsigned nbyte,
+			unsigned *nread);
+static int rdd_dedup_tell(RDD_READER *r, rdd_count_t *pos);
+static int rdd_dedup_seek(RDD_READER *r, rdd_count_t pos);
+static int rdd_dedup_close(RDD_READER *r, int recurse);
+static int rdd_dedup_pread(RDD_READER *r, unsigned char *buf, unsigned nbyte,
+			rdd_count_t pos, unsigned *nread);
+
+static RDD_READ_OPS dedup_read_ops = {
+	rdd_dedup_read,
+	rdd_dedup_tell,
+	rdd_dedup_seek,
+	rdd_dedup_close,
+	rdd_dedup_pread,
+	0
+};
+
+int
+rdd_open_dedup_reader(RDD_READER **self, const char *datapath,
+			const char *mappath)
+{
+	RDD_READER *r = 0;
+	RDD_DEDUP_READER *state = 0;
+	RDD_DEDUP_MAP_HEADER hdr;
+	rdd_count_t nblock;
+	FILE *map = 0;
+	int fd = -1;
+	int rc = RDD_OK;
+
+	if (self == 0 || datapath == 0 || mappath == 0) {
+		return RDD_BADARG;
+	}
+
+	if ((map = fopen(mappath, "rb")) == NULL) {
+		return RDD_EOPEN;
+	}
+	if (fread(&hdr, sizeof hdr, 1, map) != 1) {
+		rc = ferror(map) ? RDD_EREAD : RDD_ESYNTAX;
+		goto error;
+	}
+	if (hdr.magic != RDD_DEDUP_MAP_MAGIC
+	||  hdr.version != RDD_DEDUP_VERSION
+	||  hdr.blocksize == 0) {
+		rc = RDD_ESYNTAX;
+		goto error;
+	}
+
+	/* Every block but the last is a full block. */
+	nblock = (hdr.imagesize + hdr.blocksize - 1) / hdr.blocksize;
+	if (hdr.nblock != nblock) {
+		rc = RDD_ESYNTAX;
+		goto error;
+	}
+
+	if ((fd = open(datapath, O_RDONLY)) < 0) {
+		rc = RDD_EOPEN;
+		goto error;
+	}
+
+	rc = rdd_new_reader(&r, &dedup_read_ops, sizeof(RDD_DEDUP_READER));
+	if (rc != RDD_OK) {
+		goto error;
+	}
+
+	state = (RDD_DEDUP_READER *) r->state;
+	state->fd = fd;
+	state->map = map;
+	state->blocksize = hdr.blocksize;
+	state->imagesize = hdr.imagesize;
+	state->nblock = hdr.nblock;
+	state->nunique = hdr.nunique;
+	state->mapnext = 0;
+	state->pos = 0;
+
+	*self = r;
+	return RDD_OK;
+
+error:
+	if (fd >= 0) (void) close(fd);
+	if (map != 0) fclose(map);
+	return rc;
+}
+
+/* Looks up the data-file block that holds image block blk.
+ */
+static int
+map_lookup(RDD_DEDUP_READER *state, rdd_count_t blk, uint64_t *ref)
+{
+	off_t offset;
+
+	if (blk != state->mapnext) {
+		offset = (off_t) (sizeof(RDD_DEDUP_MAP_HEADER)
+				+ blk * sizeof(uint64_t));
+		if (fseeko(state->map, offset, SEEK_SET) != 0) {
+			return RDD_ESEEK;
+		}
+		state->mapnext = blk;
+	}
+	if (fread(ref, sizeof *ref, 1, state->map) != 1) {
+		state->mapnext = RDD_COUNT_MAX;	/* position unknown */
+		return RDD_EREAD;
+	}
+	state->mapnext = blk + 1;
+
+	if (*ref >= state->nunique) {
+		return RDD_ESYNTAX;
+	}
+	return RDD_OK;
+}
+
+/* Reads nbyte bytes at offset pos of the data file; a short read
+ * means the data file is truncated.
+ */
+static int
+data_pread(RDD_DEDUP_READER *state, unsigned char *buf, unsigned nbyte,
+		rdd_count_t pos)
+{
+	ssize_t n;
+
+	while (nbyte > 0) {
+		n = pread(state->fd, buf, nbyte, (off_t) pos);
+		if (n < 0) {
+#if defined(RDD_SIGNALS)
+			if (errno == EINTR) continue;
+#endif
+			return RDD_EREAD;
+		} else if (n == 0) {
+			return RDD_EREAD;	/* truncated data file */
+		}
+		nbyte -= n;
+		buf += n;
+		pos += n;
+	}
+	return RDD_OK;
+}
+
+static int
+rdd_dedup_pread(RDD_READER *self, unsigned char *buf, unsigned nbyte,
+			rdd_count_t pos, unsigned *nread)
+{
+	RDD_DEDUP_READER *state = self->state;
+	rdd_count_t blk;
+	unsigned offset, n;
+	uint64_t ref;
+	unsigned total = 0;
+	int rc;
+
+	while (nbyte > 0 && pos < state->imagesize) {
+		blk = pos / state->blocksize;
+		offset = (unsigned) (pos % state->blocksize);
+		n = state->blocksize - offset;
+		if (n > nbyte) n = nbyte;
+		if ((rdd_count_t) n > state->imagesize - pos) {
+			n = (unsigned) (state->imagesize - pos);
+		}
+
+		if ((rc = map_lookup(state, blk, &ref)) != RDD_OK) {
+			return rc;
+		}
+		rc = data_pread(state, buf, n,
+				ref * state->blocksize + offset);
+		if (rc != RDD_OK) {
+			return rc;
+		}
+
+		buf += n;
+		nbyte -= n;
+		pos += n;
+		total += n;
+	}
+
+	*nread = total;
+	return RDD_OK;
+}
+
+static int
+rdd_dedup_read(RDD_READER *self, unsigned char *buf, unsigned nbyte,
+			unsigned *nread)
+{
+	RDD_DEDUP_READER *state = self->state;
+	int rc;
+
+	rc = rdd_dedup_pread(self, buf, nbyte, state->pos, nread);
+	if (rc != RDD_OK) {
+		return rc;	/* position is unchanged */
+	}
+
+	state->pos += *nread;
+	return RDD_OK;
+}
+
+static int
+rdd_dedup_tell(RDD_READER *self, rdd_count_t *pos)
+{
+	RDD_DEDUP_READER *state = self->state;
+
+	*pos = state->pos;
+	return RDD_OK;
+}
+
+static int
+rdd_dedup_seek(RDD_READER *self, rdd_count_t pos)
+{
+	RDD_DEDUP_READER *state = self->state;
+
+	state->pos = pos;
+	return RDD_OK;
+}
+
+static int
+rdd_dedup_close(RDD_READER *self, int recurse /* ignored */)
+{
+	RDD_DEDUP_READER *state = self->state;
+	int rc = RDD_OK;
+
+	if (close(state->fd) < 0) {
+		rc = RDD_ECLOSE;
+	}
+	if (fclose(state->map) == EOF) {
+		rc = RDD_ECLOSE;
+	}
+
+	return rc;
+}
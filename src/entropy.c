@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include "entropy.h"
+
+/* The sample consists of NUM_RUN runs of RUN_SIZE consecutive bytes.
+ * Runs (rather than single bytes) keep the memory accesses sequential.
+ */
+#define RUN_SIZE	64
+#define NUM_RUN		(RDD_ENTROPY_SAMPLE_SIZE / RUN_SIZE)
+
+#define NUM_BYTE_VAL	256
+
+/* Counts the bytes of buf[0..nbyte-1] into histogram.
+ */
+static void
+count_bytes(unsigned *histogram, const unsigned char *buf, size_t nbyte)
+{
+	size_t i;
+
+	for (i = 0; i < nbyte; i++) {
+		histogram[buf[i]]++;
+	}
+}
+
+double
+rdd_estimate_entropy(const unsigned char *buf, size_t nbyte)
+{
+	unsigned histogram[NUM_BYTE_VAL];
+	size_t stride;
+	unsigned total;
+	double sum;
+	unsigned i;
+
+	if (nbyte == 0) {
+		return 0.0;
+	}
+
+	memset(histogram, 0, sizeof histogram);
+	if (nbyte <= RDD_ENTROPY_SAMPLE_SIZE) {
+		count_bytes(histogram, buf, nbyte);
+		total = (unsigned) nbyte;
+	} else {
+		stride = (nbyte - RUN_SIZE) / (NUM_RUN - 1);
+		for (i = 0; i < NUM_RUN; i++) {
+			count_bytes(histogram, buf + i * stride, RUN_SIZE);
+		}
+		total = NUM_RUN * RUN_SIZE;
+	}
+
+	/* H = log2(N) - sum(Ci * log2(Ci)) / N, see statsblockfilter.c. */
+	sum = 0.0;
+	for (i = 0; i < NUM_BYTE_VAL; i++) {
+		if (histogram[i] > 1) {
+			sum += histogram[i] * log2((double) histogram[i]);
+		}
+	}
+	return log2((double) total) - sum / total;
+}
+
+int
+rdd_is_incompressible(const unsigned char *buf, size_t nbyte)
+{
+	if (nbyte < RDD_ENTROPY_MIN_SIZE) {
+		return 0;
+	}
+	return rdd_estimate_entropy(buf, nbyte) >= RDD_ENTROPY_INCOMPRESSIBLE;
+}
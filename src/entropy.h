@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef __entropy_h__
+#define __entropy_h__
+
+/** @file
+ *  \brief Cheap compressibility estimate for a block of data.
+ *
+ *  The compressing writers use these routines to skip the compressor
+ *  for data that will not shrink, such as encrypted volumes and media
+ *  files.  The estimate is the order-0 (byte value) entropy of a sample
+ *  of the data, computed the same way as in the statistics block
+ *  filter.  Only RDD_ENTROPY_SAMPLE_SIZE bytes are looked at, in short
+ *  runs spread evenly over the block, so the cost is small compared
+ *  to even the fastest compression level.
+ */
+
+#include <stddef.h>
+
+/** The maximum number of bytes that the estimate looks at.
+ */
+#define RDD_ENTROPY_SAMPLE_SIZE	4096
+
+/** Sampled data with at least this many bits of entropy per byte is
+ *  considered incompressible.  For uniformly random data, a sample of
+ *  RDD_ENTROPY_SAMPLE_SIZE bytes yields about 7.95 bits per byte.
+ */
+#define RDD_ENTROPY_INCOMPRESSIBLE	7.9
+
+/** Blocks smaller than this are always considered compressible;
+ *  the sample would be too small to tell.
+ */
+#define RDD_ENTROPY_MIN_SIZE	1024
+
+/** \brief Estimates the entropy of a buffer.
+ *  \param buf the data
+ *  \param nbyte the number of bytes in \c buf
+ *  \return Returns the entropy of the sampled bytes in bits per byte,
+ *  between 0.0 and 8.0.  Returns 0.0 if \c nbyte is 0.
+ */
+double rdd_estimate_entropy(const unsigned char *buf, size_t nbyte);
+
+/** \brief Checks whether a buffer is probably incompressible.
+ *  \param buf the data
+ *  \param nbyte the number of bytes in \c buf
+ *  \return Returns 1 if the estimated entropy of \c buf is at least
+ *  RDD_ENTROPY_INCOMPRESSIBLE bits per byte, and 0 otherwise (or if
+ *  \c nbyte is less than RDD_ENTROPY_MIN_SIZE).
+ */
+int rdd_is_incompressible(const unsigned char *buf, size_t nbyte);
+
+#endif /* __entropy_h__ */
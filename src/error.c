@@ -85,13 +85,20 @@ static void
 log_vprintf(int console, char *fmt, va_list ap)
 {
 	if (console) {
+		/* The argument list may be used again below, so
+		 * print from a copy.
+		 */
+		va_list aq;
+
+		va_copy(aq, ap);
 #if defined(RDD_CONSOLE)
-		rdd_cons_vprintf(fmt, ap);
+		rdd_cons_vprintf(fmt, aq);
 #else
 		/* No true console access. Use stderr instead.
 		 */
-		vfprintf(stderr, fmt, ap);
+		vfprintf(stderr, fmt, aq);
 #endif
+		va_end(aq);
 	}
 
 	if (logfp != NULL) {
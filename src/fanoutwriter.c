@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "rdd.h"
+#include "rdd_internals.h"
+#include "writer.h"
+#include "bufring.h"
+
+/* A fan-out writer copies its input once into a ring of buffers that
+ * is shared by all its children.  Each child has a thread of its own
+ * that writes the buffers to the child, in order, at its own pace; a
+ * buffer is reused once every child has written it.  A slow child
+ * therefore only delays the others once it lags a full ring behind.
+ *
+ * If a child fails, its thread aborts the ring, which stops all other
+ * threads.  The next write (or the close) returns the child's error
+ * code.
+ */
+
+/* Forward declarations
+ */
+static int fanout_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte);
+static int fanout_close(RDD_WRITER *w);
+static int fanout_compare_address(RDD_WRITER *w, struct addrinfo *address, int *result);
+static int fanout_sync(RDD_WRITER *w);
+static int fanout_truncate(RDD_WRITER *w, rdd_count_t pos);
+
+static RDD_WRITE_OPS fanout_write_ops = {
+	fanout_write,
+	fanout_close,
+	fanout_compare_address,
+	fanout_sync,
+	fanout_truncate
+};
+
+struct _RDD_FANOUT_WRITER;
+
+typedef struct _RDD_FANOUT_CHILD {
+	struct _RDD_FANOUT_WRITER *owner;
+	RDD_WRITER    *writer;
+	unsigned       index;		/* consumer index in the ring */
+	pthread_t      thread;
+	int            running;		/* thread started? */
+	int            rc;		/* child's first error */
+} RDD_FANOUT_CHILD;
+
+typedef struct _RDD_FANOUT_WRITER {
+	RDD_FANOUT_CHILD *children;
+	unsigned       nchild;
+	RDD_BUFRING   *ring;
+	unsigned char *buf;		/* buffer being filled, or 0 */
+	unsigned       bufsize;
+	unsigned       fill;		/* # bytes in buf */
+} RDD_FANOUT_WRITER;
+
+static void *
+drain(void *arg)
+{
+	RDD_FANOUT_CHILD *child = (RDD_FANOUT_CHILD *) arg;
+	RDD_BUFRING *ring = child->owner->ring;
+	unsigned char *buf;
+	unsigned nbyte;
+	int rc;
+
+	for (;;) {
+		rc = rdd_bufring_get_full(ring, child->index, &buf, &nbyte);
+		if (rc != RDD_OK || buf == 0) {
+			break;
+		}
+
+		rc = rdd_writer_write(child->writer, buf, nbyte);
+		if (rc != RDD_OK) {
+			rdd_bufring_abort(ring, rc);
+			break;
+		}
+
+		rdd_bufring_put_free(ring, child->index);
+	}
+
+	child->rc = rc;
+	return 0;
+}
+
+/* Stops all threads that have been started and waits for them.
+ * Returns the first child error.
+ */
+static int
+join_children(RDD_FANOUT_WRITER *state)
+{
+	unsigned i;
+	int rc = RDD_OK;
+
+	for (i = 0; i < state->nchild; i++) {
+		if (! state->children[i].running) {
+			continue;
+		}
+		pthread_join(state->children[i].thread, 0);
+		state->children[i].running = 0;
+		if (rc == RDD_OK) {
+			rc = state->children[i].rc;
+		}
+	}
+	return rc;
+}
+
+int
+rdd_open_fanout_writer(RDD_WRITER **self, RDD_WRITER **children,
+			unsigned nchild, unsigned nbuf, unsigned bufsize)
+{
+	RDD_WRITER *w = 0;
+	RDD_FANOUT_WRITER *state = 0;
+	unsigned i;
+	int rc = RDD_OK;
+
+	if (self == 0 || children == 0 || nchild == 0) {
+		return RDD_BADARG;
+	}
+	if (nbuf == 0 || bufsize == 0) {
+		return RDD_BADARG;
+	}
+	for (i = 0; i < nchild; i++) {
+		if (children[i] == 0) {
+			return RDD_BADARG;
+		}
+	}
+
+	rc = rdd_new_writer(&w, &fanout_write_ops, sizeof(RDD_FANOUT_WRITER));
+	if (rc != RDD_OK) {
+		goto error;
+	}
+	state = (RDD_FANOUT_WRITER *) w->state;
+
+	state->children = calloc(nchild, sizeof(RDD_FANOUT_CHILD));
+	if (state->children == 0) {
+		rc = RDD_NOMEM;
+		goto error;
+	}
+	state->nchild = nchild;
+
+	rc = rdd_new_bufring(&state->ring, nbuf, bufsize,
+				RDD_SECTOR_SIZE, nchild);
+	if (rc != RDD_OK) {
+		goto error;
+	}
+	state->bufsize = bufsize;
+
+	for (i = 0; i < nchild; i++) {
+		RDD_FANOUT_CHILD *child = &state->children[i];
+
+		child->owner = state;
+		child->writer = children[i];
+		child->index = i;
+		if (pthread_create(&child->thread, 0, drain, child) != 0) {
+			rc = RDD_NOMEM;
+			goto error;
+		}
+		child->running = 1;
+	}
+
+	*self = w;
+	return RDD_OK;
+
+error:
+	*self = 0;
+	if (state != 0 && state->ring != 0) {
+		rdd_bufring_abort(state->ring, RDD_ABORTED);
+		join_children(state);
+		rdd_free_bufring(state->ring);
+	}
+	if (state != 0 && state->children != 0) free(state->children);
+	if (state != 0) free(state);
+	if (w != 0) free(w);
+	return rc;
+}
+
+/* Hands the buffer that is being filled to the child threads.
+ */
+static int
+publish(RDD_FANOUT_WRITER *state)
+{
+	int rc;
+
+	if (state->buf == 0) {
+		return RDD_OK;
+	}
+	if ((rc = rdd_bufring_put_full(state->ring, state->fill)) != RDD_OK) {
+		return rc;
+	}
+	state->buf = 0;
+	state->fill = 0;
+	return RDD_OK;
+}
+
+static int
+fanout_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte)
+{
+	RDD_FANOUT_WRITER *state = w->state;
+	unsigned n;
+	int rc;
+
+	while (nbyte > 0) {
+		if (state->buf == 0) {
+			rc = rdd_bufring_get_free(state->ring, &state->buf);
+			if (rc != RDD_OK) {
+				state->buf = 0;
+				return rc;
+			}
+			state->fill = 0;
+		}
+
+		n = state->bufsize - state->fill;
+		if (n > nbyte) {
+			n = nbyte;
+		}
+		memcpy(state->buf + state->fill, buf, n);
+		state->fill += n;
+		buf += n;
+		nbyte -= n;
+
+		if (state->fill == state->bufsize) {
+			if ((rc = publish(state)) != RDD_OK) {
+				return rc;
+			}
+		}
+	}
+
+	/* Report a child error as early as possible.
+	 */
+	return rdd_bufring_error(state->ring);
+}
+
+static int
+fanout_close(RDD_WRITER *w)
+{
+	RDD_FANOUT_WRITER *state = w->state;
+	unsigned i;
+	int rc, rc2;
+
+	/* Write any pending data and wait until every child
+	 * has received all of it.
+	 */
+	if (rdd_bufring_error(state->ring) == RDD_OK) {
+		publish(state);
+		rdd_bufring_put_eof(state->ring);
+	} else {
+		rdd_bufring_abort(state->ring, RDD_ABORTED);
+	}
+	rc = join_children(state);
+
+	rdd_free_bufring(state->ring);
+	state->ring = 0;
+
+	/* Close all children, even if one of them failed.
+	 */
+	for (i = 0; i < state->nchild; i++) {
+		rc2 = rdd_writer_close(state->children[i].writer);
+		if (rc == RDD_OK) {
+			rc = rc2;
+		}
+	}
+	free(state->children);
+	state->children = 0;
+
+	return rc;
+}
+
+static int
+fanout_compare_address(RDD_WRITER *w, struct addrinfo *address, int *result)
+{
+	RDD_FANOUT_WRITER *state = w->state;
+	unsigned i;
+	int rc;
+
+	/* A fan-out writer matches an address if one of its children does.
+	 */
+	*result = 0;
+	for (i = 0; i < state->nchild; i++) {
+		rc = rdd_compare_address(state->children[i].writer,
+					address, result);
+		if (rc != RDD_OK) {
+			return rc;
+		}
+		if (*result) {
+			break;
+		}
+	}
+	return RDD_OK;
+}
+
+/* Waits until every child thread has written all queued data.
+ * The threads are then idle, so the caller may use the children.
+ */
+static int
+flush_queue(RDD_FANOUT_WRITER *state)
+{
+	int rc;
+
+	if ((rc = publish(state)) != RDD_OK) {
+		return rc;
+	}
+	return rdd_bufring_wait_empty(state->ring);
+}
+
+static int
+fanout_sync(RDD_WRITER *w)
+{
+	RDD_FANOUT_WRITER *state = w->state;
+	unsigned i;
+	int rc;
+
+	if ((rc = flush_queue(state)) != RDD_OK) {
+		return rc;
+	}
+	for (i = 0; i < state->nchild; i++) {
+		rc = rdd_writer_sync(state->children[i].writer);
+		if (rc != RDD_OK) {
+			return rc;
+		}
+	}
+	return RDD_OK;
+}
+
+static int
+fanout_truncate(RDD_WRITER *w, rdd_count_t pos)
+{
+	RDD_FANOUT_WRITER *state = w->state;
+	unsigned i;
+	int rc;
+
+	if ((rc = flush_queue(state)) != RDD_OK) {
+		return rc;
+	}
+	for (i = 0; i < state->nchild; i++) {
+		rc = rdd_writer_truncate(state->children[i].writer, pos);
+		if (rc != RDD_OK) {
+			return rc;
+		}
+	}
+	return RDD_OK;
+}
@@ -73,9 +73,12 @@ static int
 rdd_faulty_seek(RDD_READER *r, rdd_count_t pos);
 static int
 rdd_faulty_close(RDD_READER *r, int recurse);
+static int
+rdd_faulty_pread(RDD_READER *r, unsigned char *buf, unsigned nbyte, rdd_count_t pos,
+		unsigned *nread);
 
 static RDD_READ_OPS faulty_read_ops = { rdd_faulty_read, rdd_faulty_tell, rdd_faulty_seek,
-		rdd_faulty_close };
+		rdd_faulty_close, rdd_faulty_pread };
 
 static int
 fault_compare(const void *p1, const void *p2)
@@ -254,6 +257,44 @@ rdd_faulty_read(RDD_READER *self, unsigned char *buf, unsigned nbyte, unsigned *
 	return rdd_reader_read(state->parent, buf, nbyte, nread);
 }
 
+/* Positional version of rdd_faulty_read().  The parent reader
+ * must implement positional reads.
+ */
+int
+rdd_faulty_pread(RDD_READER *self, unsigned char *buf, unsigned nbyte, rdd_count_t pos,
+		unsigned *nread)
+{
+	FAULTY_READER_STATE *state = self->state;
+	RDDFAULT *f;
+	unsigned i;
+	int rc;
+
+	for (i = 0; i < state->nfault; i++)
+	{
+		f = &state->faults[i];
+
+		if (f->meanpos >= pos && f->meanpos < (pos + nbyte))
+		{
+			rc = rdd_reader_pread(state->parent, buf, nbyte, pos, nread);
+			if (rc != RDD_OK)
+			{
+				return rc;
+			}
+
+			if (f->meanpos < (pos + *nread))
+			{
+				return RDD_EREAD;
+			}
+			else
+			{
+				return RDD_OK;
+			}
+		}
+	}
+
+	return rdd_reader_pread(state->parent, buf, nbyte, pos, nread);
+}
+
 int
 rdd_faulty_tell(RDD_READER *self, rdd_count_t *pos)
 {
@@ -43,13 +43,16 @@ static char copyright[] =
 #include <stdlib.h>
 #include <sys/types.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "rdd.h"
 #include "reader.h"
 
 typedef struct _RDD_FD_READER {
 	int fd;
+	int stream;	/* drop data from the cache once read? */
 } RDD_FD_READER;
 
 
@@ -60,12 +63,15 @@ static int rdd_fd_read(RDD_READER *r, unsigned char *buf, unsigned nbyte,
 static int rdd_fd_tell(RDD_READER *r, rdd_count_t *pos);
 static int rdd_fd_seek(RDD_READER *r, rdd_count_t pos);
 static int rdd_fd_close(RDD_READER *r, int recurse);
+static int rdd_fd_stream(RDD_READER *r);
 
 static RDD_READ_OPS fd_read_ops = {
 	rdd_fd_read,
 	rdd_fd_tell,
 	rdd_fd_seek,
-	rdd_fd_close
+	rdd_fd_close,
+	0,		/* pread */
+	rdd_fd_stream
 };
 
 int
@@ -87,6 +93,21 @@ rdd_open_fd_reader(RDD_READER **self, int fd)
 	return RDD_OK;
 }
 
+/* Drops the nbyte bytes just read from the page cache.
+ */
+static void
+drop_behind(RDD_FD_READER *state, unsigned nbyte)
+{
+#if defined(POSIX_FADV_DONTNEED)
+	off_t pos;
+
+	if ((pos = lseek(state->fd, (off_t) 0, SEEK_CUR)) != (off_t) -1) {
+		(void) posix_fadvise(state->fd, pos - (off_t) nbyte,
+				(off_t) nbyte, POSIX_FADV_DONTNEED);
+	}
+#endif
+}
+
 static int
 rdd_fd_read(RDD_READER *self, unsigned char *buf, unsigned nbyte,
 			unsigned *nread)
@@ -109,6 +130,10 @@ rdd_fd_read(RDD_READER *self, unsigned char *buf, unsigned nbyte,
 		next += n;
 	}
 
+	if (state->stream && next > buf) {
+		drop_behind(state, (unsigned) (next - buf));
+	}
+
 	*nread = next - buf;
 	return RDD_OK;
 }
@@ -154,3 +179,24 @@ rdd_fd_close(RDD_READER *self, int recurse /* ignored */)
 
 	return rc;
 }
+
+static int
+rdd_fd_stream(RDD_READER *self)
+{
+#if defined(POSIX_FADV_SEQUENTIAL) && defined(POSIX_FADV_DONTNEED)
+	RDD_FD_READER *state = self->state;
+	struct stat info;
+
+	if (fstat(state->fd, &info) < 0
+	||  ! (S_ISREG(info.st_mode) || S_ISBLK(info.st_mode))) {
+		return RDD_NOTFOUND;	/* pipe or socket */
+	}
+	if (posix_fadvise(state->fd, 0, 0, POSIX_FADV_SEQUENTIAL) != 0) {
+		return RDD_NOTFOUND;
+	}
+	state->stream = 1;
+	return RDD_OK;
+#else
+	return RDD_NOTFOUND;
+#endif
+}
@@ -32,10 +32,14 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE	/* fallocate(), sync_file_range() */
+
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "rdd.h"
 #include "writer.h"
@@ -45,17 +49,44 @@
 static int fd_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte);
 static int fd_close(RDD_WRITER *w);
 static int fd_compare_address(RDD_WRITER *w, struct addrinfo *address, int *result);
+static int fd_sync(RDD_WRITER *w);
+static int fd_truncate(RDD_WRITER *w, rdd_count_t pos);
+static int fd_skip(RDD_WRITER *w, rdd_count_t nbyte);
+static int fd_reserve(RDD_WRITER *w, rdd_count_t nbyte);
+static int fd_stream(RDD_WRITER *w);
 
 static RDD_WRITE_OPS fd_write_ops = {
 	fd_write,
 	fd_close,
-	fd_compare_address
+	fd_compare_address,
+	fd_sync,
+	fd_truncate,
+	fd_skip,
+	fd_reserve,
+	fd_stream
 };
 
+/* A streaming writer starts writeback every STREAM_WINDOW bytes, and
+ * waits for and drops the window before that from the page cache.
+ * About two windows of output are cached at any time.
+ */
+#define STREAM_WINDOW	(8 * 1024 * 1024)	/* bytes */
+
+#if defined(SYNC_FILE_RANGE_WRITE) && defined(POSIX_FADV_DONTNEED)
+#define RDD_STREAM_WRITES 1
+#endif
+
 typedef struct _RDD_FD_WRITER {
 	int fd;
+	int extend;	/* file may end before the current position */
+	int reserved;	/* space may be allocated beyond the end of the file */
+	int stream;	/* flush and drop output behind the write position? */
+	rdd_count_t flushed;	/* writeback started below this offset */
+	rdd_count_t dropped;	/* page cache dropped below this offset */
 } RDD_FD_WRITER;
 
+static int write_behind(RDD_FD_WRITER *state);
+
 int
 rdd_open_fd_writer(RDD_WRITER **self, int fd)
 {
@@ -103,8 +134,238 @@ fd_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte)
 		buf += n;
 		nbyte -= n;
 	}
+	state->extend = 0;
+
+	if (state->stream) {
+		return write_behind(state);
+	}
+	return RDD_OK;
+}
+
+/* Writes nbyte zero bytes; used where a hole cannot be punched.
+ */
+static int
+write_zeros(RDD_WRITER *w, rdd_count_t nbyte)
+{
+	static const unsigned char zeros[RDD_SPARSE_BLOCKSIZE];
+	unsigned n;
+	int rc;
+
+	while (nbyte > 0) {
+		n = nbyte < sizeof zeros ? (unsigned) nbyte : sizeof zeros;
+		if ((rc = fd_write(w, zeros, n)) != RDD_OK) {
+			return rc;
+		}
+		nbyte -= n;
+	}
+	return RDD_OK;
+}
+
+/* Seeks over nbyte bytes.  Existing file data in that range is
+ * replaced by a hole (or, if the file system cannot punch holes,
+ * overwritten with zeros).  If the run ends beyond the end of the
+ * file, the file is extended when the writer is synced or closed.
+ */
+static int
+fd_skip(RDD_WRITER *w, rdd_count_t nbyte)
+{
+	RDD_FD_WRITER *state = w->state;
+	struct stat info;
+	off_t pos;
+	rdd_count_t overlap = 0;
+	int rc;
+
+	if ((pos = lseek(state->fd, 0, SEEK_CUR)) == (off_t) -1) {
+		return RDD_NOTFOUND;	/* pipe or socket */
+	}
+	if (fstat(state->fd, &info) < 0 || ! S_ISREG(info.st_mode)) {
+		return RDD_NOTFOUND;
+	}
+
+	if (pos < info.st_size) {
+		overlap = (rdd_count_t) (info.st_size - pos);
+		if (overlap > nbyte) overlap = nbyte;
+#if defined(FALLOC_FL_PUNCH_HOLE)
+		if (fallocate(state->fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
+				pos, (off_t) overlap) == 0) {
+			pos += (off_t) overlap;
+			nbyte -= overlap;
+			overlap = 0;
+		}
+#endif
+		if (overlap > 0) {
+			if ((rc = write_zeros(w, overlap)) != RDD_OK) {
+				return rc;
+			}
+			pos += (off_t) overlap;
+			nbyte -= overlap;
+		}
+	}
+
+	if (nbyte > 0) {
+		if (lseek(state->fd, pos + (off_t) nbyte, SEEK_SET) == (off_t) -1) {
+			return RDD_ESEEK;
+		}
+		state->extend = 1;
+	}
+	return RDD_OK;
+}
+
+/* Makes the file size equal to the current position after a skip
+ * to a position beyond the end of the file.
+ */
+static int
+extend_file(RDD_FD_WRITER *state)
+{
+	struct stat info;
+	off_t pos;
+
+	if (! state->extend) {
+		return RDD_OK;
+	}
+	if ((pos = lseek(state->fd, 0, SEEK_CUR)) == (off_t) -1
+	||  fstat(state->fd, &info) < 0) {
+		return RDD_EWRITE;
+	}
+	if (info.st_size < pos && ftruncate(state->fd, pos) < 0) {
+		return RDD_EWRITE;
+	}
+	state->extend = 0;
+	return RDD_OK;
+}
+
+/* Allocates nbyte bytes from the current position without changing
+ * the file size.
+ */
+static int
+fd_reserve(RDD_WRITER *w, rdd_count_t nbyte)
+{
+	RDD_FD_WRITER *state = w->state;
+	off_t pos;
+
+	if ((pos = lseek(state->fd, 0, SEEK_CUR)) == (off_t) -1) {
+		return RDD_NOTFOUND;	/* pipe or socket */
+	}
+#if defined(FALLOC_FL_KEEP_SIZE)
+	if (fallocate(state->fd, FALLOC_FL_KEEP_SIZE, pos, (off_t) nbyte) == 0) {
+		state->reserved = 1;
+		return RDD_OK;
+	}
+	if (errno == ENOSPC) {
+		return RDD_ESPACE;
+	}
+#endif
+	return RDD_NOTFOUND;
+}
+
+/* Frees the space that was reserved beyond the end of the file
+ * but not written.  Truncating a file to its own size releases
+ * such blocks.
+ */
+static int
+release_reserved(RDD_FD_WRITER *state)
+{
+	struct stat info;
+
+	if (! state->reserved) {
+		return RDD_OK;
+	}
+	if (fstat(state->fd, &info) < 0) {
+		return RDD_EWRITE;
+	}
+	if (S_ISREG(info.st_mode) && ftruncate(state->fd, info.st_size) < 0) {
+		return RDD_EWRITE;
+	}
+	state->reserved = 0;
+	return RDD_OK;
+}
 
+static int
+fd_stream(RDD_WRITER *w)
+{
+#if defined(RDD_STREAM_WRITES)
+	RDD_FD_WRITER *state = w->state;
+	struct stat info;
+	off_t pos;
+
+	if (fstat(state->fd, &info) < 0
+	||  ! (S_ISREG(info.st_mode) || S_ISBLK(info.st_mode))) {
+		return RDD_NOTFOUND;
+	}
+	if ((pos = lseek(state->fd, 0, SEEK_CUR)) == (off_t) -1) {
+		return RDD_NOTFOUND;
+	}
+	state->stream = 1;
+	state->flushed = (rdd_count_t) pos;
+	state->dropped = (rdd_count_t) pos;
 	return RDD_OK;
+#else
+	return RDD_NOTFOUND;
+#endif
+}
+
+/* Called after each write by a streaming writer.  Once a full window
+ * has been written since the last call that did any work, waits until
+ * the previous window is on disk, drops it from the page cache, and
+ * starts writeback of the new window.
+ */
+static int
+write_behind(RDD_FD_WRITER *state)
+{
+#if defined(RDD_STREAM_WRITES)
+	unsigned flags;
+	rdd_count_t pos;
+	off_t offset;
+
+	if ((offset = lseek(state->fd, 0, SEEK_CUR)) == (off_t) -1) {
+		return RDD_ESEEK;
+	}
+	pos = (rdd_count_t) offset;
+
+	if (pos < state->flushed) {
+		/* Truncated; start over from here. */
+		state->flushed = pos;
+		if (state->dropped > pos) {
+			state->dropped = pos;
+		}
+	}
+	if (pos - state->flushed < STREAM_WINDOW) {
+		return RDD_OK;
+	}
+
+	if (state->flushed > state->dropped) {
+		flags = SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE
+			| SYNC_FILE_RANGE_WAIT_AFTER;
+		if (sync_file_range(state->fd, (off_t) state->dropped,
+			(off_t) (state->flushed - state->dropped), flags) < 0) {
+			return RDD_EWRITE;
+		}
+		(void) posix_fadvise(state->fd, (off_t) state->dropped,
+			(off_t) (state->flushed - state->dropped),
+			POSIX_FADV_DONTNEED);
+		state->dropped = state->flushed;
+	}
+
+	if (sync_file_range(state->fd, (off_t) state->flushed,
+		(off_t) (pos - state->flushed), SYNC_FILE_RANGE_WRITE) < 0) {
+		return RDD_EWRITE;
+	}
+	state->flushed = pos;
+#endif
+	return RDD_OK;
+}
+
+/* Drops whatever a streaming writer still has in the page cache.
+ * The data must be on disk already.
+ */
+static void
+drop_behind(RDD_FD_WRITER *state)
+{
+#if defined(RDD_STREAM_WRITES)
+	if (state->stream) {
+		(void) posix_fadvise(state->fd, 0, 0, POSIX_FADV_DONTNEED);
+	}
+#endif
 }
 
 static int
@@ -112,14 +373,23 @@ fd_close(RDD_WRITER *self)
 {
 	RDD_FD_WRITER *state = self->state;
 	int rc;
-	if (fsync(state->fd) < 0) {
-		rc = RDD_ECLOSE;
+
+	if ((rc = extend_file(state)) != RDD_OK
+	||  (rc = release_reserved(state)) != RDD_OK) {
+		(void) close(state->fd);
+		return rc;
+	}
+	/* Pipes and sockets cannot be synced (EINVAL); that is no error.
+	 */
+	if (fsync(state->fd) < 0 && errno != EINVAL) {
+		rc = RDD_ECLOSE; // close the descriptor anyway
 	}
+	drop_behind(state);
 
-	if ((rc = close(state->fd)) < 0) {
+	if (close(state->fd) < 0) {
 		return RDD_ECLOSE;
 	}
-	return RDD_OK;
+	return rc;
 }
 
 static int
@@ -135,3 +405,34 @@ fd_compare_address(RDD_WRITER *self, struct addrinfo *address, int *result)
 	*result = (address == 0);
 	return RDD_OK;
 }
+
+static int
+fd_sync(RDD_WRITER *self)
+{
+	RDD_FD_WRITER *state = self->state;
+	int rc;
+
+	if ((rc = extend_file(state)) != RDD_OK) {
+		return rc;
+	}
+	if (fsync(state->fd) < 0) {
+		return RDD_EWRITE;
+	}
+	drop_behind(state);
+	return RDD_OK;
+}
+
+static int
+fd_truncate(RDD_WRITER *self, rdd_count_t pos)
+{
+	RDD_FD_WRITER *state = self->state;
+
+	if (ftruncate(state->fd, (off_t) pos) < 0) {
+		return RDD_EWRITE;
+	}
+	if (lseek(state->fd, (off_t) pos, SEEK_SET) == (off_t) -1) {
+		return RDD_ESEEK;
+	}
+	state->extend = 0;
+	return RDD_OK;
+}
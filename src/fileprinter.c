@@ -36,6 +36,7 @@
 
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "rdd.h"
 #include "rdd_internals.h"
@@ -49,10 +50,14 @@ typedef struct _RDD_FILE_MSGPRINTER {
 
 static void file_print(RDD_MSGPRINTER *self, rdd_message_t type, int errcode, const char *msg);
 static int  file_close(RDD_MSGPRINTER *self, unsigned flags);
+static int  file_sync(RDD_MSGPRINTER *self, rdd_count_t *size);
+static int  file_truncate(RDD_MSGPRINTER *self, rdd_count_t size);
 
 static RDD_MSGPRINTER_OPS file_ops = {
 	file_print,
-	file_close
+	file_close,
+	file_sync,
+	file_truncate
 };
 
 int
@@ -138,3 +143,36 @@ file_close(RDD_MSGPRINTER *self, unsigned flags)
 	memset(file, 0, sizeof *file);
 	return RDD_OK;
 }
+
+static int
+file_sync(RDD_MSGPRINTER *self, rdd_count_t *size)
+{
+	RDD_FILE_MSGPRINTER *file = (RDD_FILE_MSGPRINTER *) self->state;
+	off_t pos;
+
+	if (fflush(file->stream) == EOF || fsync(fileno(file->stream)) < 0) {
+		return RDD_EWRITE;
+	}
+	if ((pos = ftello(file->stream)) < 0) {
+		return RDD_ETELL;
+	}
+	*size = (rdd_count_t) pos;
+	return RDD_OK;
+}
+
+static int
+file_truncate(RDD_MSGPRINTER *self, rdd_count_t size)
+{
+	RDD_FILE_MSGPRINTER *file = (RDD_FILE_MSGPRINTER *) self->state;
+
+	if (fflush(file->stream) == EOF) {
+		return RDD_EWRITE;
+	}
+	if (ftruncate(fileno(file->stream), (off_t) size) < 0) {
+		return RDD_EWRITE;
+	}
+	if (fseeko(file->stream, (off_t) size, SEEK_SET) < 0) {
+		return RDD_ESEEK;
+	}
+	return RDD_OK;
+}
@@ -60,5 +60,11 @@ rdd_open_file_reader(RDD_READER **r, const char *path, int raw)
 		return RDD_EOPEN;
 	}
 
+	/* Use positional reads, unless the file is a pipe or some
+	 * other file that does not support them.
+	 */
+	if (rdd_open_pread_reader(r, fd) == RDD_OK) {
+		return RDD_OK;
+	}
 	return rdd_open_fd_reader(r, fd);
 }
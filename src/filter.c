@@ -108,9 +108,24 @@ block_filter_push(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
 {
 	RDD_FILTER_OPS *ops = f->ops;
 	unsigned todo;
+	unsigned nblock;
 	int rc;
 
 	while (nbyte > 0) {
+		if (f->pos == 0 && nbyte >= f->blocksize && ops->blocks != 0) {
+			/* Hand all whole blocks to the filter at once.
+			 */
+			nblock = nbyte / f->blocksize;
+			rc = (*ops->blocks)(f, buf, nblock);
+			if (rc != RDD_OK) {
+				return rc;
+			}
+			todo = nblock * f->blocksize;
+			buf += todo;
+			nbyte -= todo;
+			continue;
+		}
+
 		if (f->pos + nbyte > f->blocksize) {
 			todo = f->blocksize - f->pos;
 		} else {
@@ -143,7 +158,8 @@ block_filter_push(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
  *  stream filter it will simply pass the buffer to the client's
  *  handler.  If the filter is a block filter, it processes the
  *  buffer block by block, calling the client's block handler at
- *  each block boundary.
+ *  each block boundary, or its blocks handler for runs of whole
+ *  blocks.
  */
 int 
 rdd_filter_push(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
@@ -189,6 +205,44 @@ rdd_filter_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte)
 	return (*ops->get_result)(f, buf, nbyte);
 }
 
+/* The generic part of a saved filter state is the block size and
+ * the position in the current block.
+ */
+int
+rdd_filter_save(RDD_FILTER *f, FILE *fp)
+{
+	RDD_FILTER_OPS *ops = f->ops;
+
+	if (ops->save == 0) return RDD_NOTFOUND;
+
+	if (fwrite(&f->blocksize, sizeof f->blocksize, 1, fp) < 1
+	||  fwrite(&f->pos, sizeof f->pos, 1, fp) < 1) {
+		return RDD_EWRITE;
+	}
+
+	return (*ops->save)(f, fp);
+}
+
+int
+rdd_filter_restore(RDD_FILTER *f, FILE *fp)
+{
+	RDD_FILTER_OPS *ops = f->ops;
+	unsigned blocksize, pos;
+
+	if (ops->restore == 0) return RDD_NOTFOUND;
+
+	if (fread(&blocksize, sizeof blocksize, 1, fp) < 1
+	||  fread(&pos, sizeof pos, 1, fp) < 1) {
+		return RDD_ESYNTAX;
+	}
+	if (blocksize != f->blocksize || (blocksize > 0 && pos >= blocksize)) {
+		return RDD_ESYNTAX;
+	}
+	f->pos = pos;
+
+	return (*ops->restore)(f, fp);
+}
+
 int
 rdd_filter_free(RDD_FILTER *f)
 {
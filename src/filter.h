@@ -35,6 +35,9 @@
 
 #include "rdd.h"
 #include "writer.h"
+#include "hashengine.h"
+#include "blockindex.h"
+#include "dedup.h"
 
 /** @file
  *  \brief Generic filter interface.
@@ -52,6 +55,13 @@
  *  after every B bytes of input data.  These B bytes, however, may be
  *  passed to the filter through multiple calls to the filter's input()
  *  routine.
+ *
+ *  A block filter may also supply a blocks() routine.  When a push
+ *  starts at a block boundary, the whole blocks in the buffer are
+ *  passed to blocks() in a single call instead of through one
+ *  input()/block() pair per block.  blocks() must have the same effect
+ *  as those calls; it lets a filter compute the results for a run of
+ *  blocks in one go and write them out together.
  */
 struct _RDD_FILTER;
 struct _RDD_FILTER_OPS;
@@ -71,6 +81,15 @@ typedef int
 typedef int
 (*rdd_fltr_free_fun)(struct _RDD_FILTER *f);
 
+typedef int
+(*rdd_fltr_save_fun)(struct _RDD_FILTER *f, FILE *fp);
+
+typedef int
+(*rdd_fltr_restore_fun)(struct _RDD_FILTER *f, FILE *fp);
+
+typedef int
+(*rdd_fltr_blocks_fun)(struct _RDD_FILTER *f, const unsigned char *buf, unsigned nblock);
+
 typedef struct _RDD_FILTER_OPS
 {
 	rdd_fltr_input_fun input; /* used to pass data to the filter */
@@ -78,6 +97,9 @@ typedef struct _RDD_FILTER_OPS
 	rdd_fltr_close_fun close; /* used to mark end of input */
 	rdd_fltr_rslt_fun get_result; /* used to obtain final result */
 	rdd_fltr_free_fun free; /* deallocate filter state */
+	rdd_fltr_save_fun save; /* serialize state (optional) */
+	rdd_fltr_restore_fun restore; /* deserialize state (optional) */
+	rdd_fltr_blocks_fun blocks; /* process whole blocks (optional) */
 } RDD_FILTER_OPS;
 
 typedef struct _RDD_FILTER
@@ -111,12 +133,137 @@ rdd_new_sha384_streamfilter(RDD_FILTER **f);
 int
 rdd_new_sha512_streamfilter(RDD_FILTER **f);
 
+/* Digest selection flags for the multihash stream filter.
+ */
+#define RDD_MULTIHASH_MD5	0x01
+#define RDD_MULTIHASH_SHA1	0x02
+#define RDD_MULTIHASH_SHA256	0x04
+#define RDD_MULTIHASH_SHA384	0x08
+#define RDD_MULTIHASH_SHA512	0x10
+
+/** \brief Creates a stream filter that computes several digests at once.
+ *  \param f output value: the new filter
+ *  \param algs a bitwise or of \c RDD_MULTIHASH_* flags; at least one
+ *  flag must be set
+ *  \return Returns \c RDD_OK on success.
+ *
+ *  The filter splits its input into chunks that fit in the CPU's
+ *  first-level cache and runs each selected digest over a chunk
+ *  before it moves on to the next chunk, so the data is fetched from
+ *  main memory only once.  The filter's result is the concatenation
+ *  of the selected digests in the order MD5, SHA-1, SHA-256, SHA-384,
+ *  SHA-512; use \c rdd_multihash_get_digest() to obtain one of them.
+ */
+int
+rdd_new_multihash_streamfilter(RDD_FILTER **f, unsigned algs);
+
+/** \brief Obtains one digest from a multihash stream filter.
+ *  \param f the multihash filter
+ *  \param alg a single \c RDD_MULTIHASH_* flag
+ *  \param buf the client's result buffer
+ *  \param nbyte the size of the client's result buffer
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOTFOUND if
+ *  \c f does not compute digest \c alg and \c RDD_ESPACE if \c buf
+ *  is too small.
+ */
+int
+rdd_multihash_get_digest(RDD_FILTER *f, unsigned alg,
+		unsigned char *buf, unsigned nbyte);
+
+/** \brief Creates a stream filter that computes a Merkle tree hash.
+ *  \param f output value: the new filter
+ *  \param leafsize the size of a leaf in bytes
+ *  \param nthread the number of hashing threads; 0 means one per
+ *  online processor
+ *  \return Returns \c RDD_OK on success.
+ *
+ *  The input is split into leaves of \c leafsize bytes (the last
+ *  leaf may be shorter) that are hashed in parallel.  The leaf
+ *  digests are combined into an RFC 6962 SHA-256 tree.  The result
+ *  does not depend on \c nthread, but it does depend on
+ *  \c leafsize.
+ */
+int
+rdd_new_treehash_streamfilter(RDD_FILTER **f, unsigned leafsize,
+		unsigned nthread);
+
 int
 rdd_new_write_streamfilter(RDD_FILTER **f, RDD_WRITER *writer);
 
 int
 rdd_new_md5_blockfilter(RDD_FILTER **f, unsigned blocksize, const char *outpath, int overwrite);
 
+/** \brief Creates a block filter that stores a digest of every block.
+ *  \param f output value: the new filter
+ *  \param alg the digest algorithm
+ *  \param blocksize the block size in bytes
+ *  \param nthread the number of hashing threads; 0 means one per
+ *  online processor
+ *  \param outpath the output file
+ *  \param overwrite overwrite mode for the output file
+ *  \return Returns \c RDD_OK on success.
+ *
+ *  Consecutive blocks are hashed in parallel.  The digests are
+ *  written in block order, one "<block number>\t<digest>" line per
+ *  block, like the MD5 block filter does.
+ */
+int
+rdd_new_hash_blockfilter(RDD_FILTER **f, rdd_hash_alg_t alg,
+		unsigned blocksize, unsigned nthread,
+		const char *outpath, int overwrite);
+
+/** \brief Creates a block filter that writes the digest of each block
+ *  to a binary block-index file (see blockindex.h).
+ *  \param f output value: the filter
+ *  \param alg the digest algorithm
+ *  \param blocksize the block size in bytes
+ *  \param offset the image offset of the first block; it is recorded
+ *  in the index header
+ *  \param outpath the index file
+ *  \param overwrite an \c RDD_OVERWRITE mode
+ */
+int
+rdd_new_blockindex_filter(RDD_FILTER **f, rdd_hash_alg_t alg,
+		unsigned blocksize, rdd_count_t offset,
+		const char *outpath, int overwrite);
+
+/** \brief Creates a block filter that checks blocks against an index.
+ *  \param f output value: the filter
+ *  \param idx the index; it must stay open while the filter exists
+ *  \param first the number of the first block that is pushed
+ *  \param count the number of blocks to check; 0 means all blocks
+ *  from \c first to the end of the index, in which case data beyond
+ *  the end of the index counts as an error
+ *  \param err called for every bad block (may be 0)
+ *  \param env passed to \c err
+ *
+ *  The filter's result is an \c rdd_count_t: the number of bad blocks,
+ *  including blocks in the range for which no data was pushed.
+ */
+int
+rdd_new_verify_blockindex_filter(RDD_FILTER **f, RDD_BLOCKINDEX *idx,
+		rdd_count_t first, rdd_count_t count,
+		rdd_blockindex_error_fun err, void *env);
+
+/** \brief Creates a block filter that finds duplicate blocks.
+ *  \param f output value: the filter
+ *  \param blocksize the block size in bytes
+ *  \param memsize the maximum size of the block table in bytes
+ *  \param indexpath a persistent index to load and update, or 0
+ *  \param datapath the data file of a dedup image, or 0
+ *  \param mappath the map file of a dedup image; must be 0 if and
+ *  only if \c datapath is 0
+ *  \param overwrite overwrite mode for the dedup image files
+ *
+ *  See dedup.h for the file formats.  A missing index file is
+ *  created.  The filter's result is an \c RDD_DEDUP_STATS structure.
+ *  The filter cannot save its state.
+ */
+int
+rdd_new_dedup_blockfilter(RDD_FILTER **f, unsigned blocksize,
+		rdd_count_t memsize, const char *indexpath,
+		const char *datapath, const char *mappath, int overwrite);
+
 int
 rdd_new_stats_blockfilter(RDD_FILTER **f, unsigned blocksize, const char *outpath, int overwrite);
 
@@ -126,6 +273,13 @@ rdd_new_adler32_blockfilter(RDD_FILTER **f, unsigned blocksize, const char *outp
 int
 rdd_new_crc32_blockfilter(RDD_FILTER **f, unsigned blocksize, const char *outpath, int overwrite);
 
+/** \brief Creates a block filter that writes a CRC-32C (Castagnoli)
+ *  checksum per block.  The checksum file uses the same format as the
+ *  Adler32 and CRC32 files; its header flags record the algorithm.
+ */
+int
+rdd_new_crc32c_blockfilter(RDD_FILTER **f, unsigned blocksize, const char *outpath, int overwrite);
+
 int
 rdd_new_verify_adler32_blockfilter(RDD_FILTER **f, FILE *fp, unsigned blocksize, int swap,
 		rdd_fltr_error_fun err, void *env);
@@ -134,6 +288,10 @@ int
 rdd_new_verify_crc32_blockfilter(RDD_FILTER **f, FILE *fp, unsigned blocksize, int swap,
 		rdd_fltr_error_fun err, void *env);
 
+int
+rdd_new_verify_crc32c_blockfilter(RDD_FILTER **f, FILE *fp, unsigned blocksize, int swap,
+		rdd_fltr_error_fun err, void *env);
+
 /* Generic routines
  */
 /** \brief Pushes a data buffer into a filter.
@@ -172,6 +330,36 @@ rdd_filter_close(RDD_FILTER *f);
 int
 rdd_filter_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte);
 
+/** \brief Saves a filter's state.
+ *  \param f the filter
+ *  \param fp the stream to which the state is written
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOTFOUND if
+ *  the filter cannot save its state.
+ *
+ *  This function writes everything that the filter needs to continue
+ *  processing its input stream later, in another process, to \c fp.
+ *  Output that the filter has produced so far is flushed to stable
+ *  storage first.  The saved state is only valid on the same platform
+ *  and with the same filter parameters.
+ */
+int
+rdd_filter_save(RDD_FILTER *f, FILE *fp);
+
+/** \brief Restores a filter's state.
+ *  \param f the filter; it must not have received any input yet
+ *  \param fp the stream from which the state is read
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOTFOUND if
+ *  the filter cannot restore its state.  Returns \c RDD_ESYNTAX if
+ *  the saved state is truncated or does not fit the filter.
+ *
+ *  This function reads a state written by \c rdd_filter_save().
+ *  Afterwards, filter \c f behaves as if it had received the input
+ *  that the saved filter had received.  Output files are truncated
+ *  to the size they had when the state was saved.
+ */
+int
+rdd_filter_restore(RDD_FILTER *f, FILE *fp);
+
 /** \brief Deallocates a filter and its resources.
  *  \param f the filter
  *  \return Returns \c RDD_OK on success.
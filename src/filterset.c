@@ -48,22 +48,48 @@ static char copyright[] =
 #include <assert.h>
 #include <memory.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "rdd.h"
 #include "rdd_internals.h"
 #include "writer.h"
 #include "filter.h"
 #include "filterset.h"
+#include "alignedbuf.h"
+#include "bufring.h"
 
 #define is_stream_filter(fltr)  ((fltr)->block_size <= 0)
 #define is_block_filter(fltr)  ((fltr)->block_size > 0)
 
+/* Parallel mode: each filter is driven by a worker thread that
+ * consumes the buffers of a shared ring.  Worker i is consumer i
+ * of the ring.
+ */
+typedef struct _RDD_FSET_WORKER {
+	RDD_BUFRING   *ring;
+	RDD_FSET_NODE *node;
+	unsigned       consumer;
+	pthread_t      thread;
+	int            started;
+	int            rc;
+} RDD_FSET_WORKER;
+
+typedef struct _RDD_FSET_THREADS {
+	RDD_BUFRING     *ring;
+	unsigned         nworker;
+	RDD_FSET_WORKER *workers;
+} RDD_FSET_THREADS;
+
+static int stop_threads(RDD_FILTERSET *fset, int rc);
+
 int
 rdd_fset_init(RDD_FILTERSET *fset)
 {
 	fset->head = 0;
 	fset->tail = &fset->head;
+	fset->threads = 0;
 
 	return RDD_OK;
 }
@@ -78,6 +104,9 @@ rdd_fset_add(RDD_FILTERSET *fset, const char *name, RDD_FILTER *f)
 	if (name == 0 || strlen(name) < 1 || f == 0) {
 		return RDD_BADARG;
 	}
+	if (fset->threads != 0) {
+		return RDD_BADARG;
+	}
 
 	rc = rdd_fset_get(fset, name, 0);
 
@@ -169,12 +198,154 @@ rdd_fset_cursor_close(RDD_FSET_CURSOR *c)
 	return RDD_OK;
 }
 
+static void *
+filter_worker(void *arg)
+{
+	RDD_FSET_WORKER *w = (RDD_FSET_WORKER *) arg;
+	unsigned char *buf;
+	unsigned nbyte;
+	int rc;
+
+	for (;;) {
+		rc = rdd_bufring_get_full(w->ring, w->consumer, &buf, &nbyte);
+		if (rc != RDD_OK || buf == 0) {
+			break;
+		}
+
+		rc = rdd_filter_push(w->node->filter, buf, nbyte);
+		if (rc != RDD_OK) {
+			rdd_bufring_abort(w->ring, rc);
+			break;
+		}
+
+		rdd_bufring_put_free(w->ring, w->consumer);
+	}
+
+	w->rc = rc;
+	return 0;
+}
+
+int
+rdd_fset_set_parallel(RDD_FILTERSET *fset, unsigned nbuf, unsigned bufsize)
+{
+	RDD_FSET_THREADS *t = 0;
+	RDD_FSET_NODE *node;
+	unsigned n;
+	int rc;
+
+	if (nbuf == 0 || bufsize == 0 || fset->threads != 0) {
+		return RDD_BADARG;
+	}
+
+	for (n = 0, node = fset->head; node != 0; node = node->next) {
+		n++;
+	}
+	if (n == 0) {
+		return RDD_OK;	/* nothing to run */
+	}
+
+	if ((t = calloc(1, sizeof(RDD_FSET_THREADS))) == 0) {
+		return RDD_NOMEM;
+	}
+	if ((t->workers = calloc(n, sizeof(RDD_FSET_WORKER))) == 0) {
+		free(t);
+		return RDD_NOMEM;
+	}
+	rc = rdd_new_bufring(&t->ring, nbuf, bufsize, RDD_SECTOR_SIZE, n);
+	if (rc != RDD_OK) {
+		free(t->workers);
+		free(t);
+		return rc;
+	}
+	fset->threads = t;
+
+	for (node = fset->head; node != 0; node = node->next) {
+		RDD_FSET_WORKER *w = &t->workers[t->nworker];
+
+		w->ring = t->ring;
+		w->node = node;
+		w->consumer = t->nworker++;
+		w->rc = RDD_OK;
+		if (pthread_create(&w->thread, 0, filter_worker, w) != 0) {
+			stop_threads(fset, RDD_ABORTED);
+			return RDD_NOMEM;
+		}
+		w->started = 1;
+	}
+
+	return RDD_OK;
+}
+
+/* Stops the filter threads.  If rc equals RDD_OK, the threads first
+ * process all buffers that have been pushed.  Returns the first
+ * error reported by a filter thread.
+ */
+static int
+stop_threads(RDD_FILTERSET *fset, int rc)
+{
+	RDD_FSET_THREADS *t = fset->threads;
+	unsigned i;
+
+	if (rc == RDD_OK) {
+		rdd_bufring_put_eof(t->ring);
+	} else {
+		rdd_bufring_abort(t->ring, rc);
+	}
+
+	for (i = 0; i < t->nworker; i++) {
+		if (t->workers[i].started) {
+			pthread_join(t->workers[i].thread, 0);
+		}
+	}
+	if (rc == RDD_OK) {
+		rc = rdd_bufring_error(t->ring);
+	}
+
+	rdd_free_bufring(t->ring);
+	free(t->workers);
+	free(t);
+	fset->threads = 0;
+
+	return rc;
+}
+
+static int
+parallel_push(RDD_FILTERSET *fset, const unsigned char *buf, unsigned nbyte)
+{
+	RDD_BUFRING *ring = fset->threads->ring;
+	unsigned bufsize = rdd_bufring_bufsize(ring);
+	unsigned char *slot;
+	unsigned n;
+	int rc;
+
+	while (nbyte > 0) {
+		n = nbyte < bufsize ? nbyte : bufsize;
+
+		if ((rc = rdd_bufring_get_free(ring, &slot)) != RDD_OK) {
+			return rc;
+		}
+		memcpy(slot, buf, n);
+		if ((rc = rdd_bufring_put_full(ring, n)) != RDD_OK) {
+			return rc;
+		}
+
+		buf += n;
+		nbyte -= n;
+	}
+
+	return RDD_OK;
+}
+
 int
 rdd_fset_push(RDD_FILTERSET *fset, const unsigned char *buf, unsigned nbyte)
 {
 	RDD_FSET_NODE *node;
 	int rc;
 
+	if (fset->threads != 0) {
+		return parallel_push(fset, buf, nbyte);
+	}
+
 	for (node = fset->head; node != 0; node = node->next) {
 		rc = rdd_filter_push(node->filter, buf, nbyte);
 		if (rc != RDD_OK) {
@@ -191,6 +362,12 @@ rdd_fset_close(RDD_FILTERSET *fset)
 	RDD_FSET_NODE *node;
 	int rc;
 
+	if (fset->threads != 0) {
+		if ((rc = stop_threads(fset, RDD_OK)) != RDD_OK) {
+			return rc;
+		}
+	}
+
 	for (node = fset->head; node != 0; node = node->next) {
 		rc = rdd_filter_close(node->filter);
 		if (rc != RDD_OK) {
@@ -201,6 +378,78 @@ rdd_fset_close(RDD_FILTERSET *fset)
 	return RDD_OK;
 }
 
+/* Saved filter-set layout: the number of filters, followed by the
+ * name length, name, and state of each filter.
+ */
+int
+rdd_fset_save(RDD_FILTERSET *fset, FILE *fp)
+{
+	RDD_FSET_NODE *node;
+	uint32_t n, len;
+	int rc;
+
+	if (fset->threads != 0) {
+		rc = rdd_bufring_wait_empty(fset->threads->ring);
+		if (rc != RDD_OK) {
+			return rc;
+		}
+	}
+
+	for (n = 0, node = fset->head; node != 0; node = node->next) {
+		n++;
+	}
+	if (fwrite(&n, sizeof n, 1, fp) < 1) {
+		return RDD_EWRITE;
+	}
+
+	for (node = fset->head; node != 0; node = node->next) {
+		len = strlen(node->name);
+		if (fwrite(&len, sizeof len, 1, fp) < 1
+		||  fwrite(node->name, 1, len, fp) < len) {
+			return RDD_EWRITE;
+		}
+		if ((rc = rdd_filter_save(node->filter, fp)) != RDD_OK) {
+			return rc;
+		}
+	}
+
+	return RDD_OK;
+}
+
+int
+rdd_fset_restore(RDD_FILTERSET *fset, FILE *fp)
+{
+	RDD_FSET_NODE *node;
+	char name[256];
+	uint32_t n, len;
+	int rc;
+
+	if (fread(&n, sizeof n, 1, fp) < 1) {
+		return RDD_ESYNTAX;
+	}
+
+	for (node = fset->head; node != 0; node = node->next, n--) {
+		if (n == 0) {
+			return RDD_ESYNTAX;
+		}
+		if (fread(&len, sizeof len, 1, fp) < 1 || len >= sizeof name) {
+			return RDD_ESYNTAX;
+		}
+		if (fread(name, 1, len, fp) < len) {
+			return RDD_ESYNTAX;
+		}
+		name[len] = '\000';
+		if (strcmp(name, node->name) != 0) {
+			return RDD_ESYNTAX;
+		}
+		if ((rc = rdd_filter_restore(node->filter, fp)) != RDD_OK) {
+			return rc;
+		}
+	}
+
+	return n == 0 ? RDD_OK : RDD_ESYNTAX;
+}
+
 int
 rdd_fset_clear(RDD_FILTERSET *fset)
 {
@@ -208,6 +457,13 @@ rdd_fset_clear(RDD_FILTERSET *fset)
 	RDD_FSET_NODE *next;
 	int rc;
 
+	/* The threads are still running if the filter set was
+	 * not closed, for example after a push error.
+	 */
+	if (fset->threads != 0) {
+		stop_threads(fset, RDD_ABORTED);
+	}
+
 	for (node = fset->head; node != 0; node = next) {
 		next = node->next;
 		free(node->name);
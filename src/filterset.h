@@ -61,6 +61,7 @@ typedef struct _RDD_FSET_NODE {
 typedef struct _RDD_FILTERSET {
 	RDD_FSET_NODE  *head;	/**< head of the filter list */
 	RDD_FSET_NODE **tail;	/**< tail of the filter list */
+	struct _RDD_FSET_THREADS *threads; /**< filter threads (parallel mode only) */
 } RDD_FILTERSET;
 
 /** \brief Representation of a filter cursor.
@@ -127,6 +128,33 @@ int rdd_fset_cursor_next(RDD_FSET_CURSOR *c, RDD_FILTER **f);
  */
 int rdd_fset_cursor_close(RDD_FSET_CURSOR *c);
 
+/** \brief Switches a filter set to parallel mode, in which every filter
+ *  runs in a thread of its own.
+ *  \param fset the filter set
+ *  \param nbuf the number of buffers that can be queued between
+ *  \c rdd_fset_push() and the slowest filter
+ *  \param bufsize the size in bytes of each buffer
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_BADARG if
+ *  \c nbuf or \c bufsize is zero or if the filter set already is in
+ *  parallel mode.  Returns \c RDD_NOMEM if there is insufficient
+ *  memory to create the buffers or the threads.
+ *
+ *  In parallel mode, \c rdd_fset_push() copies its data into a
+ *  shared, read-only buffer and returns without waiting for the filters.
+ *  Each filter consumes the buffers in order in its own thread; a buffer
+ *  is reused once all filters are done with it.  The throughput of the
+ *  filter set is therefore bounded by the slowest filter rather than
+ *  by the sum of all filters.  An error returned by a filter stops all
+ *  filters and is returned by the next call to \c rdd_fset_push() or
+ *  by \c rdd_fset_close().
+ *
+ *  This function must be called after all filters have been added and
+ *  before any data is pushed.  \c rdd_fset_close() waits for all filters
+ *  to consume their input, stops the threads, and then closes the filters
+ *  in the calling thread.
+ */
+int rdd_fset_set_parallel(RDD_FILTERSET *fset, unsigned nbuf, unsigned bufsize);
+
 /** \brief Pushes a data buffer into all filters in a filter set.
  *  \param fset the filter set
  *  \param buf the data buffer
@@ -135,7 +163,8 @@ int rdd_fset_cursor_close(RDD_FSET_CURSOR *c);
  *
  *  This function passes data buffer \c buf to each filter in the filter
  *  set by calling \c rdd_filter_push(f, buf, nbyte) for each filter \c f
- *  in the filter set.
+ *  in the filter set.  In parallel mode (see \c rdd_fset_set_parallel())
+ *  the filters are called asynchronously.
  */
 int rdd_fset_push(RDD_FILTERSET *fset, const unsigned char *buf, unsigned nbyte);
 
@@ -148,6 +177,30 @@ int rdd_fset_push(RDD_FILTERSET *fset, const unsigned char *buf, unsigned nbyte)
  */
 int rdd_fset_close(RDD_FILTERSET *fset);
 
+/** \brief Saves the state of all filters in a filter set.
+ *  \param fset the filter set
+ *  \param fp the stream to which the state is written
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOTFOUND if
+ *  one of the filters cannot save its state.
+ *
+ *  This function writes the name and the state (see \c rdd_filter_save())
+ *  of each filter in the filter set to \c fp.  In parallel mode it first
+ *  waits until all filters have consumed the data pushed so far.
+ */
+int rdd_fset_save(RDD_FILTERSET *fset, FILE *fp);
+
+/** \brief Restores the state of all filters in a filter set.
+ *  \param fset the filter set; no data may have been pushed into it
+ *  \param fp the stream from which the state is read
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_ESYNTAX if
+ *  the saved state does not list the same filters, in the same order,
+ *  as \c fset.
+ *
+ *  This function reads a state written by \c rdd_fset_save() and
+ *  restores each filter with \c rdd_filter_restore().
+ */
+int rdd_fset_restore(RDD_FILTERSET *fset, FILE *fp);
+
 /** \brief Destroys all resources associated with a filter set.
  *  \param fset the filter set
  *  \return Returns \c RDD_OK on success.
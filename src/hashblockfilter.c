@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+/*
+ * A block filter that computes a digest of every block with any of
+ * the hash engine's algorithms.  Blocks are independent, so they are
+ * copied into a small ring of slots and hashed by a thread pool.  The
+ * digests are written to the output file in block order, in the same
+ * format as the MD5 block filter: one "<block number>\t<digest>" line
+ * per block.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "rdd.h"
+#include "rdd_internals.h"
+
+#include "writer.h"
+#include "filter.h"
+#include "msgprinter.h"
+#include "hashengine.h"
+#include "threadpool.h"
+
+#define MAX_DIGEST_LENGTH	64	/* bytes */
+
+typedef struct _HASHBLOCK_SLOT {
+	struct _RDD_HASH_BLOCK_FILTER *state;
+	unsigned char *buf;
+	unsigned       len;		/* # bytes in buf */
+	int            busy;		/* block is being hashed */
+	int            rc;
+	RDD_HASH       hash;
+	unsigned char  digest[MAX_DIGEST_LENGTH];
+} HASHBLOCK_SLOT;
+
+/* Block i is stored in slot i % nslot.  Between calls, the slot of
+ * block nblock is free and holds the bytes of the partial block.
+ */
+typedef struct _RDD_HASH_BLOCK_FILTER {
+	rdd_hash_alg_t  alg;
+	unsigned        mdlen;
+	unsigned        nslot;
+	HASHBLOCK_SLOT *slots;
+	RDD_THREADPOOL *pool;
+	pthread_mutex_t lock;
+	pthread_cond_t  block_done;
+	rdd_count_t     nblock;		/* # blocks submitted */
+	rdd_count_t     nprinted;	/* # digests written */
+	RDD_MSGPRINTER *printer;
+} RDD_HASH_BLOCK_FILTER;
+
+static int hashblock_input(RDD_FILTER *f,
+			const unsigned char *buf, unsigned nbyte);
+static int hashblock_block(RDD_FILTER *f, unsigned nbyte);
+static int hashblock_close(RDD_FILTER *f);
+static int hashblock_free(RDD_FILTER *f);
+static int hashblock_save(RDD_FILTER *f, FILE *fp);
+static int hashblock_restore(RDD_FILTER *f, FILE *fp);
+
+static RDD_FILTER_OPS hashblock_ops = {
+	hashblock_input,
+	hashblock_block,
+	hashblock_close,
+	0,
+	hashblock_free,
+	hashblock_save,
+	hashblock_restore
+};
+
+int
+rdd_new_hash_blockfilter(RDD_FILTER **self, rdd_hash_alg_t alg,
+		unsigned blocksize, unsigned nthread,
+		const char *outpath, int force_overwrite)
+{
+	RDD_FILTER *f = 0;
+	RDD_HASH_BLOCK_FILTER *state = 0;
+	unsigned i;
+	int rc;
+
+	if (self == 0 || alg >= RDD_HASH_NALG || outpath == 0) {
+		return RDD_BADARG;
+	}
+
+	rc = rdd_new_filter(&f, &hashblock_ops, sizeof(RDD_HASH_BLOCK_FILTER),
+			blocksize);
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state = (RDD_HASH_BLOCK_FILTER *) f->state;
+
+	if (nthread == 0) {
+		nthread = rdd_ncpu();
+	}
+
+	/* Two slots per thread keep the workers busy while the
+	 * caller fills the next blocks.
+	 */
+	state->alg = alg;
+	state->mdlen = rdd_hash_size(alg);
+	state->nslot = 2 * nthread;
+	pthread_mutex_init(&state->lock, 0);
+	pthread_cond_init(&state->block_done, 0);
+
+	if ((state->slots = calloc(state->nslot, sizeof(HASHBLOCK_SLOT))) == 0) {
+		rc = RDD_NOMEM;
+		goto error;
+	}
+	for (i = 0; i < state->nslot; i++) {
+		HASHBLOCK_SLOT *slot = &state->slots[i];
+
+		slot->state = state;
+		if ((slot->buf = malloc(blocksize)) == 0) {
+			rc = RDD_NOMEM;
+			goto error;
+		}
+		if ((rc = rdd_hash_init(&slot->hash, alg)) != RDD_OK) {
+			free(slot->buf);
+			slot->buf = 0;
+			goto error;
+		}
+	}
+
+	rc = rdd_new_threadpool(&state->pool, nthread, state->nslot);
+	if (rc != RDD_OK) {
+		goto error;
+	}
+
+	rc = rdd_mp_open_file_printer(&state->printer, outpath,
+			force_overwrite);
+	if (rc != RDD_OK) {
+		goto error;
+	}
+
+	*self = f;
+	return RDD_OK;
+
+error:
+	*self = 0;
+	rdd_filter_free(f);
+	return rc;
+}
+
+/* Runs on a pool thread. */
+static int
+hash_block(void *arg)
+{
+	HASHBLOCK_SLOT *slot = (HASHBLOCK_SLOT *) arg;
+	RDD_HASH_BLOCK_FILTER *state = slot->state;
+	int rc;
+
+	if ((rc = rdd_hash_reset(&slot->hash)) == RDD_OK
+	&&  (rc = rdd_hash_update(&slot->hash, slot->buf, slot->len)) == RDD_OK) {
+		rc = rdd_hash_final(&slot->hash, slot->digest);
+	}
+
+	pthread_mutex_lock(&state->lock);
+	slot->rc = rc;
+	slot->busy = 0;
+	pthread_cond_broadcast(&state->block_done);
+	pthread_mutex_unlock(&state->lock);
+
+	return rc;
+}
+
+/* Waits for all blocks up to (not including) block number upto,
+ * writes their digests in block order, and frees their slots.
+ */
+static int
+print_blocks(RDD_HASH_BLOCK_FILTER *state, rdd_count_t upto)
+{
+	char digest[2*MAX_DIGEST_LENGTH + 1];
+	HASHBLOCK_SLOT *slot;
+	int rc;
+
+	while (state->nprinted < upto) {
+		slot = &state->slots[state->nprinted % state->nslot];
+
+		pthread_mutex_lock(&state->lock);
+		while (slot->busy) {
+			pthread_cond_wait(&state->block_done, &state->lock);
+		}
+		rc = slot->rc;
+		pthread_mutex_unlock(&state->lock);
+
+		if (rc != RDD_OK) return rc;
+
+		rc = rdd_buf2hex(slot->digest, state->mdlen,
+				digest, sizeof digest);
+		if (rc != RDD_OK) return rc;
+		rdd_mp_message(state->printer, RDD_MSG_INFO, "%llu\t%s",
+				state->nprinted, digest);
+
+		slot->len = 0;
+		state->nprinted++;
+	}
+	return RDD_OK;
+}
+
+/** Appends data to the current block.
+ */
+static int
+hashblock_input(RDD_FILTER *self, const unsigned char *buf, unsigned nbyte)
+{
+	RDD_HASH_BLOCK_FILTER *state = (RDD_HASH_BLOCK_FILTER *) self->state;
+	HASHBLOCK_SLOT *slot = &state->slots[state->nblock % state->nslot];
+
+	memcpy(slot->buf + slot->len, buf, nbyte);
+	slot->len += nbyte;
+
+	return RDD_OK;
+}
+
+/** Hands the block that has just been completed to the thread pool.
+ */
+static int
+hashblock_block(RDD_FILTER *self, unsigned block_size)
+{
+	RDD_HASH_BLOCK_FILTER *state = (RDD_HASH_BLOCK_FILTER *) self->state;
+	HASHBLOCK_SLOT *slot = &state->slots[state->nblock % state->nslot];
+	int rc;
+
+	slot->busy = 1;
+	rc = rdd_threadpool_submit(state->pool, hash_block, slot);
+	if (rc != RDD_OK) {
+		slot->busy = 0;
+		return rc;
+	}
+	state->nblock++;
+
+	/* Make sure that the slot of the next block is free. */
+	if (state->nblock - state->nprinted >= state->nslot) {
+		return print_blocks(state, state->nblock - state->nslot + 1);
+	}
+	return RDD_OK;
+}
+
+static int
+hashblock_close(RDD_FILTER *self)
+{
+	RDD_HASH_BLOCK_FILTER *state = (RDD_HASH_BLOCK_FILTER *) self->state;
+	int rc;
+
+	if ((rc = print_blocks(state, state->nblock)) != RDD_OK) {
+		return rc;
+	}
+
+	return rdd_mp_close(state->printer, RDD_MP_RECURSE|RDD_MP_READONLY);
+}
+
+static int
+hashblock_free(RDD_FILTER *self)
+{
+	RDD_HASH_BLOCK_FILTER *state = (RDD_HASH_BLOCK_FILTER *) self->state;
+	unsigned i;
+
+	if (state->pool != 0) {
+		rdd_threadpool_wait(state->pool);
+		rdd_free_threadpool(state->pool);
+	}
+	if (state->slots != 0) {
+		for (i = 0; i < state->nslot; i++) {
+			if (state->slots[i].buf != 0) {
+				rdd_hash_free(&state->slots[i].hash);
+				free(state->slots[i].buf);
+			}
+		}
+		free(state->slots);
+	}
+	pthread_cond_destroy(&state->block_done);
+	pthread_mutex_destroy(&state->lock);
+
+	return RDD_OK;
+}
+
+/** Saves the algorithm, the block number, the bytes of the current
+ *  block, and the size of the output file.  Outstanding digests are
+ *  written first.
+ */
+static int
+hashblock_save(RDD_FILTER *self, FILE *fp)
+{
+	RDD_HASH_BLOCK_FILTER *state = (RDD_HASH_BLOCK_FILTER *) self->state;
+	HASHBLOCK_SLOT *slot;
+	uint32_t alg = state->alg;
+	uint32_t len;
+	rdd_count_t size;
+	int rc;
+
+	if ((rc = print_blocks(state, state->nblock)) != RDD_OK) {
+		return rc;
+	}
+	if ((rc = rdd_mp_sync(state->printer, &size)) != RDD_OK) {
+		return rc;
+	}
+	slot = &state->slots[state->nblock % state->nslot];
+	len = slot->len;
+
+	if (fwrite(&alg, sizeof alg, 1, fp) < 1
+	||  fwrite(&state->nblock, sizeof state->nblock, 1, fp) < 1
+	||  fwrite(&len, sizeof len, 1, fp) < 1
+	||  fwrite(slot->buf, 1, len, fp) < len
+	||  fwrite(&size, sizeof size, 1, fp) < 1) {
+		return RDD_EWRITE;
+	}
+	return RDD_OK;
+}
+
+static int
+hashblock_restore(RDD_FILTER *self, FILE *fp)
+{
+	RDD_HASH_BLOCK_FILTER *state = (RDD_HASH_BLOCK_FILTER *) self->state;
+	HASHBLOCK_SLOT *slot;
+	uint32_t alg, len;
+	rdd_count_t nblock, size;
+	unsigned i;
+	int rc;
+
+	/* Discard whatever the filter has seen so far. */
+	if ((rc = rdd_threadpool_wait(state->pool)) != RDD_OK) {
+		return rc;
+	}
+	for (i = 0; i < state->nslot; i++) {
+		state->slots[i].len = 0;
+	}
+
+	if (fread(&alg, sizeof alg, 1, fp) < 1
+	||  alg != (uint32_t) state->alg
+	||  fread(&nblock, sizeof nblock, 1, fp) < 1
+	||  fread(&len, sizeof len, 1, fp) < 1
+	||  len >= self->blocksize) {
+		return RDD_ESYNTAX;
+	}
+	state->nblock = state->nprinted = nblock;
+
+	slot = &state->slots[state->nblock % state->nslot];
+	if (fread(slot->buf, 1, len, fp) < len
+	||  fread(&size, sizeof size, 1, fp) < 1) {
+		return RDD_ESYNTAX;
+	}
+	slot->len = len;
+
+	return rdd_mp_truncate(state->printer, size);
+}
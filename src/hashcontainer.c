@@ -97,6 +97,9 @@ int rdd_set_hash(RDD_HASH_CONTAINER * self, const char * hash_type, const uint8_
 	} else if (!strcmp(hash_type, RDD_SHA512)) {
 		self->sha512present = 1;
 		memcpy(self->sha512hash, hash, SHA512_DIGEST_LENGTH);
+	} else if (!strcmp(hash_type, RDD_TREEHASH)) {
+		self->treehashpresent = 1;
+		memcpy(self->treehash, hash, SHA256_DIGEST_LENGTH);
 	} else {
 		return RDD_BADARG;
 	}
@@ -141,6 +144,11 @@ int rdd_get_hash(RDD_HASH_CONTAINER * self, const char * hash_type, uint8_t * ha
 			return RDD_NOTFOUND;
 		}
 		memcpy(hash, self->sha512hash, SHA512_DIGEST_LENGTH);
+	} else if (!strcmp(hash_type, RDD_TREEHASH)) {
+		if (!self->treehashpresent) {
+			return RDD_NOTFOUND;
+		}
+		memcpy(hash, self->treehash, SHA256_DIGEST_LENGTH);
 	} else {
 		return RDD_BADARG;
 	}
@@ -171,6 +179,8 @@ int rdd_hash_present(RDD_HASH_CONTAINER * self, const char * hash_type, int * pr
 		*present = self->sha384present;
 	} else if (!strcmp(hash_type, RDD_SHA512)) {
 		*present = self->sha512present;
+	} else if (!strcmp(hash_type, RDD_TREEHASH)) {
+		*present = self->treehashpresent;
 	} else {
 		return RDD_BADARG;
 	}	
@@ -50,6 +50,7 @@ static const char RDD_SHA1[] = "SHA1";
 static const char RDD_SHA256[] = "SHA256";
 static const char RDD_SHA384[] = "SHA384";
 static const char RDD_SHA512[] = "SHA512";
+static const char RDD_TREEHASH[] = "TREEHASH";	/* SHA-256 Merkle tree */
 
 typedef struct _RDD_HASH_CONTAINER
 {
@@ -63,6 +64,8 @@ typedef struct _RDD_HASH_CONTAINER
 	uint8_t sha384hash[SHA384_DIGEST_LENGTH];
 	int sha512present;
 	uint8_t sha512hash[SHA512_DIGEST_LENGTH];
+	int treehashpresent;
+	uint8_t treehash[SHA256_DIGEST_LENGTH];
 } RDD_HASH_CONTAINER;
 
 
@@ -76,7 +79,7 @@ int rdd_new_hashcontainer(RDD_HASH_CONTAINER ** self);
 
 /** \brief Stores a specific hash in the hashcontainer.
  *  \param self a pointer to the hashcontainer.
- *  \param hash_type a null-terminated string containing the hash name (md5 or sha-1, 256, 384, or 512).
+ *  \param hash_type a null-terminated string containing the hash name (md5, sha-1, 256, 384, 512, or treehash).
  *  \param hash the hash itself. It is assumed that sufficient space is available in hash (..._DIGEST_LENGTH).
  *  \return Returns \c RDD_OK on success.
  *
@@ -86,7 +89,7 @@ int rdd_set_hash(RDD_HASH_CONTAINER * self, const char * hash_type, const uint8_
 
 /** \brief Retrieves a specific hash from the hashcontainer.
  *  \param self a pointer to the hashcontainer.
- *  \param hash_type a null-terminated string containing the hash name (md5 or sha-1, 256, 384, or 512).
+ *  \param hash_type a null-terminated string containing the hash name (md5, sha-1, 256, 384, 512, or treehash).
  *  \param hash output value: space for storing the hash. It is assumed that sufficient space is available in hash (..._DIGEST_LENGTH).
  *  \return Returns \c RDD_OK on success; returns \c RDD_NOTFOUND if the hash has not been storedin the hashcontainer.
  *  \note .
@@ -97,7 +100,7 @@ int rdd_get_hash(RDD_HASH_CONTAINER * self, const char * hash_type, uint8_t * ha
 
 /** \brief Checks if a specific hash is present in the hashcontainer.
  *  \param self a pointer to the hashcontainer.
- *  \param hash_type a null-terminated string containing the hash name (md5 or sha-1, 256, 384, or 512). 
+ *  \param hash_type a null-terminated string containing the hash name (md5, sha-1, 256, 384, 512, or treehash). 
  *  \param hash output value: will be 1 if the hash is present, 0 if it's not.
  *  \return Returns \c RDD_OK on success.
  *  \note .
@@ -0,0 +1,459 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rdd.h"
+#include "rdd_internals.h"
+
+#ifdef HAVE_OPENSSL
+/* OpenSSL 3 deprecates the low-level MD5_ and SHA*_ routines.  They
+ * are still the only digests whose state can be saved for a
+ * checkpoint (an EVP context cannot be exported), so the LEGACY
+ * engine keeps them.  This file is the only one that calls them.
+ */
+#define OPENSSL_SUPPRESS_DEPRECATED
+
+#include <openssl/evp.h>
+#include <openssl/md5.h>
+#include <openssl/sha.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/provider.h>
+#endif
+#endif /* HAVE_OPENSSL */
+
+#include "hashengine.h"
+
+/* The engine comparison hashes CALIBRATE_NBUF buffers of
+ * CALIBRATE_BUFSIZE bytes with each engine.  EVP is kept unless the
+ * low-level routines are more than CALIBRATE_MARGIN faster, since EVP
+ * is the interface that receives new hardware support.
+ */
+#define CALIBRATE_BUFSIZE	65536
+#define CALIBRATE_NBUF		16
+#define CALIBRATE_MARGIN	1.10
+
+typedef struct _HASH_ALG_INFO {
+	const char *name;	/* EVP name */
+	unsigned    size;	/* digest size */
+	int         legacy;	/* has low-level routines? */
+} HASH_ALG_INFO;
+
+static HASH_ALG_INFO alg_info[RDD_HASH_NALG] = {
+	{"MD5",         MD5_DIGEST_LENGTH,    1},
+	{"SHA1",        SHA_DIGEST_LENGTH,    1},
+	{"SHA256",      SHA256_DIGEST_LENGTH, 1},
+	{"SHA384",      SHA384_DIGEST_LENGTH, 1},
+	{"SHA512",      SHA512_DIGEST_LENGTH, 1},
+	{"BLAKE2B-512", 64,                   0},
+	{"BLAKE2S-256", 32,                   0}
+};
+
+static pthread_mutex_t engine_lock = PTHREAD_MUTEX_INITIALIZER;
+static rdd_hash_engine_t engine_pref = RDD_HASH_ENGINE_AUTO;
+static rdd_hash_engine_t engine_auto[RDD_HASH_NALG];	/* AUTO = not yet measured */
+static const EVP_MD *evp_md[RDD_HASH_NALG];		/* 0 = not fetched */
+static int evp_fetched[RDD_HASH_NALG];
+static char engine_desc[RDD_HASH_NALG][64];
+
+/* Looks up the EVP implementation of an algorithm once.  Returns 0
+ * if EVP does not offer the algorithm.  Call with engine_lock held.
+ */
+static const EVP_MD *
+fetch_md(rdd_hash_alg_t alg)
+{
+	if (!evp_fetched[alg]) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+		evp_md[alg] = EVP_MD_fetch(NULL, alg_info[alg].name, NULL);
+#else
+		switch (alg) {
+		case RDD_HASH_BLAKE2B512: evp_md[alg] = EVP_blake2b512(); break;
+		case RDD_HASH_BLAKE2S256: evp_md[alg] = EVP_blake2s256(); break;
+		default:
+			evp_md[alg] = EVP_get_digestbyname(alg_info[alg].name);
+			break;
+		}
+#endif
+		evp_fetched[alg] = 1;
+	}
+	return evp_md[alg];
+}
+
+static void
+legacy_init(RDD_HASH *h)
+{
+	switch (h->alg) {
+	case RDD_HASH_MD5:    MD5_Init(&h->legacy.md5); break;
+	case RDD_HASH_SHA1:   SHA1_Init(&h->legacy.sha1); break;
+	case RDD_HASH_SHA256: SHA256_Init(&h->legacy.sha256); break;
+	case RDD_HASH_SHA384: SHA384_Init(&h->legacy.sha512); break;
+	case RDD_HASH_SHA512: SHA512_Init(&h->legacy.sha512); break;
+	default: break;
+	}
+}
+
+static void
+legacy_update(RDD_HASH *h, const unsigned char *buf, unsigned nbyte)
+{
+	switch (h->alg) {
+	case RDD_HASH_MD5:    MD5_Update(&h->legacy.md5, buf, nbyte); break;
+	case RDD_HASH_SHA1:   SHA1_Update(&h->legacy.sha1, buf, nbyte); break;
+	case RDD_HASH_SHA256: SHA256_Update(&h->legacy.sha256, buf, nbyte); break;
+	case RDD_HASH_SHA384: SHA384_Update(&h->legacy.sha512, buf, nbyte); break;
+	case RDD_HASH_SHA512: SHA512_Update(&h->legacy.sha512, buf, nbyte); break;
+	default: break;
+	}
+}
+
+static void
+legacy_final(RDD_HASH *h, unsigned char *md)
+{
+	switch (h->alg) {
+	case RDD_HASH_MD5:    MD5_Final(md, &h->legacy.md5); break;
+	case RDD_HASH_SHA1:   SHA1_Final(md, &h->legacy.sha1); break;
+	case RDD_HASH_SHA256: SHA256_Final(md, &h->legacy.sha256); break;
+	case RDD_HASH_SHA384: SHA384_Final(md, &h->legacy.sha512); break;
+	case RDD_HASH_SHA512: SHA512_Final(md, &h->legacy.sha512); break;
+	default: break;
+	}
+}
+
+/* Returns the time in seconds that an engine needs to hash the
+ * calibration data.
+ */
+static double
+time_engine(rdd_hash_alg_t alg, rdd_hash_engine_t engine,
+		const unsigned char *buf)
+{
+	unsigned char md[EVP_MAX_MD_SIZE];
+	RDD_HASH h;
+	double start;
+	unsigned i;
+
+	memset(&h, 0, sizeof h);
+	h.alg = alg;
+	h.engine = engine;
+	if (engine == RDD_HASH_ENGINE_EVP) {
+		if ((h.evp = EVP_MD_CTX_new()) == 0
+		||  EVP_DigestInit_ex(h.evp, evp_md[alg], NULL) != 1) {
+			EVP_MD_CTX_free(h.evp);
+			return -1.0;
+		}
+	} else {
+		legacy_init(&h);
+	}
+
+	start = rdd_gettime();
+	for (i = 0; i < CALIBRATE_NBUF; i++) {
+		rdd_hash_update(&h, buf, CALIBRATE_BUFSIZE);
+	}
+	rdd_hash_final(&h, md);
+	start = rdd_gettime() - start;
+
+	rdd_hash_free(&h);
+	return start;
+}
+
+/* Picks an engine for an algorithm.  Call with engine_lock held.
+ */
+static rdd_hash_engine_t
+calibrate(rdd_hash_alg_t alg)
+{
+	unsigned char *buf;
+	double tevp, tlegacy;
+
+	if (fetch_md(alg) == 0) {
+		return RDD_HASH_ENGINE_LEGACY;
+	}
+	if ((buf = malloc(CALIBRATE_BUFSIZE)) == 0) {
+		return RDD_HASH_ENGINE_EVP;
+	}
+	memset(buf, 0x5a, CALIBRATE_BUFSIZE);
+
+	/* Warm up both code paths before timing them. */
+	time_engine(alg, RDD_HASH_ENGINE_EVP, buf);
+	time_engine(alg, RDD_HASH_ENGINE_LEGACY, buf);
+
+	tevp = time_engine(alg, RDD_HASH_ENGINE_EVP, buf);
+	tlegacy = time_engine(alg, RDD_HASH_ENGINE_LEGACY, buf);
+	free(buf);
+
+	if (tevp < 0.0 || tlegacy * CALIBRATE_MARGIN < tevp) {
+		return RDD_HASH_ENGINE_LEGACY;
+	}
+	return RDD_HASH_ENGINE_EVP;
+}
+
+int
+rdd_hash_set_engine(rdd_hash_engine_t engine)
+{
+	if (engine != RDD_HASH_ENGINE_AUTO
+	&&  engine != RDD_HASH_ENGINE_EVP
+	&&  engine != RDD_HASH_ENGINE_LEGACY) {
+		return RDD_BADARG;
+	}
+
+	pthread_mutex_lock(&engine_lock);
+	engine_pref = engine;
+	pthread_mutex_unlock(&engine_lock);
+	return RDD_OK;
+}
+
+rdd_hash_engine_t
+rdd_hash_get_engine(rdd_hash_alg_t alg)
+{
+	rdd_hash_engine_t engine;
+
+	if (alg >= RDD_HASH_NALG) {
+		return RDD_HASH_ENGINE_LEGACY;
+	}
+
+	pthread_mutex_lock(&engine_lock);
+	engine = engine_pref;
+	if (!alg_info[alg].legacy) {
+		engine = RDD_HASH_ENGINE_EVP;
+		fetch_md(alg);
+	} else if (engine == RDD_HASH_ENGINE_EVP && fetch_md(alg) == 0) {
+		engine = RDD_HASH_ENGINE_LEGACY;
+	} else if (engine == RDD_HASH_ENGINE_AUTO) {
+		if (engine_auto[alg] == RDD_HASH_ENGINE_AUTO) {
+			engine_auto[alg] = calibrate(alg);
+		}
+		engine = engine_auto[alg];
+	}
+	pthread_mutex_unlock(&engine_lock);
+
+	return engine;
+}
+
+const char *
+rdd_hash_engine_name(rdd_hash_alg_t alg)
+{
+	const char *provider = "builtin";
+
+	if (alg >= RDD_HASH_NALG) {
+		return "unknown";
+	}
+	if (rdd_hash_get_engine(alg) == RDD_HASH_ENGINE_LEGACY) {
+		return "low-level";
+	}
+
+	pthread_mutex_lock(&engine_lock);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	if (EVP_MD_get0_provider(evp_md[alg]) != 0) {
+		provider = OSSL_PROVIDER_get0_name(
+				EVP_MD_get0_provider(evp_md[alg]));
+	}
+#endif
+	snprintf(engine_desc[alg], sizeof engine_desc[alg],
+			"EVP (%s provider)", provider);
+	pthread_mutex_unlock(&engine_lock);
+
+	return engine_desc[alg];
+}
+
+unsigned
+rdd_hash_size(rdd_hash_alg_t alg)
+{
+	return alg < RDD_HASH_NALG ? alg_info[alg].size : 0;
+}
+
+const char *
+rdd_hash_name(rdd_hash_alg_t alg)
+{
+	return alg < RDD_HASH_NALG ? alg_info[alg].name : "unknown";
+}
+
+/* Compares two algorithm names, ignoring case and dashes.
+ */
+static int
+same_name(const char *s, const char *t)
+{
+	while (1) {
+		while (*s == '-') s++;
+		while (*t == '-') t++;
+		if (tolower((unsigned char) *s) != tolower((unsigned char) *t)) {
+			return 0;
+		}
+		if (*s == '\0') {
+			return 1;
+		}
+		s++;
+		t++;
+	}
+}
+
+int
+rdd_hash_lookup(const char *name, rdd_hash_alg_t *alg)
+{
+	rdd_hash_alg_t a;
+
+	if (name == 0 || alg == 0) {
+		return RDD_BADARG;
+	}
+	for (a = 0; a < RDD_HASH_NALG; a++) {
+		if (same_name(name, alg_info[a].name)) {
+			*alg = a;
+			return RDD_OK;
+		}
+	}
+	return RDD_NOTFOUND;
+}
+
+int
+rdd_hash_has_legacy(rdd_hash_alg_t alg)
+{
+	return alg < RDD_HASH_NALG && alg_info[alg].legacy;
+}
+
+int
+rdd_hash_init(RDD_HASH *h, rdd_hash_alg_t alg)
+{
+	int rc;
+
+	if (h == 0 || alg >= RDD_HASH_NALG) {
+		return RDD_BADARG;
+	}
+
+	memset(h, 0, sizeof *h);
+	h->alg = alg;
+	h->engine = rdd_hash_get_engine(alg);
+
+	if (h->engine == RDD_HASH_ENGINE_EVP) {
+		if (evp_md[alg] == 0) {
+			return RDD_NOTFOUND;	/* EVP-only and not available */
+		}
+		if ((h->evp = EVP_MD_CTX_new()) == 0) {
+			return RDD_NOMEM;
+		}
+	}
+	if ((rc = rdd_hash_reset(h)) != RDD_OK) {
+		rdd_hash_free(h);
+	}
+	return rc;
+}
+
+int
+rdd_hash_reset(RDD_HASH *h)
+{
+	if (h->engine == RDD_HASH_ENGINE_EVP) {
+		if (EVP_DigestInit_ex(h->evp, evp_md[h->alg], NULL) != 1) {
+			return RDD_NOMEM;
+		}
+	} else {
+		legacy_init(h);
+	}
+	return RDD_OK;
+}
+
+int
+rdd_hash_update(RDD_HASH *h, const unsigned char *buf, unsigned nbyte)
+{
+	/* Don't do any sanity checks; this function is in the critical loop. */
+
+	if (h->engine == RDD_HASH_ENGINE_EVP) {
+		EVP_DigestUpdate(h->evp, buf, nbyte);
+	} else {
+		legacy_update(h, buf, nbyte);
+	}
+	return RDD_OK;
+}
+
+int
+rdd_hash_final(RDD_HASH *h, unsigned char *md)
+{
+	if (h->engine == RDD_HASH_ENGINE_EVP) {
+		if (EVP_DigestFinal_ex(h->evp, md, NULL) != 1) {
+			return RDD_BADARG;
+		}
+	} else {
+		legacy_final(h, md);
+	}
+	return RDD_OK;
+}
+
+int
+rdd_hash_free(RDD_HASH *h)
+{
+	if (h->evp != 0) {
+		EVP_MD_CTX_free(h->evp);
+		h->evp = 0;
+	}
+	return RDD_OK;
+}
+
+/* The saved state is the algorithm followed by the raw low-level
+ * context.
+ */
+int
+rdd_hash_save(RDD_HASH *h, FILE *fp)
+{
+	uint32_t alg = h->alg;
+
+	if (h->engine != RDD_HASH_ENGINE_LEGACY) {
+		return RDD_NOTFOUND;
+	}
+	if (fwrite(&alg, sizeof alg, 1, fp) < 1
+	||  fwrite(&h->legacy, sizeof h->legacy, 1, fp) < 1) {
+		return RDD_EWRITE;
+	}
+	return RDD_OK;
+}
+
+int
+rdd_hash_restore(RDD_HASH *h, FILE *fp)
+{
+	uint32_t alg;
+
+	if (h->engine != RDD_HASH_ENGINE_LEGACY) {
+		return RDD_ESYNTAX;
+	}
+	if (fread(&alg, sizeof alg, 1, fp) < 1 || alg != h->alg) {
+		return RDD_ESYNTAX;
+	}
+	if (fread(&h->legacy, sizeof h->legacy, 1, fp) < 1) {
+		return RDD_ESYNTAX;
+	}
+	return RDD_OK;
+}
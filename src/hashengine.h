@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+
+#ifndef __hashengine_h__
+#define __hashengine_h__
+
+/** @file
+ *  \brief Message digests with a run-time choice of implementation.
+ *
+ *  The hash filters compute their digests through an \c RDD_HASH
+ *  object.  An \c RDD_HASH uses one of two engines: OpenSSL's EVP
+ *  interface, which dispatches to the provider's fastest code for the
+ *  CPU (SHA-NI, AVX2, and so on), or OpenSSL's low-level MD5_ and SHA*_
+ *  routines.  Only the low-level engine can save and restore the state
+ *  of a digest (for checkpoints).  BLAKE2 has no low-level routines,
+ *  so BLAKE2 digests always use EVP.
+ *
+ *  By default the engine is chosen per algorithm the first time the
+ *  algorithm is used: both engines hash a test buffer and the faster
+ *  one wins.
+ */
+
+#ifdef HAVE_OPENSSL
+#include <openssl/evp.h>
+#include <openssl/md5.h>
+#include <openssl/sha.h>
+#endif /* HAVE_OPENSSL */
+
+typedef enum _rdd_hash_alg_t {
+	RDD_HASH_MD5 = 0,
+	RDD_HASH_SHA1,
+	RDD_HASH_SHA256,
+	RDD_HASH_SHA384,
+	RDD_HASH_SHA512,
+	RDD_HASH_BLAKE2B512,
+	RDD_HASH_BLAKE2S256,
+	RDD_HASH_NALG		/**< number of algorithms */
+} rdd_hash_alg_t;
+
+typedef enum _rdd_hash_engine_t {
+	RDD_HASH_ENGINE_AUTO = 0,	/**< pick the faster engine */
+	RDD_HASH_ENGINE_EVP,		/**< OpenSSL EVP interface */
+	RDD_HASH_ENGINE_LEGACY		/**< low-level MD5_/SHA*_ routines */
+} rdd_hash_engine_t;
+
+/** \brief A running message digest.
+ */
+typedef struct _RDD_HASH {
+	rdd_hash_alg_t    alg;		/**< digest algorithm */
+	rdd_hash_engine_t engine;	/**< EVP or LEGACY, never AUTO */
+	EVP_MD_CTX       *evp;		/**< EVP context (EVP engine only) */
+	union {
+		MD5_CTX    md5;
+		SHA_CTX    sha1;
+		SHA256_CTX sha256;
+		SHA512_CTX sha512;	/**< also used for SHA-384 */
+	} legacy;			/**< low-level context (LEGACY engine only) */
+} RDD_HASH;
+
+/** \brief Selects the engine for all digests created from now on.
+ *  \param engine the engine; \c RDD_HASH_ENGINE_AUTO restores the default
+ *  \return Returns \c RDD_OK on success.
+ */
+int rdd_hash_set_engine(rdd_hash_engine_t engine);
+
+/** \brief Returns the engine that new digests of an algorithm will use.
+ *  \param alg the digest algorithm
+ *  \return Returns \c RDD_HASH_ENGINE_EVP or \c RDD_HASH_ENGINE_LEGACY.
+ *
+ *  If the engine is \c RDD_HASH_ENGINE_AUTO and \c alg has not been
+ *  used yet, this function runs the engine comparison for \c alg.
+ */
+rdd_hash_engine_t rdd_hash_get_engine(rdd_hash_alg_t alg);
+
+/** \brief Describes the engine that new digests of an algorithm will use.
+ *  \param alg the digest algorithm
+ *  \return Returns a static string, for example "EVP (default provider)".
+ */
+const char *rdd_hash_engine_name(rdd_hash_alg_t alg);
+
+/** \brief Returns the digest size of an algorithm in bytes.
+ */
+unsigned rdd_hash_size(rdd_hash_alg_t alg);
+
+/** \brief Returns the name of an algorithm, for example "SHA256".
+ */
+const char *rdd_hash_name(rdd_hash_alg_t alg);
+
+/** \brief Looks up an algorithm by name.
+ *  \param name an algorithm name; the comparison ignores case and
+ *  dashes, so "sha-256" and "SHA256" are equivalent
+ *  \param alg output value: the algorithm
+ *  \return Returns \c RDD_OK on success and \c RDD_NOTFOUND if
+ *  \c name is not a known algorithm.
+ */
+int rdd_hash_lookup(const char *name, rdd_hash_alg_t *alg);
+
+/** \brief Returns 1 if an algorithm has a low-level implementation
+ *  (and can therefore be saved and restored), 0 otherwise.
+ */
+int rdd_hash_has_legacy(rdd_hash_alg_t alg);
+
+/** \brief Starts a new digest.
+ *  \param h the digest object
+ *  \param alg the digest algorithm
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOMEM if
+ *  an EVP context cannot be allocated and \c RDD_NOTFOUND if the
+ *  algorithm is EVP-only and OpenSSL does not provide it.
+ *
+ *  Call \c rdd_hash_free() to release the digest's resources.
+ */
+int rdd_hash_init(RDD_HASH *h, rdd_hash_alg_t alg);
+
+/** \brief Restarts a digest with the same algorithm and engine.
+ */
+int rdd_hash_reset(RDD_HASH *h);
+
+/** \brief Adds data to a digest.
+ */
+int rdd_hash_update(RDD_HASH *h, const unsigned char *buf, unsigned nbyte);
+
+/** \brief Finishes a digest.
+ *  \param h the digest object
+ *  \param md output value: the digest; must hold
+ *  \c rdd_hash_size(h->alg) bytes
+ *  \return Returns \c RDD_OK on success.
+ *
+ *  After this call, only \c rdd_hash_reset() and \c rdd_hash_free()
+ *  may be applied to \c h.
+ */
+int rdd_hash_final(RDD_HASH *h, unsigned char *md);
+
+/** \brief Releases the resources of a digest.
+ */
+int rdd_hash_free(RDD_HASH *h);
+
+/** \brief Writes the state of a running digest to a stream.
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOTFOUND if
+ *  the digest uses the EVP engine, whose state cannot be exported.
+ */
+int rdd_hash_save(RDD_HASH *h, FILE *fp);
+
+/** \brief Reads the state of a running digest from a stream.
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_ESYNTAX if
+ *  the saved state does not belong to the same algorithm and engine.
+ */
+int rdd_hash_restore(RDD_HASH *h, FILE *fp);
+
+#endif /* __hashengine_h__ */
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LIBLZ4
+#include <lz4frame.h>
+#endif
+
+#include "rdd.h"
+#include "reader.h"
+
+#ifdef HAVE_LIBLZ4
+
+#define ZBUF_SIZE 65536
+
+typedef struct _RDD_LZ4_READER {
+	RDD_READER     *parent;
+	LZ4F_dctx      *dctx;
+	unsigned char  *zbuf;
+	unsigned        zlen;		/* # bytes in zbuf */
+	unsigned        zpos;		/* # bytes of zbuf consumed */
+	size_t          hint;		/* 0 if the last frame is complete */
+	int             eof;		/* parent is exhausted */
+	rdd_count_t     pos;
+} RDD_LZ4_READER;
+
+/* Forward declarations
+ */
+static int rdd_lz4_read(RDD_READER *r, unsigned char *buf, unsigned nbyte,
+			unsigned *nread);
+static int rdd_lz4_tell(RDD_READER *r, rdd_count_t *pos);
+static int rdd_lz4_seek(RDD_READER *r, rdd_count_t pos);
+static int rdd_lz4_close(RDD_READER *r, int recurse);
+
+static RDD_READ_OPS lz4_read_ops = {
+	rdd_lz4_read,
+	rdd_lz4_tell,
+	rdd_lz4_seek,
+	rdd_lz4_close
+};
+
+int
+rdd_open_lz4_reader(RDD_READER **self, RDD_READER *parent)
+{
+	RDD_READER *r = 0;
+	RDD_LZ4_READER *state = 0;
+	int rc = RDD_OK;
+
+	if (self == 0 || parent == 0) {
+		return RDD_BADARG;
+	}
+
+	rc = rdd_new_reader(&r, &lz4_read_ops, sizeof(RDD_LZ4_READER));
+	if (rc != RDD_OK) {
+		goto error;
+	}
+	state = (RDD_LZ4_READER *) r->state;
+	state->parent = parent;
+
+	if ((state->zbuf = malloc(ZBUF_SIZE)) == 0) {
+		rc = RDD_NOMEM;
+		goto error;
+	}
+	if (LZ4F_isError(LZ4F_createDecompressionContext(&state->dctx,
+						LZ4F_VERSION))) {
+		state->dctx = 0;
+		rc = RDD_NOMEM;
+		goto error;
+	}
+
+	*self = r;
+	return RDD_OK;
+
+error:
+	*self = 0;
+	if (state != 0 && state->dctx != 0) LZ4F_freeDecompressionContext(state->dctx);
+	if (state != 0 && state->zbuf != 0) free(state->zbuf);
+	if (state != 0) free(state);
+	if (r != 0) free(r);
+	return rc;
+}
+
+static int
+rdd_lz4_read(RDD_READER *self, unsigned char *buf, unsigned nbyte,
+			unsigned *nread)
+{
+	RDD_LZ4_READER *state = self->state;
+	size_t srclen, dstlen, hint;
+	unsigned got = 0;
+	unsigned n;
+	int rc;
+
+	*nread = 0;
+
+	while (got < nbyte) {
+		/* Let the decoder flush any buffered output before it
+		 * asks for more input.
+		 */
+		srclen = state->zlen - state->zpos;
+		dstlen = nbyte - got;
+		hint = LZ4F_decompress(state->dctx, buf + got, &dstlen,
+				state->zbuf + state->zpos, &srclen, 0);
+		if (LZ4F_isError(hint)) {
+			return RDD_ECOMPRESS;
+		}
+		got += (unsigned) dstlen;
+		state->zpos += (unsigned) srclen;
+		if (srclen > 0 || dstlen > 0) {
+			state->hint = hint;
+		}
+		if (got == nbyte || state->zpos < state->zlen) {
+			continue;
+		}
+
+		/* Input buffer (zbuf) is empty: refill it with compressed
+		 * data that is obtained from the parent reader.
+		 */
+		if (state->eof) {
+			break;
+		}
+		rc = rdd_reader_read(state->parent, state->zbuf, ZBUF_SIZE, &n);
+		if (rc != RDD_OK) {
+			return rc;
+		}
+		if (n == 0) {
+			state->eof = 1;
+			if (state->hint != 0) {
+				return RDD_ECOMPRESS;	/* truncated frame */
+			}
+			break;
+		}
+		state->zlen = n;
+		state->zpos = 0;
+	}
+
+	*nread = got;
+	state->pos += got;
+	return RDD_OK;
+}
+
+static int
+rdd_lz4_tell(RDD_READER *self, rdd_count_t *pos)
+{
+	RDD_LZ4_READER *state = self->state;
+
+	*pos = state->pos;
+	return RDD_OK;
+}
+
+static int
+rdd_lz4_seek(RDD_READER *self, rdd_count_t pos)
+{
+	return RDD_ESEEK;	/* not implemented */
+}
+
+static int
+rdd_lz4_close(RDD_READER *self, int recurse)
+{
+	RDD_LZ4_READER *state = self->state;
+	int rc;
+
+	LZ4F_freeDecompressionContext(state->dctx);
+	free(state->zbuf);
+
+	if (recurse) {
+		if ((rc = rdd_reader_close(state->parent, 1)) != RDD_OK) {
+			return rc;
+		}
+	}
+
+	return RDD_OK;
+}
+
+#else /* no LZ4 */
+
+int
+rdd_open_lz4_reader(RDD_READER **self, RDD_READER *parent)
+{
+	if (self != 0) *self = 0;
+	return RDD_ECOMPRESS;
+}
+
+#endif
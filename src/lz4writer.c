@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_LIBLZ4
+#include <lz4frame.h>
+#endif
+
+#include "rdd.h"
+#include "writer.h"
+
+#ifdef HAVE_LIBLZ4
+
+/* The writer passes at most LZ4_CHUNK_SIZE bytes to the compressor
+ * at a time, so a single output buffer of LZ4F_compressBound() bytes
+ * is always large enough.
+ */
+#define LZ4_CHUNK_SIZE	(256 * 1024)
+
+/* Forward declarations
+ */
+static int lz4_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte);
+static int lz4_close(RDD_WRITER *w);
+static int lz4_compare_address(RDD_WRITER *w, struct addrinfo *address, int *result);
+
+static RDD_WRITE_OPS lz4_write_ops = {
+	lz4_write,
+	lz4_close,
+	lz4_compare_address
+};
+
+typedef struct _RDD_LZ4_WRITER {
+	RDD_WRITER         *parent;
+	LZ4F_cctx          *cctx;
+	LZ4F_preferences_t  prefs;
+	unsigned char      *zbuf;
+	size_t              zbufsize;
+	int                 started;	/* frame header written? */
+} RDD_LZ4_WRITER;
+
+int
+rdd_open_lz4_writer(RDD_WRITER **self, RDD_WRITER *parent)
+{
+	RDD_WRITER *w = 0;
+	RDD_LZ4_WRITER *state = 0;
+	int rc = RDD_OK;
+
+	if (self == 0 || parent == 0) {
+		return RDD_BADARG;
+	}
+
+	rc = rdd_new_writer(&w, &lz4_write_ops, sizeof(RDD_LZ4_WRITER));
+	if (rc != RDD_OK) {
+		goto error;
+	}
+	state = (RDD_LZ4_WRITER *) w->state;
+	state->parent = parent;
+
+	memset(&state->prefs, 0, sizeof state->prefs);
+	state->prefs.frameInfo.blockSizeID = LZ4F_max256KB;
+	state->prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+
+	state->zbufsize = LZ4F_compressBound(LZ4_CHUNK_SIZE, &state->prefs);
+	if (state->zbufsize < LZ4F_HEADER_SIZE_MAX) {
+		state->zbufsize = LZ4F_HEADER_SIZE_MAX;
+	}
+	if ((state->zbuf = malloc(state->zbufsize)) == 0) {
+		rc = RDD_NOMEM;
+		goto error;
+	}
+	if (LZ4F_isError(LZ4F_createCompressionContext(&state->cctx,
+						LZ4F_VERSION))) {
+		state->cctx = 0;
+		rc = RDD_NOMEM;
+		goto error;
+	}
+
+	*self = w;
+	return RDD_OK;
+
+error:
+	*self = 0;
+	if (state != 0 && state->cctx != 0) LZ4F_freeCompressionContext(state->cctx);
+	if (state != 0 && state->zbuf != 0) free(state->zbuf);
+	if (state != 0) free(state);
+	if (w != 0) free(w);
+	return rc;
+}
+
+/* Writes the first n bytes of zbuf (the result of an LZ4F call)
+ * to the parent writer.
+ */
+static int
+flush(RDD_LZ4_WRITER *state, size_t n)
+{
+	if (LZ4F_isError(n)) {
+		return RDD_ECOMPRESS;
+	}
+	if (n == 0) {
+		return RDD_OK;
+	}
+	return rdd_writer_write(state->parent, state->zbuf, (unsigned) n);
+}
+
+/* Writes the frame header before the first compressed data.
+ */
+static int
+start_frame(RDD_LZ4_WRITER *state)
+{
+	int rc;
+
+	if (state->started) {
+		return RDD_OK;
+	}
+	rc = flush(state, LZ4F_compressBegin(state->cctx, state->zbuf,
+					state->zbufsize, &state->prefs));
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state->started = 1;
+	return RDD_OK;
+}
+
+static int
+lz4_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte)
+{
+	RDD_LZ4_WRITER *state = w->state;
+	unsigned n;
+	int rc;
+
+	if ((rc = start_frame(state)) != RDD_OK) {
+		return rc;
+	}
+
+	while (nbyte > 0) {
+		n = nbyte < LZ4_CHUNK_SIZE ? nbyte : LZ4_CHUNK_SIZE;
+		rc = flush(state, LZ4F_compressUpdate(state->cctx, state->zbuf,
+					state->zbufsize, buf, n, 0));
+		if (rc != RDD_OK) {
+			return rc;
+		}
+		buf += n;
+		nbyte -= n;
+	}
+
+	return RDD_OK;
+}
+
+static int
+lz4_close(RDD_WRITER *w)
+{
+	RDD_LZ4_WRITER *state = w->state;
+	int rc;
+
+	if ((rc = start_frame(state)) == RDD_OK) {
+		rc = flush(state, LZ4F_compressEnd(state->cctx, state->zbuf,
+					state->zbufsize, 0));
+	}
+
+	LZ4F_freeCompressionContext(state->cctx);
+	state->cctx = 0;
+	free(state->zbuf);
+	state->zbuf = 0;
+	if (rc != RDD_OK) {
+		return rc;
+	}
+
+	return rdd_writer_close(state->parent);
+}
+
+static int
+lz4_compare_address(RDD_WRITER *w, struct addrinfo *address, int *result)
+{
+	RDD_LZ4_WRITER *state = w->state;
+	return rdd_compare_address(state->parent, address, result);
+}
+
+#else /* no LZ4 */
+
+int
+rdd_open_lz4_writer(RDD_WRITER **self, RDD_WRITER *parent)
+{
+	if (self != 0) *self = 0;
+	return RDD_ECOMPRESS;
+}
+
+#endif
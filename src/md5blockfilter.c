@@ -61,10 +61,11 @@ static char copyright[] =
 #include "writer.h"
 #include "filter.h"
 #include "msgprinter.h"
+#include "hashengine.h"
 
 typedef struct _RDD_BLOCKHASH_FILTER {
 	rdd_count_t     blocknum;
-	MD5_CTX         md5_state;
+	RDD_HASH        hash;
 	char           *path;
 	RDD_MSGPRINTER *printer;
 } RDD_BLOCKHASH_FILTER;
@@ -74,13 +75,20 @@ static int blockhash_input(RDD_FILTER *f,
 static int blockhash_block(RDD_FILTER *f, unsigned nbyte);
 static int blockhash_close(RDD_FILTER *f);
 static int blockhash_free(RDD_FILTER *f);
+static int blockhash_save(RDD_FILTER *f, FILE *fp);
+static int blockhash_restore(RDD_FILTER *f, FILE *fp);
+static int blockhash_blocks(RDD_FILTER *f,
+			const unsigned char *buf, unsigned nblock);
 
 static RDD_FILTER_OPS blockhash_ops = {
 	blockhash_input,
 	blockhash_block,
 	blockhash_close,
 	0,
-	blockhash_free
+	blockhash_free,
+	blockhash_save,
+	blockhash_restore,
+	blockhash_blocks
 };
 
 int
@@ -106,13 +114,16 @@ rdd_new_md5_blockfilter(RDD_FILTER **self, unsigned blocksize,
 	}
 	strcpy(path, outpath);
 
+	if ((rc = rdd_hash_init(&state->hash, RDD_HASH_MD5)) != RDD_OK) {
+		goto error;
+	}
+
 	if ((rc = rdd_mp_open_file_printer(&prn, outpath, force_overwrite)) != RDD_OK) {
 		goto error;
 	}
 
 	state->path = path;
 	state->printer = prn;
-	MD5_Init(&state->md5_state);
 
 	*self = f;
 	return RDD_OK;
@@ -120,6 +131,7 @@ rdd_new_md5_blockfilter(RDD_FILTER **self, unsigned blocksize,
 error:
 	*self = 0;
 	if (path != 0) free(path);
+	if (state != 0) rdd_hash_free(&state->hash);
 	if (state != 0) free(state);
 	if (f != 0) free(f);
 	return rc;
@@ -132,7 +144,7 @@ blockhash_input(RDD_FILTER *self, const unsigned char *buf, unsigned nbyte)
 {
 	RDD_BLOCKHASH_FILTER *state = (RDD_BLOCKHASH_FILTER *) self->state;
 
-	MD5_Update(&state->md5_state, buf, nbyte);
+	rdd_hash_update(&state->hash, buf, nbyte);
 
 	return RDD_OK;
 }
@@ -148,7 +160,9 @@ blockhash_block(RDD_FILTER *self, unsigned block_size)
 	char digest[2*MD5_DIGEST_LENGTH + 1];
 	int rc;
 
-	MD5_Final(md5bytes, &state->md5_state);
+	if ((rc = rdd_hash_final(&state->hash, md5bytes)) != RDD_OK) {
+		return rc;
+	}
 
 	rc = rdd_buf2hex(md5bytes, sizeof md5bytes, digest, sizeof digest);
 	if (rc != RDD_OK) {
@@ -158,7 +172,29 @@ blockhash_block(RDD_FILTER *self, unsigned block_size)
 			state->blocknum, digest);
 
 	state->blocknum++;
-	MD5_Init(&state->md5_state);
+
+	return rdd_hash_reset(&state->hash);
+}
+
+/** Hashes a run of whole blocks without a round trip through
+ *  the generic filter code for each block.
+ */
+static int
+blockhash_blocks(RDD_FILTER *self, const unsigned char *buf, unsigned nblock)
+{
+	RDD_BLOCKHASH_FILTER *state = (RDD_BLOCKHASH_FILTER *) self->state;
+	int rc;
+
+	for (; nblock > 0; nblock--) {
+		rc = rdd_hash_update(&state->hash, buf, self->blocksize);
+		if (rc != RDD_OK) {
+			return rc;
+		}
+		if ((rc = blockhash_block(self, self->blocksize)) != RDD_OK) {
+			return rc;
+		}
+		buf += self->blocksize;
+	}
 
 	return RDD_OK;
 }
@@ -170,7 +206,9 @@ blockhash_close(RDD_FILTER *self)
 	unsigned char md5bytes[MD5_DIGEST_LENGTH];
 	int rc;
 
-	MD5_Final(md5bytes, &state->md5_state);
+	if ((rc = rdd_hash_final(&state->hash, md5bytes)) != RDD_OK) {
+		return rc;
+	}
 
 	rc = rdd_mp_close(state->printer, RDD_MP_RECURSE|RDD_MP_READONLY);
 	if (rc != RDD_OK) {
@@ -187,5 +225,51 @@ blockhash_free(RDD_FILTER *self)
 
 	free(state->path);
 
+	return rdd_hash_free(&state->hash);
+}
+
+/** Saves the block number, the hash context of the current block,
+ *  and the size of the output file.
+ */
+static int
+blockhash_save(RDD_FILTER *self, FILE *fp)
+{
+	RDD_BLOCKHASH_FILTER *state = (RDD_BLOCKHASH_FILTER *) self->state;
+	rdd_count_t size;
+	int rc;
+
+	if ((rc = rdd_mp_sync(state->printer, &size)) != RDD_OK) {
+		return rc;
+	}
+
+	if (fwrite(&state->blocknum, sizeof state->blocknum, 1, fp) < 1) {
+		return RDD_EWRITE;
+	}
+	if ((rc = rdd_hash_save(&state->hash, fp)) != RDD_OK) {
+		return rc;
+	}
+	if (fwrite(&size, sizeof size, 1, fp) < 1) {
+		return RDD_EWRITE;
+	}
 	return RDD_OK;
 }
+
+static int
+blockhash_restore(RDD_FILTER *self, FILE *fp)
+{
+	RDD_BLOCKHASH_FILTER *state = (RDD_BLOCKHASH_FILTER *) self->state;
+	rdd_count_t size;
+	int rc;
+
+	if (fread(&state->blocknum, sizeof state->blocknum, 1, fp) < 1) {
+		return RDD_ESYNTAX;
+	}
+	if ((rc = rdd_hash_restore(&state->hash, fp)) != RDD_OK) {
+		return rc;
+	}
+	if (fread(&size, sizeof size, 1, fp) < 1) {
+		return RDD_ESYNTAX;
+	}
+
+	return rdd_mp_truncate(state->printer, size);
+}
@@ -57,22 +57,28 @@ static char copyright[] =
 
 #include "writer.h"
 #include "filter.h"
+#include "hashengine.h"
 
 typedef struct _RDD_MD5_STREAM_FILTER {
-	MD5_CTX   md5_state;
+	RDD_HASH      hash;
 	unsigned char result[MD5_DIGEST_LENGTH];
 } RDD_MD5_STREAM_FILTER;
 
 static int md5_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte);
 static int md5_close(RDD_FILTER *f);
 static int md5_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte);
+static int md5_free(RDD_FILTER *f);
+static int md5_save(RDD_FILTER *f, FILE *fp);
+static int md5_restore(RDD_FILTER *f, FILE *fp);
 
 static RDD_FILTER_OPS md5_ops = {
 	md5_input,
 	0,
 	md5_close,
 	md5_get_result,
-	0
+	md5_free,
+	md5_save,
+	md5_restore
 };
 
 int
@@ -92,7 +98,10 @@ rdd_new_md5_streamfilter(RDD_FILTER **self)
 	}
        	state = (RDD_MD5_STREAM_FILTER *) f->state;
 
-	MD5_Init(&state->md5_state);
+	if ((rc = rdd_hash_init(&state->hash, RDD_HASH_MD5)) != RDD_OK) {
+		rdd_filter_free(f);
+		return rc;
+	}
 
 	*self = f;
 	return RDD_OK;
@@ -105,7 +114,7 @@ md5_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
 
 	RDD_MD5_STREAM_FILTER *state = (RDD_MD5_STREAM_FILTER *) f->state;
 
-	MD5_Update(&state->md5_state, buf, nbyte);
+	rdd_hash_update(&state->hash, buf, nbyte);
 
 	return RDD_OK;
 }
@@ -119,9 +128,7 @@ md5_close(RDD_FILTER *f)
 
 	RDD_MD5_STREAM_FILTER *state = (RDD_MD5_STREAM_FILTER *) f->state;
 
-	MD5_Final(state->result, &state->md5_state);
-
-	return RDD_OK;
+	return rdd_hash_final(&state->hash, state->result);
 }
 
 static int
@@ -139,3 +146,29 @@ md5_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte)
 
 	return RDD_OK;
 }
+
+static int
+md5_free(RDD_FILTER *f)
+{
+	RDD_MD5_STREAM_FILTER *state = (RDD_MD5_STREAM_FILTER *) f->state;
+
+	return rdd_hash_free(&state->hash);
+}
+
+/* The saved state is that of the hash engine (see rdd_hash_save()).
+ */
+static int
+md5_save(RDD_FILTER *f, FILE *fp)
+{
+	RDD_MD5_STREAM_FILTER *state = (RDD_MD5_STREAM_FILTER *) f->state;
+
+	return rdd_hash_save(&state->hash, fp);
+}
+
+static int
+md5_restore(RDD_FILTER *f, FILE *fp)
+{
+	RDD_MD5_STREAM_FILTER *state = (RDD_MD5_STREAM_FILTER *) f->state;
+
+	return rdd_hash_restore(&state->hash, fp);
+}
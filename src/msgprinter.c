@@ -87,6 +87,28 @@ rdd_mp_close(RDD_MSGPRINTER *printer, unsigned flags)
 	return RDD_OK;
 }
 
+int
+rdd_mp_sync(RDD_MSGPRINTER *printer, rdd_count_t *size)
+{
+	RDD_MSGPRINTER_OPS *ops = printer->ops;
+
+	if (ops->sync == 0) {
+		return RDD_NOTFOUND;
+	}
+	return (*ops->sync)(printer, size);
+}
+
+int
+rdd_mp_truncate(RDD_MSGPRINTER *printer, rdd_count_t size)
+{
+	RDD_MSGPRINTER_OPS *ops = printer->ops;
+
+	if (ops->truncate == 0) {
+		return RDD_NOTFOUND;
+	}
+	return (*ops->truncate)(printer, size);
+}
+
 uint32_t
 rdd_mp_get_mask(RDD_MSGPRINTER *printer)
 {
@@ -99,6 +99,10 @@ typedef void (*rdd_mp_print_fun)(struct _RDD_MSGPRINTER *printer,
 			rdd_message_t type, int errcode, const char *msg);
 typedef int (*rdd_mp_close_fun)(struct _RDD_MSGPRINTER *printer,
 			unsigned flags);
+typedef int (*rdd_mp_sync_fun)(struct _RDD_MSGPRINTER *printer,
+			rdd_count_t *size);
+typedef int (*rdd_mp_truncate_fun)(struct _RDD_MSGPRINTER *printer,
+			rdd_count_t size);
 
 /** All printer implementations provide a structure of type \c RDD_WRITE_OPS.
  *  This structure contains pointers to the routines that implement
@@ -107,6 +111,8 @@ typedef int (*rdd_mp_close_fun)(struct _RDD_MSGPRINTER *printer,
 typedef struct _RDD_MSGPRINTER_OPS {
 	rdd_mp_print_fun print;		/*<< prints a message */
 	rdd_mp_close_fun close;		/*<< closes the printer instance */
+	rdd_mp_sync_fun sync;		/*<< flushes the output (optional) */
+	rdd_mp_truncate_fun truncate;	/*<< truncates the output (optional) */
 } RDD_MSGPRINTER_OPS;
 
 /** Printer object. A printer object consists of a print buffer
@@ -166,6 +172,18 @@ int rdd_mp_open_file_printer(RDD_MSGPRINTER **printer, const char *path, const i
  */
 int rdd_mp_close(RDD_MSGPRINTER *printer, unsigned flags);
 
+/** \brief Flushes a printer's output to stable storage and returns
+ *  the output size in \c size.  Returns \c RDD_NOTFOUND if the printer
+ *  does not write to a file.
+ */
+int rdd_mp_sync(RDD_MSGPRINTER *printer, rdd_count_t *size);
+
+/** \brief Discards all printer output beyond the first \c size bytes;
+ *  later messages are appended at that point.  Returns \c RDD_NOTFOUND
+ *  if the printer does not write to a file.
+ */
+int rdd_mp_truncate(RDD_MSGPRINTER *printer, rdd_count_t size);
+
 /** \brief Retrieves a printer's current message mask.
  */
 uint32_t rdd_mp_get_mask(RDD_MSGPRINTER *printer);
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+/*
+ * A stream filter that computes any combination of MD5, SHA-1, and
+ * SHA-2 digests in a single pass over its input.  Separate hash
+ * filters each stream a whole copy block through the CPU caches;
+ * for large blocks the data is evicted before the next filter sees
+ * it.  This filter feeds the input to all digests in cache-sized
+ * chunks instead.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "rdd.h"
+#include "rdd_internals.h"
+
+#ifdef HAVE_OPENSSL
+#include <openssl/sha.h>
+#endif /* HAVE_OPENSSL */
+
+#include "writer.h"
+#include "filter.h"
+#include "hashengine.h"
+
+/* Chunk size; small enough to stay in the first-level data cache
+ * while all digests run over it.
+ */
+#define MULTIHASH_CHUNK	16384
+
+#define ALL_DIGESTS (RDD_MULTIHASH_MD5|RDD_MULTIHASH_SHA1 \
+		|RDD_MULTIHASH_SHA256|RDD_MULTIHASH_SHA384|RDD_MULTIHASH_SHA512)
+
+/* Flag RDD_MULTIHASH_<X> selects algorithm RDD_HASH_<X>. */
+#define ALG_FLAG(alg)	(1u << (alg))
+
+typedef struct _RDD_MULTIHASH_STREAM_FILTER {
+	unsigned      algs;
+	unsigned      nhash;			/* # selected digests */
+	RDD_HASH      hash[RDD_HASH_NALG];	/* the first nhash are in use */
+	unsigned char result[RDD_HASH_NALG][SHA512_DIGEST_LENGTH];
+} RDD_MULTIHASH_STREAM_FILTER;
+
+static int multihash_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte);
+static int multihash_close(RDD_FILTER *f);
+static int multihash_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte);
+static int multihash_free(RDD_FILTER *f);
+static int multihash_save(RDD_FILTER *f, FILE *fp);
+static int multihash_restore(RDD_FILTER *f, FILE *fp);
+
+static RDD_FILTER_OPS multihash_ops = {
+	multihash_input,
+	0,
+	multihash_close,
+	multihash_get_result,
+	multihash_free,
+	multihash_save,
+	multihash_restore
+};
+
+int
+rdd_new_multihash_streamfilter(RDD_FILTER **self, unsigned algs)
+{
+	RDD_FILTER *f;
+	RDD_MULTIHASH_STREAM_FILTER *state;
+	rdd_hash_alg_t alg;
+	int rc;
+
+	if (self == 0 || algs == 0 || (algs & ~ALL_DIGESTS) != 0) {
+		return RDD_BADARG;
+	}
+
+	rc = rdd_new_filter(&f, &multihash_ops,
+			sizeof(RDD_MULTIHASH_STREAM_FILTER), 0);
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state = (RDD_MULTIHASH_STREAM_FILTER *) f->state;
+
+	state->algs = algs;
+	for (alg = 0; alg < RDD_HASH_NALG; alg++) {
+		if ((algs & ALG_FLAG(alg)) == 0) {
+			continue;
+		}
+		rc = rdd_hash_init(&state->hash[state->nhash], alg);
+		if (rc != RDD_OK) {
+			rdd_filter_free(f);
+			return rc;
+		}
+		state->nhash++;
+	}
+
+	*self = f;
+	return RDD_OK;
+}
+
+static int
+multihash_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
+{
+	/* Don't do any sanity checks; this function is in the critical loop. */
+
+	RDD_MULTIHASH_STREAM_FILTER *state = (RDD_MULTIHASH_STREAM_FILTER *) f->state;
+	unsigned nhash = state->nhash;
+	unsigned i, n;
+
+	while (nbyte > 0) {
+		n = nbyte < MULTIHASH_CHUNK ? nbyte : MULTIHASH_CHUNK;
+
+		for (i = 0; i < nhash; i++) {
+			rdd_hash_update(&state->hash[i], buf, n);
+		}
+
+		buf += n;
+		nbyte -= n;
+	}
+
+	return RDD_OK;
+}
+
+static int
+multihash_close(RDD_FILTER *f)
+{
+	if (f == 0) {
+		return RDD_BADARG;
+	}
+
+	RDD_MULTIHASH_STREAM_FILTER *state = (RDD_MULTIHASH_STREAM_FILTER *) f->state;
+	unsigned i;
+	int rc;
+
+	for (i = 0; i < state->nhash; i++) {
+		rc = rdd_hash_final(&state->hash[i], state->result[i]);
+		if (rc != RDD_OK) {
+			return rc;
+		}
+	}
+
+	return RDD_OK;
+}
+
+static int
+multihash_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte)
+{
+	if (f == 0) {
+		return RDD_BADARG;
+	}
+
+	RDD_MULTIHASH_STREAM_FILTER *state = (RDD_MULTIHASH_STREAM_FILTER *) f->state;
+	unsigned i, len, total = 0;
+
+	for (i = 0; i < state->nhash; i++) {
+		total += rdd_hash_size(state->hash[i].alg);
+	}
+	if (nbyte < total) return RDD_ESPACE;
+
+	for (i = 0; i < state->nhash; i++) {
+		len = rdd_hash_size(state->hash[i].alg);
+		memcpy(buf, state->result[i], len);
+		buf += len;
+	}
+
+	return RDD_OK;
+}
+
+int
+rdd_multihash_get_digest(RDD_FILTER *f, unsigned alg,
+		unsigned char *buf, unsigned nbyte)
+{
+	RDD_MULTIHASH_STREAM_FILTER *state;
+	unsigned i, len;
+
+	if (f == 0 || buf == 0 || f->ops != &multihash_ops) {
+		return RDD_BADARG;
+	}
+	if (alg == 0 || (alg & (alg - 1)) != 0 || (alg & ~ALL_DIGESTS) != 0) {
+		return RDD_BADARG;
+	}
+	state = (RDD_MULTIHASH_STREAM_FILTER *) f->state;
+
+	for (i = 0; i < state->nhash; i++) {
+		if (ALG_FLAG(state->hash[i].alg) == alg) {
+			len = rdd_hash_size(state->hash[i].alg);
+			if (nbyte < len) return RDD_ESPACE;
+			memcpy(buf, state->result[i], len);
+			return RDD_OK;
+		}
+	}
+	return RDD_NOTFOUND;
+}
+
+static int
+multihash_free(RDD_FILTER *f)
+{
+	RDD_MULTIHASH_STREAM_FILTER *state = (RDD_MULTIHASH_STREAM_FILTER *) f->state;
+	unsigned i;
+
+	for (i = 0; i < state->nhash; i++) {
+		rdd_hash_free(&state->hash[i]);
+	}
+	return RDD_OK;
+}
+
+/* The saved state is the set of selected digests followed by the
+ * state of each digest.
+ */
+static int
+multihash_save(RDD_FILTER *f, FILE *fp)
+{
+	RDD_MULTIHASH_STREAM_FILTER *state = (RDD_MULTIHASH_STREAM_FILTER *) f->state;
+	uint32_t algs = state->algs;
+	unsigned i;
+	int rc;
+
+	if (fwrite(&algs, sizeof algs, 1, fp) < 1) {
+		return RDD_EWRITE;
+	}
+	for (i = 0; i < state->nhash; i++) {
+		if ((rc = rdd_hash_save(&state->hash[i], fp)) != RDD_OK) {
+			return rc;
+		}
+	}
+	return RDD_OK;
+}
+
+static int
+multihash_restore(RDD_FILTER *f, FILE *fp)
+{
+	RDD_MULTIHASH_STREAM_FILTER *state = (RDD_MULTIHASH_STREAM_FILTER *) f->state;
+	uint32_t algs;
+	unsigned i;
+	int rc;
+
+	if (fread(&algs, sizeof algs, 1, fp) < 1 || algs != state->algs) {
+		return RDD_ESYNTAX;
+	}
+	for (i = 0; i < state->nhash; i++) {
+		if ((rc = rdd_hash_restore(&state->hash[i], fp)) != RDD_OK) {
+			return rc;
+		}
+	}
+	return RDD_OK;
+}
@@ -37,9 +37,13 @@
 #include "reader.h"
 
 typedef enum _rdd_net_flags_t {
-	RDD_NET_COMPRESS = 0x1
+	RDD_NET_COMPRESS = 0x1,	/* data is compressed (zlib unless LZ4/ZSTD) */
+	RDD_NET_LZ4      = 0x2,	/* compressed data is an LZ4 frame */
+	RDD_NET_ZSTD     = 0x4	/* compressed data is a zstd frame */
 } rdd_net_flags_t;
 
+#define RDD_NET_KNOWN_FLAGS	(RDD_NET_COMPRESS|RDD_NET_LZ4|RDD_NET_ZSTD)
+
 int rdd_init_server(RDD_MSGPRINTER *printer, unsigned int port,
 			int *server_sock);
 
@@ -57,6 +57,7 @@ static char copyright[] =
 #include "rdd.h"
 #include "rdd_internals.h"
 #include "error.h"
+#include "writer.h"
 #include "outfile.h"
 
 /* Check whether path is a valid path name in the file system.
@@ -69,7 +70,8 @@ path_exists(const char *path, struct stat *info)
 
 
 /* Opens a new output file, but refuses to overwrite
- * an existing file, unless the user specified -f.
+ * an existing file, unless the user specified -f.  If force_overwrite
+ * equals RDD_RESUME, an existing file is opened without truncating it.
  */
 int
 outfile_open(int *fdp, const char *path, int force_overwrite)
@@ -86,7 +88,7 @@ outfile_open(int *fdp, const char *path, int force_overwrite)
 		if (! force_overwrite) {
 			error("refusing to overwrite %s; use -f", path);
 		}
-		if (S_ISREG(statinfo.st_mode)) {
+		if (S_ISREG(statinfo.st_mode) && force_overwrite != RDD_RESUME) {
 			open_flags |= O_TRUNC;
 		}
 	}
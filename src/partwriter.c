@@ -43,6 +43,12 @@ static char copyright[] =
  * files, each of which has a maximum size that is specified
  * at construction time.  When one file has been filled, the
  * partwriter closes it and opens a new file.
+ *
+ * When the total size is known, a helper thread opens the next file
+ * while the current one is being written, so that the copy does not
+ * wait for file creation (and space allocation) at every boundary.
+ * The helper thread is started when a file is opened and joined when
+ * that file is full; at any time at most one helper is running.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -57,7 +63,9 @@ static char copyright[] =
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 
 #include "rdd.h"
 #include "writer.h"
@@ -69,11 +77,20 @@ static char copyright[] =
 static int part_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte);
 static int part_close(RDD_WRITER *w);
 static int part_compare_address(RDD_WRITER *w, struct addrinfo *addr, int *result);
+static int part_sync(RDD_WRITER *w);
+static int part_truncate(RDD_WRITER *w, rdd_count_t pos);
+static int part_skip(RDD_WRITER *w, rdd_count_t nbyte);
+static int part_stream(RDD_WRITER *w);
 
 static RDD_WRITE_OPS part_write_ops = {
 	part_write,
 	part_close,
-	part_compare_address
+	part_compare_address,
+	part_sync,
+	part_truncate,
+	part_skip,
+	0,		/* reserve: parts reserve their own space */
+	part_stream
 };
 
 typedef struct _RDD_PART_WRITER {
@@ -86,6 +103,17 @@ typedef struct _RDD_PART_WRITER {
 	unsigned     ndigit;		/* #decimal digits in sequence no. */
 	rdd_count_t  written;		/* #bytes in current part */
 	RDD_WRITER *parent;
+	rdd_count_t  maxlen;
+	int          prealloc;		/* reserve space for each part? */
+	int          stream;		/* stream each part? */
+
+	/* Part opened ahead of time by the helper thread */
+	pthread_t    opener;
+	int          opening;		/* helper thread started? */
+	unsigned     next_partnum_open;	/* part the helper opens */
+	char        *nextpathbuf;
+	RDD_WRITER  *next;
+	int          next_rc;
 } RDD_PART_WRITER;
 
 
@@ -114,15 +142,14 @@ count_digits(rdd_count_t maxlen, rdd_count_t splitlen)
 	return ndigit;
 }
 
-/* Opens a new file. Each file's name includes a sequence number
- * that is prepended to the basename of the template file name
- * specified at construction time (stored in state->path).
+/* Builds the name of part partnum in buf.  Each file's name includes
+ * a sequence number that is prepended to the basename of the template
+ * file name specified at construction time (stored in state->path).
  */
-static int
-open_next_part(RDD_PART_WRITER *state)
+static void
+part_name(RDD_PART_WRITER *state, unsigned partnum, char *buf)
 {
 	char *sep;
-	int rc;
 
 	assert(state->path != 0);
 	sep = strrchr(state->path, '/');
@@ -130,43 +157,226 @@ open_next_part(RDD_PART_WRITER *state)
 		/* Simple path, no '/' separators.
 		 * Example: foo.img -> 002-foo.img.
 		 */
-		snprintf(state->pathbuf, state->maxpathlen, "%0*d-%s",
-			state->ndigit, state->next_partnum, state->path);
-		state->pathbuf[state->maxpathlen-1] = '\000';
+		snprintf(buf, state->maxpathlen, "%0*d-%s",
+			state->ndigit, partnum, state->path);
 	} else {
 		/* Multipart path, path components separated by '/' chars.
 		 * Example: /tmp/foo.img -> /tmp/002-foo.img.
 		 */
-		char *dir = state->path;
-		char *file = sep + 1;
-		*sep = '\000';	/* overwrites last '/' in state->path */
-		snprintf(state->pathbuf, state->maxpathlen, "%s/%0*d-%s",
-				dir, state->ndigit, state->next_partnum, file);
-		state->pathbuf[state->maxpathlen-1] = '\000';
-		*sep = '/';	/* restores last '/' in state->path */
+		snprintf(buf, state->maxpathlen, "%.*s/%0*d-%s",
+			(int) (sep - state->path), state->path,
+			state->ndigit, partnum, sep + 1);
 	}
+	buf[state->maxpathlen-1] = '\000';
+}
 
-	rc = rdd_open_safe_writer(&state->parent, state->pathbuf,
-					state->writemode);
+/* Returns the size of part partnum, if the total size is known.
+ */
+static rdd_count_t
+part_size(RDD_PART_WRITER *state, unsigned partnum)
+{
+	rdd_count_t start = ((rdd_count_t) partnum) * state->splitlen;
 
+	if (state->maxlen == RDD_WHOLE_FILE
+	||  state->maxlen - start > state->splitlen) {
+		return state->splitlen;
+	}
+	return state->maxlen - start;
+}
+
+/* Opens part partnum and, if requested, allocates its disk space.
+ * File systems that cannot allocate space in advance are no error.
+ */
+static int
+open_part(RDD_PART_WRITER *state, unsigned partnum, char *buf,
+		RDD_WRITER **writer)
+{
+	int rc;
+
+	part_name(state, partnum, buf);
+	rc = rdd_open_safe_writer(writer, buf, state->writemode);
 	if (rc != RDD_OK) {
 		return rc;
 	}
 
+	if (state->prealloc) {
+		rc = rdd_writer_reserve(*writer, part_size(state, partnum));
+		if (rc != RDD_OK && rc != RDD_NOTFOUND) {
+			(void) rdd_writer_close(*writer);
+			*writer = 0;
+			(void) remove(buf);
+			return rc;
+		}
+	}
+
+	return RDD_OK;
+}
+
+static void *
+open_part_thread(void *arg)
+{
+	RDD_PART_WRITER *state = (RDD_PART_WRITER *) arg;
+
+	state->next_rc = open_part(state, state->next_partnum_open,
+				state->nextpathbuf, &state->next);
+	return 0;
+}
+
+/* Starts a helper thread that opens the part after the current one,
+ * if that part will be needed and can be opened without asking the
+ * user.  If the thread cannot be started, the part is opened when it
+ * is needed.
+ *
+ * The input may end before that part is reached, and an unused part
+ * is removed.  A part that already exists is therefore not opened
+ * ahead: in RDD_OVERWRITE mode that would truncate it, and then
+ * remove it, even though the copy never reached it.
+ */
+static void
+start_open_ahead(RDD_PART_WRITER *state)
+{
+	struct stat info;
+
+	assert(! state->opening);
+
+	if (state->maxlen == RDD_WHOLE_FILE
+	||  ((rdd_count_t) state->next_partnum) * state->splitlen >= state->maxlen) {
+		return;
+	}
+	if (state->writemode != RDD_NO_OVERWRITE
+	&&  state->writemode != RDD_OVERWRITE) {
+		return;
+	}
+	part_name(state, state->next_partnum, state->nextpathbuf);
+	if (lstat(state->nextpathbuf, &info) == 0) {
+		return;
+	}
+
+	state->next_partnum_open = state->next_partnum;
+	state->next = 0;
+	state->next_rc = RDD_OK;
+	if (pthread_create(&state->opener, 0, open_part_thread, state) == 0) {
+		state->opening = 1;
+	}
+}
+
+/* Waits for the helper thread.  A part that it opened but that is no
+ * longer wanted is closed and removed.
+ */
+static int
+finish_open_ahead(RDD_PART_WRITER *state, int wanted)
+{
+	int rc;
+
+	if (! state->opening) {
+		return RDD_OK;
+	}
+	pthread_join(state->opener, 0);
+	state->opening = 0;
+
+	if (wanted) {
+		return state->next_rc;
+	}
+	if (state->next != 0) {
+		rc = rdd_writer_close(state->next);
+		state->next = 0;
+		(void) remove(state->nextpathbuf);
+		return rc;
+	}
+	return RDD_OK;
+}
+
+/* Opens the next part, or takes it from the helper thread, and
+ * starts opening the part after it.
+ */
+static int
+open_next_part(RDD_PART_WRITER *state)
+{
+	int rc;
+
+	if (state->opening
+	&&  state->next_partnum_open == state->next_partnum) {
+		if ((rc = finish_open_ahead(state, 1)) != RDD_OK) {
+			return rc;
+		}
+		state->parent = state->next;
+		state->next = 0;
+		strcpy(state->pathbuf, state->nextpathbuf);
+	} else {
+		if ((rc = finish_open_ahead(state, 0)) != RDD_OK) {
+			return rc;
+		}
+		rc = open_part(state, state->next_partnum, state->pathbuf,
+				&state->parent);
+		if (rc != RDD_OK) {
+			return rc;
+		}
+	}
+	if (state->stream) {
+		rc = rdd_writer_stream(state->parent);
+		if (rc != RDD_OK && rc != RDD_NOTFOUND) {
+			return rc;
+		}
+	}
+
 	state->next_partnum++;
+	start_open_ahead(state);
 
 	return RDD_OK;
 }
 
+/* Fails if the file system that holds the parts has less free space
+ * than maxlen.  Parts that already exist will be overwritten, so the
+ * space they occupy counts as free.  If the free space cannot be
+ * determined, the check passes.
+ */
+static int
+check_space(RDD_PART_WRITER *state)
+{
+	struct statvfs fsinfo;
+	struct stat info;
+	rdd_count_t avail;
+	unsigned partnum;
+	char *sep;
+	int rc;
+
+	sep = strrchr(state->path, '/');
+	if (sep == 0) {
+		rc = statvfs(".", &fsinfo);
+	} else if (sep == state->path) {
+		rc = statvfs("/", &fsinfo);
+	} else {
+		*sep = '\000';	/* overwrites last '/' in state->path */
+		rc = statvfs(state->path, &fsinfo);
+		*sep = '/';	/* restores last '/' in state->path */
+	}
+	if (rc < 0) {
+		return RDD_OK;
+	}
+	avail = ((rdd_count_t) fsinfo.f_bavail) * fsinfo.f_frsize;
+
+	for (partnum = 0;
+	     ((rdd_count_t) partnum) * state->splitlen < state->maxlen;
+	     partnum++) {
+		part_name(state, partnum, state->pathbuf);
+		if (stat(state->pathbuf, &info) == 0 && S_ISREG(info.st_mode)) {
+			avail += ((rdd_count_t) info.st_blocks) * 512;
+		}
+	}
+
+	return avail < state->maxlen ? RDD_ESPACE : RDD_OK;
+}
+
 int
 rdd_open_part_writer(RDD_WRITER **self,
 	const char *path, rdd_count_t maxlen, rdd_count_t splitlen,
-	rdd_write_mode_t wrmode)
+	rdd_write_mode_t wrmode, int prealloc)
 {
 	RDD_WRITER *w = 0;
 	RDD_PART_WRITER *state = 0;
 	char *pathcopy = 0;
 	char *pathbuf = 0;
+	char *nextpathbuf = 0;
 	int rc = RDD_OK;
 
 	if (self == 0) {
@@ -193,6 +403,8 @@ rdd_open_part_writer(RDD_WRITER **self,
 	state->splitlen = splitlen;
 	state->written = 0;
 	state->writemode = wrmode;
+	state->maxlen = maxlen;
+	state->prealloc = prealloc;
 
 	if ((pathcopy = malloc(strlen(path) + 1)) == 0) {
 		rc = RDD_NOMEM;
@@ -202,13 +414,24 @@ rdd_open_part_writer(RDD_WRITER **self,
 	state->path = pathcopy;
 	state->maxpathlen = strlen(state->path) + 128;
 
-	if ((pathbuf = malloc(state->maxpathlen)) == 0) {
+	if ((pathbuf = malloc(state->maxpathlen)) == 0
+	||  (nextpathbuf = malloc(state->maxpathlen)) == 0) {
+		rc = RDD_NOMEM;
 		goto error;
 	}
 	memset(pathbuf, 0, state->maxpathlen);
+	memset(nextpathbuf, 0, state->maxpathlen);
 	state->pathbuf = pathbuf;
+	state->nextpathbuf = nextpathbuf;
+
+	if (prealloc && maxlen != RDD_WHOLE_FILE && wrmode != RDD_RESUME) {
+		if ((rc = check_space(state)) != RDD_OK) {
+			goto error;
+		}
+	}
 
 	if ((rc = open_next_part(state)) != RDD_OK) {
+		finish_open_ahead(state, 0);
 		goto error;
 	}
 
@@ -217,6 +440,9 @@ rdd_open_part_writer(RDD_WRITER **self,
 
 error:
 	*self = 0;
+	if (nextpathbuf != 0) {
+		free(nextpathbuf);
+	}
 	if (pathbuf != 0) {
 		free(pathbuf);
 	}
@@ -232,6 +458,28 @@ error:
 	return rc;
 }
 
+/* Closes the current part if it is full and opens the next one.
+ */
+static int
+next_part_if_full(RDD_PART_WRITER *state)
+{
+	int rc;
+
+	if (state->written < state->splitlen) {
+		return RDD_OK;
+	}
+	if ((rc = rdd_writer_close(state->parent)) != RDD_OK) {
+		return rc;
+	}
+	state->parent = 0;
+	if ((rc = open_next_part(state)) != RDD_OK) {
+		return rc;
+	}
+	state->written = 0;
+
+	return RDD_OK;
+}
+
 static int
 part_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte)
 {
@@ -240,17 +488,8 @@ part_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte)
 	int rc;
 
 	while (nbyte > 0) {
-		if (state->written >= state->splitlen) {
-			/* Current part is full; close, then open next part.
-			 */
-			if ((rc = rdd_writer_close(state->parent)) != RDD_OK) {
-				return rc;
-			}
-			state->parent = 0;
-			if ((rc = open_next_part(state)) != RDD_OK) {
-				return rc;
-			}
-			state->written = 0;
+		if ((rc = next_part_if_full(state)) != RDD_OK) {
+			return rc;
 		}
 
 		/* Figure out how much space is left in the current
@@ -278,14 +517,23 @@ static int
 part_close(RDD_WRITER *self)
 {
 	RDD_PART_WRITER *state = self->state;
-	int rc;
+	int rc, rc_ahead;
 
 	assert(state->parent != 0);
 
+	/* The input may end before maxlen bytes have been written,
+	 * so the part that was opened ahead may not be needed.
+	 */
+	rc_ahead = finish_open_ahead(state, 0);
 	if ((rc = rdd_writer_close(state->parent)) != RDD_OK) {
 		return rc;
 	}
+	if (rc_ahead != RDD_OK) {
+		return rc_ahead;
+	}
 
+	free(state->nextpathbuf);
+	state->nextpathbuf = 0;
 	free(state->pathbuf);
 	state->pathbuf = 0;
 	free(state->path);
@@ -308,3 +556,85 @@ part_compare_address(RDD_WRITER *self, struct addrinfo *address, int *result)
 	*result = (address == 0);
 	return RDD_OK;
 }
+
+/* Completed parts have been synced when they were closed, so only
+ * the current part needs to be synced.
+ */
+static int
+part_sync(RDD_WRITER *self)
+{
+	RDD_PART_WRITER *state = self->state;
+
+	return rdd_writer_sync(state->parent);
+}
+
+/* Reopens the part that contains position pos and truncates it.
+ * Parts beyond that part are overwritten when they are reached.
+ */
+static int
+part_truncate(RDD_WRITER *self, rdd_count_t pos)
+{
+	RDD_PART_WRITER *state = self->state;
+	rdd_count_t partnum;
+	int rc;
+
+	partnum = pos > 0 ? (pos - 1) / state->splitlen : 0;
+
+	if ((rc = finish_open_ahead(state, 0)) != RDD_OK) {
+		return rc;
+	}
+	if ((rc = rdd_writer_close(state->parent)) != RDD_OK) {
+		return rc;
+	}
+	state->parent = 0;
+
+	state->next_partnum = (unsigned) partnum;
+	if ((rc = open_next_part(state)) != RDD_OK) {
+		return rc;
+	}
+	state->written = pos - partnum * state->splitlen;
+	if (state->writemode == RDD_RESUME) {
+		state->writemode = RDD_OVERWRITE;
+	}
+
+	return rdd_writer_truncate(state->parent, state->written);
+}
+
+/* Skips nbyte bytes, part by part.  A part that consists of zero
+ * bytes only still gets created, as a hole of the full part size.
+ */
+static int
+part_skip(RDD_WRITER *self, rdd_count_t nbyte)
+{
+	RDD_PART_WRITER *state = self->state;
+	rdd_count_t to_skip;
+	int rc;
+
+	while (nbyte > 0) {
+		if ((rc = next_part_if_full(state)) != RDD_OK) {
+			return rc;
+		}
+		to_skip = state->splitlen - state->written;
+		if (to_skip > nbyte) {
+			to_skip = nbyte;
+		}
+		if ((rc = rdd_writer_skip(state->parent, to_skip)) != RDD_OK) {
+			return rc;
+		}
+		nbyte -= to_skip;
+		state->written += to_skip;
+	}
+
+	return RDD_OK;
+}
+
+/* Streams the current part and every part that is opened after it.
+ */
+static int
+part_stream(RDD_WRITER *self)
+{
+	RDD_PART_WRITER *state = self->state;
+
+	state->stream = 1;
+	return rdd_writer_stream(state->parent);
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2004\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "rdd.h"
+#include "reader.h"
+
+/* A pread reader reads from a file descriptor with pread(), so
+ * it never uses or moves the descriptor's file pointer.  The reader
+ * keeps its own file position; tell and seek only access that
+ * position and do not make system calls.
+ *
+ * A streaming pread reader drops each block from the page cache as
+ * soon as it has been read.  Each read drops only its own range, so
+ * concurrent positional reads need no coordination.
+ */
+typedef struct _RDD_PREAD_READER {
+	int         fd;
+	rdd_count_t pos;
+	int         stream;	/* drop data from the cache once read? */
+} RDD_PREAD_READER;
+
+
+/* Forward declarations
+ */
+static int rdd_pread_read(RDD_READER *r, unsigned char *buf, unsigned nbyte,
+			unsigned *nread);
+static int rdd_pread_tell(RDD_READER *r, rdd_count_t *pos);
+static int rdd_pread_seek(RDD_READER *r, rdd_count_t pos);
+static int rdd_pread_close(RDD_READER *r, int recurse);
+static int rdd_pread_pread(RDD_READER *r, unsigned char *buf, unsigned nbyte,
+			rdd_count_t pos, unsigned *nread);
+static int rdd_pread_stream(RDD_READER *r);
+
+static RDD_READ_OPS pread_read_ops = {
+	rdd_pread_read,
+	rdd_pread_tell,
+	rdd_pread_seek,
+	rdd_pread_close,
+	rdd_pread_pread,
+	rdd_pread_stream
+};
+
+int
+rdd_open_pread_reader(RDD_READER **self, int fd)
+{
+	RDD_READER *r = 0;
+	RDD_PREAD_READER *state = 0;
+	off_t offset;
+	int rc = RDD_OK;
+
+	/* Start at the descriptor's current position.  This fails
+	 * for pipes, sockets, and other descriptors that pread() cannot
+	 * handle.
+	 */
+	if ((offset = lseek(fd, (off_t) 0, SEEK_CUR)) == (off_t) -1) {
+		return RDD_ESEEK;
+	}
+
+	rc = rdd_new_reader(&r, &pread_read_ops, sizeof(RDD_PREAD_READER));
+	if (rc != RDD_OK) {
+		return rc;
+	}
+
+	state = (RDD_PREAD_READER *) r->state;
+	state->fd = fd;
+	state->pos = (rdd_count_t) offset;
+
+	*self = r;
+	return RDD_OK;
+}
+
+static int
+rdd_pread_pread(RDD_READER *self, unsigned char *buf, unsigned nbyte,
+			rdd_count_t pos, unsigned *nread)
+{
+	RDD_PREAD_READER *state = self->state;
+	unsigned char *next = buf;
+	rdd_count_t start = pos;
+	ssize_t n;
+
+	while (nbyte > 0) {
+		n = pread(state->fd, next, nbyte, (off_t) pos);
+		if (n < 0) {
+#if defined(RDD_SIGNALS)
+			if (errno == EINTR) continue;
+#endif
+			return RDD_EREAD;
+		} else if (n == 0) {
+			break;	/* reached EOF */
+		}
+		nbyte -= n;
+		next += n;
+		pos += n;
+	}
+
+#if defined(POSIX_FADV_DONTNEED)
+	if (state->stream && next > buf) {
+		(void) posix_fadvise(state->fd, (off_t) start,
+				(off_t) (next - buf), POSIX_FADV_DONTNEED);
+	}
+#endif
+
+	*nread = next - buf;
+	return RDD_OK;
+}
+
+static int
+rdd_pread_read(RDD_READER *self, unsigned char *buf, unsigned nbyte,
+			unsigned *nread)
+{
+	RDD_PREAD_READER *state = self->state;
+	int rc;
+
+	rc = rdd_pread_pread(self, buf, nbyte, state->pos, nread);
+	if (rc != RDD_OK) {
+		return rc;	/* position is unchanged */
+	}
+
+	state->pos += *nread;
+	return RDD_OK;
+}
+
+static int
+rdd_pread_tell(RDD_READER *self, rdd_count_t *pos)
+{
+	RDD_PREAD_READER *state = self->state;
+
+	*pos = state->pos;
+	return RDD_OK;
+}
+
+static int
+rdd_pread_seek(RDD_READER *self, rdd_count_t pos)
+{
+	RDD_PREAD_READER *state = self->state;
+
+	state->pos = pos;
+	return RDD_OK;
+}
+
+static int
+rdd_pread_close(RDD_READER *self, int recurse /* ignored */)
+{
+	RDD_PREAD_READER *state = self->state;
+
+	if (close(state->fd) < 0) {
+		return RDD_ECLOSE;
+	}
+
+	return RDD_OK;
+}
+
+static int
+rdd_pread_stream(RDD_READER *self)
+{
+#if defined(POSIX_FADV_SEQUENTIAL) && defined(POSIX_FADV_DONTNEED)
+	RDD_PREAD_READER *state = self->state;
+	struct stat info;
+
+	if (fstat(state->fd, &info) < 0
+	||  ! (S_ISREG(info.st_mode) || S_ISBLK(info.st_mode))) {
+		return RDD_NOTFOUND;
+	}
+	if (posix_fadvise(state->fd, 0, 0, POSIX_FADV_SEQUENTIAL) != 0) {
+		return RDD_NOTFOUND;
+	}
+	state->stream = 1;
+	return RDD_OK;
+#else
+	return RDD_NOTFOUND;
+#endif
+}
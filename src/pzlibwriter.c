@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#else
+#error: libz not present
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "rdd.h"
+#include "writer.h"
+#include "threadpool.h"
+#include "entropy.h"
+
+/* A parallel zlib writer splits its input into chunks of
+ * PZ_CHUNK_SIZE bytes and deflates the chunks on a thread pool.
+ * Each chunk is compressed as raw deflate data that ends with a sync
+ * flush, so it ends on a byte boundary and is not marked final.  The
+ * last 32 Kbyte of the previous chunk are used as a preset dictionary,
+ * so compression is nearly as good as for a single stream.  The
+ * writer emits the chunks in order between a zlib header and an
+ * Adler-32 trailer; the result is one ordinary zlib stream that
+ * rdd_open_zlib_reader() (or any inflate) can decode.
+ *
+ * Chunks that look incompressible (see entropy.h) are deflated at
+ * level 0, i.e. as stored blocks, which is nearly as fast as a copy.
+ *
+ * Chunk i is stored in slot i % nslot.  Between calls, the slot of
+ * chunk nchunk is free and holds the bytes of the partial chunk.
+ */
+
+#define PZ_CHUNK_SIZE	(128 * 1024)
+#define PZ_DICT_SIZE	32768
+#define PZ_WINDOW_BITS	15
+
+/* Forward declarations
+ */
+static int pzlib_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte);
+static int pzlib_close(RDD_WRITER *w);
+static int pzlib_compare_address(RDD_WRITER *w, struct addrinfo *address, int *result);
+
+static RDD_WRITE_OPS pzlib_write_ops = {
+	pzlib_write,
+	pzlib_close,
+	pzlib_compare_address
+};
+
+typedef struct _PZLIB_SLOT {
+	struct _RDD_PZLIB_WRITER *state;
+	unsigned char *in;		/* dictionary, followed by the chunk */
+	unsigned       ndict;		/* # dictionary bytes before the chunk */
+	unsigned       len;		/* # bytes in the chunk */
+	int            last;		/* last chunk of the stream? */
+	unsigned char *out;		/* compressed chunk */
+	unsigned       outsize;
+	unsigned       nout;		/* # bytes in out */
+	uLong          adler;		/* Adler-32 of the chunk */
+	z_stream       z;
+	int            zinit;		/* z has been initialized */
+	int            busy;		/* chunk is being compressed */
+	int            rc;
+} PZLIB_SLOT;
+
+typedef struct _RDD_PZLIB_WRITER {
+	RDD_WRITER     *parent;
+	unsigned        nslot;
+	PZLIB_SLOT     *slots;
+	RDD_THREADPOOL *pool;
+	pthread_mutex_t lock;
+	pthread_cond_t  chunk_done;
+	rdd_count_t     nchunk;		/* # chunks submitted */
+	rdd_count_t     nwritten;	/* # chunks written to the parent */
+	int             header;		/* zlib header written? */
+	uLong           adler;		/* Adler-32 of all chunks written */
+} RDD_PZLIB_WRITER;
+
+static void
+free_state(RDD_PZLIB_WRITER *state)
+{
+	unsigned i;
+
+	if (state->pool != 0) {
+		rdd_threadpool_wait(state->pool);
+		rdd_free_threadpool(state->pool);
+		state->pool = 0;
+	}
+	if (state->slots != 0) {
+		for (i = 0; i < state->nslot; i++) {
+			PZLIB_SLOT *slot = &state->slots[i];
+
+			if (slot->zinit) {
+				deflateEnd(&slot->z);
+			}
+			free(slot->in);
+			free(slot->out);
+		}
+		free(state->slots);
+		state->slots = 0;
+	}
+	pthread_cond_destroy(&state->chunk_done);
+	pthread_mutex_destroy(&state->lock);
+}
+
+int
+rdd_open_pzlib_writer(RDD_WRITER **self, RDD_WRITER *parent, unsigned nthread)
+{
+	RDD_WRITER *w = 0;
+	RDD_PZLIB_WRITER *state = 0;
+	unsigned i;
+	int rc = RDD_OK;
+
+	if (self == 0 || parent == 0) {
+		return RDD_BADARG;
+	}
+
+	rc = rdd_new_writer(&w, &pzlib_write_ops, sizeof(RDD_PZLIB_WRITER));
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state = (RDD_PZLIB_WRITER *) w->state;
+	state->parent = parent;
+	state->adler = adler32(0L, Z_NULL, 0);
+	pthread_mutex_init(&state->lock, 0);
+	pthread_cond_init(&state->chunk_done, 0);
+
+	if (nthread == 0) {
+		nthread = rdd_ncpu();
+	}
+
+	/* Two slots per thread keep the workers busy while the
+	 * caller fills the next chunks.
+	 */
+	state->nslot = 2 * nthread;
+	if ((state->slots = calloc(state->nslot, sizeof(PZLIB_SLOT))) == 0) {
+		rc = RDD_NOMEM;
+		goto error;
+	}
+	for (i = 0; i < state->nslot; i++) {
+		PZLIB_SLOT *slot = &state->slots[i];
+
+		slot->state = state;
+		rc = deflateInit2(&slot->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+				-PZ_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY);
+		if (rc != Z_OK) {
+			rc = (rc == Z_MEM_ERROR ? RDD_NOMEM : RDD_ECOMPRESS);
+			goto error;
+		}
+		slot->zinit = 1;
+
+		/* A sync flush adds an empty stored block of 5 bytes
+		 * (plus up to 7 bits to finish the last block).
+		 */
+		slot->outsize = deflateBound(&slot->z, PZ_CHUNK_SIZE) + 16;
+		slot->in = malloc(PZ_DICT_SIZE + PZ_CHUNK_SIZE);
+		slot->out = malloc(slot->outsize);
+		if (slot->in == 0 || slot->out == 0) {
+			rc = RDD_NOMEM;
+			goto error;
+		}
+	}
+
+	rc = rdd_new_threadpool(&state->pool, nthread, state->nslot);
+	if (rc != RDD_OK) {
+		goto error;
+	}
+
+	*self = w;
+	return RDD_OK;
+
+error:
+	*self = 0;
+	free_state(state);
+	free(state);
+	free(w);
+	return rc;
+}
+
+/* Runs on a pool thread. */
+static int
+compress_chunk(void *arg)
+{
+	PZLIB_SLOT *slot = (PZLIB_SLOT *) arg;
+	RDD_PZLIB_WRITER *state = slot->state;
+	z_stream *z = &slot->z;
+	unsigned char *chunk = slot->in + PZ_DICT_SIZE;
+	int rc = RDD_OK;
+	int level;
+	int zrc;
+
+	slot->adler = adler32(adler32(0L, Z_NULL, 0), chunk, slot->len);
+
+	/* Right after a reset there is no pending data, so changing the
+	 * level cannot fail for lack of output space.
+	 */
+	level = rdd_is_incompressible(chunk, slot->len)
+		? 0 : Z_DEFAULT_COMPRESSION;
+	if (deflateReset(z) != Z_OK
+	||  deflateParams(z, level, Z_DEFAULT_STRATEGY) != Z_OK) {
+		rc = RDD_ECOMPRESS;
+		goto done;
+	}
+	if (slot->ndict > 0
+	&&  deflateSetDictionary(z, chunk - slot->ndict, slot->ndict) != Z_OK) {
+		rc = RDD_ECOMPRESS;
+		goto done;
+	}
+
+	z->next_in = chunk;
+	z->avail_in = slot->len;
+	z->next_out = slot->out;
+	z->avail_out = slot->outsize;
+	zrc = deflate(z, slot->last ? Z_FINISH : Z_SYNC_FLUSH);
+
+	/* The output buffer is large enough for the whole chunk; if it
+	 * filled up, some output may still be pending.
+	 */
+	if (slot->last ? zrc != Z_STREAM_END
+		       : (zrc != Z_OK || z->avail_in > 0 || z->avail_out == 0)) {
+		rc = RDD_ECOMPRESS;
+		goto done;
+	}
+	slot->nout = slot->outsize - z->avail_out;
+
+done:
+	pthread_mutex_lock(&state->lock);
+	slot->rc = rc;
+	slot->busy = 0;
+	pthread_cond_broadcast(&state->chunk_done);
+	pthread_mutex_unlock(&state->lock);
+
+	return rc;
+}
+
+/* Waits for all chunks up to (not including) chunk number upto,
+ * writes them to the parent in chunk order, and frees their slots.
+ */
+static int
+write_chunks(RDD_PZLIB_WRITER *state, rdd_count_t upto)
+{
+	static const unsigned char header[2] = { 0x78, 0x9c };
+	PZLIB_SLOT *slot;
+	int rc;
+
+	if (! state->header && state->nwritten < upto) {
+		if ((rc = rdd_writer_write(state->parent, header, sizeof header)) != RDD_OK) {
+			return rc;
+		}
+		state->header = 1;
+	}
+
+	while (state->nwritten < upto) {
+		slot = &state->slots[state->nwritten % state->nslot];
+
+		pthread_mutex_lock(&state->lock);
+		while (slot->busy) {
+			pthread_cond_wait(&state->chunk_done, &state->lock);
+		}
+		rc = slot->rc;
+		pthread_mutex_unlock(&state->lock);
+
+		if (rc != RDD_OK) return rc;
+
+		rc = rdd_writer_write(state->parent, slot->out, slot->nout);
+		if (rc != RDD_OK) return rc;
+		state->adler = adler32_combine(state->adler, slot->adler,
+						(z_off_t) slot->len);
+
+		slot->len = 0;
+		state->nwritten++;
+	}
+	return RDD_OK;
+}
+
+/* Hands the chunk in the current slot to the thread pool.  The
+ * tail of the previous chunk, which is still in its slot, becomes
+ * the dictionary of the new chunk.
+ */
+static int
+submit_chunk(RDD_PZLIB_WRITER *state, int last)
+{
+	PZLIB_SLOT *slot = &state->slots[state->nchunk % state->nslot];
+	PZLIB_SLOT *prev;
+	int rc;
+
+	slot->ndict = 0;
+	if (state->nchunk > 0 && slot->len > 0) {
+		prev = &state->slots[(state->nchunk - 1) % state->nslot];
+		slot->ndict = PZ_DICT_SIZE;
+		memcpy(slot->in, prev->in + PZ_CHUNK_SIZE, PZ_DICT_SIZE);
+	}
+	slot->last = last;
+
+	slot->busy = 1;
+	rc = rdd_threadpool_submit(state->pool, compress_chunk, slot);
+	if (rc != RDD_OK) {
+		slot->busy = 0;
+		return rc;
+	}
+	state->nchunk++;
+
+	/* Make sure that the slot of the next chunk is free. */
+	if (state->nchunk - state->nwritten >= state->nslot) {
+		return write_chunks(state, state->nchunk - state->nslot + 1);
+	}
+	return RDD_OK;
+}
+
+static int
+pzlib_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte)
+{
+	RDD_PZLIB_WRITER *state = w->state;
+	PZLIB_SLOT *slot;
+	unsigned n;
+	int rc;
+
+	while (nbyte > 0) {
+		slot = &state->slots[state->nchunk % state->nslot];
+
+		n = PZ_CHUNK_SIZE - slot->len;
+		if (n > nbyte) {
+			n = nbyte;
+		}
+		memcpy(slot->in + PZ_DICT_SIZE + slot->len, buf, n);
+		slot->len += n;
+		buf += n;
+		nbyte -= n;
+
+		if (slot->len == PZ_CHUNK_SIZE) {
+			if ((rc = submit_chunk(state, 0)) != RDD_OK) {
+				return rc;
+			}
+		}
+	}
+
+	return RDD_OK;
+}
+
+static int
+pzlib_close(RDD_WRITER *w)
+{
+	RDD_PZLIB_WRITER *state = w->state;
+	unsigned char trailer[4];
+	int rc;
+
+	/* The last chunk, which may be empty, ends the deflate stream.
+	 */
+	if ((rc = submit_chunk(state, 1)) != RDD_OK
+	||  (rc = write_chunks(state, state->nchunk)) != RDD_OK) {
+		free_state(state);
+		return rc;
+	}
+	free_state(state);
+
+	trailer[0] = (unsigned char) (state->adler >> 24);
+	trailer[1] = (unsigned char) (state->adler >> 16);
+	trailer[2] = (unsigned char) (state->adler >> 8);
+	trailer[3] = (unsigned char) state->adler;
+	if ((rc = rdd_writer_write(state->parent, trailer, sizeof trailer)) != RDD_OK) {
+		return rc;
+	}
+
+	return rdd_writer_close(state->parent);
+}
+
+static int
+pzlib_compare_address(RDD_WRITER *w, struct addrinfo *address, int *result)
+{
+	RDD_PZLIB_WRITER *state = w->state;
+	return rdd_compare_address(state->parent, address, result);
+}
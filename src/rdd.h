@@ -48,7 +48,8 @@ typedef uint32_t rdd_checksum_t;	/*  = 32 bits */
 
 typedef enum {
 	RDD_ADLER32 = 0x1,
-	RDD_CRC32 = 0x2
+	RDD_CRC32 = 0x2,
+	RDD_CRC32C = 0x4	/* Castagnoli polynomial */
 } rdd_checksum_algorithm_t;
 
 typedef struct _RDD_CHECKSUM_FILE_HEADER {
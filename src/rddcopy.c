@@ -94,12 +94,25 @@ static char copyright[] =
 #include "netio.h"
 #include "progress.h"
 #include "msgprinter.h"
+#include "checkpoint.h"
+#include "hashengine.h"
+#include "checksum.h"
+#include "zeroblock.h"
+#include "threadpool.h"
 
 #define DEFAULT_BLOCK_LEN	    262144	/* bytes */
 #define DEFAULT_MIN_BLOCK_SIZE	     32768	/* bytes */
+#define REGION_STRIPE_BLOCKS	        16	/* blocks per region-copier stripe */
 #define DEFAULT_HIST_BLOCK_SIZE	    262144	/* bytes */
 #define DEFAULT_CHKSUM_BLOCK_SIZE    32768	/* bytes */
 #define DEFAULT_BLOCKMD5_SIZE         4096	/* bytes */
+#define DEFAULT_BLOCKHASH_SIZE     1048576	/* bytes */
+#define DEFAULT_DEDUP_SIZE         4096		/* bytes */
+#define DEFAULT_DEDUP_MEMORY       (256 * 1024 * 1024)	/* bytes */
+#define DEFAULT_FILTER_NBUF              8	/* blocks queued per filter set */
+#define DEFAULT_FANOUT_NBUF              8	/* blocks queued per output (fan-out) */
+#define DEFAULT_CHECKPOINT_LEN  (1ULL << 30)	/* bytes between checkpoints */
+#define DEFAULT_TREEHASH_LEAF_SIZE (1 << 20)	/* bytes */
 
 #define DEFAULT_NRETRY               1
 #define DEFAULT_RECOVERY_LEN	     4	/* read blocks */
@@ -119,28 +132,40 @@ typedef enum _rdd_copy_mode_t {
 
 #define ALL_MODES (RDD_LOCAL|RDD_CLIENT|RDD_SERVER)
 
-#define RDD_MAX_OUTPUT_OPTS 16
-
 typedef struct _rdd_output_opt_t {
 	int 	 	ewf;			/* output as ewf?, 0 = no, 1 ewf none, 2 ewf fast, 3 ewf best, 4 ewf empty-block */
 	rdd_count_t  	splitlen;		/* create new output file every splitlen bytes */
 	char     	*outpath;		/* output file or its prefix */
 	char     	*server_host;		/* host name of rdd server */
 	unsigned int 	server_port;		/* TCP port of rdd server */
+	int		sparse;			/* leave holes for zero blocks? */
+	char		*sparsemap;		/* sparse map file or 0 */
 } rdd_output_opt_t;
 
 /* rdd's command-line arguments
  */
 typedef struct _rdd_copy_opts {
 	int       compress;		/* compression enabled? */
+	int       compress_parallel;	/* compress on several threads? */
+	unsigned  compress_threads;	/* # compression threads (0 = all CPUs) */
+	unsigned  compress_codec;	/* RDD_NET_LZ4, RDD_NET_ZSTD, or 0 (zlib) */
+	int       compress_level;	/* zstd compression level (0 = default) */
 	int       quiet;		/* batch mode (no questions)? */
 	char     *infile;		/* input file (source of copy) */
 	char     *logfile;		/* log file */
 	char     *simfile;		/* read-fault simulation config file */
 	char     *crc32file;		/* output file for CRC32 checksums */
+	char     *crc32cfile;		/* output file for CRC32C checksums */
 	char     *adler32file;		/* output file for Adler32 checksums */
 	char     *histfile;		/* output file for histogram stats */
 	char     *blockmd5file;		/* output file for blockwise MD5 */
+	char     *blockhashfile;	/* output file for block-wise digests */
+	char     *blockindexfile;	/* output file for the binary block index */
+	int       dedup;		/* look for duplicate blocks? */
+	char     *dedupindex;		/* persistent dedup index */
+	char     *dedupdata;		/* dedup image data file */
+	char     *dedupmap;		/* dedup image map file */
+	char     *deduprestore;		/* map file of a dedup image input */
 	int       verbose;		/* Be verbose? */
 	int       raw;			/* Reading from a raw device? */
 	unsigned  mode;			/* local, client, or server mode */
@@ -152,23 +177,50 @@ typedef struct _rdd_copy_opts {
 	int       sha256;		/* SHA256-hash all data? */
 	int       sha384;		/* SHA384-hash all data? */
 	int       sha512;		/* SHA512-hash all data? */
+	int       treehash;		/* tree-hash all data? */
+	rdd_count_t  treehashleaflen;	/* tree-hash leaf size */
+	unsigned  treehash_threads;	/* # tree-hash threads (0 = all CPUs) */
 	unsigned  nretry;		/* Max. # read retries for bad blocks */
 	rdd_count_t  blocklen;		/* default copy-block size */
 	rdd_count_t  adler32len;	/* block size for Adler32 */
 	rdd_count_t  crc32len;		/* block size for CRC32 */
+	rdd_count_t  crc32clen;		/* block size for CRC32C */
 	rdd_count_t  histblocklen;	/* histogramming block size */
 	rdd_count_t  blockmd5len;	/* block size for block-wise MD5 */
+	rdd_count_t  blockhashlen;	/* block size for block-wise digests */
+	rdd_hash_alg_t blockhash_alg;	/* block-wise digest algorithm */
+	unsigned  blockhash_threads;	/* # block-hash threads (0 = all CPUs) */
+	rdd_count_t  blockindexlen;	/* block size of the block index */
+	rdd_hash_alg_t blockindex_alg;	/* block-index digest algorithm */
+	rdd_count_t  deduplen;		/* dedup block size */
+	rdd_count_t  dedupmem;		/* max. size of the dedup table */
 	rdd_count_t  minblocklen;	/* unit of data loss */
 	rdd_count_t  offset;		/* start copying here */
 	rdd_count_t  count;		/* copy this many bytes */
 	unsigned int output_count;	/* the number of output files */
-	rdd_output_opt_t output[RDD_MAX_OUTPUT_OPTS];	/* the output options list */
+	unsigned int output_alloc;	/* allocated size of the output list */
+	rdd_output_opt_t *output;	/* the output options list */
 	rdd_count_t  progresslen;	/* progress reporting interval (s) */
 	rdd_count_t  max_read_err;	/* Max. # read errors allowed */
+	unsigned  pipeline;		/* # blocks read ahead of filters (0 = off) */
+	int       filter_threads;	/* run each filter in its own thread? */
+	int       multihash;		/* compute all digests in a single filter? */
+	unsigned  uring_depth;		/* # io_uring reads in flight (0 = off) */
+	rdd_count_t  write_behind;	/* output queue size in bytes (0 = off) */
+	int       fanout;		/* write each output in its own thread? */
+	int       stream_cache;		/* keep the copied data out of the page cache? */
+	unsigned  region_threads;	/* # parallel input readers (0 = off) */
+	char     *rescue_map;		/* multi-pass rescue map file (0 = off) */
+	int       rescue_resume;	/* resuming a rescue from its map? */
+	char     *checkpoint;		/* checkpoint file (0 = off) */
+	rdd_count_t  checkpointlen;	/* # bytes between checkpoints */
+	int       resume;		/* resume from the checkpoint file? */
 } rdd_copy_opts;
 
 static rdd_copy_opts  opts;
 
+static RDD_CHECKPOINT resume_point;	/* counters copied before this run */
+
 static char* compression_types[] = { "no ewf", "none", "fast", "best", "empty-block", NULL};
 
 static char* usage_message = "\n"
@@ -183,14 +235,35 @@ static RDD_OPTION opttab[] = {
 	{0,				"--sha384",			0,			ALL_MODES,		"Compute and print SHA384 hash",			0,	0},
 	{0,				"--sha512",			0,			ALL_MODES,		"Compute and print SHA512 hash",			0,	0},
         {0,				"--md5",			0,			ALL_MODES,		"Compute and print MD5 hash",				0,	0},
+	{0,				"--treehash",			0,			ALL_MODES,		"Compute and print SHA256 Merkle tree hash",		0,	0},
+	{0,				"--treehash-leaf-size",		"<size>",		ALL_MODES,		"Tree hash uses <size>-byte leaves",			0,	0},
+	{0,				"--treehash-threads",		"<count>",		ALL_MODES,		"Tree hash uses <count> threads (0 = all CPUs)",	0,	0},
         {"-A",				"--adler32",			"<file>",		ALL_MODES,		"Compute and store Adler32 checksums in <file>",	0,	0},
         {"-a",				"--adler32-block-size",		"<size>",		ALL_MODES,		"Adler32 uses <size>-byte blocks",			0,	0},
         {"-b",				"--block-size",			"<count>[kKmMgG]",	RDD_LOCAL|RDD_CLIENT,	"Read blocks of <count> [KMG]byte at a time",		0,	0},
+        {0,				"--checkpoint",			"<file>",		RDD_LOCAL,		"Periodically save the copy state in <file>",		0,	0},
+        {0,				"--checkpoint-interval",	"<count>[kKmMgG]",	RDD_LOCAL,		"Save a checkpoint every <count> [KMG]bytes",		0,	0},
         {"-C",				"--client",			0,			0,			"Run rdd as a network client",				0,	0},
         {"-c",				"--count",			"<count>[kKmMgG]",	ALL_MODES,		"Read at most <count> [KMG]bytes",			0,	0},
         {0,				"--block-md5",			"<file>",		ALL_MODES,		"Store block-wise MD5 hash values in <file>",		0,	0},
         {0,				"--block-md5-size",		"<size>",		ALL_MODES,		"block-wise MD5 block size",				0,	0},
+        {0,				"--block-hash",			"<file>",		ALL_MODES,		"Store block-wise hash values in <file>",		0,	0},
+        {0,				"--block-hash-alg",		"<algorithm>",		ALL_MODES,		"block-wise hash algorithm (default sha256)",		0,	0},
+        {0,				"--block-hash-size",		"<size>",		ALL_MODES,		"block-wise hash block size",				0,	0},
+        {0,				"--block-hash-threads",		"<count>",		ALL_MODES,		"block-wise hash uses <count> threads (0 = all CPUs)",	0,	0},
+        {0,				"--block-index",		"<file>",		ALL_MODES,		"Store a binary index of block-wise hash values in <file>",	0,	0},
+        {0,				"--block-index-alg",		"<algorithm>",		ALL_MODES,		"block-index hash algorithm (default sha256)",		0,	0},
+        {0,				"--block-index-size",		"<size>",		ALL_MODES,		"block-index block size",				0,	0},
+        {0,				"--dedup",			0,			ALL_MODES,		"Count duplicate blocks",				0,	0},
+        {0,				"--dedup-size",			"<size>",		ALL_MODES,		"dedup block size (default 4k)",			0,	0},
+        {0,				"--dedup-memory",		"<size>",		ALL_MODES,		"max. size of the dedup block table (default 256m)",	0,	0},
+        {0,				"--dedup-index",		"<file>",		ALL_MODES,		"Load and update a persistent dedup index in <file>",	0,	0},
+        {0,				"--dedup-out",			"<file>",		ALL_MODES,		"Store each unique block once in <file>",		0,	0},
+        {0,				"--dedup-map",			"<file>",		ALL_MODES,		"Store the dedup block map in <file>",			0,	0},
+        {0,				"--dedup-restore",		"<file>",		RDD_LOCAL|RDD_CLIENT,	"Read the dedup image with data file --in and map <file>",	0,	0},
         {"-F",				"--fault-simulation",		"<file>",		RDD_LOCAL|RDD_CLIENT,	"simulate read errors specified in <file>",		0,	0},
+        {0,				"--multihash",		0,			ALL_MODES,		"Compute all hash values in a single pass over each block",	0,	0},
+        {0,				"--filter-threads",		0,			ALL_MODES,		"Run each hash, checksum, and output filter in its own thread",	0,	0},
         {"-f",				"--force",			0,			ALL_MODES,		"Ruthlessly overwrite existing files (including log file)",			0,	0},
         {"-H",				"--histogram",			"<file>",		ALL_MODES,		"Store histogram-derived stats in <file>",		0,	0},
         {"-h",				"--histogram-block-size",	"<size>",		ALL_MODES,		"Histogramming block size",				0,	0},
@@ -200,16 +273,29 @@ static RDD_OPTION opttab[] = {
         {"-m",				"--min-block-size",		"<count>[kKmMgG]",	RDD_LOCAL|RDD_CLIENT,	"Minimum read-block size is <count> [KMG]byte",		0,	0},
         {"-n",				"--nretry",			"<count>",		RDD_LOCAL|RDD_CLIENT,	"Retry failed reads <count> times",			0,	0},
         {"-o",				"--offset",			"<count>[kKmMgG]",	ALL_MODES,		"Skip <count> [KMG] input bytes",			0,	0},
+        {0,				"--pipeline",			"<count>",		RDD_LOCAL|RDD_CLIENT,	"Read up to <count> blocks ahead of the filters",	0,	0},
+        {0,				"--region-threads",		"<count>",		RDD_LOCAL|RDD_CLIENT,	"Read the input with <count> parallel threads",	0,	0},
+        {0,				"--rescue-map",			"<file>",		RDD_LOCAL|RDD_CLIENT,	"Rescue the input in several passes; keep state in <file>",	0,	0},
         {"-P",				"--progress",			"<sec>",		ALL_MODES,		"Report progress every <sec> seconds",			0,	0},
         {"-p",				"--port",			"<portnum>",		RDD_SERVER,		"Set server port to <port>",				0,	0},
         {"-q",				"--quiet",			0,			ALL_MODES,		"Do not ask questions",					0,	0},
+        {0,				"--resume",			0,			RDD_LOCAL,		"Resume an interrupted copy from its checkpoint",	0,	0},
         {"-r",				"--raw",			0,			RDD_LOCAL|RDD_CLIENT,	"Read from a raw device (/dev/raw/raw[0-9])",		0,	0},
+        {0,				"--uring",			"<depth>",		RDD_LOCAL|RDD_CLIENT,	"Keep <depth> io_uring reads in flight",		0,	0},
+        {0,				"--write-behind",		"<size>[kKmMgG]",	ALL_MODES,		"Queue up to <size> [KMG]bytes per output",		0,	0},
+        {0,				"--fan-out",			0,			ALL_MODES,		"Write each output in its own thread",			0,	0},
+        {0,				"--stream-cache",		0,			ALL_MODES,		"Drop copied data from the page cache behind the reads and writes",	0,	0},
         {"-S",				"--server",			0,			0,			"Run rdd as a network server",				0,	0},
         {0,				"--crc32",			"<file>",		ALL_MODES,		"Compute and store CRC32 checksums in <file>",		0,	0},
         {0,				"--crc32-block-size",		"<size>",		ALL_MODES,		"CRC32 uses <size>-byte blocks",			0,	0},
+        {0,				"--crc32c",			"<file>",		ALL_MODES,		"Compute and store CRC32C checksums in <file>",		0,	0},
+        {0,				"--crc32c-block-size",		"<size>",		ALL_MODES,		"CRC32C uses <size>-byte blocks",			0,	0},
         {"-V",				"--version",			0,			ALL_MODES,		"Report version number and exit",			0,	0},
         {"-v",				"--verbose",			0,			ALL_MODES,		"Be verbose",						0,	0},
         {"-z",				"--compress",			0,			RDD_CLIENT,		"Compress data sent across the network",		0,	0},
+        {0,				"--compress-threads",		"<count>",		RDD_CLIENT,		"Compress with <count> threads (0 = all CPUs)",		0,	0},
+        {0,				"--compress-alg",		"<algorithm>",		RDD_CLIENT,		"Compress with zlib (default), lz4, or zstd",		0,	0},
+        {0,				"--compress-level",		"<level>",		RDD_CLIENT,		"zstd compression level",				0,	0},
         {"-I",				"--in",				"<file>",		RDD_LOCAL|RDD_CLIENT,	"Use <file> as input file"			,	0,	0},
         {"-O",				"--out",			"<output options>",	RDD_LOCAL|RDD_CLIENT,	"Output using <output options> (can be used multiple times)",	0,	0},
         {0,				0,				0,			0,			0,							0,	0} /* sentinel */
@@ -220,12 +306,14 @@ static RDD_OPTION output_opttab[] = {
         {"-s",				"--split",			"<count>[kKmMgG]",	RDD_LOCAL|RDD_CLIENT,	"Split output,	all files < <count> [KMG]bytes",	0,	0},
 	{"-N", 				"--name",			"<file>",		RDD_LOCAL|RDD_CLIENT, 	"The output file name",					0,	0},
         {"-p",				"--port",			"<portnum>",		RDD_CLIENT,		"Set server port to <port>",				0,	0},
+	{0,				"--sparse",			0,			RDD_LOCAL,		"Do not write zero blocks; leave holes in the output file",	0,	0},
+	{0,				"--sparse-map",			"<file>",		RDD_LOCAL,		"Write a sparse output file and list its holes in <file>",	0,	0},
         {0,				0,				0,			0,			0,							0,	0} /* sentinel */
 };
 
 #define RDD_OUTPUT_OPTTAB_OPTION_COUNT sizeof(output_opttab)/sizeof(RDD_OPTION)
 
-static RDD_OPTION all_output_opttabs[RDD_OUTPUT_OPTTAB_OPTION_COUNT * RDD_MAX_OUTPUT_OPTS];
+static RDD_OPTION *all_output_opttabs = 0;
 
 static RDD_MSGPRINTER *the_printer;
 
@@ -291,6 +379,17 @@ print_ewf_compress_option()
 	return "";
 }
 
+static char *
+compress_alg_name(unsigned codec)
+{
+	if ((codec & RDD_NET_ZSTD) != 0) {
+		return "zstd";
+	} else if ((codec & RDD_NET_LZ4) != 0) {
+		return "lz4";
+	}
+	return "zlib";
+}
+
 static unsigned
 scan_uint(char *str)
 {
@@ -329,16 +428,59 @@ init_options(void)
 	opts.histblocklen = DEFAULT_HIST_BLOCK_SIZE;
 	opts.adler32len = DEFAULT_CHKSUM_BLOCK_SIZE;
 	opts.crc32len = DEFAULT_CHKSUM_BLOCK_SIZE;
+	opts.crc32clen = DEFAULT_CHKSUM_BLOCK_SIZE;
 	opts.blockmd5len = DEFAULT_BLOCKMD5_SIZE;
+	opts.blockhashlen = DEFAULT_BLOCKHASH_SIZE;
+	opts.blockhash_alg = RDD_HASH_SHA256;
+	opts.blockindexlen = DEFAULT_BLOCKHASH_SIZE;
+	opts.blockindex_alg = RDD_HASH_SHA256;
+	opts.deduplen = DEFAULT_DEDUP_SIZE;
+	opts.dedupmem = DEFAULT_DEDUP_MEMORY;
+	opts.checkpointlen = DEFAULT_CHECKPOINT_LEN;
+	opts.treehashleaflen = DEFAULT_TREEHASH_LEAF_SIZE;
 	opts.output_count = 0;
-	int i;
-	for (i=0; i<RDD_MAX_OUTPUT_OPTS; i++) {
-		opts.output[i].ewf = 0;
-		opts.output[i].splitlen = 0;
-		opts.output[i].outpath = 0;
-		opts.output[i].server_host = 0;
-		opts.output[i].server_port = DEFAULT_RDD_SERVER_PORT;
+	opts.output_alloc = 0;
+	opts.output = 0;
+}
+
+/* Makes room for output option set n (counting from 0) in the output
+ * options list and in the output option tables.  New entries get
+ * their default values.
+ */
+static void
+grow_output_opts(unsigned n)
+{
+	rdd_output_opt_t *output;
+	RDD_OPTION *tabs;
+	unsigned nalloc;
+	unsigned i;
+
+	if (n < opts.output_alloc) {
+		return;
+	}
+
+	nalloc = opts.output_alloc == 0 ? 4 : opts.output_alloc;
+	while (nalloc <= n) {
+		nalloc *= 2;
+	}
+
+	output = realloc(opts.output, nalloc * sizeof(rdd_output_opt_t));
+	if (output == 0) {
+		error("out of memory (%u output files)", nalloc);
 	}
+	tabs = realloc(all_output_opttabs,
+		nalloc * RDD_OUTPUT_OPTTAB_OPTION_COUNT * sizeof(RDD_OPTION));
+	if (tabs == 0) {
+		error("out of memory (%u output files)", nalloc);
+	}
+
+	for (i = opts.output_alloc; i < nalloc; i++) {
+		memset(&output[i], 0, sizeof output[i]);
+		output[i].server_port = DEFAULT_RDD_SERVER_PORT;
+	}
+	opts.output = output;
+	opts.output_alloc = nalloc;
+	all_output_opttabs = tabs;
 }
 
 
@@ -398,6 +540,42 @@ process_options()
 	}
 
 	opts.compress = rdd_opt_set(opttab, "compress");
+	if (rdd_opt_set_arg(opttab, "compress-threads", &arg)) {
+		opts.compress_parallel = 1;
+		opts.compress_threads = scan_uint(arg);
+		if (! opts.compress) {
+			error("--compress-threads requires --compress");
+		}
+	}
+	if (rdd_opt_set_arg(opttab, "compress-alg", &arg)) {
+		if (! opts.compress) {
+			error("--compress-alg requires --compress");
+		}
+		if (streq(arg, "zlib")) {
+			opts.compress_codec = 0;
+		} else if (streq(arg, "lz4")) {
+#if !defined(HAVE_LIBLZ4)
+			error("rdd not configured with LZ4 support");
+#endif
+			opts.compress_codec = RDD_NET_LZ4;
+		} else if (streq(arg, "zstd")) {
+#if !defined(HAVE_LIBZSTD)
+			error("rdd not configured with zstd support");
+#endif
+			opts.compress_codec = RDD_NET_ZSTD;
+		} else {
+			error("unknown compression algorithm %s", arg);
+		}
+	}
+	if (rdd_opt_set_arg(opttab, "compress-level", &arg)) {
+		if (opts.compress_codec != RDD_NET_ZSTD) {
+			error("--compress-level requires --compress-alg zstd");
+		}
+		opts.compress_level = (int) scan_uint(arg);
+	}
+	if (opts.compress_parallel && opts.compress_codec == RDD_NET_LZ4) {
+		error("LZ4 compression cannot use --compress-threads");
+	}
 	opts.quiet = rdd_opt_set(opttab, "quiet");
 	rdd_set_quiet(opts.quiet);
 #if !defined(HAVE_LIBZ)
@@ -423,8 +601,13 @@ process_options()
 	opts.sha256 = rdd_opt_set(opttab, "sha256");
 	opts.sha384 = rdd_opt_set(opttab, "sha384");
 	opts.sha512 = rdd_opt_set(opttab, "sha512");
+	opts.treehash = rdd_opt_set(opttab, "treehash");
 	
 	opts.force_overwrite = rdd_opt_set(opttab, "force");
+	opts.filter_threads = rdd_opt_set(opttab, "filter-threads");
+	opts.multihash = rdd_opt_set(opttab, "multihash");
+	opts.fanout = rdd_opt_set(opttab, "fan-out");
+	opts.stream_cache = rdd_opt_set(opttab, "stream-cache");
 		
 	if (rdd_opt_set_arg(opttab, "in", &arg)) {
 		opts.infile = arg;
@@ -467,6 +650,13 @@ process_options()
 				opts.output[i].outpath = arg;
 			}
 		}
+		if (rdd_opt_set(&all_output_opttabs[RDD_OUTPUT_OPTTAB_OPTION_COUNT * i], "sparse")) {
+			opts.output[i].sparse = 1;
+		}
+		if (rdd_opt_set_arg(&all_output_opttabs[RDD_OUTPUT_OPTTAB_OPTION_COUNT * i], "sparse-map", &arg)) {
+			opts.output[i].sparse = 1;
+			opts.output[i].sparsemap = arg;
+		}
 		if (opts.mode == RDD_CLIENT) {
 			if (rdd_opt_set_arg(&all_output_opttabs[RDD_OUTPUT_OPTTAB_OPTION_COUNT * i], "port", &arg)) {
 				opts.output[i].server_port = scan_tcp_port(arg);
@@ -501,6 +691,16 @@ process_options()
 			      "(use --crc32)");
 		}
 	}
+	if (rdd_opt_set_arg(opttab, "crc32c", &arg)) {
+		opts.crc32cfile = arg;
+	}
+	if (rdd_opt_set_arg(opttab, "crc32c-block-size", &arg)) {
+		opts.crc32clen = scan_size(arg, RDD_POSITIVE);
+		if (opts.crc32cfile == 0) {
+			error("missing CRC-32C output file name "
+			      "(use --crc32c)");
+		}
+	}
 	if (rdd_opt_set_arg(opttab, "histogram", &arg)) {
 		opts.histfile = arg;
 	}
@@ -521,6 +721,104 @@ process_options()
 			      "(use --block-md5)");
 		}
 	}
+	if (rdd_opt_set_arg(opttab, "block-hash", &arg)) {
+		opts.blockhashfile = arg;
+	}
+	if (rdd_opt_set_arg(opttab, "block-hash-alg", &arg)) {
+		if (rdd_hash_lookup(arg, &opts.blockhash_alg) != RDD_OK) {
+			error("unknown hash algorithm %s", arg);
+		}
+	}
+	if (rdd_opt_set_arg(opttab, "block-hash-size", &arg)) {
+		opts.blockhashlen = scan_size(arg, RDD_POSITIVE);
+		if (opts.blockhashlen > (rdd_count_t) INT_MAX) {
+			error("block-hash block size (%llu) too large",
+				opts.blockhashlen);
+		}
+	}
+	if (rdd_opt_set_arg(opttab, "block-hash-threads", &arg)) {
+		opts.blockhash_threads = scan_uint(arg);
+	}
+	if (opts.blockhashfile == 0
+	&&  (rdd_opt_set(opttab, "block-hash-alg")
+	     || rdd_opt_set(opttab, "block-hash-size")
+	     || rdd_opt_set(opttab, "block-hash-threads"))) {
+		error("missing block-hash output file name (use --block-hash)");
+	}
+	if (rdd_opt_set_arg(opttab, "block-index", &arg)) {
+		opts.blockindexfile = arg;
+	}
+	if (rdd_opt_set_arg(opttab, "block-index-alg", &arg)) {
+		if (rdd_hash_lookup(arg, &opts.blockindex_alg) != RDD_OK) {
+			error("unknown hash algorithm %s", arg);
+		}
+	}
+	if (rdd_opt_set_arg(opttab, "block-index-size", &arg)) {
+		opts.blockindexlen = scan_size(arg, RDD_POSITIVE);
+		if (opts.blockindexlen > (rdd_count_t) INT_MAX) {
+			error("block-index block size (%llu) too large",
+				opts.blockindexlen);
+		}
+	}
+	if (opts.blockindexfile == 0
+	&&  (rdd_opt_set(opttab, "block-index-alg")
+	     || rdd_opt_set(opttab, "block-index-size"))) {
+		error("missing block-index output file name (use --block-index)");
+	}
+	opts.dedup = rdd_opt_set(opttab, "dedup");
+	if (rdd_opt_set_arg(opttab, "dedup-size", &arg)) {
+		opts.deduplen = scan_size(arg, RDD_POSITIVE);
+		if (opts.deduplen > (rdd_count_t) INT_MAX) {
+			error("dedup block size (%llu) too large",
+				opts.deduplen);
+		}
+	}
+	if (rdd_opt_set_arg(opttab, "dedup-memory", &arg)) {
+		opts.dedupmem = scan_size(arg, RDD_POSITIVE);
+	}
+	if (rdd_opt_set_arg(opttab, "dedup-index", &arg)) {
+		opts.dedupindex = arg;
+		opts.dedup = 1;
+	}
+	if (rdd_opt_set_arg(opttab, "dedup-out", &arg)) {
+		opts.dedupdata = arg;
+		opts.dedup = 1;
+	}
+	if (rdd_opt_set_arg(opttab, "dedup-map", &arg)) {
+		opts.dedupmap = arg;
+		opts.dedup = 1;
+	}
+	if ((opts.dedupdata == 0) != (opts.dedupmap == 0)) {
+		error("--dedup-out and --dedup-map must be used together");
+	}
+	if (rdd_opt_set_arg(opttab, "dedup-restore", &arg)) {
+		opts.deduprestore = arg;
+		if (opts.raw || rdd_opt_set(opttab, "uring")) {
+			error("--dedup-restore cannot be combined with "
+				"--raw or --uring");
+		}
+	}
+	if (! opts.dedup
+	&&  (rdd_opt_set(opttab, "dedup-size")
+	     || rdd_opt_set(opttab, "dedup-memory"))) {
+		error("dedup options require --dedup");
+	}
+	if (rdd_opt_set_arg(opttab, "treehash-leaf-size", &arg)) {
+		opts.treehashleaflen = scan_size(arg, RDD_POSITIVE);
+		if (opts.treehashleaflen > (rdd_count_t) INT_MAX) {
+			error("tree-hash leaf size (%llu) too large",
+				opts.treehashleaflen);
+		}
+		if (!opts.treehash) {
+			error("--treehash-leaf-size requires --treehash");
+		}
+	}
+	if (rdd_opt_set_arg(opttab, "treehash-threads", &arg)) {
+		opts.treehash_threads = scan_uint(arg);
+		if (!opts.treehash) {
+			error("--treehash-threads requires --treehash");
+		}
+	}
 	if (rdd_opt_set_arg(opttab, "progress", &arg)) {
 		opts.progresslen = scan_uint(arg);
 	}
@@ -542,6 +840,71 @@ process_options()
 	if (rdd_opt_set_arg(opttab, "max-read-err", &arg)) {
 		opts.max_read_err = scan_uint(arg);
 	}
+	if (rdd_opt_set_arg(opttab, "pipeline", &arg)) {
+		opts.pipeline = scan_uint(arg);
+		if (opts.pipeline < 2) {
+			error("pipeline length (%u) must be at least 2",
+				opts.pipeline);
+		}
+	}
+	if (rdd_opt_set_arg(opttab, "uring", &arg)) {
+		opts.uring_depth = scan_uint(arg);
+		if (opts.uring_depth < 1) {
+			error("io_uring queue depth must be at least 1");
+		}
+	}
+	if (rdd_opt_set_arg(opttab, "write-behind", &arg)) {
+		opts.write_behind = scan_size(arg, RDD_POSITIVE);
+		if (opts.write_behind >= (rdd_count_t) INT_MAX) {
+			error("write-behind queue size (%llu) too large",
+				opts.write_behind);
+		}
+	}
+	if (rdd_opt_set_arg(opttab, "region-threads", &arg)) {
+		opts.region_threads = scan_uint(arg);
+		if (opts.region_threads < 1) {
+			error("number of region threads must be at least 1");
+		}
+		if (opts.pipeline > 0) {
+			error("--region-threads cannot be combined with --pipeline");
+		}
+	}
+	if (rdd_opt_set_arg(opttab, "rescue-map", &arg)) {
+		opts.rescue_map = arg;
+		if (opts.pipeline > 0 || opts.region_threads > 0) {
+			error("--rescue-map cannot be combined with --pipeline "
+				"or --region-threads");
+		}
+		/* The outputs of an interrupted rescue exist but hold no
+		 * data yet; the resumed rescue writes them from scratch.
+		 */
+		opts.rescue_resume = access(arg, F_OK) == 0;
+	}
+	if (rdd_opt_set_arg(opttab, "checkpoint", &arg)) {
+		opts.checkpoint = arg;
+		if (opts.region_threads > 0 || opts.rescue_map != 0) {
+			error("--checkpoint cannot be combined with "
+				"--region-threads or --rescue-map");
+		}
+		if (opts.dedup) {
+			error("--checkpoint cannot be combined with --dedup");
+		}
+		/* The block index keeps a running digest of the current
+		 * block, which only the low-level routines can save.
+		 */
+		if (opts.blockindexfile != 0
+		&&  ! rdd_hash_has_legacy(opts.blockindex_alg)) {
+			error("--checkpoint cannot be combined with a %s "
+				"block index", rdd_hash_name(opts.blockindex_alg));
+		}
+	}
+	if (rdd_opt_set_arg(opttab, "checkpoint-interval", &arg)) {
+		opts.checkpointlen = scan_size(arg, RDD_POSITIVE);
+	}
+	opts.resume = rdd_opt_set(opttab, "resume");
+	if (opts.resume && opts.checkpoint == 0) {
+		error("--resume requires --checkpoint");
+	}
 	if (rdd_opt_set_arg(opttab, "port", &arg)) {
 		if (opts.mode == RDD_SERVER) {
 			opts.server_port = scan_tcp_port(arg);
@@ -599,9 +962,8 @@ command_line(int argc, char **argv)
 		} else {
 
 			if (!strcmp(od->long_name, "--out")) {
-				if (od->count > RDD_MAX_OUTPUT_OPTS) {
-					error("too many output files specified; maximum is %d", RDD_MAX_OUTPUT_OPTS);
-				}
+				grow_output_opts(od->count - 1);
+
 				/* Start of parse for output file;
 				   copy the output_opttab table to the right position in the all_output_opttabs table */
 
@@ -659,19 +1021,50 @@ command_line(int argc, char **argv)
 		if (compare_paths(opts.infile, opts.output[i].outpath) == 0) {
 			error("input and output file cannot be the same (output #%d)", i);
 		}
+		if (opts.output[i].sparse && opts.output[i].ewf) {
+			error("--sparse cannot be combined with --ewf in output #%d", i);
+		}
+		if (opts.output[i].sparsemap != 0 && opts.checkpoint != 0) {
+			error("--sparse-map cannot be combined with --checkpoint in output #%d", i);
+		}
 	}
 }
 
 static RDD_READER *
-open_disk_input(rdd_count_t *inputlen)
+open_file_input(rdd_count_t *inputlen)
 {
 	RDD_READER *reader = 0;
+	unsigned chunklen;
 	int rc;
 
-	rc = rdd_open_file_reader(&reader, opts.infile, opts.raw);
+	rc = RDD_EOPEN;
+	if (opts.uring_depth > 0) {
+		chunklen = (unsigned) opts.blocklen;
+		if (chunklen % RDD_SECTOR_SIZE != 0) {
+			chunklen += RDD_SECTOR_SIZE - chunklen % RDD_SECTOR_SIZE;
+		}
+		rc = rdd_open_uring_reader(&reader, opts.infile, opts.raw,
+					opts.uring_depth, chunklen);
+		if (rc != RDD_OK) {
+			logmsg("cannot use io_uring on %s; "
+				"falling back to ordinary reads", opts.infile);
+		}
+	}
+	if (rc != RDD_OK) {
+		rc = rdd_open_file_reader(&reader, opts.infile, opts.raw);
+	}
 	if (rc != RDD_OK) {
 		fatal_rdd_error(rc, "cannot open %s", opts.infile);
 	}
+	if (opts.stream_cache) {
+		rc = rdd_reader_stream(reader);
+		if (rc == RDD_NOTFOUND) {
+			logmsg("Warning: cannot stream %s through the page cache",
+				opts.infile);
+		} else if (rc != RDD_OK) {
+			fatal_rdd_error(rc, "cannot stream %s", opts.infile);
+		}
+	}
 	if ((rc = rdd_reader_seek(reader, 0)) != RDD_OK) {
 		fatal_rdd_error(rc, "cannot seek on %s", opts.infile);
 	}
@@ -689,6 +1082,41 @@ open_disk_input(rdd_count_t *inputlen)
 		fatal_rdd_error(rc, "%s: cannot determine device size", opts.infile);
 	}
 
+	return reader;
+}
+
+/* Opens the dedup image whose data file is the input file.  The
+ * image size is only known to the reader, so the input length is
+ * left open; the copy stops at the end of the image.
+ */
+static RDD_READER *
+open_dedup_input(rdd_count_t *inputlen)
+{
+	RDD_READER *reader = 0;
+	int rc;
+
+	rc = rdd_open_dedup_reader(&reader, opts.infile, opts.deduprestore);
+	if (rc != RDD_OK) {
+		fatal_rdd_error(rc, "cannot open dedup image %s (map %s)",
+				opts.infile, opts.deduprestore);
+	}
+
+	*inputlen = RDD_WHOLE_FILE;
+	return reader;
+}
+
+static RDD_READER *
+open_disk_input(rdd_count_t *inputlen)
+{
+	RDD_READER *reader = 0;
+	int rc;
+
+	if (opts.deduprestore != 0) {
+		reader = open_dedup_input(inputlen);
+	} else {
+		reader = open_file_input(inputlen);
+	}
+
 	if (opts.simfile != 0) {
 		rc = rdd_open_faulty_reader(&reader, reader, opts.simfile);
 		if (rc != RDD_OK) {
@@ -736,7 +1164,9 @@ open_net_input(rdd_count_t *inputlen)
 	 * For each output file, receive parameters. Do this until an empty file name is received.
 	 */
 	int compress = 0; /* compression will take place if at least one such flag has been received */
+	unsigned codec = 0; /* RDD_NET_LZ4 or RDD_NET_ZSTD; 0 means zlib */
 	rdd_output_opt_t current_output_opt;
+	memset(&current_output_opt, 0, sizeof current_output_opt);
 	current_output_opt.outpath = "init"; /* to make while condition succeed the first time */
 	rdd_count_t current_blocklen;	// blocklen may be transmitted multiple times but should be the same each time
 	rdd_count_t current_inputlen;	// inputlen may be transmitted multiple times but should be the same each time
@@ -746,14 +1176,20 @@ open_net_input(rdd_count_t *inputlen)
 		if (rc != RDD_OK) {
 			fatal_rdd_error(rc, "bad client request");
 		}
+		/* A flag that this server does not know would change how
+		 * the stream must be read, so refuse it.
+		 */
+		if ((flags & ~RDD_NET_KNOWN_FLAGS) != 0) {
+			fatal_rdd_error(RDD_ESYNTAX,
+				"bad client request (unknown flags 0x%x)", flags);
+		}
 		if (current_output_opt.outpath[0] != '\0') {
-			if (opts.output_count + 1 >= RDD_MAX_OUTPUT_OPTS) {
-				error("received too many output file requests");
-			}
+			grow_output_opts(opts.output_count);
 			opts.output[opts.output_count] = current_output_opt;
 			opts.blocklen = current_blocklen;
 			if ((flags & RDD_NET_COMPRESS) != 0) {
 				compress = 1;
+				codec = flags & (RDD_NET_LZ4|RDD_NET_ZSTD);
 			}
 			*inputlen = current_inputlen;
 			++opts.output_count;
@@ -774,8 +1210,21 @@ open_net_input(rdd_count_t *inputlen)
 	}
 
 	if (compress) {
-		if ((rc = rdd_open_zlib_reader(&reader, reader)) != RDD_OK) {
-			fatal_rdd_error(rc, "cannot open zlib reader");
+		if (opts.verbose) {
+			logmsg("\tcompression: %s", compress_alg_name(codec));
+		}
+		if (codec == RDD_NET_LZ4) {
+			rc = rdd_open_lz4_reader(&reader, reader);
+		} else if (codec == RDD_NET_ZSTD) {
+			rc = rdd_open_zstd_reader(&reader, reader);
+		} else if (codec == 0) {
+			rc = rdd_open_zlib_reader(&reader, reader);
+		} else {
+			rc = RDD_ECOMPRESS;
+		}
+		if (rc != RDD_OK) {
+			fatal_rdd_error(rc, "cannot open %s reader",
+					compress_alg_name(codec));
 		}
 	}
 
@@ -807,17 +1256,31 @@ open_disk_output(rdd_count_t outputsize, RDD_HASH_CONTAINER * hashcontainer, int
 		return 0;
 	}
 
-	wrmode = (opts.force_overwrite ? RDD_OVERWRITE_ASK : RDD_NO_OVERWRITE);
+	if (opts.resume) {
+		wrmode = RDD_RESUME;
+	} else if (opts.rescue_resume) {
+		wrmode = RDD_OVERWRITE;
+	} else if (opts.force_overwrite) {
+		wrmode = RDD_OVERWRITE_ASK;
+	} else {
+		wrmode = RDD_NO_OVERWRITE;
+	}
 
 	if (strcmp(output_opts->outpath, "-") == 0) {
 		if (output_opts->splitlen > 0) {
 			error("cannot split standard output stream");
 		}
+		if (opts.checkpoint != 0) {
+			error("cannot checkpoint a copy to standard output");
+		}
 		rc = rdd_open_fd_writer(&writer, STDOUT_FILENO);
 		if (rc != RDD_OK) {
 			fatal_rdd_error(rc, "cannot write to standard output?");
 		}
 	} else if (output_opts->ewf) {
+		if (opts.checkpoint != 0) {
+			error("cannot checkpoint a copy to an ewf file");
+		}
 		if (opts.sha256) {
 			logmsg("Warning: cannot store SHA256 hash in ewf file");
 		}
@@ -833,8 +1296,10 @@ open_disk_output(rdd_count_t outputsize, RDD_HASH_CONTAINER * hashcontainer, int
 					output_opts->outpath);
 		}
 	} else if (output_opts->splitlen > 0) {
+		/* Allocating the parts would defeat sparse output. */
 		rc = rdd_open_part_writer(&writer, output_opts->outpath,
-				outputsize, output_opts->splitlen, wrmode);
+				outputsize, output_opts->splitlen, wrmode,
+				! output_opts->sparse);
 		if (rc != RDD_OK) {
 			fatal_rdd_error(rc, "cannot open multipart output file");
 		}
@@ -846,6 +1311,27 @@ open_disk_output(rdd_count_t outputsize, RDD_HASH_CONTAINER * hashcontainer, int
 		}
 	}
 
+	if (opts.stream_cache) {
+		rc = rdd_writer_stream(writer);
+		if (rc == RDD_NOTFOUND) {
+			logmsg("Warning: cannot stream %s through the page cache",
+				output_opts->outpath);
+		} else if (rc != RDD_OK) {
+			fatal_rdd_error(rc, "cannot stream %s",
+					output_opts->outpath);
+		}
+	}
+
+	if (output_opts->sparse) {
+		rc = rdd_open_sparse_writer(&writer, writer,
+				output_opts->sparsemap,
+				opts.force_overwrite || opts.rescue_resume);
+		if (rc != RDD_OK) {
+			fatal_rdd_error(rc, "cannot open sparse output for %s",
+					output_opts->outpath);
+		}
+	}
+
 	return writer;
 }
 
@@ -946,7 +1432,11 @@ open_net_output(rdd_count_t outputsize, RDD_WRITER * tcp_writer_list[], int * nu
 	/**
 	 * Send output parameters.
 	 */
-	flags = (opts.compress ? RDD_NET_COMPRESS : 0);
+	/* An LZ4 or zstd stream also carries RDD_NET_COMPRESS, so that
+	 * a server that does not know the codec fails to decompress it
+	 * instead of storing compressed data.
+	 */
+	flags = (opts.compress ? RDD_NET_COMPRESS | opts.compress_codec : 0);
 
 	rc = rdd_send_info(writer, opts.output[output_number].outpath, outputsize,
 			opts.blocklen, opts.output[output_number].splitlen, opts.output[output_number].ewf, flags);
@@ -959,7 +1449,20 @@ open_net_output(rdd_count_t outputsize, RDD_WRITER * tcp_writer_list[], int * nu
 		if (opts.compress) {
 			/* Stack a zlib writer on top of the TCP writer.
 			*/
-			rc = rdd_open_zlib_writer(&writer, writer);
+			if (opts.compress_codec == RDD_NET_LZ4) {
+				rc = rdd_open_lz4_writer(&writer, writer);
+			} else if (opts.compress_codec == RDD_NET_ZSTD) {
+				rc = rdd_open_zstd_writer(&writer, writer,
+						opts.compress_level,
+						! opts.compress_parallel ? 0
+						: opts.compress_threads > 0 ? opts.compress_threads
+						: rdd_ncpu());
+			} else if (opts.compress_parallel) {
+				rc = rdd_open_pzlib_writer(&writer, writer,
+						opts.compress_threads);
+			} else {
+				rc = rdd_open_zlib_writer(&writer, writer);
+			}
 
 			if (rc != RDD_OK) {
 				fatal_rdd_error(rc, "cannot compress network traffic "
@@ -1110,13 +1613,32 @@ log_params(rdd_copy_opts *opts)
 		logmsg("\toutput as ewf compression: %s", print_ewf_compress_option());
 		logmsg("\toutput host: %s",		opts->output[i].server_host);
 		logmsg("\toutput port: %u",		opts->output[i].server_port);
+		logmsg("\tsparse output: %s",		bool2str(opts->output[i].sparse));
+		logmsg("\tsparse map file: %s",	str2str(opts->output[i].sparsemap));
 	}
 	logmsg("CRC32 file: %s",              str2str(opts->crc32file));
+	logmsg("CRC32C file: %s",             str2str(opts->crc32cfile));
 	logmsg("Adler32 file: %s",            str2str(opts->adler32file));
 	logmsg("Statistics file: %s",         str2str(opts->histfile));
 	logmsg("Block MD5 file: %s",          str2str(opts->blockmd5file));
+	logmsg("Block hash file: %s",         str2str(opts->blockhashfile));
+	logmsg("Block index file: %s",        str2str(opts->blockindexfile));
+	logmsg("dedup: %s",                   bool2str(opts->dedup));
+	logmsg("dedup index file: %s",        str2str(opts->dedupindex));
+	logmsg("dedup data file: %s",         str2str(opts->dedupdata));
+	logmsg("dedup map file: %s",          str2str(opts->dedupmap));
+	logmsg("dedup restore map file: %s",  str2str(opts->deduprestore));
 	logmsg("raw-device input: %s",        bool2str(opts->raw));
 	logmsg("compress network data: %s",   bool2str(opts->compress));
+	if (opts->compress) {
+		logmsg("compression algorithm: %s",   compress_alg_name(opts->compress_codec));
+	}
+	if (opts->compress_codec == RDD_NET_ZSTD) {
+		logmsg("compression level: %d",       opts->compress_level);
+	}
+	if (opts->compress_parallel) {
+		logmsg("compression threads: %u",     opts->compress_threads);
+	}
 	logmsg("use (x)inetd: %s",            bool2str(opts->inetd));
 	logmsg("force overwrite: %s",         bool2str(opts->force_overwrite));
 	logmsg("compute MD5: %s",             bool2str(opts->md5));
@@ -1124,17 +1646,40 @@ log_params(rdd_copy_opts *opts)
 	logmsg("compute SHA256: %s",          bool2str(opts->sha256));
 	logmsg("compute SHA384: %s",          bool2str(opts->sha384));
 	logmsg("compute SHA512: %s",          bool2str(opts->sha512));
+	logmsg("compute tree hash: %s",       bool2str(opts->treehash));
+	logmsg("tree-hash leaf size: %llu",   opts->treehashleaflen);
+	logmsg("tree-hash threads: %u",       opts->treehash_threads);
 	logmsg("max #retries: %u",            opts->nretry);
 	logmsg("block size: %llu",            opts->blocklen);
 	logmsg("minimum block size: %llu",    opts->minblocklen);
 	logmsg("Adler32 block size: %llu",    opts->adler32len);
 	logmsg("CRC32 block size: %llu",      opts->crc32len);
+	logmsg("CRC32C block size: %llu",     opts->crc32clen);
 	logmsg("statistics block size: %llu", opts->histblocklen);
 	logmsg("MD5 block size: %llu",        opts->blockmd5len);
+	logmsg("block hash algorithm: %s",    rdd_hash_name(opts->blockhash_alg));
+	logmsg("block hash block size: %llu", opts->blockhashlen);
+	logmsg("block hash threads: %u",      opts->blockhash_threads);
+	logmsg("block index algorithm: %s",   rdd_hash_name(opts->blockindex_alg));
+	logmsg("block index block size: %llu", opts->blockindexlen);
+	logmsg("dedup block size: %llu",      opts->deduplen);
+	logmsg("dedup table size: %llu",      opts->dedupmem);
 	logmsg("input offset: %llu",          opts->offset);
 	logmsg("input count: %llu",           opts->count);
 	logmsg("progress reporting interval: %llu", opts->progresslen);
 	logmsg("max #errors to tolerate: %llu",     opts->max_read_err);
+	logmsg("pipeline length: %u",         opts->pipeline);
+	logmsg("filter threads: %s",          bool2str(opts->filter_threads));
+	logmsg("multihash: %s",               bool2str(opts->multihash));
+	logmsg("io_uring queue depth: %u",    opts->uring_depth);
+	logmsg("write-behind queue size: %llu", opts->write_behind);
+	logmsg("fan-out: %s",                 bool2str(opts->fanout));
+	logmsg("streaming page cache: %s",    bool2str(opts->stream_cache));
+	logmsg("region threads: %u",          opts->region_threads);
+	logmsg("rescue map: %s",              opts->rescue_map == 0 ? "none" : opts->rescue_map);
+	logmsg("checkpoint file: %s",         opts->checkpoint == 0 ? "none" : opts->checkpoint);
+	logmsg("checkpoint interval: %llu",   opts->checkpointlen);
+	logmsg("resume: %s",                  bool2str(opts->resume));
 	logmsg("========================================");
 	logmsg("");
 }
@@ -1165,6 +1710,9 @@ handle_progress(rdd_count_t pos, rdd_count_t nsubst, void *env)
 
 	int rc;
 
+	pos += resume_point.copied.nbyte;
+	nsubst += resume_point.copied.nlost;
+
 	if ((rc = rdd_progress_update(p, pos, nsubst)) != RDD_OK) {
 		fatal_rdd_error(rc, "cannot update progress object");
 	}
@@ -1222,6 +1770,49 @@ handle_progress(rdd_count_t pos, rdd_count_t nsubst, void *env)
 	return RDD_OK;
 }
 
+static int
+handle_checkpoint(RDD_COPIER_RETURN *state, void *env)
+{
+	RDD_FILTERSET *fset = (RDD_FILTERSET *) env;
+	RDD_CHECKPOINT cp = resume_point;
+	int rc;
+
+	cp.copied.nbyte += state->nbyte;
+	cp.copied.nlost += state->nlost;
+	cp.copied.nread_err += state->nread_err;
+	cp.copied.nsubst += state->nsubst;
+
+	if ((rc = rdd_checkpoint_save(opts.checkpoint, &cp, fset)) != RDD_OK) {
+		fatal_rdd_error(rc, "cannot save checkpoint %s", opts.checkpoint);
+	}
+	if (opts.verbose) {
+		logmsg("checkpoint at %llu bytes",
+			(unsigned long long) cp.copied.nbyte);
+	}
+	return RDD_OK;
+}
+
+static void
+load_checkpoint(RDD_FILTERSET *fset)
+{
+	int rc;
+
+	rc = rdd_checkpoint_load(opts.checkpoint, &resume_point, fset);
+	if (rc == RDD_NOTFOUND) {
+		error("checkpoint file %s not found", opts.checkpoint);
+	} else if (rc != RDD_OK) {
+		fatal_rdd_error(rc, "cannot resume from checkpoint %s",
+				opts.checkpoint);
+	}
+	if (resume_point.offset != opts.offset) {
+		error("checkpoint %s was made with offset %llu",
+			opts.checkpoint,
+			(unsigned long long) resume_point.offset);
+	}
+	logmsg("resuming at %llu bytes", 
+		(unsigned long long) resume_point.copied.nbyte);
+}
+
 static void
 add_filter(RDD_FILTERSET *fset, const char *name, RDD_FILTER *f)
 {
@@ -1232,12 +1823,101 @@ add_filter(RDD_FILTERSET *fset, const char *name, RDD_FILTER *f)
 	}
 }
 
+/* Returns the set of stream digests that the user asked for.
+ */
+static unsigned
+hash_algs(void)
+{
+	unsigned algs = 0;
+
+	if (opts.md5)    algs |= RDD_MULTIHASH_MD5;
+	if (opts.sha1)   algs |= RDD_MULTIHASH_SHA1;
+	if (opts.sha256) algs |= RDD_MULTIHASH_SHA256;
+	if (opts.sha384) algs |= RDD_MULTIHASH_SHA384;
+	if (opts.sha512) algs |= RDD_MULTIHASH_SHA512;
+	return algs;
+}
+
+/* Logs the checksum kernel that is used for each block checksum.
+ */
+static void
+log_checksum_impls(void)
+{
+	int i;
+
+	if (opts.adler32file != 0) {
+		logmsg("Adler32 implementation: %s",
+			rdd_checksum_impl_name(RDD_ADLER32));
+	}
+	if (opts.crc32file != 0) {
+		logmsg("CRC32 implementation: %s",
+			rdd_checksum_impl_name(RDD_CRC32));
+	}
+	if (opts.crc32cfile != 0) {
+		logmsg("CRC32C implementation: %s",
+			rdd_checksum_impl_name(RDD_CRC32C));
+	}
+	for (i = 0; i < opts.output_count; i++) {
+		if (opts.output[i].sparse) {
+			logmsg("zero-block detection: %s",
+				rdd_is_zero_impl_name());
+			break;
+		}
+	}
+}
+
+/* Logs the hash implementation that is used for each digest.
+ */
+static void
+log_hash_engines(void)
+{
+	unsigned algs = hash_algs();
+	unsigned alg;
+
+	if (opts.blockmd5file != 0) {
+		algs |= RDD_MULTIHASH_MD5;
+	}
+	if (opts.blockhashfile != 0) {
+		algs |= 1u << opts.blockhash_alg;
+	}
+	if (opts.blockindexfile != 0) {
+		algs |= 1u << opts.blockindex_alg;
+	}
+	if (opts.dedup) {
+		algs |= 1u << RDD_HASH_SHA256;
+	}
+	for (alg = 0; alg < RDD_HASH_NALG; alg++) {
+		if (algs & (1u << alg)) {
+			logmsg("%s engine: %s", rdd_hash_name(alg),
+				rdd_hash_engine_name((rdd_hash_alg_t) alg));
+		}
+	}
+}
+
+/* Computes all digests in a single filter if --multihash asks for it
+ * and there is more than one, unless each filter runs in its own
+ * thread anyway.
+ */
+static int
+use_multihash(void)
+{
+	unsigned algs = hash_algs();
+
+	return opts.multihash && !opts.filter_threads
+		&& (algs & (algs - 1)) != 0;
+}
+
 static void
 install_filters(RDD_FILTERSET *fset, RDD_WRITER * writers[])
 {
 	RDD_FILTER *f = 0;
 	int rc;
 	char writer_name[16];
+	int ovwmode = (opts.resume ? RDD_RESUME : opts.force_overwrite);
+
+	if (opts.rescue_resume) {
+		ovwmode = RDD_OVERWRITE;
+	}
 
 	if ((rc = rdd_fset_init(fset)) != RDD_OK) {
 		fatal_rdd_error(rc, "cannot create filter fset");
@@ -1258,60 +1938,114 @@ install_filters(RDD_FILTERSET *fset, RDD_WRITER * writers[])
 		}
 	}
 
-	if (opts.md5) {
-		rc = rdd_new_md5_streamfilter(&f);
+	if (use_multihash()) {
+		rc = rdd_new_multihash_streamfilter(&f, hash_algs());
 		if (rc != RDD_OK) {
-			fatal_rdd_error(rc, "cannot create MD5 filter");
+			fatal_rdd_error(rc, "cannot create multihash filter");
+		}
+		add_filter(fset, "multihash stream", f);
+	} else {
+		if (opts.md5) {
+			rc = rdd_new_md5_streamfilter(&f);
+			if (rc != RDD_OK) {
+				fatal_rdd_error(rc, "cannot create MD5 filter");
+			}
+			add_filter(fset, "MD5 stream", f);
 		}
-		add_filter(fset, "MD5 stream", f);
-	}
 
-	if (opts.sha1) {
-		rc = rdd_new_sha1_streamfilter(&f);
-		if (rc != RDD_OK) {
-			fatal_rdd_error(rc, "cannot create SHA-1 filter");
+		if (opts.sha1) {
+			rc = rdd_new_sha1_streamfilter(&f);
+			if (rc != RDD_OK) {
+				fatal_rdd_error(rc, "cannot create SHA-1 filter");
+			}
+			add_filter(fset, "SHA-1 stream", f);
 		}
-		add_filter(fset, "SHA-1 stream", f);
-	}
 	
-	if (opts.sha256) {
-		rc = rdd_new_sha256_streamfilter(&f);
-		if (rc != RDD_OK) {
-			fatal_rdd_error(rc, "cannot create SHA-256 filter");
+		if (opts.sha256) {
+			rc = rdd_new_sha256_streamfilter(&f);
+			if (rc != RDD_OK) {
+				fatal_rdd_error(rc, "cannot create SHA-256 filter");
+			}
+			add_filter(fset, "SHA-256 stream", f);
 		}
-		add_filter(fset, "SHA-256 stream", f);
-	}
 	
-	if (opts.sha384) {
-		rc = rdd_new_sha384_streamfilter(&f);
-		if (rc != RDD_OK) {
-			fatal_rdd_error(rc, "cannot create SHA-384 filter");
+		if (opts.sha384) {
+			rc = rdd_new_sha384_streamfilter(&f);
+			if (rc != RDD_OK) {
+				fatal_rdd_error(rc, "cannot create SHA-384 filter");
+			}
+			add_filter(fset, "SHA-384 stream", f);
 		}
-		add_filter(fset, "SHA-384 stream", f);
-	}
 	
-	if (opts.sha512) {
-		rc = rdd_new_sha512_streamfilter(&f);
+		if (opts.sha512) {
+			rc = rdd_new_sha512_streamfilter(&f);
+			if (rc != RDD_OK) {
+				fatal_rdd_error(rc, "cannot create SHA-512 filter");
+			}
+			add_filter(fset, "SHA-512 stream", f);
+		}
+	}
+
+	if (opts.treehash) {
+		rc = rdd_new_treehash_streamfilter(&f,
+				(unsigned) opts.treehashleaflen,
+				opts.treehash_threads);
 		if (rc != RDD_OK) {
-			fatal_rdd_error(rc, "cannot create SHA-512 filter");
+			fatal_rdd_error(rc, "cannot create tree-hash filter");
 		}
-		add_filter(fset, "SHA-512 stream", f);
+		add_filter(fset, "tree hash stream", f);
 	}
 
 	if (opts.blockmd5file != 0) {
 		rc = rdd_new_md5_blockfilter(&f, opts.blockmd5len,
 						opts.blockmd5file,
-						opts.force_overwrite);
+						ovwmode);
 		if (rc != RDD_OK) {
 			fatal_rdd_error(rc, "cannot create MD5 block filter");
 		}
 		add_filter(fset, "MD5 block", f);
 	}
 
+	if (opts.blockhashfile != 0) {
+		rc = rdd_new_hash_blockfilter(&f, opts.blockhash_alg,
+						(unsigned) opts.blockhashlen,
+						opts.blockhash_threads,
+						opts.blockhashfile,
+						ovwmode);
+		if (rc != RDD_OK) {
+			fatal_rdd_error(rc, "cannot create %s block filter",
+					rdd_hash_name(opts.blockhash_alg));
+		}
+		add_filter(fset, "hash block", f);
+	}
+
+	if (opts.blockindexfile != 0) {
+		rc = rdd_new_blockindex_filter(&f, opts.blockindex_alg,
+						(unsigned) opts.blockindexlen,
+						opts.offset,
+						opts.blockindexfile,
+						ovwmode);
+		if (rc != RDD_OK) {
+			fatal_rdd_error(rc, "cannot create block-index filter");
+		}
+		add_filter(fset, "block index", f);
+	}
+
+	if (opts.dedup) {
+		rc = rdd_new_dedup_blockfilter(&f, (unsigned) opts.deduplen,
+						opts.dedupmem, opts.dedupindex,
+						opts.dedupdata, opts.dedupmap,
+						ovwmode);
+		if (rc != RDD_OK) {
+			fatal_rdd_error(rc, "cannot create dedup filter");
+		}
+		add_filter(fset, "dedup block", f);
+	}
+
 	if (opts.histfile != 0) {
 		rc = rdd_new_stats_blockfilter(&f,
 				opts.histblocklen, opts.histfile,
-				opts.force_overwrite);
+				ovwmode);
 		if (rc != RDD_OK) {
 			fatal_rdd_error(rc, "cannot create statistics filter");
 		}
@@ -1321,7 +2055,7 @@ install_filters(RDD_FILTERSET *fset, RDD_WRITER * writers[])
 	if (opts.adler32file != 0) {
 		rc = rdd_new_adler32_blockfilter(&f,
 				opts.adler32len, opts.adler32file,
-				opts.force_overwrite);
+				ovwmode);
 		if (rc != RDD_OK) {
 			fatal_rdd_error(rc, "cannot create Adler32 filter");
 		}
@@ -1331,19 +2065,39 @@ install_filters(RDD_FILTERSET *fset, RDD_WRITER * writers[])
 	if (opts.crc32file != 0) {
 		rc = rdd_new_crc32_blockfilter(&f,
 				opts.crc32len, opts.crc32file,
-				opts.force_overwrite);
+				ovwmode);
 		if (rc != RDD_OK) {
 			fatal_rdd_error(rc, "cannot create CRC-32 filter");
 		}
 		add_filter(fset, "CRC-32 block", f);
 	}
+
+	if (opts.crc32cfile != 0) {
+		rc = rdd_new_crc32c_blockfilter(&f,
+				opts.crc32clen, opts.crc32cfile,
+				ovwmode);
+		if (rc != RDD_OK) {
+			fatal_rdd_error(rc, "cannot create CRC-32C filter");
+		}
+		add_filter(fset, "CRC-32C block", f);
+	}
+
+	if (opts.filter_threads) {
+		rc = rdd_fset_set_parallel(fset, DEFAULT_FILTER_NBUF,
+				(unsigned) opts.blocklen);
+		if (rc != RDD_OK) {
+			fatal_rdd_error(rc, "cannot start filter threads");
+		}
+	}
 }
 
 static RDD_COPIER *
-create_copier(rdd_count_t input_size, RDD_PROGRESS *progress)
+create_copier(rdd_count_t input_size, RDD_PROGRESS *progress,
+		RDD_FILTERSET *fset)
 {
 	RDD_COPIER *copier = 0;
 	rdd_count_t count = 0;
+	rdd_count_t offset = opts.offset;
 	int rc;
 
 	/* Process the offset option.
@@ -1372,6 +2126,23 @@ create_copier(rdd_count_t input_size, RDD_PROGRESS *progress)
 		logmsg("read size: %s", rdd_strsize(count));
 	}
 
+	/* When resuming, skip the part that was copied before the
+	 * checkpoint.
+	 */
+	if (opts.resume) {
+		if (resume_point.count != count) {
+			error("checkpoint %s was made with a different "
+				"input size or count", opts.checkpoint);
+		}
+		offset += resume_point.copied.nbyte;
+		if (count != RDD_WHOLE_FILE) {
+			count -= resume_point.copied.nbyte;
+		}
+	} else {
+		memset(&resume_point, 0, sizeof resume_point);
+		resume_point.offset = opts.offset;
+		resume_point.count = count;
+	}
 
 	if (opts.mode == RDD_SERVER) {
 		RDD_SIMPLE_PARAMS p;
@@ -1400,20 +2171,89 @@ create_copier(rdd_count_t input_size, RDD_PROGRESS *progress)
 			p.progressfun = handle_progress;
 			p.progressenv = progress;
 		}
+		if (opts.checkpoint != 0) {
+			p.checkpointfun = handle_checkpoint;
+			p.checkpointenv = fset;
+			p.checkpointlen = opts.checkpointlen;
+		}
 
-		rc = rdd_new_robust_copier(&copier,
-				opts.offset, count, &p);
-		if (rc != RDD_OK) {
-			fatal_rdd_error(rc, "cannot create robust copier");
+		if (opts.region_threads > 0 && count == RDD_WHOLE_FILE) {
+			logmsg("input size unknown; reading with a single thread");
+		}
+		if (opts.rescue_map != 0) {
+			if (count == RDD_WHOLE_FILE) {
+				error("--rescue-map requires a known input size; "
+					"use --count");
+			}
+			if (opts.rescue_resume) {
+				logmsg("rescue map %s exists; the output files "
+					"are overwritten", opts.rescue_map);
+			}
+			rc = rdd_new_rescue_copier(&copier,
+					opts.offset, count, &p, opts.rescue_map);
+			if (rc != RDD_OK) {
+				fatal_rdd_error(rc, "cannot create rescue copier");
+			}
+		} else if (opts.region_threads > 0 && count != RDD_WHOLE_FILE) {
+			rc = rdd_new_region_copier(&copier,
+					opts.offset, count, &p,
+					opts.region_threads,
+					REGION_STRIPE_BLOCKS * p.maxblocklen);
+			if (rc != RDD_OK) {
+				fatal_rdd_error(rc, "cannot create region copier");
+			}
+		} else if (opts.pipeline > 0) {
+			rc = rdd_new_pipelined_copier(&copier,
+					offset, count, &p, opts.pipeline);
+			if (rc != RDD_OK) {
+				fatal_rdd_error(rc, "cannot create pipelined copier");
+			}
+		} else {
+			rc = rdd_new_robust_copier(&copier,
+					offset, count, &p);
+			if (rc != RDD_OK) {
+				fatal_rdd_error(rc, "cannot create robust copier");
+			}
 		}
 	}
 
 	return copier;
 }
 
+static void
+report_dedup(RDD_FILTERSET *fset)
+{
+	RDD_DEDUP_STATS stats;
+	RDD_FILTER *f = 0;
+	double pct;
+	int rc;
+
+	if ((rc = rdd_fset_get(fset, "dedup block", &f)) != RDD_OK) {
+		fatal_rdd_error(rc, "cannot find dedup filter");
+	}
+	rc = rdd_filter_get_result(f, (unsigned char *) &stats, sizeof stats);
+	if (rc != RDD_OK) {
+		fatal_rdd_error(rc, "cannot get dedup statistics");
+	}
+
+	pct = stats.nblock > 0 ?
+		100.0 * (stats.nduplicate + stats.nknown) / stats.nblock : 0.0;
+	logmsg("dedup blocks: %llu", stats.nblock);
+	logmsg("dedup unique blocks: %llu", stats.nunique);
+	logmsg("dedup duplicate blocks: %llu", stats.nduplicate);
+	logmsg("dedup blocks found in index: %llu", stats.nknown);
+	logmsg("dedup ratio: %.1f%% of the blocks are duplicates", pct);
+	if (stats.nuntracked > 0) {
+		logmsg("dedup table full: %llu blocks were not tracked "
+			"(table holds %llu blocks)",
+			stats.nuntracked, stats.capacity);
+	}
+}
+
 static void
 process_hash_result(RDD_FILTERSET *fset, const char *hash_name,
-		const char *filter_name, unsigned mdsize, RDD_HASH_CONTAINER * hashcontainer)
+		const char *filter_name, unsigned alg, unsigned mdsize,
+		RDD_HASH_CONTAINER * hashcontainer)
 {
 	unsigned char md[RDD_MAX_DIGEST_LENGTH];
 	char hexdigest[2*RDD_MAX_DIGEST_LENGTH + 1];
@@ -1426,11 +2266,20 @@ process_hash_result(RDD_FILTERSET *fset, const char *hash_name,
 		fatal_rdd_error(RDD_ESPACE, "digest size exceeds buffer size");
 	}
 
+	/* alg is 0 for digests that the multihash filter does not compute. */
+	if (alg != 0 && use_multihash()) {
+		filter_name = "multihash stream";
+	}
 	if ((rc = rdd_fset_get(fset, filter_name, &f)) != RDD_OK) {
 		fatal_rdd_error(rc, "cannot find %s filter", filter_name);
 	}
 
-	if ((rc = rdd_filter_get_result(f, md, mdsize)) != RDD_OK) {
+	if (alg != 0 && use_multihash()) {
+		rc = rdd_multihash_get_digest(f, alg, md, mdsize);
+	} else {
+		rc = rdd_filter_get_result(f, md, mdsize);
+	}
+	if (rc != RDD_OK) {
 		fatal_rdd_error(rc, "cannot get result for %s filter",
 				filter_name);
 	}
@@ -1455,8 +2304,8 @@ main(int argc, char **argv)
 {
 	double start, end;
 	RDD_READER *reader;
-	RDD_WRITER * writers[RDD_MAX_OUTPUT_OPTS];
-	RDD_WRITER * tcp_writers[RDD_MAX_OUTPUT_OPTS];
+	RDD_WRITER **writers;
+	RDD_WRITER **tcp_writers;
 	int num_tcp_writers = 0;
 	RDD_PROGRESS progress;
 	RDD_COPIER_RETURN copier_ret;
@@ -1468,13 +2317,6 @@ main(int argc, char **argv)
 	int rc;
 	int i;
 
-	/* Initialise writers array.
-	 */
-	for (i=0; i<RDD_MAX_OUTPUT_OPTS; i++) {
-		writers[i] = 0;
-		tcp_writers[i] = 0;
-	}
-
 	set_progname(argv[0]);
 	rdd_cons_open();
 	rdd_init();
@@ -1503,7 +2345,8 @@ main(int argc, char **argv)
 	log_header(argv, argc);
 	log_params(&opts);
 
-	if (!opts.md5 && !opts.sha1 && !opts.sha256 && !opts.sha384 && !opts.sha512) {
+	if (!opts.md5 && !opts.sha1 && !opts.sha256 && !opts.sha384 && !opts.sha512
+	&&  !opts.treehash) {
 	       rdd_quit_if(RDD_NO, "Continue without hashing (yes/no)?");
 	}
 	if (opts.logfile == 0) {
@@ -1516,6 +2359,12 @@ main(int argc, char **argv)
 		fatal_rdd_error(rc, "cannot create hashes object");	
 	}
 
+	/* Allocate the writers arrays; in server mode the number of outputs
+	 * is only known once the client request has been received.
+	 */
+	writers = rdd_malloc((opts.output_count + 1) * sizeof(RDD_WRITER *));
+	tcp_writers = rdd_malloc((opts.output_count + 1) * sizeof(RDD_WRITER *));
+
 	for (i=0; i<opts.output_count; i++) {
 		writers[i] = open_output(RDD_WHOLE_FILE, hashcontainer, tcp_writers, &num_tcp_writers, i);
 	}
@@ -1524,16 +2373,63 @@ main(int argc, char **argv)
 		fatal_rdd_error(rc, "cannot send end of output opts marker");
 	}
 
+	if (opts.write_behind > 0) {
+		for (i=0; i<opts.output_count; i++) {
+			if (writers[i] == 0) {
+				continue;
+			}
+			rc = rdd_open_async_writer(&writers[i], writers[i],
+					(unsigned) opts.write_behind);
+			if (rc != RDD_OK) {
+				fatal_rdd_error(rc, "cannot create write-behind queue for output #%d", i);
+			}
+		}
+	}
+
+	if (opts.fanout) {
+		/* Replace all writers by a single fan-out writer that
+		 * drives each of them in a thread of its own.
+		 */
+		int nchild = 0;
+
+		for (i=0; i<opts.output_count; i++) {
+			if (writers[i] != 0) {
+				writers[nchild++] = writers[i];
+			}
+		}
+		if (nchild > 0) {
+			rc = rdd_open_fanout_writer(&writers[0], writers,
+					(unsigned) nchild, DEFAULT_FANOUT_NBUF,
+					(unsigned) opts.blocklen);
+			if (rc != RDD_OK) {
+				fatal_rdd_error(rc, "cannot create fan-out writer");
+			}
+		}
+		for (i = nchild > 0 ? 1 : 0; i<opts.output_count; i++) {
+			writers[i] = 0;
+		}
+	}
+
+	if (opts.checkpoint != 0) {
+		/* Only the low-level hash routines can save their state. */
+		rdd_hash_set_engine(RDD_HASH_ENGINE_LEGACY);
+	}
+	log_hash_engines();
+	log_checksum_impls();
+
 	install_filters(&filterset, writers);
+	if (opts.resume) {
+		load_checkpoint(&filterset);
+	}
 
 	if (opts.progresslen > 0) {
 		rc = rdd_progress_init(&progress, input_size, opts.progresslen);
 		if (rc != RDD_OK) {
 			fatal_rdd_error(rc, "cannot initialize progress object");
 		}
-		copier = create_copier(input_size, &progress);
+		copier = create_copier(input_size, &progress, &filterset);
 	} else {
-		copier = create_copier(input_size, 0);
+		copier = create_copier(input_size, 0, &filterset);
 	}
 
 	start = rdd_gettime();
@@ -1543,6 +2439,11 @@ main(int argc, char **argv)
 	}
 	end = rdd_gettime();
 
+	copier_ret.nbyte += resume_point.copied.nbyte;
+	copier_ret.nlost += resume_point.copied.nlost;
+	copier_ret.nread_err += resume_point.copied.nread_err;
+	copier_ret.nsubst += resume_point.copied.nsubst;
+
 	rdd_mp_message(the_printer, RDD_MSG_INFO, "=== done ***");
 	rdd_mp_message(the_printer, RDD_MSG_INFO, "seconds: %.3f", end - start);
 	rdd_mp_message(the_printer, RDD_MSG_INFO, "bytes written: %llu", 
@@ -1554,31 +2455,40 @@ main(int argc, char **argv)
 	rdd_mp_message(the_printer, RDD_MSG_INFO, "zero-block substitutions: "
 						  "%lu", copier_ret.nsubst);
 
+	if (opts.dedup) {
+		report_dedup(&filterset);
+	}
+
 	if (opts.md5) {
-		process_hash_result(&filterset, RDD_MD5, "MD5 stream", MD5_DIGEST_LENGTH, hashcontainer);
+		process_hash_result(&filterset, RDD_MD5, "MD5 stream", RDD_MULTIHASH_MD5, MD5_DIGEST_LENGTH, hashcontainer);
 	} else {
 		logmsg("MD5: <none>");
 	}
 	if (opts.sha1) {
-		process_hash_result(&filterset, RDD_SHA1, "SHA-1 stream", SHA_DIGEST_LENGTH, hashcontainer);
+		process_hash_result(&filterset, RDD_SHA1, "SHA-1 stream", RDD_MULTIHASH_SHA1, SHA_DIGEST_LENGTH, hashcontainer);
 	} else {
 		logmsg("SHA1: <none>");
 	}
 	if (opts.sha256) {
-		process_hash_result(&filterset, RDD_SHA256, "SHA-256 stream", SHA256_DIGEST_LENGTH, hashcontainer);
+		process_hash_result(&filterset, RDD_SHA256, "SHA-256 stream", RDD_MULTIHASH_SHA256, SHA256_DIGEST_LENGTH, hashcontainer);
 	} else {
 		logmsg("SHA256: <none>");
 	}
 	if (opts.sha384) {
-		process_hash_result(&filterset, RDD_SHA384, "SHA-384 stream", SHA384_DIGEST_LENGTH, hashcontainer);
+		process_hash_result(&filterset, RDD_SHA384, "SHA-384 stream", RDD_MULTIHASH_SHA384, SHA384_DIGEST_LENGTH, hashcontainer);
 	} else {
 		logmsg("SHA384: <none>");
 	}
 	if (opts.sha512) {
-		process_hash_result(&filterset, RDD_SHA512, "SHA-512 stream", SHA512_DIGEST_LENGTH, hashcontainer);
+		process_hash_result(&filterset, RDD_SHA512, "SHA-512 stream", RDD_MULTIHASH_SHA512, SHA512_DIGEST_LENGTH, hashcontainer);
 	} else {
 		logmsg("SHA512: <none>");
 	}
+	if (opts.treehash) {
+		process_hash_result(&filterset, RDD_TREEHASH, "tree hash stream", 0, SHA256_DIGEST_LENGTH, hashcontainer);
+	} else {
+		logmsg("TREEHASH: <none>");
+	}
 
 	if ((rc = rdd_copy_free(copier)) != RDD_OK) {
 		fatal_rdd_error(rc, "cannot clean up copier");
@@ -1591,6 +2501,8 @@ main(int argc, char **argv)
 			}
 		}
 	}
+	rdd_free(writers);
+	rdd_free(tcp_writers);
 
 	if ((rc = rdd_fset_clear(&filterset)) != RDD_OK) {
 		fatal_rdd_error(rc, "cannot clean up filters");
@@ -1600,6 +2512,11 @@ main(int argc, char **argv)
 		fatal_rdd_error(rc, "cannot clean up reader");
 	}
 
+	if (opts.checkpoint != 0 && unlink(opts.checkpoint) < 0
+	&&  errno != ENOENT) {
+		logmsg("cannot remove checkpoint file %s", opts.checkpoint);
+	}
+
 	close_printer();
 
 	if (copier_ret.nread_err > 0) {
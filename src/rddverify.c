@@ -83,6 +83,7 @@ static char copyright[] =
 #include "rdd_internals.h"
 #include "error.h"
 #include "commandline.h"
+#include "numparser.h"
 
 /* Types of verication checks to perform.
  */
@@ -90,21 +91,33 @@ static char copyright[] =
 #define VFY_SHA1     0x2
 #define VFY_ADLER32  0x4
 #define VFY_CRC32    0x8
+#define VFY_TREEHASH 0x10
+#define VFY_CRC32C   0x20
+#define VFY_BLOCKINDEX 0x40
 
 #define READ_SIZE	262144	/* bytes */
+#define DEFAULT_TREEHASH_LEAF_SIZE (1 << 20)	/* bytes; same as rdd-copy */
 #define bool2str(b)   ((b) ? "yes" : "no")
 
 static struct verifier_opts {
 	char       **files;		/* input files */
 	unsigned     nfile;		/* #input files */
 	char        *crc32file;		/* output file for CRC32 checksums */
+	char        *crc32cfile;	/* output file for CRC32C checksums */
+	char        *blockindexfile;	/* binary block index */
+	rdd_count_t  blockindex_start;	/* first block to verify */
+	rdd_count_t  blockindex_count;	/* # blocks to verify (0 = all) */
 	char        *adler32file;	/* output file for Adler32 checksums */
 	int          verbose;		/* Be verbose? */
 	int          md5;		/* MD5-hash all data? */
 	int          sha1;		/* SHA1-hash all data? */
+	int          treehash;		/* tree-hash all data? */
+	unsigned     treehashleaflen;	/* tree-hash leaf size */
+	unsigned     treehash_threads;	/* # tree-hash threads (0 = all CPUs) */
 	rdd_count_t  progresslen;	/* progress reporting interval (s) */
 	char        *md5digest;
 	char        *sha1digest;
+	char        *treehashdigest;
 } opts;
 
 typedef rdd_checksum_t (*checksum_fun)(rdd_checksum_t, const unsigned char *, size_t);
@@ -116,8 +129,15 @@ static RDD_OPTION opttab[] = {
 	{"-A",		"--adler32",	"<file>",		0,	"verify Adler32 checksums in <file> against input files",	0,	0},
 	{"-C",		"--checksum",	"<file>",		0,	"verify Adler32 checksums in <file> against input files",	0,	0},
 	{"-c",		"--crc32",	"<file>",		0,	"verify CRC32 checksums in <file> against input files",		0,	0},
+	{0,		"--crc32c",	"<file>",		0,	"verify CRC32C checksums in <file> against input files",	0,	0},
+	{0,		"--block-index",	"<file>",	0,	"verify the blocks of the input files against the block index in <file>",	0,	0},
+	{0,		"--block-index-start",	"<block>",	0,	"verify blocks from block number <block> on",			0,	0},
+	{0,		"--block-index-count",	"<count>",	0,	"verify <count> blocks only",					0,	0},
 	{"-m",		"--md5",	"<md5 digest>",		0,	"verify MD5 hash",						0,	0},
 	{"-s",		"--sha1",	"<sha-1 digest>",	0,	"verify SHA1 hash",						0,	0},
+	{0,		"--treehash",	"<tree-hash digest>",	0,	"verify SHA256 Merkle tree hash",				0,	0},
+	{0,		"--treehash-leaf-size",	"<size>",	0,	"tree hash uses <size>-byte leaves",				0,	0},
+	{0,		"--treehash-threads",	"<count>",	0,	"tree hash uses <count> threads (0 = all CPUs)",		0,	0},
 	{"-V",		"--version",	0,			0,	"Report version number and exit",				0,	0},
 	{"-v",		"--verbose",	0,			0,	"Be verbose",							0,	0},
 	{0,		0,		0,			0,	0,								0,	0} /* sentinel */
@@ -147,14 +167,75 @@ process_options(void)
 		opts.sha1 = 1;
 		opts.sha1digest = arg;
 	}
+	opts.treehashleaflen = DEFAULT_TREEHASH_LEAF_SIZE;
+	if (rdd_opt_set_arg(opttab, "treehash", &arg)) {
+		opts.treehash = 1;
+		opts.treehashdigest = arg;
+	}
+	if (rdd_opt_set_arg(opttab, "treehash-leaf-size", &arg)) {
+		rdd_count_t len;
+		int rc;
+
+		rc = rdd_parse_bignum(arg, RDD_POSITIVE, &len);
+		if (rc != RDD_OK) {
+			rdd_error(rc, "bad number %s", arg);
+		}
+		if (len > (rdd_count_t) INT_MAX) {
+			error("tree-hash leaf size (%llu) too large", len);
+		}
+		opts.treehashleaflen = (unsigned) len;
+	}
+	if (rdd_opt_set_arg(opttab, "treehash-threads", &arg)) {
+		int rc;
+
+		if ((rc = rdd_parse_uint(arg, &opts.treehash_threads)) != RDD_OK) {
+			rdd_error(rc, "bad number %s", arg);
+		}
+	}
 	if (rdd_opt_set_arg(opttab, "adler32", &arg)) {
 		opts.adler32file = arg;
 	}
 	if (rdd_opt_set_arg(opttab, "crc32", &arg)) {
 		opts.crc32file = arg;
 	}
-	if ((!opts.md5) && (!opts.sha1)
-	&&  (opts.adler32file == NULL) && (opts.crc32file == NULL)) {
+	if (rdd_opt_set_arg(opttab, "crc32c", &arg)) {
+		opts.crc32cfile = arg;
+	}
+	if (rdd_opt_set_arg(opttab, "block-index", &arg)) {
+		opts.blockindexfile = arg;
+	}
+	if (rdd_opt_set_arg(opttab, "block-index-start", &arg)) {
+		int rc;
+
+		rc = rdd_parse_bignum(arg, 0, &opts.blockindex_start);
+		if (rc != RDD_OK) {
+			rdd_error(rc, "bad number %s", arg);
+		}
+	}
+	if (rdd_opt_set_arg(opttab, "block-index-count", &arg)) {
+		int rc;
+
+		rc = rdd_parse_bignum(arg, RDD_POSITIVE, &opts.blockindex_count);
+		if (rc != RDD_OK) {
+			rdd_error(rc, "bad number %s", arg);
+		}
+	}
+	if (rdd_opt_set(opttab, "block-index-start")
+	||  rdd_opt_set(opttab, "block-index-count")) {
+		if (opts.blockindexfile == NULL) {
+			error("missing block-index file name (use --block-index)");
+		}
+		/* The other checks need all of the data. */
+		if (opts.md5 || opts.sha1 || opts.treehash
+		||  opts.adler32file != NULL || opts.crc32file != NULL
+		||  opts.crc32cfile != NULL) {
+			error("a block range can only be verified with "
+			      "--block-index alone");
+		}
+	}
+	if ((!opts.md5) && (!opts.sha1) && (!opts.treehash)
+	&&  (opts.adler32file == NULL) && (opts.crc32file == NULL)
+	&&  (opts.crc32cfile == NULL) && (opts.blockindexfile == NULL)) {
 		rdd_opt_usage(opttab, 0, EXIT_FAILURE);
 	}
 }
@@ -311,22 +392,49 @@ close_checksum_file(const char *path, FILE *fp)
 	}
 }
 
+/* Pushes the contents of a file through the filters.  The first
+ * *skip bytes of the input (which may span several files) are skipped,
+ * and at most *limit bytes are read.
+ */
 static void
-verify_file(RDD_FILTERSET *filters, const char *path)
+verify_file(RDD_FILTERSET *filters, const char *path,
+		rdd_count_t *skip, rdd_count_t *limit)
 {
 	RDD_READER *reader = 0;
 	unsigned char buf[READ_SIZE];
+	struct stat info;
 	unsigned nread;
+	unsigned n;
 	int rc;
 	
+	if (*skip > 0) {
+		if (stat(path, &info) < 0) {
+			unix_error("cannot stat %s", path);
+		}
+		if (S_ISREG(info.st_mode) && (rdd_count_t) info.st_size <= *skip) {
+			*skip -= (rdd_count_t) info.st_size;
+			return;
+		}
+	}
+
 	reader = open_image_file(path);
 
-	while (1) {
-		rc = rdd_reader_read(reader, buf, READ_SIZE, &nread);
+	if (*skip > 0) {
+		if ((rc = rdd_reader_seek(reader, *skip)) != RDD_OK) {
+			rdd_error(rc, "%s: cannot seek to offset %llu",
+					path, *skip);
+		}
+		*skip = 0;
+	}
+
+	while (*limit > 0) {
+		n = *limit < READ_SIZE ? (unsigned) *limit : READ_SIZE;
+		rc = rdd_reader_read(reader, buf, n, &nread);
 		if (rc != RDD_OK) {
 			rdd_error(rc, "%s: read error", path);
 		}
 		if (nread == 0) break;	/* EOF */
+		*limit -= nread;
 		
 		if ((rc = rdd_fset_push(filters, buf, nread)) != RDD_OK) {
 			rdd_error(rc, "cannot push buffer into filter");
@@ -361,7 +469,30 @@ handle_checksum_error(rdd_count_t pos,
 }
 
 static void
-get_checksum_result(RDD_FILTERSET *fset, const char *name, unsigned *num_error)
+handle_blockindex_error(rdd_count_t blocknum,
+	const unsigned char *expected, const unsigned char *computed,
+	unsigned mdsize, void *env)
+{
+	char hexexp[2*EVP_MAX_MD_SIZE + 1];
+	char hexgot[2*EVP_MAX_MD_SIZE + 1];
+
+	if (expected == 0) {
+		errlognl("block index error; block %llu is not in the index",
+			blocknum);
+	} else if (computed == 0) {
+		errlognl("block index error; block %llu is missing from the input",
+			blocknum);
+	} else {
+		(void) rdd_buf2hex(expected, mdsize, hexexp, sizeof hexexp);
+		(void) rdd_buf2hex(computed, mdsize, hexgot, sizeof hexgot);
+		errlognl("block index error; block %llu; "
+			"expected %s, got %s", blocknum, hexexp, hexgot);
+	}
+}
+
+static void
+get_checksum_result(RDD_FILTERSET *fset, const char *name,
+		rdd_count_t *num_error)
 {
 	RDD_FILTER *f = 0;
 	int rc;
@@ -413,11 +544,15 @@ equal_digest(char *md1, char *md2, unsigned mdlen)
 static int
 verify_files(char **files, unsigned nfile,
 		FILE* adler32file, rdd_count_t a32len, int a32swap,
-		FILE* crc32file, rdd_count_t crc32len, int crc32swap)
+		FILE* crc32file, rdd_count_t crc32len, int crc32swap,
+		FILE* crc32cfile, rdd_count_t crc32clen, int crc32cswap,
+		RDD_BLOCKINDEX *blockindex)
 {
 	RDD_FILTERSET filters;
 	RDD_FILTER *f = 0;
-	unsigned num_error;
+	rdd_count_t num_error;
+	rdd_count_t skip = 0;
+	rdd_count_t limit = RDD_COUNT_MAX;
 	int broken = 0;
 	int rc;
 	unsigned i;
@@ -442,6 +577,15 @@ verify_files(char **files, unsigned nfile,
 		add_filter(&filters, "SHA-1 stream", f);
 	}
 
+	if (opts.treehash) {
+		rc = rdd_new_treehash_streamfilter(&f, opts.treehashleaflen,
+						opts.treehash_threads);
+		if (rc != RDD_OK) {
+			rdd_error(rc, "cannot create tree-hash filter");
+		}
+		add_filter(&filters, "tree hash stream", f);
+	}
+
 	if (adler32file != 0) {
 		rc = rdd_new_verify_adler32_blockfilter(&f, adler32file,
 							a32len, a32swap,
@@ -464,13 +608,45 @@ verify_files(char **files, unsigned nfile,
 		add_filter(&filters, "CRC-32 verification block", f);
 	}
 
+	if (crc32cfile != 0) {
+		rc = rdd_new_verify_crc32c_blockfilter(&f, crc32cfile,
+							crc32clen, crc32cswap,
+							handle_checksum_error,
+							"CRC-32C");
+		if (rc != RDD_OK) {
+			rdd_error(rc, "cannot create CRC-32C verification filter");
+		}
+		add_filter(&filters, "CRC-32C verification block", f);
+	}
+
+	if (blockindex != 0) {
+		const RDD_BLOCKINDEX_HEADER *hdr = rdd_blockindex_header(blockindex);
+
+		rc = rdd_new_verify_blockindex_filter(&f, blockindex,
+					opts.blockindex_start,
+					opts.blockindex_count,
+					handle_blockindex_error, 0);
+		if (rc != RDD_OK) {
+			rdd_error(rc, "cannot create block-index verification "
+				"filter (block range %llu+%llu, index has "
+				"%llu blocks)", opts.blockindex_start,
+				opts.blockindex_count, hdr->nblock);
+		}
+		add_filter(&filters, "block-index verification block", f);
+
+		skip = opts.blockindex_start * hdr->blocksize;
+		if (opts.blockindex_count > 0) {
+			limit = opts.blockindex_count * hdr->blocksize;
+		}
+	}
+
 	/* Run verification.
 	 */
 	for (i = 0; i < nfile; i++) {
 		if (opts.verbose) {
 			errlognl("verifying %s ...", files[i]);
 		}
-		verify_file(&filters, files[i]);
+		verify_file(&filters, files[i], &skip, &limit);
 	}
 
 	/* Check results.
@@ -491,6 +667,24 @@ verify_files(char **files, unsigned nfile,
 		}
 	}
 
+	if (crc32cfile != 0) {
+		get_checksum_result(&filters, "CRC-32C verification block",
+					&num_error);
+		if (num_error > 0) {
+			broken |= VFY_CRC32C;
+		}
+	}
+
+	if (blockindex != 0) {
+		get_checksum_result(&filters, "block-index verification block",
+					&num_error);
+		if (num_error > 0) {
+			errlognl("%llu bad block(s) according to the block index",
+				num_error);
+			broken |= VFY_BLOCKINDEX;
+		}
+	}
+
 	if (opts.sha1) {
 		unsigned char md[20];
 		char hexmd[2*20 + 1];
@@ -514,6 +708,29 @@ verify_files(char **files, unsigned nfile,
 		}
 	}
 
+	if (opts.treehash) {
+		unsigned char md[SHA256_DIGEST_LENGTH];
+		char hexmd[2*SHA256_DIGEST_LENGTH + 1];
+		int rc;
+
+		get_hash_result(&filters, "tree hash stream", md, sizeof md);
+		rc = rdd_buf2hex(md, sizeof md, hexmd, sizeof hexmd);
+		if (rc != RDD_OK) {
+			rdd_error(rc, "cannot print tree-hash digest");
+		}
+
+		if (opts.verbose) {
+			errlognl("Found TREEHASH digest: [%s]", hexmd);
+		}
+
+		if (! equal_digest(hexmd, opts.treehashdigest, 2*SHA256_DIGEST_LENGTH)) {
+			errlognl("TREEHASH values do not match:");
+			errlognl("\texpected: %s", opts.treehashdigest);
+			errlognl("\tfound:    %s", hexmd);
+			broken |= VFY_TREEHASH;
+		}
+	}
+
 	if (opts.md5) {
 		unsigned char md[16];
 		char hexmd[2*16 + 1];
@@ -549,10 +766,14 @@ main(int argc, char** argv)
 {
 	RDD_CHECKSUM_FILE_HEADER adler32hdr;
 	RDD_CHECKSUM_FILE_HEADER crc32hdr;
+	RDD_CHECKSUM_FILE_HEADER crc32chdr;
 	FILE *adler32file = NULL;
 	FILE *crc32file = NULL;
+	FILE *crc32cfile = NULL;
 	int adler32swap = 0;
 	int crc32swap = 0;
+	int crc32cswap = 0;
+	RDD_BLOCKINDEX *blockindex = 0;
 	int res;
 	int i;
 	
@@ -565,6 +786,7 @@ main(int argc, char** argv)
 
 	memset(&adler32hdr, 0, sizeof adler32hdr);
 	memset(&crc32hdr, 0, sizeof crc32hdr);
+	memset(&crc32chdr, 0, sizeof crc32chdr);
 
 	if (opts.adler32file) {
 		adler32file = open_checksum_file(opts.adler32file,
@@ -576,6 +798,20 @@ main(int argc, char** argv)
 					       RDD_CRC32, &crc32hdr,
 					       &crc32swap);
 	}
+	if (opts.crc32cfile) {
+		crc32cfile = open_checksum_file(opts.crc32cfile,
+						RDD_CRC32C, &crc32chdr,
+						&crc32cswap);
+	}
+	if (opts.blockindexfile) {
+		int rc;
+
+		rc = rdd_open_blockindex(&blockindex, opts.blockindexfile);
+		if (rc != RDD_OK) {
+			rdd_error(rc, "cannot open block index %s",
+				opts.blockindexfile);
+		}
+	}
 
 	errlognl("");
 	errlognl("%s", rdd_ctime());
@@ -599,10 +835,19 @@ main(int argc, char** argv)
 	if (opts.verbose) {
 		errlognl("verbose: %s", bool2str(opts.verbose));
 	}
+	if (blockindex != 0) {
+		const RDD_BLOCKINDEX_HEADER *hdr = rdd_blockindex_header(blockindex);
+
+		errlognl("block index: %s, %llu blocks of %u bytes, "
+			"image size %llu", rdd_hash_name(hdr->algorithm),
+			hdr->nblock, hdr->blocksize, hdr->imagesize);
+	}
 
 	res = verify_files(opts.files, opts.nfile,
 			adler32file, adler32hdr.blocksize, adler32swap,
-			crc32file, crc32hdr.blocksize, crc32swap);
+			crc32file, crc32hdr.blocksize, crc32swap,
+			crc32cfile, crc32chdr.blocksize, crc32cswap,
+			blockindex);
 
 	if (res == 0) {
 		errlognl("Verification complete: NO ERRORS");
@@ -615,14 +860,27 @@ main(int argc, char** argv)
 		if ((res & VFY_CRC32) != 0) {
 			errlognl("CRC32 verification failed");
 		}
+		if ((res & VFY_CRC32C) != 0) {
+			errlognl("CRC32C verification failed");
+		}
+		if ((res & VFY_BLOCKINDEX) != 0) {
+			errlognl("block-index verification failed");
+		}
 		if ((res & VFY_SHA1) != 0) {
 			errlognl("SHA1 verification failed");
 		}
 		if ((res & VFY_MD5) != 0) {
 			errlognl("MD5 verification failed");
 		}
+		if ((res & VFY_TREEHASH) != 0) {
+			errlognl("TREEHASH verification failed");
+		}
 	}
 
+	if (blockindex != 0) {
+		(void) rdd_close_blockindex(blockindex);
+	}
+	close_checksum_file(opts.crc32cfile, crc32cfile);
 	close_checksum_file(opts.crc32file, crc32file);
 	close_checksum_file(opts.adler32file, adler32file);
 
@@ -103,6 +103,25 @@ rdd_reader_skip(RDD_READER *r, rdd_count_t skip)
 	return RDD_OK;
 }
 
+int
+rdd_reader_pread(RDD_READER *r, unsigned char *buf, unsigned nbyte,
+		rdd_count_t pos, unsigned *nread)
+{
+	if (r->ops->pread == 0) {
+		return RDD_BADARG;
+	}
+	return (*(r->ops->pread))(r, buf, nbyte, pos, nread);
+}
+
+int
+rdd_reader_stream(RDD_READER *r)
+{
+	if (r->ops->stream == 0) {
+		return RDD_NOTFOUND;
+	}
+	return (*(r->ops->stream))(r);
+}
+
 int
 rdd_reader_close(RDD_READER *r, int recurse)
 {
@@ -56,15 +56,24 @@ typedef int (*rdd_rd_seek_fun)(struct _RDD_READER *r, rdd_count_t pos);
 
 typedef int (*rdd_rd_close_fun)(struct _RDD_READER *r, int recurse);
 
+typedef int (*rdd_rd_pread_fun)(struct _RDD_READER *r,
+				unsigned char *buf, unsigned nbyte,
+				rdd_count_t pos, unsigned *nread);
+
+typedef int (*rdd_rd_stream_fun)(struct _RDD_READER *r);
+
 /** All reader implementations provide a structure of type \c RDD_READ_OPS.
  *  This structure contains pointers to the routines that implement
- *  the interface.
+ *  the interface.  The \c pread and \c stream routines are optional;
+ *  readers that do not implement them leave them zero.
  */
 typedef struct _RDD_READ_OPS {
 	rdd_rd_read_fun  read;
 	rdd_rd_tell_fun  tell;
 	rdd_rd_seek_fun  seek;
 	rdd_rd_close_fun close;
+	rdd_rd_pread_fun pread;
+	rdd_rd_stream_fun stream;
 } RDD_READ_OPS;
 
 /** A reader object consists of a pointer to implementation-defined state and
@@ -103,6 +112,21 @@ int rdd_new_reader(RDD_READER **r, RDD_READ_OPS *ops, unsigned statesize);
  */
 int rdd_open_fd_reader(RDD_READER **r, int fd);
 
+/** \brief Instantiates a reader that reads from an open file descriptor
+ *  with positional reads.
+ *  \param r output value: a new reader object.
+ *  \param fd the open file descriptor that the reader will read from.
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_ESEEK if
+ *  \c fd does not support positional reads (e.g. a pipe or socket).
+ *
+ *  A pread reader reads with \c pread() and keeps track of its own
+ *  file position, starting at the current position of \c fd.
+ *  It never moves the file pointer of \c fd, so \c tell() and \c seek()
+ *  do not make system calls.  A failed read leaves the position
+ *  unchanged.  A pread reader implements \c rdd_reader_pread().
+ */
+int rdd_open_pread_reader(RDD_READER **r, int fd);
+
 /** \brief Instantiates a reader that reads from an open file descriptor
  *  that refers to a raw block device.
  *  \param r output value: a new reader object.
@@ -132,10 +156,34 @@ int rdd_open_aligned_reader(RDD_READER **r, RDD_READER *parent, unsigned align);
  *  \param raw true iff \c path refers to a raw-device file
  *  \return Returns \c RDD_OK on success.
  *
- *  A file reader opens a file and reads from it.
+ *  A file reader opens a file and reads from it.  If the file
+ *  supports positional reads, the file reader is a pread reader
+ *  (see \c rdd_open_pread_reader()).
  */
 int rdd_open_file_reader(RDD_READER **r, const char *path, int raw);
 
+/** \brief Instantiates a reader that reads a file through io_uring.
+ *  \param r output value: a new reader object.
+ *  \param path the name of the file that must be read.
+ *  \param raw if nonzero, the file is opened with \c O_DIRECT.
+ *  \param depth the number of reads that are kept in flight.
+ *  \param chunklen the size in bytes of each read; must be a
+ *  nonzero multiple of the sector size.
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_EOPEN if
+ *  the file cannot be opened or if the kernel does not support
+ *  io_uring.
+ *
+ *  An io_uring reader reads ahead of the caller: it keeps \c depth
+ *  reads of \c chunklen bytes in flight beyond the current file
+ *  position, so the device's command queue stays busy while the
+ *  caller processes earlier data.  If one of these reads fails, the
+ *  reader falls back to synchronous reads for the range covered by
+ *  that read only; these reads have the size that the caller asked for
+ *  and report read errors in the same way as a file reader.
+ */
+int rdd_open_uring_reader(RDD_READER **r, const char *path, int raw,
+			unsigned depth, unsigned chunklen);
+
 /** \brief Instantiates a reader that does not move the file pointer
  *  when a read error occurs.
  *  \param r output value: a new reader object.
@@ -147,6 +195,11 @@ int rdd_open_file_reader(RDD_READER **r, const char *path, int raw);
  * restore the file position to the same value it had before the
  * read was issued.
  *
+ * An atomic reader asks its parent for the file position only once
+ * and keeps track of it from then on, so a successful read costs no
+ * extra \c tell() or \c seek() call.  All reads of the parent must
+ * therefore go through the atomic reader.
+ *
  * \b Note: the parent reader \c p \b MUST implement the \c seek()
  * and \c tell() operations.
  */
@@ -163,6 +216,53 @@ int rdd_open_atomic_reader(RDD_READER **r, RDD_READER *p);
  */
 int rdd_open_zlib_reader(RDD_READER **r, RDD_READER *p);
 
+/** \brief Instantiates a reader that decompresses LZ4-compressed data.
+ *  \param r output value: a new reader object.
+ *  \param p an existing parent reader.
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_ECOMPRESS
+ *  if rdd was built without LZ4 support.
+ *
+ *  An LZ4 reader decodes the LZ4 frames written by an LZ4 writer
+ *  (see \c rdd_open_lz4_writer()).  A read fails with
+ *  \c RDD_ECOMPRESS if the data is corrupt or if the parent reaches
+ *  end-of-file in the middle of a frame.
+ *
+ *  \b Note: an LZ4 reader does not implement the \c seek() routine.
+ */
+int rdd_open_lz4_reader(RDD_READER **r, RDD_READER *p);
+
+/** \brief Instantiates a reader that decompresses zstd-compressed data.
+ *  \param r output value: a new reader object.
+ *  \param p an existing parent reader.
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_ECOMPRESS
+ *  if rdd was built without zstd support.
+ *
+ *  A zstd reader decodes the zstd frames written by a zstd writer
+ *  (see \c rdd_open_zstd_writer()).  A read fails with
+ *  \c RDD_ECOMPRESS if the data is corrupt or if the parent reaches
+ *  end-of-file in the middle of a frame.
+ *
+ *  \b Note: a zstd reader does not implement the \c seek() routine.
+ */
+int rdd_open_zstd_reader(RDD_READER **r, RDD_READER *p);
+
+/** \brief Instantiates a reader that restores a dedup image.
+ *  \param r output value: a new reader object.
+ *  \param datapath the data file of the dedup image.
+ *  \param mappath the map file of the dedup image.
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_ESYNTAX if
+ *  the map file does not start with a valid map header.
+ *
+ *  A dedup reader reads the image that a dedup block filter stored
+ *  in \c datapath and \c mappath (see \c rdd_new_dedup_blockfilter()
+ *  and dedup.h).  A read fails with \c RDD_ESYNTAX if a map record
+ *  refers past the end of the data file's blocks, and with
+ *  \c RDD_EREAD if the map or data file is truncated.  A dedup
+ *  reader implements \c rdd_reader_pread().
+ */
+int rdd_open_dedup_reader(RDD_READER **r, const char *datapath,
+			const char *mappath);
+
 int rdd_open_cdrom_reader(RDD_READER **r, const char *path);
 
 /** \brief Instantiates a reader that simulates read errors.
@@ -222,6 +322,39 @@ int rdd_reader_seek(RDD_READER *r, rdd_count_t pos);
  */
 int rdd_reader_skip(RDD_READER *r, rdd_count_t skip);
 
+/** \brief Reads data at a given file position.
+ *  \param r  pointer to the reader object.
+ *  \param buf pointer to the target buffer.
+ *  \param nbyte the number of bytes to read
+ *  \param pos the (absolute) file position in bytes to read from.
+ *  \param nread output value: the number of bytes actually read.
+ *  \return Returns RDD_OK if the read succeeds.  Returns \c RDD_BADARG
+ *  if the reader does not implement positional reads.
+ *
+ *  A positional read behaves like \c rdd_reader_read(), but it
+ *  neither uses nor changes the reader's current file position.
+ *  Readers that implement positional reads may be used for
+ *  positional reads by several threads at once.
+ *
+ *  \b Note: not all readers implement the \c pread() routine.
+ */
+int rdd_reader_pread(RDD_READER *r, unsigned char *buf, unsigned nbyte,
+		rdd_count_t pos, unsigned *nread);
+
+/** \brief Makes the reader stream its input through the page cache.
+ *  \param r  pointer to the reader object.
+ *  \return Returns RDD_OK on success.  Returns \c RDD_NOTFOUND if
+ *  the reader (or the file it reads from) does not support streaming.
+ *
+ *  A streaming reader tells the kernel that the file is read
+ *  sequentially, so that it reads ahead aggressively, and drops the
+ *  data that it has read from the page cache.  Copying a large file
+ *  then no longer evicts everything else from memory.
+ *
+ *  \b Note: not all readers implement the \c stream() routine.
+ */
+int rdd_reader_stream(RDD_READER *r);
+
 /** \brief Closes and deallocates the reader object.
  *  \param r  pointer to the reader object.
  *  \param recurse recursive-close flag
@@ -0,0 +1,557 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2004\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+/*
+ * A region copier reads its input with several worker threads.
+ * The input range is cut into stripes of stripelen bytes; worker w
+ * copies stripes w, w + nworker, w + 2*nworker, and so on.  Each
+ * stripe is copied by an ordinary robust copier, so read errors are
+ * handled exactly as in sequential mode.  The robust copier reads
+ * through a private view reader that issues positional reads on
+ * the shared input reader, and it pushes its output into a stripe
+ * buffer.
+ *
+ * The calling thread pushes the stripe buffers through the filter set
+ * strictly in stripe order.  There are 2*nworker stripe buffers;
+ * stripe i always uses buffer i % nslot, and a worker waits until
+ * the calling thread has released that buffer.  So at most nslot
+ * stripes are read ahead of the filters.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "rdd.h"
+#include "rdd_internals.h"
+#include "reader.h"
+#include "writer.h"
+#include "filter.h"
+#include "filterset.h"
+#include "copier.h"
+#include "alignedbuf.h"
+#include "progress.h"
+
+typedef enum _slot_state_t { SLOT_FREE, SLOT_FILLING, SLOT_READY } slot_state_t;
+
+typedef struct _RDD_REGION_COPIER {
+	rdd_count_t       offset;	/* start reading at this position */
+	rdd_count_t       count;	/* number of bytes to read */
+	unsigned          nworker;
+	unsigned          stripelen;
+	RDD_ROBUST_PARAMS params;
+} RDD_REGION_COPIER;
+
+/* A stripe buffer.
+ */
+typedef struct _RDD_REGION_SLOT {
+	slot_state_t   state;
+	rdd_count_t    stripe;		/* stripe that may use this slot next */
+	RDD_ALIGNEDBUF buf;
+	unsigned       len;		/* # bytes in buf */
+	int            rc;		/* stripe's copy result */
+	RDD_COPIER_RETURN ret;		/* stripe's copy statistics */
+} RDD_REGION_SLOT;
+
+/* State shared by the calling thread and the workers during
+ * a single exec.
+ */
+typedef struct _RDD_REGION_RUN {
+	RDD_REGION_COPIER *copier;
+	RDD_READER        *reader;	/* shared; positional reads only */
+	rdd_count_t        nstripe;
+	unsigned           nslot;
+	RDD_REGION_SLOT   *slots;
+	RDD_ROBUST_PARAMS  params;	/* per-stripe copier parameters */
+
+	pthread_mutex_t    lock;
+	pthread_cond_t     changed;
+	int                rc;		/* first error; stops all workers */
+
+	pthread_mutex_t    cblock;	/* serializes user callbacks */
+} RDD_REGION_RUN;
+
+typedef struct _RDD_REGION_WORKER {
+	RDD_REGION_RUN *run;
+	unsigned        index;
+	pthread_t       thread;
+} RDD_REGION_WORKER;
+
+static int region_exec(RDD_COPIER *c, RDD_READER *r,
+				      RDD_FILTERSET *fset,
+				      RDD_COPIER_RETURN *ret);
+static int region_free(RDD_COPIER *c);
+
+static RDD_COPY_OPS region_ops = {
+	region_exec,
+	region_free
+};
+
+/* View reader: reads the shared input reader with positional reads
+ * and keeps a private file position.
+ */
+typedef struct _RDD_VIEW_READER {
+	RDD_READER  *parent;
+	rdd_count_t  pos;
+} RDD_VIEW_READER;
+
+static int
+view_read(RDD_READER *self, unsigned char *buf, unsigned nbyte,
+		unsigned *nread)
+{
+	RDD_VIEW_READER *state = self->state;
+	int rc;
+
+	rc = rdd_reader_pread(state->parent, buf, nbyte, state->pos, nread);
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state->pos += *nread;
+	return RDD_OK;
+}
+
+static int
+view_tell(RDD_READER *self, rdd_count_t *pos)
+{
+	RDD_VIEW_READER *state = self->state;
+
+	*pos = state->pos;
+	return RDD_OK;
+}
+
+static int
+view_seek(RDD_READER *self, rdd_count_t pos)
+{
+	RDD_VIEW_READER *state = self->state;
+
+	state->pos = pos;
+	return RDD_OK;
+}
+
+static int
+view_close(RDD_READER *self, int recurse)
+{
+	return RDD_OK;	/* the parent is shared */
+}
+
+static RDD_READ_OPS view_read_ops = {
+	view_read,
+	view_tell,
+	view_seek,
+	view_close
+};
+
+/* Sink filter: appends its input to a stripe buffer.
+ */
+typedef struct _RDD_SINK_STATE {
+	RDD_REGION_SLOT *slot;
+} RDD_SINK_STATE;
+
+static int
+sink_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
+{
+	RDD_REGION_SLOT *slot = ((RDD_SINK_STATE *) f->state)->slot;
+
+	if (nbyte > slot->buf.asize - slot->len) {
+		return RDD_ESPACE;
+	}
+	memcpy(slot->buf.aligned + slot->len, buf, nbyte);
+	slot->len += nbyte;
+	return RDD_OK;
+}
+
+static RDD_FILTER_OPS sink_ops = {
+	sink_input,
+	0,
+	0,
+	0,
+	0
+};
+
+/* Callback wrappers: the user's callbacks are called by one
+ * worker at a time.
+ */
+static void
+region_readerr(rdd_count_t offset, unsigned nbyte, void *env)
+{
+	RDD_REGION_RUN *run = (RDD_REGION_RUN *) env;
+
+	pthread_mutex_lock(&run->cblock);
+	(*run->copier->params.readerrfun)(offset, nbyte,
+					run->copier->params.readerrenv);
+	pthread_mutex_unlock(&run->cblock);
+}
+
+static void
+region_subst(rdd_count_t offset, unsigned nbyte, void *env)
+{
+	RDD_REGION_RUN *run = (RDD_REGION_RUN *) env;
+
+	pthread_mutex_lock(&run->cblock);
+	(*run->copier->params.substfun)(offset, nbyte,
+					run->copier->params.substenv);
+	pthread_mutex_unlock(&run->cblock);
+}
+
+int
+rdd_new_region_copier(RDD_COPIER **self,
+		rdd_count_t offset, rdd_count_t count,
+		RDD_ROBUST_PARAMS *p, unsigned nworker, unsigned stripelen)
+{
+	RDD_COPIER *c = 0;
+	RDD_REGION_COPIER *state = 0;
+	int rc;
+
+	if (p->maxblocklen <= 0) return RDD_BADARG;
+	if (p->minblocklen <= 0) return RDD_BADARG;
+	if (p->minblocklen > p->maxblocklen) return RDD_BADARG;
+	if (nworker == 0 || stripelen == 0) return RDD_BADARG;
+	if (count == RDD_WHOLE_FILE) return RDD_BADARG;
+
+	rc = rdd_new_copier(&c, &region_ops, sizeof(RDD_REGION_COPIER));
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state = (RDD_REGION_COPIER *) c->state;
+
+	state->offset = offset;
+	state->count = count;
+	state->nworker = nworker;
+	state->stripelen = stripelen;
+	state->params = *p;
+
+	*self = c;
+	return RDD_OK;
+}
+
+/* Copies one stripe into a stripe buffer.
+ */
+static int
+copy_stripe(RDD_REGION_RUN *run, RDD_REGION_SLOT *slot,
+		rdd_count_t start, unsigned len)
+{
+	RDD_READER *view = 0;
+	RDD_COPIER *copier = 0;
+	RDD_FILTER *sink = 0;
+	RDD_FILTERSET fset;
+	int rc;
+
+	slot->len = 0;
+	memset(&slot->ret, 0, sizeof slot->ret);
+
+	if ((rc = rdd_fset_init(&fset)) != RDD_OK) {
+		return rc;
+	}
+
+	rc = rdd_new_reader(&view, &view_read_ops, sizeof(RDD_VIEW_READER));
+	if (rc != RDD_OK) {
+		goto done;
+	}
+	((RDD_VIEW_READER *) view->state)->parent = run->reader;
+
+	rc = rdd_new_filter(&sink, &sink_ops, sizeof(RDD_SINK_STATE), 0);
+	if (rc != RDD_OK) {
+		goto done;
+	}
+	((RDD_SINK_STATE *) sink->state)->slot = slot;
+	if ((rc = rdd_fset_add(&fset, "stripe", sink)) != RDD_OK) {
+		rdd_filter_free(sink);
+		goto done;
+	}
+
+	rc = rdd_new_robust_copier(&copier, start, len, &run->params);
+	if (rc != RDD_OK) {
+		goto done;
+	}
+	rc = rdd_copy_exec(copier, view, &fset, &slot->ret);
+
+done:
+	if (copier != 0) rdd_copy_free(copier);
+	if (view != 0) rdd_reader_close(view, 0);
+	rdd_fset_clear(&fset);
+	return rc;
+}
+
+static void
+abort_run(RDD_REGION_RUN *run, int rc)
+{
+	pthread_mutex_lock(&run->lock);
+	if (run->rc == RDD_OK) {
+		run->rc = rc;
+	}
+	pthread_cond_broadcast(&run->changed);
+	pthread_mutex_unlock(&run->lock);
+}
+
+static void *
+region_worker(void *arg)
+{
+	RDD_REGION_WORKER *w = (RDD_REGION_WORKER *) arg;
+	RDD_REGION_RUN *run = w->run;
+	RDD_REGION_COPIER *s = run->copier;
+	RDD_REGION_SLOT *slot;
+	rdd_count_t i, start;
+	unsigned len;
+	int rc;
+
+	for (i = w->index; i < run->nstripe; i += s->nworker) {
+		slot = &run->slots[i % run->nslot];
+
+		/* Wait until the filters are done with the stripe that
+		 * used this slot before.
+		 */
+		pthread_mutex_lock(&run->lock);
+		while (run->rc == RDD_OK
+		&& (slot->state != SLOT_FREE || slot->stripe != i)) {
+			pthread_cond_wait(&run->changed, &run->lock);
+		}
+		if (run->rc != RDD_OK) {
+			pthread_mutex_unlock(&run->lock);
+			break;
+		}
+		slot->state = SLOT_FILLING;
+		pthread_mutex_unlock(&run->lock);
+
+		start = s->offset + i * s->stripelen;
+		if (s->count - i * s->stripelen < s->stripelen) {
+			len = (unsigned) (s->count - i * s->stripelen);
+		} else {
+			len = s->stripelen;
+		}
+		rc = copy_stripe(run, slot, start, len);
+
+		pthread_mutex_lock(&run->lock);
+		slot->rc = rc;
+		slot->state = SLOT_READY;
+		pthread_cond_broadcast(&run->changed);
+		pthread_mutex_unlock(&run->lock);
+
+		if (rc != RDD_OK) {
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/* Pushes all stripes through the filter set, in order, as the workers
+ * complete them.
+ */
+static int
+push_stripes(RDD_REGION_RUN *run, RDD_FILTERSET *fset,
+		RDD_COPIER_RETURN *ret, int *aborted)
+{
+	RDD_REGION_COPIER *s = run->copier;
+	RDD_ROBUST_PARAMS *p = &s->params;
+	RDD_REGION_SLOT *slot;
+	rdd_count_t i;
+	int rc;
+
+	for (i = 0; i < run->nstripe; i++) {
+		slot = &run->slots[i % run->nslot];
+
+		pthread_mutex_lock(&run->lock);
+		while (run->rc == RDD_OK
+		&& (slot->state != SLOT_READY || slot->stripe != i)) {
+			pthread_cond_wait(&run->changed, &run->lock);
+		}
+		rc = run->rc;
+		pthread_mutex_unlock(&run->lock);
+		if (rc != RDD_OK) {
+			return rc;
+		}
+		if (slot->rc != RDD_OK) {
+			return slot->rc;
+		}
+
+		if ((rc = rdd_fset_push(fset, slot->buf.aligned, slot->len))
+		    != RDD_OK) {
+			return rc;
+		}
+		ret->nbyte += slot->ret.nbyte;
+		ret->nlost += slot->ret.nlost;
+		ret->nread_err += slot->ret.nread_err;
+		ret->nsubst += slot->ret.nsubst;
+
+		pthread_mutex_lock(&run->lock);
+		slot->state = SLOT_FREE;
+		slot->stripe += run->nslot;
+		pthread_cond_broadcast(&run->changed);
+		pthread_mutex_unlock(&run->lock);
+
+		if (p->maxsubst > 0 && ret->nsubst >= p->maxsubst) {
+			return RDD_ABORTED;
+		}
+
+		if (p->progressfun != 0) {
+			rc = (*p->progressfun)(ret->nbyte, ret->nlost,
+						p->progressenv);
+			if (rc == RDD_ABORTED) {
+				*aborted = 1;
+				return RDD_ABORTED;
+			} else if (rc != RDD_OK) {
+				return rc;
+			}
+		}
+	}
+
+	return RDD_OK;
+}
+
+static int
+region_exec(RDD_COPIER *c, RDD_READER *reader, RDD_FILTERSET *fset,
+					       RDD_COPIER_RETURN *ret)
+{
+	RDD_REGION_COPIER *s = (RDD_REGION_COPIER *) c->state;
+	RDD_REGION_RUN run;
+	RDD_REGION_WORKER *workers = 0;
+	unsigned nstarted = 0;
+	unsigned i;
+	int aborted = 0;
+	int rc = RDD_OK;
+
+	memset(ret, 0, sizeof(*ret));
+
+	if (reader->ops->pread == 0) {
+		return RDD_BADARG;	/* need positional reads */
+	}
+
+	memset(&run, 0, sizeof run);
+	run.copier = s;
+	run.reader = reader;
+	run.nstripe = (s->count + s->stripelen - 1) / s->stripelen;
+	run.nslot = 2 * s->nworker;
+	run.rc = RDD_OK;
+
+	/* Stripe copiers report errors through the wrappers and
+	 * progress through the calling thread.
+	 */
+	run.params = s->params;
+	run.params.progressfun = 0;
+	run.params.progressenv = 0;
+	run.params.readerrenv = &run;
+	run.params.substenv = &run;
+	if (s->params.readerrfun != 0) run.params.readerrfun = region_readerr;
+	if (s->params.substfun != 0) run.params.substfun = region_subst;
+
+	pthread_mutex_init(&run.lock, 0);
+	pthread_cond_init(&run.changed, 0);
+	pthread_mutex_init(&run.cblock, 0);
+
+	if ((run.slots = calloc(run.nslot, sizeof(RDD_REGION_SLOT))) == 0) {
+		rc = RDD_NOMEM;
+		goto done;
+	}
+	for (i = 0; i < run.nslot; i++) {
+		run.slots[i].state = SLOT_FREE;
+		run.slots[i].stripe = i;
+		rc = rdd_new_alignedbuf(&run.slots[i].buf, s->stripelen,
+					RDD_SECTOR_SIZE);
+		if (rc != RDD_OK) {
+			goto done;
+		}
+	}
+
+	if ((workers = calloc(s->nworker, sizeof(RDD_REGION_WORKER))) == 0) {
+		rc = RDD_NOMEM;
+		goto done;
+	}
+	for (i = 0; i < s->nworker; i++) {
+		workers[i].run = &run;
+		workers[i].index = i;
+		if (pthread_create(&workers[i].thread, 0, region_worker,
+				   &workers[i]) != 0) {
+			rc = RDD_NOMEM;
+			goto done;
+		}
+		nstarted++;
+	}
+
+	rc = push_stripes(&run, fset, ret, &aborted);
+
+done:
+	if (rc != RDD_OK) {
+		abort_run(&run, rc);
+	}
+	for (i = 0; i < nstarted; i++) {
+		pthread_join(workers[i].thread, 0);
+	}
+	if (workers != 0) free(workers);
+	if (run.slots != 0) {
+		for (i = 0; i < run.nslot; i++) {
+			if (run.slots[i].buf.unaligned != 0) {
+				rdd_free_alignedbuf(&run.slots[i].buf);
+			}
+		}
+		free(run.slots);
+	}
+	pthread_mutex_destroy(&run.cblock);
+	pthread_cond_destroy(&run.changed);
+	pthread_mutex_destroy(&run.lock);
+
+	if (rc != RDD_OK && !aborted) {
+		return rc;
+	}
+
+	if (!aborted && s->params.progressfun != 0) {
+		((RDD_PROGRESS *)s->params.progressenv)->period=0;
+		((RDD_PROGRESS *)s->params.progressenv)->poll_delta=0;
+
+		rc = (*s->params.progressfun)(ret->nbyte, ret->nlost,
+					s->params.progressenv);
+		if (rc == RDD_ABORTED) {
+			aborted = 1;
+		} else if (rc != RDD_OK) {
+			return rc;
+		}
+	}
+
+	if ((rc = rdd_fset_close(fset)) != RDD_OK) {
+		return rc;
+	}
+
+	return aborted ? RDD_ABORTED : RDD_OK;
+}
+
+static int
+region_free(RDD_COPIER *c)
+{
+	return RDD_OK;
+}
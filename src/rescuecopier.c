@@ -0,0 +1,974 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2004\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+/*
+ * A rescue copier recovers data from a failing device in several
+ * passes, in the style of GNU ddrescue.  It keeps a map of the input
+ * range in a text file; each extent in the map has one of these
+ * statuses:
+ *
+ *   ?  not tried yet
+ *   *  failed or skipped during the copy pass
+ *   -  bad: failed during a later pass
+ *   +  rescued
+ *
+ * The passes are:
+ *
+ *   1. copy:  reads all untried extents forward with full-size
+ *             blocks.  After a read error it marks the block as
+ *             failed and skips ahead; the skip distance doubles with
+ *             every consecutive error.
+ *   2. split: reads the failed and skipped extents forward with
+ *             full-size blocks, without skipping.
+ *   3. trim:  reads the bad extents backward with minimum-size blocks.
+ *   4+. retry: reads the bad extents forward with minimum-size
+ *             blocks; there are nretry retry passes.
+ *
+ * Rescued data is written to a working image (the map file name
+ * with ".data" appended) at its offset within the input range.  The map
+ * and the working image are saved regularly, so an interrupted rescue
+ * resumes where it stopped when the same map file is used again.
+ * After the last pass, the working image is pushed through the filter
+ * set in order, with zero blocks substituted for bad extents.  Once
+ * that succeeds, the working image and the map are removed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "rdd.h"
+#include "rdd_internals.h"
+#include "reader.h"
+#include "writer.h"
+#include "filter.h"
+#include "filterset.h"
+#include "copier.h"
+#include "error.h"
+#include "alignedbuf.h"
+#include "progress.h"
+
+#define RESCUE_UNTRIED  '?'
+#define RESCUE_FAILED   '*'
+#define RESCUE_BAD      '-'
+#define RESCUE_OK       '+'
+
+#define RESCUE_PASS_COPY   1
+#define RESCUE_PASS_SPLIT  2
+#define RESCUE_PASS_TRIM   3
+#define RESCUE_PASS_RETRY  4	/* first retry pass */
+
+#define RESCUE_MAX_SKIP_BLOCKS 1024	/* max. skip distance (blocks) */
+#define RESCUE_SAVE_INTERVAL    256	/* save map every # reads */
+#define RESCUE_MAX_LINE         128
+
+typedef struct _RDD_RESCUE_EXTENT {
+	rdd_count_t pos;
+	rdd_count_t size;
+	int         status;
+} RDD_RESCUE_EXTENT;
+
+typedef struct _RDD_RESCUE_COPIER {
+	rdd_count_t  offset;		/* start reading at this position */
+	rdd_count_t  count;		/* number of bytes to read */
+	RDD_ROBUST_PARAMS params;
+	char        *mappath;
+	char        *imagepath;
+
+	/* Valid during exec only.
+	 */
+	RDD_RESCUE_EXTENT *ext;		/* sorted, non-overlapping */
+	unsigned     next;
+	unsigned     maxext;
+	rdd_count_t  nok;		/* # bytes with status RESCUE_OK */
+	rdd_count_t  nbad;		/* # bytes with status RESCUE_BAD */
+	unsigned     pass;		/* current pass */
+	int          imagefd;
+	RDD_ALIGNEDBUF buf;
+	unsigned     nread;		/* # reads since last save */
+	rdd_count_t  nread_err;
+} RDD_RESCUE_COPIER;
+
+static int rescue_exec(RDD_COPIER *c, RDD_READER *r,
+				      RDD_FILTERSET *fset,
+				      RDD_COPIER_RETURN *ret);
+static int rescue_free(RDD_COPIER *c);
+
+static RDD_COPY_OPS rescue_ops = {
+	rescue_exec,
+	rescue_free
+};
+
+int
+rdd_new_rescue_copier(RDD_COPIER **self,
+		rdd_count_t offset, rdd_count_t count,
+		RDD_ROBUST_PARAMS *p, const char *mappath)
+{
+	RDD_COPIER *c = 0;
+	RDD_RESCUE_COPIER *state = 0;
+	int rc;
+
+	if (p->maxblocklen <= 0) return RDD_BADARG;
+	if (p->minblocklen <= 0) return RDD_BADARG;
+	if (p->minblocklen > p->maxblocklen) return RDD_BADARG;
+	if (count == RDD_WHOLE_FILE || mappath == 0) return RDD_BADARG;
+
+	rc = rdd_new_copier(&c, &rescue_ops, sizeof(RDD_RESCUE_COPIER));
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state = (RDD_RESCUE_COPIER *) c->state;
+
+	state->offset = offset;
+	state->count = count;
+	state->params = *p;
+	state->imagefd = -1;
+
+	if ((state->mappath = malloc(strlen(mappath) + 1)) == 0) {
+		goto nomem;
+	}
+	strcpy(state->mappath, mappath);
+	if ((state->imagepath = malloc(strlen(mappath) + 6)) == 0) {
+		goto nomem;
+	}
+	sprintf(state->imagepath, "%s.data", mappath);
+
+	*self = c;
+	return RDD_OK;
+
+nomem:
+	*self = 0;
+	if (state->mappath != 0) free(state->mappath);
+	free(state);
+	free(c);
+	return RDD_NOMEM;
+}
+
+/* Rescue map routines.
+ */
+
+static int
+map_grow(RDD_RESCUE_COPIER *s, unsigned n)
+{
+	RDD_RESCUE_EXTENT *ext;
+	unsigned maxext;
+
+	if (s->next + n <= s->maxext) {
+		return RDD_OK;
+	}
+	maxext = 2 * (s->next + n);
+	if ((ext = realloc(s->ext, maxext * sizeof(*ext))) == 0) {
+		return RDD_NOMEM;
+	}
+	s->ext = ext;
+	s->maxext = maxext;
+	return RDD_OK;
+}
+
+/* Adds (sign > 0) or subtracts (sign < 0) size bytes with status
+ * 'status' to the running totals.
+ */
+static void
+map_count(RDD_RESCUE_COPIER *s, int status, rdd_count_t size, int sign)
+{
+	rdd_count_t *total;
+
+	if (status == RESCUE_OK) {
+		total = &s->nok;
+	} else if (status == RESCUE_BAD) {
+		total = &s->nbad;
+	} else {
+		return;
+	}
+	if (sign > 0) {
+		*total += size;
+	} else {
+		*total -= size;
+	}
+}
+
+/* Returns the index of the extent that contains position pos, or
+ * s->next if pos lies beyond the last extent.  The extents are sorted
+ * and contiguous, so a binary search suffices; this keeps the passes
+ * fast when a failing drive leaves many scattered bad extents.
+ */
+static unsigned
+map_index(RDD_RESCUE_COPIER *s, rdd_count_t pos)
+{
+	unsigned lo = 0, hi = s->next, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (pos < s->ext[mid].pos + s->ext[mid].size) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return lo;
+}
+
+/* Gives range [pos, pos + size) status 'status' and merges
+ * adjacent extents with equal status.
+ */
+static int
+map_set(RDD_RESCUE_COPIER *s, rdd_count_t pos, rdd_count_t size, int status)
+{
+	rdd_count_t end = pos + size;
+	RDD_RESCUE_EXTENT *e;
+	unsigned i, j, k;
+	int rc;
+
+	if (size == 0) {
+		return RDD_OK;
+	}
+	if ((rc = map_grow(s, 2)) != RDD_OK) {
+		return rc;
+	}
+
+	/* Find the extent that contains pos and split it at pos.
+	 */
+	i = map_index(s, pos);
+	if (i >= s->next) {
+		return RDD_ERANGE;
+	}
+	e = &s->ext[i];
+	if (e->pos < pos) {
+		memmove(&s->ext[i + 1], &s->ext[i],
+			(s->next - i) * sizeof(*e));
+		s->next++;
+		s->ext[i].size = pos - e->pos;
+		s->ext[i + 1].pos = pos;
+		s->ext[i + 1].size -= s->ext[i].size;
+		i++;
+	}
+
+	/* Find the extent that contains end - 1 and split it at end.
+	 */
+	j = map_index(s, end - 1);
+	if (j >= s->next) {
+		return RDD_ERANGE;
+	}
+	e = &s->ext[j];
+	if (end < e->pos + e->size) {
+		memmove(&s->ext[j + 1], &s->ext[j],
+			(s->next - j) * sizeof(*e));
+		s->next++;
+		s->ext[j].size = end - s->ext[j].pos;
+		s->ext[j + 1].pos = end;
+		s->ext[j + 1].size -= s->ext[j].size;
+	}
+
+	/* Extents i..j now cover the range exactly; replace them.
+	 */
+	for (k = i; k <= j; k++) {
+		map_count(s, s->ext[k].status, s->ext[k].size, -1);
+	}
+	map_count(s, status, size, 1);
+	s->ext[i].size = size;
+	s->ext[i].status = status;
+	if (j > i) {
+		memmove(&s->ext[i + 1], &s->ext[j + 1],
+			(s->next - j - 1) * sizeof(*e));
+		s->next -= j - i;
+	}
+
+	/* Merge with neighbours.
+	 */
+	if (i + 1 < s->next && s->ext[i + 1].status == status) {
+		s->ext[i].size += s->ext[i + 1].size;
+		memmove(&s->ext[i + 1], &s->ext[i + 2],
+			(s->next - i - 2) * sizeof(*e));
+		s->next--;
+	}
+	if (i > 0 && s->ext[i - 1].status == status) {
+		s->ext[i - 1].size += s->ext[i].size;
+		memmove(&s->ext[i], &s->ext[i + 1],
+			(s->next - i - 1) * sizeof(*e));
+		s->next--;
+	}
+
+	return RDD_OK;
+}
+
+/* Finds the first part of an extent with status 'status' that
+ * lies at or after position pos.
+ */
+static int
+map_find_next(RDD_RESCUE_COPIER *s, rdd_count_t pos, int status,
+		rdd_count_t *start, rdd_count_t *end)
+{
+	RDD_RESCUE_EXTENT *e;
+	unsigned i;
+
+	for (i = map_index(s, pos); i < s->next; i++) {
+		e = &s->ext[i];
+		if (e->status != status) {
+			continue;
+		}
+		*start = e->pos > pos ? e->pos : pos;
+		*end = e->pos + e->size;
+		return 1;
+	}
+	return 0;
+}
+
+/* Finds the last part of an extent with status 'status' that
+ * lies before position pos.
+ */
+static int
+map_find_prev(RDD_RESCUE_COPIER *s, rdd_count_t pos, int status,
+		rdd_count_t *start, rdd_count_t *end)
+{
+	RDD_RESCUE_EXTENT *e;
+	unsigned i;
+
+	if (pos <= s->offset) {
+		return 0;
+	}
+	i = map_index(s, pos - 1);
+	for (i = i < s->next ? i + 1 : s->next; i > 0; i--) {
+		e = &s->ext[i - 1];
+		if (e->status != status) {
+			continue;
+		}
+		*start = e->pos;
+		*end = e->pos + e->size < pos ? e->pos + e->size : pos;
+		return 1;
+	}
+	return 0;
+}
+
+/* Writes the map to a temporary file and renames it, so that the map
+ * file on disk is always complete.  Rescued data is flushed to the
+ * working image first.
+ */
+static int
+map_save(RDD_RESCUE_COPIER *s)
+{
+	char *tmppath;
+	FILE *fp;
+	unsigned i;
+	int rc = RDD_OK;
+
+	if (fsync(s->imagefd) < 0) {
+		return RDD_EWRITE;
+	}
+
+	if ((tmppath = malloc(strlen(s->mappath) + 5)) == 0) {
+		return RDD_NOMEM;
+	}
+	sprintf(tmppath, "%s.tmp", s->mappath);
+
+	if ((fp = fopen(tmppath, "w")) == 0) {
+		free(tmppath);
+		return RDD_EOPEN;
+	}
+	fprintf(fp, "# rdd rescue map\n");
+	fprintf(fp, "# offset count pass read-errors\n");
+	fprintf(fp, "%llu %llu %u %llu\n", (unsigned long long) s->offset,
+		(unsigned long long) s->count, s->pass,
+		(unsigned long long) s->nread_err);
+	fprintf(fp, "# position size status\n");
+	for (i = 0; i < s->next; i++) {
+		fprintf(fp, "%llu %llu %c\n",
+			(unsigned long long) s->ext[i].pos,
+			(unsigned long long) s->ext[i].size,
+			s->ext[i].status);
+	}
+	if (fflush(fp) == EOF || fsync(fileno(fp)) < 0) {
+		rc = RDD_EWRITE;
+	}
+	if (fclose(fp) == EOF) {
+		rc = RDD_ECLOSE;
+	}
+	if (rc == RDD_OK && rename(tmppath, s->mappath) < 0) {
+		rc = RDD_EWRITE;
+	}
+
+	free(tmppath);
+	s->nread = 0;
+	return rc;
+}
+
+/* Reads an existing map.  Returns RDD_NOTFOUND if there is no map
+ * file, and RDD_BADARG if the map describes a different input range.
+ * The read-error count is missing from maps of older rdd versions.
+ */
+static int
+map_load(RDD_RESCUE_COPIER *s)
+{
+	char line[RESCUE_MAX_LINE];
+	unsigned long long offset, count, pos, size, nerr;
+	rdd_count_t expect;
+	unsigned pass;
+	int header = 0;
+	char status;
+	FILE *fp;
+	int rc = RDD_OK;
+
+	if ((fp = fopen(s->mappath, "r")) == 0) {
+		return errno == ENOENT ? RDD_NOTFOUND : RDD_EOPEN;
+	}
+
+	expect = 0;
+	while (fgets(line, sizeof line, fp) != 0) {
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+		if (!header) {
+			nerr = 0;
+			if (sscanf(line, "%llu %llu %u %llu",
+				   &offset, &count, &pass, &nerr) < 3) {
+				rc = RDD_ESYNTAX;
+				break;
+			}
+			if (offset != s->offset || count != s->count) {
+				rc = RDD_BADARG;
+				break;
+			}
+			s->pass = pass;
+			s->nread_err = nerr;
+			expect = offset;
+			header = 1;
+			continue;
+		}
+		if (sscanf(line, "%llu %llu %c", &pos, &size, &status) != 3
+		||  pos != expect || size == 0) {
+			rc = RDD_ESYNTAX;
+			break;
+		}
+		if (status != RESCUE_UNTRIED && status != RESCUE_FAILED
+		&&  status != RESCUE_BAD && status != RESCUE_OK) {
+			rc = RDD_ESYNTAX;
+			break;
+		}
+		if ((rc = map_grow(s, 1)) != RDD_OK) {
+			break;
+		}
+		s->ext[s->next].pos = pos;
+		s->ext[s->next].size = size;
+		s->ext[s->next].status = status;
+		s->next++;
+		map_count(s, status, size, 1);
+		expect = pos + size;
+	}
+	if (rc == RDD_OK && (!header || expect != s->offset + s->count)) {
+		rc = RDD_ESYNTAX;
+	}
+
+	fclose(fp);
+	return rc;
+}
+
+static int
+map_init(RDD_RESCUE_COPIER *s)
+{
+	int rc;
+
+	s->next = 0;
+	if ((rc = map_grow(s, 1)) != RDD_OK) {
+		return rc;
+	}
+	s->ext[0].pos = s->offset;
+	s->ext[0].size = s->count;
+	s->ext[0].status = RESCUE_UNTRIED;
+	s->next = 1;
+	s->nok = 0;
+	s->nbad = 0;
+	s->pass = RESCUE_PASS_COPY;
+
+	return RDD_OK;
+}
+
+/* Reads nbyte bytes at input position pos.
+ */
+static int
+read_at(RDD_READER *reader, unsigned char *buf, unsigned nbyte,
+		rdd_count_t pos, unsigned *nread)
+{
+	int rc;
+
+	if (reader->ops->pread != 0) {
+		return rdd_reader_pread(reader, buf, nbyte, pos, nread);
+	}
+	if ((rc = rdd_reader_seek(reader, pos)) != RDD_OK) {
+		return rc;
+	}
+	return rdd_reader_read(reader, buf, nbyte, nread);
+}
+
+static int
+report_progress(RDD_RESCUE_COPIER *s)
+{
+	RDD_ROBUST_PARAMS *p = &s->params;
+
+	if (p->progressfun == 0) {
+		return RDD_OK;
+	}
+	return (*p->progressfun)(s->nok, s->nbad, p->progressenv);
+}
+
+/* Tries to rescue [pos, pos + nbyte).  On success the range is
+ * stored in the working image and marked as rescued.  On a read
+ * error the range gets status 'failstatus'.  Returns RDD_OK or
+ * RDD_EREAD, or some other error code if the rescue must stop.
+ */
+static int
+rescue_block(RDD_RESCUE_COPIER *s, RDD_READER *reader,
+		rdd_count_t pos, unsigned nbyte, int failstatus)
+{
+	RDD_ROBUST_PARAMS *p = &s->params;
+	unsigned char *buf = s->buf.aligned;
+	unsigned nread = 0;
+	ssize_t n;
+	int rc;
+
+	rc = read_at(reader, buf, nbyte, pos, &nread);
+	if (rc == RDD_OK && nread < nbyte) {
+		error("unexpected end-of-file at offset %llu "
+			"(expected %s bytes)",
+			pos + nread, rdd_strsize(s->offset + s->count));
+	}
+
+	if (rc == RDD_OK) {
+		n = pwrite(s->imagefd, buf, nbyte, (off_t) (pos - s->offset));
+		if (n != (ssize_t) nbyte) {
+			return RDD_EWRITE;
+		}
+		rc = map_set(s, pos, nbyte, RESCUE_OK);
+	} else if (rc == RDD_EREAD) {
+		s->nread_err++;
+		if (p->readerrfun != 0) {
+			(*p->readerrfun)(pos, nbyte, p->readerrenv);
+		}
+		if ((rc = map_set(s, pos, nbyte, failstatus)) == RDD_OK) {
+			rc = RDD_EREAD;
+		}
+	}
+	if (rc != RDD_OK && rc != RDD_EREAD) {
+		return rc;
+	}
+
+	if (++s->nread >= RESCUE_SAVE_INTERVAL) {
+		int rc2;
+
+		if ((rc2 = map_save(s)) != RDD_OK) {
+			return rc2;
+		}
+	}
+
+	return rc;
+}
+
+/* Pass 1: copies all untried extents with full-size blocks and skips
+ * ahead after read errors.
+ */
+static int
+copy_pass(RDD_RESCUE_COPIER *s, RDD_READER *reader)
+{
+	unsigned blocklen = s->params.maxblocklen;
+	rdd_count_t maxskip = (rdd_count_t) RESCUE_MAX_SKIP_BLOCKS * blocklen;
+	rdd_count_t pos, start, end, skip = 0, n;
+	int rc;
+
+	pos = s->offset;
+	while (map_find_next(s, pos, RESCUE_UNTRIED, &start, &end)) {
+		pos = start;
+		n = end - pos < blocklen ? end - pos : blocklen;
+
+		rc = rescue_block(s, reader, pos, (unsigned) n, RESCUE_FAILED);
+		pos += n;
+		if (rc == RDD_OK) {
+			skip = 0;
+		} else if (rc == RDD_EREAD) {
+			/* Skip ahead; the skipped range is left for the
+			 * later passes.
+			 */
+			skip = skip == 0 ? blocklen : 2 * skip;
+			if (skip > maxskip) {
+				skip = maxskip;
+			}
+			n = end - pos < skip ? end - pos : skip;
+			if ((rc = map_set(s, pos, n, RESCUE_FAILED)) != RDD_OK) {
+				return rc;
+			}
+			pos += n;
+		} else {
+			return rc;
+		}
+
+		if ((rc = report_progress(s)) != RDD_OK) {
+			return rc;
+		}
+	}
+
+	return RDD_OK;
+}
+
+/* Reads all extents with status 'status' forward in blocks of
+ * blocklen bytes.  Blocks that fail get status RESCUE_BAD.
+ */
+static int
+forward_pass(RDD_RESCUE_COPIER *s, RDD_READER *reader, int status,
+		unsigned blocklen)
+{
+	rdd_count_t pos, start, end, n;
+	int rc;
+
+	pos = s->offset;
+	while (map_find_next(s, pos, status, &start, &end)) {
+		pos = start;
+		n = end - pos < blocklen ? end - pos : blocklen;
+
+		rc = rescue_block(s, reader, pos, (unsigned) n, RESCUE_BAD);
+		if (rc != RDD_OK && rc != RDD_EREAD) {
+			return rc;
+		}
+		pos += n;
+
+		if ((rc = report_progress(s)) != RDD_OK) {
+			return rc;
+		}
+	}
+
+	return RDD_OK;
+}
+
+/* Reads all bad extents backward in blocks of blocklen bytes.
+ */
+static int
+reverse_pass(RDD_RESCUE_COPIER *s, RDD_READER *reader, unsigned blocklen)
+{
+	rdd_count_t pos, start, end, n;
+	int rc;
+
+	pos = s->offset + s->count;
+	while (map_find_prev(s, pos, RESCUE_BAD, &start, &end)) {
+		n = end - start < blocklen ? end - start : blocklen;
+		pos = end - n;
+
+		rc = rescue_block(s, reader, pos, (unsigned) n, RESCUE_BAD);
+		if (rc != RDD_OK && rc != RDD_EREAD) {
+			return rc;
+		}
+
+		if ((rc = report_progress(s)) != RDD_OK) {
+			return rc;
+		}
+	}
+
+	return RDD_OK;
+}
+
+static int
+run_passes(RDD_RESCUE_COPIER *s, RDD_READER *reader)
+{
+	RDD_ROBUST_PARAMS *p = &s->params;
+	unsigned lastpass = RESCUE_PASS_RETRY + p->nretry;
+	int rc = RDD_OK;
+
+	for (; s->pass < lastpass; s->pass++) {
+		if ((rc = map_save(s)) != RDD_OK) {
+			return rc;
+		}
+		errlognl("rescue pass %u: %llu bytes rescued, "
+			"%llu bytes to go", s->pass,
+			(unsigned long long) s->nok,
+			(unsigned long long) (s->count - s->nok));
+
+		switch (s->pass) {
+		case RESCUE_PASS_COPY:
+			rc = copy_pass(s, reader);
+			break;
+		case RESCUE_PASS_SPLIT:
+			rc = forward_pass(s, reader, RESCUE_FAILED,
+					p->maxblocklen);
+			break;
+		case RESCUE_PASS_TRIM:
+			rc = reverse_pass(s, reader, p->minblocklen);
+			break;
+		default:
+			rc = forward_pass(s, reader, RESCUE_BAD,
+					p->minblocklen);
+			break;
+		}
+		if (rc != RDD_OK) {
+			return rc;
+		}
+	}
+
+	return map_save(s);
+}
+
+/* Returns the number of zero blocks that push_image() substitutes:
+ * every extent that was not rescued is pushed in blocks of at most
+ * maxblocklen bytes.
+ */
+static rdd_count_t
+count_subst(RDD_RESCUE_COPIER *s)
+{
+	rdd_count_t nsubst = 0;
+	unsigned blocklen = s->params.maxblocklen;
+	unsigned i;
+
+	for (i = 0; i < s->next; i++) {
+		if (s->ext[i].status != RESCUE_OK) {
+			nsubst += (s->ext[i].size + blocklen - 1) / blocklen;
+		}
+	}
+	return nsubst;
+}
+
+/* Pushes the assembled image through the filters, in order.
+ * Bad extents are replaced by zeroes.
+ */
+static int
+push_image(RDD_RESCUE_COPIER *s, RDD_FILTERSET *fset, RDD_COPIER_RETURN *ret)
+{
+	RDD_ROBUST_PARAMS *p = &s->params;
+	unsigned char *buf = s->buf.aligned;
+	RDD_RESCUE_EXTENT *e;
+	rdd_count_t pos, end;
+	unsigned i, n;
+	ssize_t nread;
+	int rc;
+
+	for (i = 0; i < s->next; i++) {
+		e = &s->ext[i];
+		end = e->pos + e->size;
+		for (pos = e->pos; pos < end; pos += n) {
+			n = end - pos < p->maxblocklen ?
+				(unsigned) (end - pos) : p->maxblocklen;
+
+			if (e->status == RESCUE_OK) {
+				nread = pread(s->imagefd, buf, n,
+						(off_t) (pos - s->offset));
+				if (nread != (ssize_t) n) {
+					return RDD_EREAD;
+				}
+			} else {
+				memset(buf, 0, n);
+			}
+
+			if ((rc = rdd_fset_push(fset, buf, n)) != RDD_OK) {
+				return rc;
+			}
+			ret->nbyte += n;
+
+			if (e->status != RESCUE_OK) {
+				ret->nlost += n;
+				ret->nsubst++;
+				if (p->substfun != 0) {
+					(*p->substfun)(pos, n, p->substenv);
+				}
+			}
+		}
+	}
+
+	return RDD_OK;
+}
+
+/* Checks that the working image of a resumed rescue is still the one
+ * that the map describes.  Without it, the data that the map marks as
+ * rescued would be lost.
+ */
+static int
+check_image(RDD_RESCUE_COPIER *s)
+{
+	struct stat info;
+
+	if (fstat(s->imagefd, &info) < 0) {
+		return RDD_EOPEN;
+	}
+	if ((rdd_count_t) info.st_size != s->count) {
+		errlognl("rescue image %s has %llu bytes instead of %llu; "
+			"cannot resume", s->imagepath,
+			(unsigned long long) info.st_size,
+			(unsigned long long) s->count);
+		return RDD_BADARG;
+	}
+	return RDD_OK;
+}
+
+/* Removes the working image and the map of a completed rescue.
+ */
+static void
+remove_state(RDD_RESCUE_COPIER *s)
+{
+	if (unlink(s->imagepath) < 0) {
+		errlognl("cannot remove rescue image %s", s->imagepath);
+	}
+	if (unlink(s->mappath) < 0) {
+		errlognl("cannot remove rescue map %s", s->mappath);
+	}
+}
+
+static int
+rescue_exec(RDD_COPIER *c, RDD_READER *reader, RDD_FILTERSET *fset,
+					       RDD_COPIER_RETURN *ret)
+{
+	RDD_RESCUE_COPIER *s = (RDD_RESCUE_COPIER *) c->state;
+	RDD_ROBUST_PARAMS *p = &s->params;
+	int flags = O_RDWR;
+	int aborted = 0;
+	int rc;
+
+	memset(ret, 0, sizeof(*ret));
+	s->nread = 0;
+	s->nread_err = 0;
+	s->nok = 0;
+	s->nbad = 0;
+
+	/* Resume from an existing map, or start a new rescue.
+	 */
+	rc = map_load(s);
+	if (rc == RDD_NOTFOUND) {
+		rc = map_init(s);
+		flags |= O_CREAT|O_TRUNC;
+	} else if (rc == RDD_OK) {
+		errlognl("resuming rescue from map %s at pass %u",
+			s->mappath, s->pass);
+	}
+	if (rc != RDD_OK) {
+		goto done;
+	}
+
+	if ((s->imagefd = open(s->imagepath, flags, 0600)) < 0) {
+		if (!(flags & O_CREAT)) {
+			errlognl("cannot open rescue image %s; cannot resume",
+				s->imagepath);
+		}
+		rc = RDD_EOPEN;
+		goto done;
+	}
+	if (flags & O_TRUNC) {
+		if (ftruncate(s->imagefd, (off_t) s->count) < 0) {
+			rc = RDD_ESPACE;
+			goto done;
+		}
+	} else if ((rc = check_image(s)) != RDD_OK) {
+		goto done;
+	}
+
+	rc = rdd_new_alignedbuf(&s->buf, p->maxblocklen, RDD_SECTOR_SIZE);
+	if (rc != RDD_OK) {
+		goto done;
+	}
+
+	rc = run_passes(s, reader);
+	ret->nread_err = s->nread_err;
+	if (rc == RDD_ABORTED) {
+		/* Interrupted; the map allows a later resume. */
+		map_save(s);
+		aborted = 1;
+		goto done;
+	} else if (rc != RDD_OK) {
+		map_save(s);
+		goto done;
+	}
+
+	if (p->maxsubst > 0) {
+		rdd_count_t nsubst = count_subst(s);
+
+		if (nsubst >= p->maxsubst) {
+			errlognl("giving up: %llu unreadable blocks would be "
+				"replaced by zeroes (limit %u)",
+				(unsigned long long) nsubst, p->maxsubst);
+			rc = RDD_ABORTED;
+			goto done;
+		}
+	}
+
+	if ((rc = push_image(s, fset, ret)) != RDD_OK) {
+		goto done;
+	}
+	ret->nread_err = s->nread_err;
+
+	if (p->progressfun != 0) {
+		((RDD_PROGRESS *)p->progressenv)->period=0;
+		((RDD_PROGRESS *)p->progressenv)->poll_delta=0;
+
+		rc = (*p->progressfun)(ret->nbyte, ret->nlost, p->progressenv);
+		if (rc == RDD_ABORTED) {
+			aborted = 1;
+		} else if (rc != RDD_OK) {
+			goto done;
+		}
+	}
+
+	rc = rdd_fset_close(fset);
+	if (rc == RDD_OK && !aborted) {
+		remove_state(s);
+	}
+
+done:
+	if (s->buf.unaligned != 0) {
+		rdd_free_alignedbuf(&s->buf);
+		s->buf.unaligned = 0;
+	}
+	if (s->imagefd >= 0) {
+		close(s->imagefd);
+		s->imagefd = -1;
+	}
+	free(s->ext);
+	s->ext = 0;
+	s->next = s->maxext = 0;
+
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	return aborted ? RDD_ABORTED : RDD_OK;
+}
+
+static int
+rescue_free(RDD_COPIER *c)
+{
+	RDD_RESCUE_COPIER *state = (RDD_RESCUE_COPIER *) c->state;
+
+	free(state->mappath);
+	free(state->imagepath);
+	return RDD_OK;
+}
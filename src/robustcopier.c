@@ -56,6 +56,7 @@ static char copyright[] =
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "rdd.h"
 #include "rdd_internals.h"
@@ -69,6 +70,7 @@ static char copyright[] =
 #include "netio.h"
 #include "alignedbuf.h"
 #include "progress.h"
+#include "bufring.h"
 
 #define KNOWN_INPUT_SIZE(s)   ((s)->count != RDD_WHOLE_FILE)
 
@@ -102,24 +104,48 @@ typedef struct _RDD_ROBUST_COPIER {
 	void                 *substenv;
 	rdd_proghandler_t     progressfun;
 	void                 *progressenv;
+	rdd_ckpthandler_t     checkpointfun;
+	void                 *checkpointenv;
+	rdd_count_t           checkpointlen;
+	rdd_count_t           checkpointpos;	/* nbyte at last checkpoint */
 
-	RDD_ALIGNEDBUF readbuf;
+	RDD_ALIGNEDBUF readbuf;		/* sequential mode only */
+
+	unsigned     nbuf;		/* pipelined mode only: ring size */
+	RDD_BUFRING *ring;		/* pipelined mode only: valid in exec */
 } RDD_ROBUST_COPIER;
 
+/* State of the filter stage of a pipelined copier.
+ */
+typedef struct _RDD_PIPELINE_STAGE {
+	RDD_BUFRING   *ring;
+	RDD_FILTERSET *fset;
+	int            rc;
+} RDD_PIPELINE_STAGE;
+
 static int robust_exec(RDD_COPIER *c, RDD_READER *r, 
 				      RDD_FILTERSET *fset,
 				      RDD_COPIER_RETURN *ret);
 static int robust_free(RDD_COPIER *c);
 
+static int pipelined_exec(RDD_COPIER *c, RDD_READER *r,
+				      RDD_FILTERSET *fset,
+				      RDD_COPIER_RETURN *ret);
+
 static RDD_COPY_OPS robust_ops = {
 	robust_exec,
 	robust_free
 };
 
-int
-rdd_new_robust_copier(RDD_COPIER **self,
+static RDD_COPY_OPS pipelined_ops = {
+	pipelined_exec,
+	robust_free
+};
+
+static int
+new_robust_copier(RDD_COPIER **self, RDD_COPY_OPS *ops,
 		rdd_count_t offset, rdd_count_t count,
-		RDD_ROBUST_PARAMS *p)
+		RDD_ROBUST_PARAMS *p, unsigned nbuf)
 {
 	RDD_COPIER *c = 0;
 	RDD_ROBUST_COPIER *state = 0;
@@ -129,7 +155,7 @@ rdd_new_robust_copier(RDD_COPIER **self,
 	if (p->minblocklen <= 0) return RDD_BADARG;
 	if (p->minblocklen > p->maxblocklen) return RDD_BADARG;
 
-	rc = rdd_new_copier(&c, &robust_ops, sizeof(RDD_ROBUST_COPIER));
+	rc = rdd_new_copier(&c, ops, sizeof(RDD_ROBUST_COPIER));
 	if (rc != RDD_OK) {
 		goto error;
 	}
@@ -150,6 +176,10 @@ rdd_new_robust_copier(RDD_COPIER **self,
 	state->substenv = p->substenv;
 	state->progressfun = p->progressfun;
 	state->progressenv = p->progressenv;
+	state->checkpointfun = p->checkpointfun;
+	state->checkpointenv = p->checkpointenv;
+	state->checkpointlen = p->checkpointlen;
+	state->checkpointpos = 0;
 	state->verbose = 1;
 
 	state->nretry = p->nretry;
@@ -165,12 +195,17 @@ rdd_new_robust_copier(RDD_COPIER **self,
 
 	/* Allocate a sector-aligned buffer.  Alignment is required
 	 * when rdd access a raw device (Linux: /dev/raw/raw1, ...).
-	 * It never hurts, so we always do this.
+	 * It never hurts, so we always do this.  A pipelined copier
+	 * reads into the (equally aligned) buffers of its ring.
 	 */
-	rc = rdd_new_alignedbuf(&state->readbuf, p->maxblocklen,
-				RDD_SECTOR_SIZE);
-	if (rc != RDD_OK) {
-		goto error;
+	state->nbuf = nbuf;
+	state->ring = 0;
+	if (nbuf == 0) {
+		rc = rdd_new_alignedbuf(&state->readbuf, p->maxblocklen,
+					RDD_SECTOR_SIZE);
+		if (rc != RDD_OK) {
+			goto error;
+		}
 	}
 
 #if 0
@@ -188,6 +223,24 @@ error:
 	return rc;
 }
 
+int
+rdd_new_robust_copier(RDD_COPIER **self,
+		rdd_count_t offset, rdd_count_t count,
+		RDD_ROBUST_PARAMS *p)
+{
+	return new_robust_copier(self, &robust_ops, offset, count, p, 0);
+}
+
+int
+rdd_new_pipelined_copier(RDD_COPIER **self,
+		rdd_count_t offset, rdd_count_t count,
+		RDD_ROBUST_PARAMS *p, unsigned nbuf)
+{
+	if (nbuf < 2) return RDD_BADARG;
+
+	return new_robust_copier(self, &pipelined_ops, offset, count, p, nbuf);
+}
+
 static void
 handle_eof(RDD_ROBUST_COPIER *state)
 {
@@ -314,51 +367,75 @@ handle_read_error(RDD_ROBUST_COPIER *state, RDD_READER *reader,
 	return rc;
 }
 
-/* Below follows the key copy routine.  Most complexity results
- * from the need to handle (disk) read errors properly.  In general
- * rdd makes no attempt to recover from TCP errors or disk-write errors.
- *
- * There are three states: READ_OK, READ_ERROR, READ_RECOVERY.
- * In state READ_OK, rdd reads at full speed and tries to double
- * the current read-block size until the default block size
- * is reached.
- *
- * State READ_ERROR is entered whenever a read error occurs.
- * In this state, rdd repeatedly tries to read a minimum-sized
- * block.  Variable ntry is valid in this state only.
- *
- * In state READ_RECOVERY, rdd recovers from a previous read
- * error.  This state is used to prevent rdd from increasing
- * its block size too quickly after a previous read error.
- * Variable nok is valid in this state only.
+/* Returns the buffer that the next block is read into.  A pipelined
+ * copier reads into a free slot of its buffer ring.
  */
 static int
-robust_exec(RDD_COPIER *c, RDD_READER *reader, RDD_FILTERSET *fset,
-					       RDD_COPIER_RETURN *ret)
+get_block_buffer(RDD_ROBUST_COPIER *s, unsigned char **buf)
 {
-	RDD_ROBUST_COPIER *s = (RDD_ROBUST_COPIER *) c->state;
-	RDD_READER *areader = 0;
-	uint32_t rsize;
-	unsigned nread;
-	unsigned char *buf = 0;
-	int aborted = 0;
-	int rc = RDD_OK;
+	if (s->ring != 0) {
+		return rdd_bufring_get_free(s->ring, buf);
+	}
 
-	ret->nbyte = 0;
-	ret->nlost = 0;
-	ret->nread_err = 0;
-	ret->nsubst = 0;
+	*buf = s->readbuf.aligned;
+	return RDD_OK;
+}
 
-	if ((rc = rdd_open_atomic_reader(&areader, reader)) != RDD_OK) {
-		return rc;
+/* Passes a block to the filters.  A pipelined copier publishes the
+ * block to its filter stage; the filter stage will push it.
+ */
+static int
+push_block(RDD_ROBUST_COPIER *s, RDD_FILTERSET *fset,
+		unsigned char *buf, unsigned nbyte)
+{
+	if (s->ring != 0) {
+		return rdd_bufring_put_full(s->ring, nbyte);
 	}
 
-	if (s->offset > 0) {
-		if ((rc = rdd_reader_skip(areader, s->offset)) != RDD_OK) {
+	return rdd_fset_push(fset, buf, nbyte);
+}
+
+/* Calls the checkpoint handler if enough data has been copied since
+ * the last checkpoint.  A pipelined copier first waits until its
+ * filter stage has pushed all blocks.
+ */
+static int
+checkpoint(RDD_ROBUST_COPIER *s)
+{
+	RDD_COPIER_RETURN state;
+	int rc;
+
+	if (s->checkpointfun == 0
+	||  s->nbyte - s->checkpointpos < s->checkpointlen) {
+		return RDD_OK;
+	}
+
+	if (s->ring != 0) {
+		if ((rc = rdd_bufring_wait_empty(s->ring)) != RDD_OK) {
 			return rc;
 		}
 	}
 
+	state.nbyte = s->nbyte;
+	state.nlost = s->nlost;
+	state.nread_err = s->nread_err;
+	state.nsubst = s->nsubst;
+	s->checkpointpos = s->nbyte;
+
+	return (*s->checkpointfun)(&state, s->checkpointenv);
+}
+
+static int
+robust_copy(RDD_ROBUST_COPIER *s, RDD_READER *areader, RDD_FILTERSET *fset,
+		int *aborted)
+{
+	uint32_t rsize;
+	unsigned nread;
+	unsigned char *buf = 0;
+	int rc = RDD_OK;
+
+	*aborted = 0;
+
 	while (s->nbyte < s->count) {
 		if (s->nbyte + s->curblocklen < s->count) {
 			/* Read a full block. */
@@ -368,7 +445,9 @@ robust_exec(RDD_COPIER *c, RDD_READER *reader, RDD_FILTERSET *fset,
 			rsize = (uint32_t) (s->count - s->nbyte);
 		}
 
-		buf = s->readbuf.aligned;
+		if ((rc = get_block_buffer(s, &buf)) != RDD_OK) {
+			return rc;
+		}
 		nread = 0;
 		rc = rdd_reader_read(areader, buf, rsize, &nread);
 		if (rc == RDD_OK && nread == 0) {
@@ -376,7 +455,7 @@ robust_exec(RDD_COPIER *c, RDD_READER *reader, RDD_FILTERSET *fset,
 			break;
 		} else if (rc == RDD_OK && nread > 0) {
 			handle_read_ok(s, rsize, nread);
-			rc = rdd_fset_push(fset, buf, nread);
+			rc = push_block(s, fset, buf, nread);
 			if (rc != RDD_OK) {
 				return rc;
 			}
@@ -404,7 +483,7 @@ robust_exec(RDD_COPIER *c, RDD_READER *reader, RDD_FILTERSET *fset,
 				 */
 				memset(buf, 0, rsize);
 				s->nlost += rsize;  /* XXX to subst handler */
-				rc = rdd_fset_push(fset, buf, rsize);
+				rc = push_block(s, fset, buf, rsize);
 				if (rc != RDD_OK) {
 					return rc;
 				}
@@ -430,14 +509,30 @@ robust_exec(RDD_COPIER *c, RDD_READER *reader, RDD_FILTERSET *fset,
 		if (s->progressfun != 0) {
 			rc = (*s->progressfun)(s->nbyte, s->nlost, s->progressenv);
 			if (rc == RDD_ABORTED) {
-				aborted = 1;
+				*aborted = 1;
 				break;
 			} else if (rc != RDD_OK) {
 				return rc;
 			}
 		}
+
+		if ((rc = checkpoint(s)) != RDD_OK) {
+			return rc;
+		}
 	}
 
+	return RDD_OK;
+}
+
+/* Reports final progress, closes the filters and the atomic reader
+ * and fills in the copier's return values.
+ */
+static int
+robust_finish(RDD_ROBUST_COPIER *s, RDD_READER *areader,
+		RDD_FILTERSET *fset, RDD_COPIER_RETURN *ret, int aborted)
+{
+	int rc;
+
 	if (s->progressfun != 0) {
 		((RDD_PROGRESS *)s->progressenv)->period=0;
 		((RDD_PROGRESS *)s->progressenv)->poll_delta=0;
@@ -470,10 +565,174 @@ robust_exec(RDD_COPIER *c, RDD_READER *reader, RDD_FILTERSET *fset,
 	return aborted ? RDD_ABORTED : RDD_OK;
 }
 
+static int
+robust_start(RDD_ROBUST_COPIER *s, RDD_READER *reader, RDD_READER **areader,
+		RDD_COPIER_RETURN *ret)
+{
+	int rc;
+
+	ret->nbyte = 0;
+	ret->nlost = 0;
+	ret->nread_err = 0;
+	ret->nsubst = 0;
+
+	if ((rc = rdd_open_atomic_reader(areader, reader)) != RDD_OK) {
+		return rc;
+	}
+
+	if (s->offset > 0) {
+		if ((rc = rdd_reader_skip(*areader, s->offset)) != RDD_OK) {
+			rdd_reader_close(*areader, 0);
+			return rc;
+		}
+	}
+
+	return RDD_OK;
+}
+
+/* Below follows the key copy routine.  Most complexity results
+ * from the need to handle (disk) read errors properly.  In general
+ * rdd makes no attempt to recover from TCP errors or disk-write errors.
+ *
+ * There are three states: READ_OK, READ_ERROR, READ_RECOVERY.
+ * In state READ_OK, rdd reads at full speed and tries to double
+ * the current read-block size until the default block size
+ * is reached.
+ *
+ * State READ_ERROR is entered whenever a read error occurs.
+ * In this state, rdd repeatedly tries to read a minimum-sized
+ * block.  Variable ntry is valid in this state only.
+ *
+ * In state READ_RECOVERY, rdd recovers from a previous read
+ * error.  This state is used to prevent rdd from increasing
+ * its block size too quickly after a previous read error.
+ * Variable nok is valid in this state only.
+ *
+ * The copy loop itself lives in robust_copy(); it is shared with
+ * the pipelined copier.
+ */
+static int
+robust_exec(RDD_COPIER *c, RDD_READER *reader, RDD_FILTERSET *fset,
+					       RDD_COPIER_RETURN *ret)
+{
+	RDD_ROBUST_COPIER *s = (RDD_ROBUST_COPIER *) c->state;
+	RDD_READER *areader = 0;
+	int aborted = 0;
+	int rc = RDD_OK;
+
+	if ((rc = robust_start(s, reader, &areader, ret)) != RDD_OK) {
+		return rc;
+	}
+
+	if ((rc = robust_copy(s, areader, fset, &aborted)) != RDD_OK) {
+		rdd_reader_close(areader, 0);
+		return rc;
+	}
+
+	return robust_finish(s, areader, fset, ret, aborted);
+}
+
+/* Filter stage of a pipelined copier: pushes each block that the
+ * read stage publishes through the filter set.  A filter error
+ * aborts the ring, which stops the read stage at its next block.
+ */
+static void *
+pipeline_filter_stage(void *arg)
+{
+	RDD_PIPELINE_STAGE *stage = (RDD_PIPELINE_STAGE *) arg;
+	unsigned char *buf;
+	unsigned nbyte;
+	int rc;
+
+	for (;;) {
+		rc = rdd_bufring_get_full(stage->ring, 0, &buf, &nbyte);
+		if (rc != RDD_OK || buf == 0) {
+			break;
+		}
+
+		rc = rdd_fset_push(stage->fset, buf, nbyte);
+		if (rc != RDD_OK) {
+			rdd_bufring_abort(stage->ring, rc);
+			break;
+		}
+
+		rdd_bufring_put_free(stage->ring, 0);
+	}
+
+	stage->rc = rc;
+	return 0;
+}
+
+/* A pipelined copier runs the robust copy loop in the calling thread
+ * (the read stage) and pushes the blocks it reads through the filter
+ * set in a separate thread (the filter stage).  The two stages are
+ * connected by a ring of nbuf sector-aligned blocks, so the read
+ * stage can run up to nbuf blocks ahead of the filters.  Read errors
+ * are handled exactly as by the robust copier: substituted blocks
+ * simply travel through the ring like any other block.
+ */
+static int
+pipelined_exec(RDD_COPIER *c, RDD_READER *reader, RDD_FILTERSET *fset,
+					       RDD_COPIER_RETURN *ret)
+{
+	RDD_ROBUST_COPIER *s = (RDD_ROBUST_COPIER *) c->state;
+	RDD_READER *areader = 0;
+	RDD_PIPELINE_STAGE stage;
+	pthread_t filter_thread;
+	int aborted = 0;
+	int rc = RDD_OK;
+
+	if ((rc = robust_start(s, reader, &areader, ret)) != RDD_OK) {
+		return rc;
+	}
+
+	rc = rdd_new_bufring(&s->ring, s->nbuf, s->maxblocklen,
+			RDD_SECTOR_SIZE, 1);
+	if (rc != RDD_OK) {
+		rdd_reader_close(areader, 0);
+		return rc;
+	}
+
+	stage.ring = s->ring;
+	stage.fset = fset;
+	stage.rc = RDD_OK;
+	if (pthread_create(&filter_thread, 0, pipeline_filter_stage, &stage)
+	    != 0) {
+		rc = RDD_NOMEM;
+		goto done;
+	}
+
+	rc = robust_copy(s, areader, fset, &aborted);
+	if (rc == RDD_OK) {
+		rdd_bufring_put_eof(s->ring);
+	} else {
+		rdd_bufring_abort(s->ring, rc);
+	}
+
+	pthread_join(filter_thread, 0);
+	if (rc == RDD_OK) {
+		rc = stage.rc;
+	}
+
+done:
+	rdd_free_bufring(s->ring);
+	s->ring = 0;
+
+	if (rc != RDD_OK) {
+		rdd_reader_close(areader, 0);
+		return rc;
+	}
+
+	return robust_finish(s, areader, fset, ret, aborted);
+}
+
 static int
 robust_free(RDD_COPIER *c)
 {
 	RDD_ROBUST_COPIER *state = (RDD_ROBUST_COPIER *) c->state;
 
+	if (state->nbuf > 0) {
+		return RDD_OK;
+	}
 	return rdd_free_alignedbuf(&state->readbuf);
 }
@@ -56,11 +56,21 @@ static char copyright[] =
 static int safe_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte);
 static int safe_close(RDD_WRITER *w);
 static int safe_compare_address(RDD_WRITER *w, struct addrinfo *address, int *result);
+static int safe_sync(RDD_WRITER *w);
+static int safe_truncate(RDD_WRITER *w, rdd_count_t pos);
+static int safe_skip(RDD_WRITER *w, rdd_count_t nbyte);
+static int safe_reserve(RDD_WRITER *w, rdd_count_t nbyte);
+static int safe_stream(RDD_WRITER *w);
 
 static RDD_WRITE_OPS safe_write_ops = {
 	safe_write,
 	safe_close,
-	safe_compare_address
+	safe_compare_address,
+	safe_sync,
+	safe_truncate,
+	safe_skip,
+	safe_reserve,
+	safe_stream
 };
 
 typedef struct _RDD_SAFE_WRITER {
@@ -112,7 +122,20 @@ rdd_open_safe_writer(RDD_WRITER **self, const char *path,
 	strcpy(pathcopy, path);
 	state->path = pathcopy;
 
-	rc = rdd_open_file_writer(&state->parent, path);
+	if (wmode == RDD_RESUME) {
+		/* Keep the existing contents; the caller truncates
+		 * the file with rdd_writer_truncate().
+		 */
+		int fd;
+
+		if ((fd = open(path, O_CREAT|O_WRONLY, S_IRUSR|S_IWUSR)) < 0) {
+			rc = RDD_EOPEN;
+			goto error;
+		}
+		rc = rdd_open_fd_writer(&state->parent, fd);
+	} else {
+		rc = rdd_open_file_writer(&state->parent, path);
+	}
 	if (rc != RDD_OK) {
 		goto error;
 	}
@@ -185,3 +208,43 @@ safe_compare_address(RDD_WRITER *self, struct addrinfo *address, int *result)
 	*result = (address == 0);
 	return RDD_OK;
 }
+
+static int
+safe_sync(RDD_WRITER *self)
+{
+	RDD_SAFE_WRITER *state = self->state;
+
+	return rdd_writer_sync(state->parent);
+}
+
+static int
+safe_truncate(RDD_WRITER *self, rdd_count_t pos)
+{
+	RDD_SAFE_WRITER *state = self->state;
+
+	return rdd_writer_truncate(state->parent, pos);
+}
+
+static int
+safe_skip(RDD_WRITER *self, rdd_count_t nbyte)
+{
+	RDD_SAFE_WRITER *state = self->state;
+
+	return rdd_writer_skip(state->parent, nbyte);
+}
+
+static int
+safe_reserve(RDD_WRITER *self, rdd_count_t nbyte)
+{
+	RDD_SAFE_WRITER *state = self->state;
+
+	return rdd_writer_reserve(state->parent, nbyte);
+}
+
+static int
+safe_stream(RDD_WRITER *self)
+{
+	RDD_SAFE_WRITER *state = self->state;
+
+	return rdd_writer_stream(state->parent);
+}
@@ -57,22 +57,28 @@ static char copyright[] =
 
 #include "writer.h"
 #include "filter.h"
+#include "hashengine.h"
 
 typedef struct _RDD_SHA1_STREAM_FILTER {
-	SHA_CTX   sha1_state;
+	RDD_HASH      hash;
 	unsigned char result[SHA_DIGEST_LENGTH];
 } RDD_SHA1_STREAM_FILTER;
 
 static int sha1_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte);
 static int sha1_close(RDD_FILTER *f);
 static int sha1_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte);
+static int sha1_free(RDD_FILTER *f);
+static int sha1_save(RDD_FILTER *f, FILE *fp);
+static int sha1_restore(RDD_FILTER *f, FILE *fp);
 
 static RDD_FILTER_OPS sha1_ops = {
 	sha1_input,
 	0,
 	sha1_close,
 	sha1_get_result,
-	0
+	sha1_free,
+	sha1_save,
+	sha1_restore
 };
 
 int
@@ -92,7 +98,10 @@ rdd_new_sha1_streamfilter(RDD_FILTER **self)
 	}
 	state = (RDD_SHA1_STREAM_FILTER *) f->state;
 
-	SHA1_Init(&state->sha1_state);
+	if ((rc = rdd_hash_init(&state->hash, RDD_HASH_SHA1)) != RDD_OK) {
+		rdd_filter_free(f);
+		return rc;
+	}
 
 	*self = f;
 	return RDD_OK;
@@ -105,7 +114,7 @@ sha1_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
 
 	RDD_SHA1_STREAM_FILTER *state = (RDD_SHA1_STREAM_FILTER *) f->state;
 
-	SHA1_Update(&state->sha1_state, (unsigned char *) buf, nbyte);
+	rdd_hash_update(&state->hash, buf, nbyte);
 
 	return RDD_OK;
 }
@@ -119,9 +128,7 @@ sha1_close(RDD_FILTER *f)
 
 	RDD_SHA1_STREAM_FILTER *state = (RDD_SHA1_STREAM_FILTER *) f->state;
 
-	SHA1_Final(state->result, &state->sha1_state);
-
-	return RDD_OK;
+	return rdd_hash_final(&state->hash, state->result);
 }
 
 static int
@@ -141,3 +148,29 @@ sha1_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte)
 
 	return RDD_OK;
 }
+
+static int
+sha1_free(RDD_FILTER *f)
+{
+	RDD_SHA1_STREAM_FILTER *state = (RDD_SHA1_STREAM_FILTER *) f->state;
+
+	return rdd_hash_free(&state->hash);
+}
+
+/* The saved state is that of the hash engine (see rdd_hash_save()).
+ */
+static int
+sha1_save(RDD_FILTER *f, FILE *fp)
+{
+	RDD_SHA1_STREAM_FILTER *state = (RDD_SHA1_STREAM_FILTER *) f->state;
+
+	return rdd_hash_save(&state->hash, fp);
+}
+
+static int
+sha1_restore(RDD_FILTER *f, FILE *fp)
+{
+	RDD_SHA1_STREAM_FILTER *state = (RDD_SHA1_STREAM_FILTER *) f->state;
+
+	return rdd_hash_restore(&state->hash, fp);
+}
@@ -50,22 +50,28 @@ static char copyright[] =
 
 #include "writer.h"
 #include "filter.h"
+#include "hashengine.h"
 
 typedef struct _RDD_SHA256_STREAM_FILTER {
-	SHA256_CTX   sha256_state;
+	RDD_HASH      hash;
 	unsigned char result[SHA256_DIGEST_LENGTH];
 } RDD_SHA256_STREAM_FILTER;
 
 static int sha256_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte);
 static int sha256_close(RDD_FILTER *f);
 static int sha256_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte);
+static int sha256_free(RDD_FILTER *f);
+static int sha256_save(RDD_FILTER *f, FILE *fp);
+static int sha256_restore(RDD_FILTER *f, FILE *fp);
 
 static RDD_FILTER_OPS sha256_ops = {
 	sha256_input,
 	0,
 	sha256_close,
 	sha256_get_result,
-	0
+	sha256_free,
+	sha256_save,
+	sha256_restore
 };
 
 int
@@ -85,7 +91,10 @@ rdd_new_sha256_streamfilter(RDD_FILTER **self)
 	}
 	state = (RDD_SHA256_STREAM_FILTER *) f->state;
 
-	SHA256_Init(&state->sha256_state);
+	if ((rc = rdd_hash_init(&state->hash, RDD_HASH_SHA256)) != RDD_OK) {
+		rdd_filter_free(f);
+		return rc;
+	}
 
 	*self = f;
 	return RDD_OK;
@@ -98,7 +107,7 @@ sha256_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
 
 	RDD_SHA256_STREAM_FILTER *state = (RDD_SHA256_STREAM_FILTER *) f->state;
 
-	SHA256_Update(&state->sha256_state, (unsigned char *) buf, nbyte);
+	rdd_hash_update(&state->hash, buf, nbyte);
 
 	return RDD_OK;
 }
@@ -112,9 +121,7 @@ sha256_close(RDD_FILTER *f)
 
 	RDD_SHA256_STREAM_FILTER *state = (RDD_SHA256_STREAM_FILTER *) f->state;
 
-	SHA256_Final(state->result, &state->sha256_state);
-
-	return RDD_OK;
+	return rdd_hash_final(&state->hash, state->result);
 }
 
 static int
@@ -132,3 +139,29 @@ sha256_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte)
 
 	return RDD_OK;
 }
+
+static int
+sha256_free(RDD_FILTER *f)
+{
+	RDD_SHA256_STREAM_FILTER *state = (RDD_SHA256_STREAM_FILTER *) f->state;
+
+	return rdd_hash_free(&state->hash);
+}
+
+/* The saved state is that of the hash engine (see rdd_hash_save()).
+ */
+static int
+sha256_save(RDD_FILTER *f, FILE *fp)
+{
+	RDD_SHA256_STREAM_FILTER *state = (RDD_SHA256_STREAM_FILTER *) f->state;
+
+	return rdd_hash_save(&state->hash, fp);
+}
+
+static int
+sha256_restore(RDD_FILTER *f, FILE *fp)
+{
+	RDD_SHA256_STREAM_FILTER *state = (RDD_SHA256_STREAM_FILTER *) f->state;
+
+	return rdd_hash_restore(&state->hash, fp);
+}
@@ -50,22 +50,28 @@ static char copyright[] =
 
 #include "writer.h"
 #include "filter.h"
+#include "hashengine.h"
 
 typedef struct _RDD_SHA384_STREAM_FILTER {
-	SHA512_CTX   sha384_state;
+	RDD_HASH      hash;
 	unsigned char result[SHA384_DIGEST_LENGTH];
 } RDD_SHA384_STREAM_FILTER;
 
 static int sha384_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte);
 static int sha384_close(RDD_FILTER *f);
 static int sha384_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte);
+static int sha384_free(RDD_FILTER *f);
+static int sha384_save(RDD_FILTER *f, FILE *fp);
+static int sha384_restore(RDD_FILTER *f, FILE *fp);
 
 static RDD_FILTER_OPS sha384_ops = {
 	sha384_input,
 	0,
 	sha384_close,
 	sha384_get_result,
-	0
+	sha384_free,
+	sha384_save,
+	sha384_restore
 };
 
 int
@@ -85,7 +91,10 @@ rdd_new_sha384_streamfilter(RDD_FILTER **self)
 	}
 	state = (RDD_SHA384_STREAM_FILTER *) f->state;
 
-	SHA384_Init(&state->sha384_state);
+	if ((rc = rdd_hash_init(&state->hash, RDD_HASH_SHA384)) != RDD_OK) {
+		rdd_filter_free(f);
+		return rc;
+	}
 
 	*self = f;
 	return RDD_OK;
@@ -98,7 +107,7 @@ sha384_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
 
 	RDD_SHA384_STREAM_FILTER *state = (RDD_SHA384_STREAM_FILTER *) f->state;
 
-	SHA384_Update(&state->sha384_state, (unsigned char *) buf, nbyte);
+	rdd_hash_update(&state->hash, buf, nbyte);
 
 	return RDD_OK;
 }
@@ -112,9 +121,7 @@ sha384_close(RDD_FILTER *f)
 
 	RDD_SHA384_STREAM_FILTER *state = (RDD_SHA384_STREAM_FILTER *) f->state;
 
-	SHA384_Final(state->result, &state->sha384_state);
-
-	return RDD_OK;
+	return rdd_hash_final(&state->hash, state->result);
 }
 
 static int
@@ -132,3 +139,29 @@ sha384_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte)
 
 	return RDD_OK;
 }
+
+static int
+sha384_free(RDD_FILTER *f)
+{
+	RDD_SHA384_STREAM_FILTER *state = (RDD_SHA384_STREAM_FILTER *) f->state;
+
+	return rdd_hash_free(&state->hash);
+}
+
+/* The saved state is that of the hash engine (see rdd_hash_save()).
+ */
+static int
+sha384_save(RDD_FILTER *f, FILE *fp)
+{
+	RDD_SHA384_STREAM_FILTER *state = (RDD_SHA384_STREAM_FILTER *) f->state;
+
+	return rdd_hash_save(&state->hash, fp);
+}
+
+static int
+sha384_restore(RDD_FILTER *f, FILE *fp)
+{
+	RDD_SHA384_STREAM_FILTER *state = (RDD_SHA384_STREAM_FILTER *) f->state;
+
+	return rdd_hash_restore(&state->hash, fp);
+}
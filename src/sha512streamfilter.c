@@ -50,22 +50,28 @@ static char copyright[] =
 
 #include "writer.h"
 #include "filter.h"
+#include "hashengine.h"
 
 typedef struct _RDD_SHA512_STREAM_FILTER {
-	SHA512_CTX   sha512_state;
+	RDD_HASH      hash;
 	unsigned char result[SHA512_DIGEST_LENGTH];
 } RDD_SHA512_STREAM_FILTER;
 
 static int sha512_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte);
 static int sha512_close(RDD_FILTER *f);
 static int sha512_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte);
+static int sha512_free(RDD_FILTER *f);
+static int sha512_save(RDD_FILTER *f, FILE *fp);
+static int sha512_restore(RDD_FILTER *f, FILE *fp);
 
 static RDD_FILTER_OPS sha512_ops = {
 	sha512_input,
 	0,
 	sha512_close,
 	sha512_get_result,
-	0
+	sha512_free,
+	sha512_save,
+	sha512_restore
 };
 
 int
@@ -85,7 +91,10 @@ rdd_new_sha512_streamfilter(RDD_FILTER **self)
 	}
 	state = (RDD_SHA512_STREAM_FILTER *) f->state;
 
-	SHA512_Init(&state->sha512_state);
+	if ((rc = rdd_hash_init(&state->hash, RDD_HASH_SHA512)) != RDD_OK) {
+		rdd_filter_free(f);
+		return rc;
+	}
 
 	*self = f;
 	return RDD_OK;
@@ -96,7 +105,7 @@ sha512_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
 {
 	RDD_SHA512_STREAM_FILTER *state = (RDD_SHA512_STREAM_FILTER *) f->state;
 
-	SHA512_Update(&state->sha512_state, (unsigned char *) buf, nbyte);
+	rdd_hash_update(&state->hash, buf, nbyte);
 
 	return RDD_OK;
 }
@@ -110,9 +119,7 @@ sha512_close(RDD_FILTER *f)
 
 	RDD_SHA512_STREAM_FILTER *state = (RDD_SHA512_STREAM_FILTER *) f->state;
 
-	SHA512_Final(state->result, &state->sha512_state);
-
-	return RDD_OK;
+	return rdd_hash_final(&state->hash, state->result);
 }
 
 static int
@@ -130,3 +137,29 @@ sha512_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte)
 
 	return RDD_OK;
 }
+
+static int
+sha512_free(RDD_FILTER *f)
+{
+	RDD_SHA512_STREAM_FILTER *state = (RDD_SHA512_STREAM_FILTER *) f->state;
+
+	return rdd_hash_free(&state->hash);
+}
+
+/* The saved state is that of the hash engine (see rdd_hash_save()).
+ */
+static int
+sha512_save(RDD_FILTER *f, FILE *fp)
+{
+	RDD_SHA512_STREAM_FILTER *state = (RDD_SHA512_STREAM_FILTER *) f->state;
+
+	return rdd_hash_save(&state->hash, fp);
+}
+
+static int
+sha512_restore(RDD_FILTER *f, FILE *fp)
+{
+	RDD_SHA512_STREAM_FILTER *state = (RDD_SHA512_STREAM_FILTER *) f->state;
+
+	return rdd_hash_restore(&state->hash, fp);
+}
@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rdd.h"
+#include "writer.h"
+#include "msgprinter.h"
+#include "zeroblock.h"
+
+/* A sparse writer classifies its input block by block (blocks are
+ * aligned to the start of the output) and gathers consecutive zero
+ * blocks into a pending hole.  The hole is passed to the parent's
+ * skip routine when the next nonzero data arrives, or when the
+ * writer is synced or closed, so that a long zero run costs a single
+ * seek.  Nonzero blocks go to the parent in runs as large as the
+ * caller's buffer allows.  Only whole blocks become holes.
+ */
+
+/* Forward declarations
+ */
+static int sparse_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte);
+static int sparse_close(RDD_WRITER *w);
+static int sparse_compare_address(RDD_WRITER *w, struct addrinfo *address, int *result);
+static int sparse_sync(RDD_WRITER *w);
+static int sparse_truncate(RDD_WRITER *w, rdd_count_t pos);
+static int sparse_skip(RDD_WRITER *w, rdd_count_t nbyte);
+
+static RDD_WRITE_OPS sparse_write_ops = {
+	sparse_write,
+	sparse_close,
+	sparse_compare_address,
+	sparse_sync,
+	sparse_truncate,
+	sparse_skip
+};
+
+typedef struct _RDD_SPARSE_WRITER {
+	RDD_WRITER     *parent;
+	RDD_MSGPRINTER *map;		/* sparse map, or 0 */
+	rdd_count_t     pos;		/* # bytes received so far */
+	rdd_count_t     hole_start;	/* offset of the pending hole */
+	rdd_count_t     hole_len;	/* length of the pending hole */
+	unsigned char   partial[RDD_SPARSE_BLOCKSIZE]; /* incomplete block */
+	unsigned        npartial;	/* # bytes in partial */
+	int             no_holes;	/* parent cannot skip */
+} RDD_SPARSE_WRITER;
+
+int
+rdd_open_sparse_writer(RDD_WRITER **self, RDD_WRITER *parent,
+			const char *mappath, rdd_write_mode_t overwrite)
+{
+	RDD_WRITER *w = 0;
+	RDD_SPARSE_WRITER *state = 0;
+	RDD_MSGPRINTER *map = 0;
+	int rc = RDD_OK;
+
+	if (self == 0 || parent == 0) {
+		return RDD_BADARG;
+	}
+
+	rc = rdd_new_writer(&w, &sparse_write_ops, sizeof(RDD_SPARSE_WRITER));
+	if (rc != RDD_OK) {
+		goto error;
+	}
+	state = (RDD_SPARSE_WRITER *) w->state;
+
+	if (mappath != 0) {
+		rc = rdd_mp_open_file_printer(&map, mappath, overwrite);
+		if (rc != RDD_OK) {
+			goto error;
+		}
+	}
+	state->parent = parent;
+	state->map = map;
+	state->pos = 0;
+	state->hole_len = 0;
+	state->npartial = 0;
+	state->no_holes = 0;
+
+	*self = w;
+	return RDD_OK;
+
+error:
+	*self = 0;
+	if (state != 0) free(state);
+	if (w != 0) free(w);
+	return rc;
+}
+
+/* Writes nbyte zero bytes to the parent.
+ */
+static int
+write_zeros(RDD_SPARSE_WRITER *state, rdd_count_t nbyte)
+{
+	static const unsigned char zeros[RDD_SPARSE_BLOCKSIZE];
+	unsigned n;
+	int rc;
+
+	while (nbyte > 0) {
+		n = nbyte < sizeof zeros ? (unsigned) nbyte : sizeof zeros;
+		if ((rc = rdd_writer_write(state->parent, zeros, n)) != RDD_OK) {
+			return rc;
+		}
+		nbyte -= n;
+	}
+	return RDD_OK;
+}
+
+/* Passes the pending hole (if any) on to the parent.
+ */
+static int
+flush_hole(RDD_SPARSE_WRITER *state)
+{
+	rdd_count_t len = state->hole_len;
+	int rc;
+
+	if (len == 0) {
+		return RDD_OK;
+	}
+	state->hole_len = 0;
+
+	if (! state->no_holes) {
+		rc = rdd_writer_skip(state->parent, len);
+		if (rc == RDD_OK) {
+			if (state->map != 0) {
+				rdd_mp_message(state->map, RDD_MSG_INFO,
+					"%llu\t%llu", state->hole_start, len);
+			}
+			return RDD_OK;
+		} else if (rc != RDD_NOTFOUND) {
+			return rc;
+		}
+		state->no_holes = 1;
+	}
+	return write_zeros(state, len);
+}
+
+static void
+add_hole(RDD_SPARSE_WRITER *state, rdd_count_t nbyte)
+{
+	if (state->hole_len == 0) {
+		state->hole_start = state->pos;
+	}
+	state->hole_len += nbyte;
+	state->pos += nbyte;
+}
+
+/* Passes on nbyte bytes that start at the current position.  Whole
+ * zero blocks become (part of) a hole; everything else is written.
+ */
+static int
+put_blocks(RDD_SPARSE_WRITER *state, const unsigned char *buf, unsigned nbyte)
+{
+	unsigned len, n;
+	int zero, z;
+	int rc;
+
+	while (nbyte > 0) {
+		/* Find the end of the run of zero (or nonzero) blocks
+		 * that starts at buf.
+		 */
+		zero = -1;
+		for (len = 0; len < nbyte; len += n) {
+			n = RDD_SPARSE_BLOCKSIZE
+				- (unsigned) ((state->pos + len) % RDD_SPARSE_BLOCKSIZE);
+			if (n > nbyte - len) {
+				n = nbyte - len;
+			}
+			z = n == RDD_SPARSE_BLOCKSIZE && rdd_is_zero(buf + len, n);
+			if (zero < 0) {
+				zero = z;
+			} else if (z != zero) {
+				break;
+			}
+		}
+
+		if (zero) {
+			add_hole(state, len);
+		} else {
+			if ((rc = flush_hole(state)) != RDD_OK) {
+				return rc;
+			}
+			if ((rc = rdd_writer_write(state->parent, buf, len)) != RDD_OK) {
+				return rc;
+			}
+			state->pos += len;
+		}
+		buf += len;
+		nbyte -= len;
+	}
+
+	return RDD_OK;
+}
+
+/* Writes the buffered start of an incomplete block, if any.
+ */
+static int
+flush_partial(RDD_SPARSE_WRITER *state)
+{
+	int rc;
+
+	if (state->npartial == 0) {
+		return RDD_OK;
+	}
+	if ((rc = flush_hole(state)) != RDD_OK) {
+		return rc;
+	}
+	rc = rdd_writer_write(state->parent, state->partial, state->npartial);
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state->pos += state->npartial;
+	state->npartial = 0;
+
+	return RDD_OK;
+}
+
+/* Input that ends inside a block is held back until the block is
+ * complete, so that the block can still become part of a hole when
+ * the caller's buffers are not block aligned.
+ */
+static int
+sparse_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte)
+{
+	RDD_SPARSE_WRITER *state = w->state;
+	unsigned n, tail;
+	int rc;
+
+	if (state->no_holes) {
+		if ((rc = flush_hole(state)) != RDD_OK
+		||  (rc = flush_partial(state)) != RDD_OK) {
+			return rc;
+		}
+		state->pos += nbyte;
+		return rdd_writer_write(state->parent, buf, nbyte);
+	}
+
+	if (state->npartial > 0) {
+		n = RDD_SPARSE_BLOCKSIZE - (unsigned)
+			((state->pos + state->npartial) % RDD_SPARSE_BLOCKSIZE);
+		if (n > nbyte) {
+			n = nbyte;
+		}
+		memcpy(state->partial + state->npartial, buf, n);
+		state->npartial += n;
+		buf += n;
+		nbyte -= n;
+		if ((state->pos + state->npartial) % RDD_SPARSE_BLOCKSIZE != 0) {
+			return RDD_OK;	/* block still incomplete */
+		}
+		n = state->npartial;
+		state->npartial = 0;
+		if ((rc = put_blocks(state, state->partial, n)) != RDD_OK) {
+			return rc;
+		}
+	}
+
+	tail = (unsigned) ((state->pos + nbyte) % RDD_SPARSE_BLOCKSIZE);
+	if (tail > nbyte) {
+		tail = nbyte;
+	}
+	if ((rc = put_blocks(state, buf, nbyte - tail)) != RDD_OK) {
+		return rc;
+	}
+	memcpy(state->partial, buf + nbyte - tail, tail);
+	state->npartial = tail;
+
+	return RDD_OK;
+}
+
+static int
+sparse_close(RDD_WRITER *self)
+{
+	RDD_SPARSE_WRITER *state = self->state;
+	int rc;
+
+	if ((rc = flush_hole(state)) != RDD_OK
+	||  (rc = flush_partial(state)) != RDD_OK) {
+		return rc;
+	}
+	if (state->map != 0) {
+		rc = rdd_mp_close(state->map, RDD_MP_RECURSE|RDD_MP_READONLY);
+		if (rc != RDD_OK) {
+			return rc;
+		}
+		state->map = 0;
+	}
+	return rdd_writer_close(state->parent);
+}
+
+static int
+sparse_compare_address(RDD_WRITER *self, struct addrinfo *address, int *result)
+{
+	RDD_SPARSE_WRITER *state = self->state;
+
+	return rdd_compare_address(state->parent, address, result);
+}
+
+static int
+sparse_sync(RDD_WRITER *self)
+{
+	RDD_SPARSE_WRITER *state = self->state;
+	rdd_count_t size;
+	int rc;
+
+	if ((rc = flush_hole(state)) != RDD_OK
+	||  (rc = flush_partial(state)) != RDD_OK) {
+		return rc;
+	}
+	if (state->map != 0) {
+		if ((rc = rdd_mp_sync(state->map, &size)) != RDD_OK) {
+			return rc;
+		}
+	}
+	return rdd_writer_sync(state->parent);
+}
+
+/* The sparse map cannot be rolled back, so a writer with a map
+ * does not support truncation.
+ */
+static int
+sparse_truncate(RDD_WRITER *self, rdd_count_t pos)
+{
+	RDD_SPARSE_WRITER *state = self->state;
+	int rc;
+
+	if (state->map != 0) {
+		return RDD_NOTFOUND;
+	}
+	if ((rc = rdd_writer_truncate(state->parent, pos)) != RDD_OK) {
+		return rc;
+	}
+	state->hole_len = 0;
+	state->npartial = 0;
+	state->pos = pos;
+
+	return RDD_OK;
+}
+
+static int
+sparse_skip(RDD_WRITER *self, rdd_count_t nbyte)
+{
+	RDD_SPARSE_WRITER *state = self->state;
+	int rc;
+
+	if ((rc = flush_partial(state)) != RDD_OK) {
+		return rc;
+	}
+	add_hole(state, nbyte);
+	return RDD_OK;
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+/* A fixed-size pool of worker threads that share a bounded task
+ * queue.  The queue is a ring of maxqueue entries; qhead is the next
+ * task to run and qlen the number of queued tasks.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "rdd.h"
+#include "threadpool.h"
+
+typedef struct _RDD_TASK {
+	rdd_task_fun fun;
+	void        *arg;
+} RDD_TASK;
+
+struct _RDD_THREADPOOL {
+	pthread_mutex_t lock;
+	pthread_cond_t  task_queued;	/* signalled when a task is queued */
+	pthread_cond_t  task_done;	/* signalled when a task finishes */
+	pthread_t      *threads;
+	unsigned        nthread;
+	unsigned        nstarted;	/* # threads actually started */
+	RDD_TASK       *queue;
+	unsigned        maxqueue;
+	unsigned        qhead;
+	unsigned        qlen;
+	unsigned        nbusy;		/* # tasks being run */
+	int             stop;
+	int             error;		/* first task error */
+};
+
+unsigned
+rdd_ncpu(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return n < 1 ? 1 : (unsigned) n;
+}
+
+static void *
+worker(void *arg)
+{
+	RDD_THREADPOOL *pool = (RDD_THREADPOOL *) arg;
+	RDD_TASK task;
+	int rc;
+
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+		while (pool->qlen == 0 && !pool->stop) {
+			pthread_cond_wait(&pool->task_queued, &pool->lock);
+		}
+		if (pool->qlen == 0) {
+			break;		/* stopped and nothing left to do */
+		}
+
+		task = pool->queue[pool->qhead];
+		pool->qhead = (pool->qhead + 1) % pool->maxqueue;
+		pool->qlen--;
+		pool->nbusy++;
+		pthread_mutex_unlock(&pool->lock);
+
+		rc = (*task.fun)(task.arg);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->nbusy--;
+		if (rc != RDD_OK && pool->error == RDD_OK) {
+			pool->error = rc;
+		}
+		pthread_cond_broadcast(&pool->task_done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+int
+rdd_new_threadpool(RDD_THREADPOOL **self, unsigned nthread, unsigned maxqueue)
+{
+	RDD_THREADPOOL *pool = 0;
+	unsigned i;
+
+	if (self == 0 || maxqueue == 0) return RDD_BADARG;
+
+	if (nthread == 0) {
+		nthread = rdd_ncpu();
+	}
+
+	if ((pool = calloc(1, sizeof(RDD_THREADPOOL))) == 0) {
+		return RDD_NOMEM;
+	}
+	if ((pool->threads = calloc(nthread, sizeof(pthread_t))) == 0) {
+		free(pool);
+		return RDD_NOMEM;
+	}
+	if ((pool->queue = calloc(maxqueue, sizeof(RDD_TASK))) == 0) {
+		free(pool->threads);
+		free(pool);
+		return RDD_NOMEM;
+	}
+	pool->nthread = nthread;
+	pool->maxqueue = maxqueue;
+	pool->error = RDD_OK;
+
+	pthread_mutex_init(&pool->lock, 0);
+	pthread_cond_init(&pool->task_queued, 0);
+	pthread_cond_init(&pool->task_done, 0);
+
+	for (i = 0; i < nthread; i++) {
+		if (pthread_create(&pool->threads[i], 0, worker, pool) != 0) {
+			rdd_free_threadpool(pool);
+			return RDD_NOMEM;
+		}
+		pool->nstarted++;
+	}
+
+	*self = pool;
+	return RDD_OK;
+}
+
+unsigned
+rdd_threadpool_nthread(RDD_THREADPOOL *pool)
+{
+	return pool->nthread;
+}
+
+int
+rdd_threadpool_submit(RDD_THREADPOOL *pool, rdd_task_fun fun, void *arg)
+{
+	unsigned tail;
+
+	if (pool == 0 || fun == 0) return RDD_BADARG;
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->qlen == pool->maxqueue) {
+		pthread_cond_wait(&pool->task_done, &pool->lock);
+	}
+	tail = (pool->qhead + pool->qlen) % pool->maxqueue;
+	pool->queue[tail].fun = fun;
+	pool->queue[tail].arg = arg;
+	pool->qlen++;
+	pthread_cond_signal(&pool->task_queued);
+	pthread_mutex_unlock(&pool->lock);
+
+	return RDD_OK;
+}
+
+int
+rdd_threadpool_wait(RDD_THREADPOOL *pool)
+{
+	int rc;
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->qlen > 0 || pool->nbusy > 0) {
+		pthread_cond_wait(&pool->task_done, &pool->lock);
+	}
+	rc = pool->error;
+	pthread_mutex_unlock(&pool->lock);
+
+	return rc;
+}
+
+int
+rdd_free_threadpool(RDD_THREADPOOL *pool)
+{
+	unsigned i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->task_queued);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->nstarted; i++) {
+		pthread_join(pool->threads[i], 0);
+	}
+
+	pthread_cond_destroy(&pool->task_done);
+	pthread_cond_destroy(&pool->task_queued);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->queue);
+	free(pool->threads);
+	free(pool);
+
+	return RDD_OK;
+}
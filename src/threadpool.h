@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+
+#ifndef __threadpool_h__
+#define __threadpool_h__
+
+/** @file
+ *  \brief A fixed-size pool of worker threads.
+ *
+ *  Tasks are queued in submission order and run by the first idle
+ *  worker.  A task is a function that takes one argument and
+ *  returns an rdd error code.  The pool records the first error
+ *  returned by any task.
+ */
+
+struct _RDD_THREADPOOL;
+typedef struct _RDD_THREADPOOL RDD_THREADPOOL;
+
+typedef int (*rdd_task_fun)(void *arg);
+
+/** \brief Returns the number of online processors (at least 1).
+ */
+unsigned rdd_ncpu(void);
+
+/** \brief Creates a thread pool.
+ *  \param pool output value: will be set to the new pool.
+ *  \param nthread the number of worker threads; 0 means one per
+ *  online processor.
+ *  \param maxqueue the maximum number of queued tasks; must be at
+ *  least 1.
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOMEM if
+ *  there is insufficient memory or a thread cannot be started.
+ */
+int rdd_new_threadpool(RDD_THREADPOOL **pool, unsigned nthread,
+		unsigned maxqueue);
+
+/** \brief Returns the number of worker threads in \c pool.
+ */
+unsigned rdd_threadpool_nthread(RDD_THREADPOOL *pool);
+
+/** \brief Queues a task.
+ *  \param pool the thread pool.
+ *  \param fun the task function.
+ *  \param arg the argument passed to \c fun.
+ *  \return Returns \c RDD_OK on success.
+ *
+ *  This function blocks while the queue is full.
+ */
+int rdd_threadpool_submit(RDD_THREADPOOL *pool, rdd_task_fun fun, void *arg);
+
+/** \brief Waits until all queued tasks have finished.
+ *  \return Returns \c RDD_OK if all tasks that finished since the
+ *  pool was created succeeded; otherwise returns the first error.
+ */
+int rdd_threadpool_wait(RDD_THREADPOOL *pool);
+
+/** \brief Waits for all tasks, stops the worker threads and
+ *  deallocates the pool.
+ *  \return Always returns \c RDD_OK.
+ */
+int rdd_free_threadpool(RDD_THREADPOOL *pool);
+
+#endif /* __threadpool_h__ */
@@ -0,0 +1,486 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+/*
+ * A stream filter that computes a Merkle tree hash over fixed-size
+ * leaves.  The tree is the one of RFC 6962: a leaf hash is
+ * SHA-256(0x00 || data) and an interior node is
+ * SHA-256(0x01 || left || right), where the left subtree covers the
+ * largest power of two leaves that is smaller than the number of
+ * leaves.  The empty input hashes to SHA-256("").
+ *
+ * Leaves are copied into a small ring of slots and hashed by a thread
+ * pool, so the filter scales with the number of cores.  Leaf digests
+ * are merged in leaf order onto a stack of perfect subtrees (like a
+ * binary counter); the stack is folded into the root at close.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "rdd.h"
+#include "rdd_internals.h"
+
+#ifdef HAVE_OPENSSL
+#include <openssl/sha.h>
+#endif /* HAVE_OPENSSL */
+
+#include "writer.h"
+#include "filter.h"
+#include "hashengine.h"
+#include "threadpool.h"
+
+#define TREEHASH_LEAF_PREFIX	0x00
+#define TREEHASH_NODE_PREFIX	0x01
+
+/* Deep enough for 2^64 leaves. */
+#define TREEHASH_MAX_DEPTH	65
+
+typedef struct _TREEHASH_SLOT {
+	struct _RDD_TREEHASH_STREAM_FILTER *state;
+	unsigned char *buf;
+	unsigned       len;		/* # bytes in buf */
+	int            busy;		/* leaf is being hashed */
+	int            rc;
+	RDD_HASH       hash;
+	unsigned char  digest[SHA256_DIGEST_LENGTH];
+} TREEHASH_SLOT;
+
+typedef struct _TREEHASH_NODE {
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	rdd_count_t   nleaf;		/* # leaves below this node */
+} TREEHASH_NODE;
+
+/* Leaf i is stored in slot i % nslot.  Between calls, the slot of
+ * leaf nleaf is free and holds the bytes of the partial leaf.
+ */
+typedef struct _RDD_TREEHASH_STREAM_FILTER {
+	unsigned        leafsize;
+	unsigned        nslot;
+	TREEHASH_SLOT  *slots;
+	RDD_THREADPOOL *pool;
+	pthread_mutex_t lock;
+	pthread_cond_t  leaf_done;
+	rdd_count_t     nleaf;		/* # leaves submitted */
+	rdd_count_t     nmerged;	/* # leaves merged onto the stack */
+	TREEHASH_NODE   stack[TREEHASH_MAX_DEPTH];
+	unsigned        depth;
+	RDD_HASH        nodehash;
+	unsigned char   result[SHA256_DIGEST_LENGTH];
+} RDD_TREEHASH_STREAM_FILTER;
+
+static int treehash_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte);
+static int treehash_close(RDD_FILTER *f);
+static int treehash_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte);
+static int treehash_free(RDD_FILTER *f);
+static int treehash_save(RDD_FILTER *f, FILE *fp);
+static int treehash_restore(RDD_FILTER *f, FILE *fp);
+
+static RDD_FILTER_OPS treehash_ops = {
+	treehash_input,
+	0,
+	treehash_close,
+	treehash_get_result,
+	treehash_free,
+	treehash_save,
+	treehash_restore
+};
+
+int
+rdd_new_treehash_streamfilter(RDD_FILTER **self, unsigned leafsize,
+		unsigned nthread)
+{
+	RDD_FILTER *f;
+	RDD_TREEHASH_STREAM_FILTER *state;
+	unsigned i;
+	int rc;
+
+	if (self == 0 || leafsize == 0) {
+		return RDD_BADARG;
+	}
+
+	rc = rdd_new_filter(&f, &treehash_ops,
+			sizeof(RDD_TREEHASH_STREAM_FILTER), 0);
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state = (RDD_TREEHASH_STREAM_FILTER *) f->state;
+
+	if (nthread == 0) {
+		nthread = rdd_ncpu();
+	}
+
+	/* Two slots per thread keep the workers busy while the
+	 * caller fills the next leaves.
+	 */
+	state->leafsize = leafsize;
+	state->nslot = 2 * nthread;
+	pthread_mutex_init(&state->lock, 0);
+	pthread_cond_init(&state->leaf_done, 0);
+
+	if ((rc = rdd_hash_init(&state->nodehash, RDD_HASH_SHA256)) != RDD_OK) {
+		goto error;
+	}
+	if ((state->slots = calloc(state->nslot, sizeof(TREEHASH_SLOT))) == 0) {
+		rc = RDD_NOMEM;
+		goto error;
+	}
+	for (i = 0; i < state->nslot; i++) {
+		TREEHASH_SLOT *slot = &state->slots[i];
+
+		slot->state = state;
+		if ((slot->buf = malloc(leafsize)) == 0) {
+			rc = RDD_NOMEM;
+			goto error;
+		}
+		rc = rdd_hash_init(&slot->hash, RDD_HASH_SHA256);
+		if (rc != RDD_OK) {
+			free(slot->buf);
+			slot->buf = 0;
+			goto error;
+		}
+	}
+
+	rc = rdd_new_threadpool(&state->pool, nthread, state->nslot);
+	if (rc != RDD_OK) {
+		goto error;
+	}
+
+	*self = f;
+	return RDD_OK;
+
+error:
+	rdd_filter_free(f);
+	return rc;
+}
+
+/* Runs on a pool thread. */
+static int
+hash_leaf(void *arg)
+{
+	TREEHASH_SLOT *slot = (TREEHASH_SLOT *) arg;
+	RDD_TREEHASH_STREAM_FILTER *state = slot->state;
+	unsigned char prefix = TREEHASH_LEAF_PREFIX;
+	int rc;
+
+	if ((rc = rdd_hash_reset(&slot->hash)) == RDD_OK
+	&&  (rc = rdd_hash_update(&slot->hash, &prefix, 1)) == RDD_OK
+	&&  (rc = rdd_hash_update(&slot->hash, slot->buf, slot->len)) == RDD_OK) {
+		rc = rdd_hash_final(&slot->hash, slot->digest);
+	}
+
+	pthread_mutex_lock(&state->lock);
+	slot->rc = rc;
+	slot->busy = 0;
+	pthread_cond_broadcast(&state->leaf_done);
+	pthread_mutex_unlock(&state->lock);
+
+	return rc;
+}
+
+static int
+submit_leaf(RDD_TREEHASH_STREAM_FILTER *state, TREEHASH_SLOT *slot)
+{
+	int rc;
+
+	slot->busy = 1;
+	rc = rdd_threadpool_submit(state->pool, hash_leaf, slot);
+	if (rc != RDD_OK) {
+		slot->busy = 0;
+		return rc;
+	}
+	state->nleaf++;
+	return RDD_OK;
+}
+
+static int
+hash_node(RDD_TREEHASH_STREAM_FILTER *state, const unsigned char *left,
+		const unsigned char *right, unsigned char *md)
+{
+	unsigned char prefix = TREEHASH_NODE_PREFIX;
+	int rc;
+
+	if ((rc = rdd_hash_reset(&state->nodehash)) != RDD_OK
+	||  (rc = rdd_hash_update(&state->nodehash, &prefix, 1)) != RDD_OK
+	||  (rc = rdd_hash_update(&state->nodehash, left, SHA256_DIGEST_LENGTH)) != RDD_OK
+	||  (rc = rdd_hash_update(&state->nodehash, right, SHA256_DIGEST_LENGTH)) != RDD_OK) {
+		return rc;
+	}
+	return rdd_hash_final(&state->nodehash, md);
+}
+
+/* Pushes a leaf digest onto the stack and combines equal-sized
+ * subtrees.
+ */
+static int
+push_leaf(RDD_TREEHASH_STREAM_FILTER *state, const unsigned char *digest)
+{
+	TREEHASH_NODE *top;
+	int rc;
+
+	if (state->depth >= TREEHASH_MAX_DEPTH) return RDD_ERANGE;
+
+	top = &state->stack[state->depth++];
+	memcpy(top->digest, digest, SHA256_DIGEST_LENGTH);
+	top->nleaf = 1;
+
+	while (state->depth >= 2) {
+		TREEHASH_NODE *left = &state->stack[state->depth - 2];
+		TREEHASH_NODE *right = &state->stack[state->depth - 1];
+
+		if (left->nleaf != right->nleaf) break;
+
+		rc = hash_node(state, left->digest, right->digest, left->digest);
+		if (rc != RDD_OK) return rc;
+		left->nleaf += right->nleaf;
+		state->depth--;
+	}
+	return RDD_OK;
+}
+
+/* Waits for all leaves up to (not including) leaf number upto,
+ * merges them onto the stack in leaf order, and frees their slots.
+ */
+static int
+merge_leaves(RDD_TREEHASH_STREAM_FILTER *state, rdd_count_t upto)
+{
+	TREEHASH_SLOT *slot;
+	int rc;
+
+	while (state->nmerged < upto) {
+		slot = &state->slots[state->nmerged % state->nslot];
+
+		pthread_mutex_lock(&state->lock);
+		while (slot->busy) {
+			pthread_cond_wait(&state->leaf_done, &state->lock);
+		}
+		rc = slot->rc;
+		pthread_mutex_unlock(&state->lock);
+
+		if (rc != RDD_OK) return rc;
+		if ((rc = push_leaf(state, slot->digest)) != RDD_OK) return rc;
+		slot->len = 0;
+		state->nmerged++;
+	}
+	return RDD_OK;
+}
+
+static int
+treehash_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
+{
+	RDD_TREEHASH_STREAM_FILTER *state = (RDD_TREEHASH_STREAM_FILTER *) f->state;
+	TREEHASH_SLOT *slot;
+	unsigned n;
+	int rc;
+
+	while (nbyte > 0) {
+		slot = &state->slots[state->nleaf % state->nslot];
+
+		n = state->leafsize - slot->len;
+		if (n > nbyte) n = nbyte;
+		memcpy(slot->buf + slot->len, buf, n);
+		slot->len += n;
+		buf += n;
+		nbyte -= n;
+
+		if (slot->len < state->leafsize) continue;
+
+		if ((rc = submit_leaf(state, slot)) != RDD_OK) return rc;
+
+		/* Make sure that the slot of the next leaf is free. */
+		if (state->nleaf - state->nmerged >= state->nslot) {
+			rc = merge_leaves(state, state->nleaf - state->nslot + 1);
+			if (rc != RDD_OK) return rc;
+		}
+	}
+
+	return RDD_OK;
+}
+
+static int
+treehash_close(RDD_FILTER *f)
+{
+	if (f == 0) {
+		return RDD_BADARG;
+	}
+
+	RDD_TREEHASH_STREAM_FILTER *state = (RDD_TREEHASH_STREAM_FILTER *) f->state;
+	TREEHASH_SLOT *slot = &state->slots[state->nleaf % state->nslot];
+	unsigned char md[SHA256_DIGEST_LENGTH];
+	int i, rc;
+
+	if (slot->len > 0) {
+		if ((rc = submit_leaf(state, slot)) != RDD_OK) return rc;
+	}
+	if ((rc = merge_leaves(state, state->nleaf)) != RDD_OK) {
+		return rc;
+	}
+
+	if (state->depth == 0) {
+		/* The empty tree. */
+		if ((rc = rdd_hash_reset(&state->nodehash)) != RDD_OK) return rc;
+		return rdd_hash_final(&state->nodehash, state->result);
+	}
+
+	memcpy(md, state->stack[state->depth - 1].digest, sizeof md);
+	for (i = (int) state->depth - 2; i >= 0; i--) {
+		rc = hash_node(state, state->stack[i].digest, md, md);
+		if (rc != RDD_OK) return rc;
+	}
+	memcpy(state->result, md, sizeof md);
+
+	return RDD_OK;
+}
+
+static int
+treehash_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte)
+{
+	if (f == 0) {
+		return RDD_BADARG;
+	}
+
+	RDD_TREEHASH_STREAM_FILTER *state = (RDD_TREEHASH_STREAM_FILTER *) f->state;
+
+	if (nbyte < SHA256_DIGEST_LENGTH) return RDD_ESPACE;
+
+	memcpy(buf, state->result, SHA256_DIGEST_LENGTH);
+	return RDD_OK;
+}
+
+static int
+treehash_free(RDD_FILTER *f)
+{
+	RDD_TREEHASH_STREAM_FILTER *state = (RDD_TREEHASH_STREAM_FILTER *) f->state;
+	unsigned i;
+
+	if (state->pool != 0) {
+		rdd_threadpool_wait(state->pool);
+		rdd_free_threadpool(state->pool);
+	}
+	if (state->slots != 0) {
+		for (i = 0; i < state->nslot; i++) {
+			if (state->slots[i].buf != 0) {
+				rdd_hash_free(&state->slots[i].hash);
+				free(state->slots[i].buf);
+			}
+		}
+		free(state->slots);
+	}
+	rdd_hash_free(&state->nodehash);
+	pthread_cond_destroy(&state->leaf_done);
+	pthread_mutex_destroy(&state->lock);
+
+	return RDD_OK;
+}
+
+/* The saved state is the leaf size, the number of leaves, the subtree
+ * stack, and the bytes of the partial leaf.  Outstanding leaves are
+ * merged first so that the stack covers every complete leaf.
+ */
+static int
+treehash_save(RDD_FILTER *f, FILE *fp)
+{
+	RDD_TREEHASH_STREAM_FILTER *state = (RDD_TREEHASH_STREAM_FILTER *) f->state;
+	TREEHASH_SLOT *slot;
+	uint32_t leafsize = state->leafsize;
+	uint32_t depth, len;
+	uint64_t nleaf;
+	int rc;
+
+	if ((rc = merge_leaves(state, state->nleaf)) != RDD_OK) {
+		return rc;
+	}
+	slot = &state->slots[state->nleaf % state->nslot];
+
+	nleaf = state->nleaf;
+	depth = state->depth;
+	len = slot->len;
+	if (fwrite(&leafsize, sizeof leafsize, 1, fp) < 1
+	||  fwrite(&nleaf, sizeof nleaf, 1, fp) < 1
+	||  fwrite(&depth, sizeof depth, 1, fp) < 1
+	||  fwrite(state->stack, sizeof(TREEHASH_NODE), depth, fp) < depth
+	||  fwrite(&len, sizeof len, 1, fp) < 1
+	||  fwrite(slot->buf, 1, len, fp) < len) {
+		return RDD_EWRITE;
+	}
+	return RDD_OK;
+}
+
+static int
+treehash_restore(RDD_FILTER *f, FILE *fp)
+{
+	RDD_TREEHASH_STREAM_FILTER *state = (RDD_TREEHASH_STREAM_FILTER *) f->state;
+	TREEHASH_SLOT *slot;
+	uint32_t leafsize, depth, len;
+	uint64_t nleaf;
+	unsigned i;
+	int rc;
+
+	/* Discard whatever the filter has seen so far. */
+	if ((rc = rdd_threadpool_wait(state->pool)) != RDD_OK) {
+		return rc;
+	}
+	for (i = 0; i < state->nslot; i++) {
+		state->slots[i].len = 0;
+	}
+
+	if (fread(&leafsize, sizeof leafsize, 1, fp) < 1
+	||  leafsize != state->leafsize
+	||  fread(&nleaf, sizeof nleaf, 1, fp) < 1
+	||  fread(&depth, sizeof depth, 1, fp) < 1
+	||  depth > TREEHASH_MAX_DEPTH
+	||  fread(state->stack, sizeof(TREEHASH_NODE), depth, fp) < depth
+	||  fread(&len, sizeof len, 1, fp) < 1
+	||  len >= leafsize) {
+		return RDD_ESYNTAX;
+	}
+	state->nleaf = state->nmerged = nleaf;
+	state->depth = depth;
+
+	slot = &state->slots[state->nleaf % state->nslot];
+	if (fread(slot->buf, 1, len, fp) < len) {
+		return RDD_ESYNTAX;
+	}
+	slot->len = len;
+
+	return RDD_OK;
+}
@@ -0,0 +1,683 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2004\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+/* An io_uring reader keeps a window of read requests in flight ahead
+ * of the current file position.  The window consists of nslot chunks
+ * of chunklen bytes each.  Each chunk is read into its own registered,
+ * sector-aligned buffer with IORING_OP_READ_FIXED on a registered
+ * (fixed) file.  Slots are consumed in file order; a slot that has been
+ * consumed is immediately resubmitted for the chunk that follows the
+ * window.
+ *
+ * A chunk whose read fails is not reported as a read error right away.
+ * Reads that overlap a failed chunk are served by synchronous pread()
+ * calls of exactly the size that the caller asked for.  The robust
+ * copier's small-block retries therefore cover only the failing range,
+ * and the chunks that follow it stay in flight.
+ *
+ * The code uses the io_uring system calls directly, so it needs
+ * only the kernel headers, not liburing.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+
+#if defined(HAVE_LINUX_IO_URING_H)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "rdd.h"
+#include "rdd_internals.h"
+#include "alignedbuf.h"
+#include "reader.h"
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+
+typedef enum _slot_state_t {
+	SLOT_IDLE,		/* not part of the window */
+	SLOT_INFLIGHT,		/* read submitted */
+	SLOT_DONE,		/* read completed, res bytes valid */
+	SLOT_FAILED		/* read failed */
+} slot_state_t;
+
+typedef struct _RDD_URING_SLOT {
+	slot_state_t   state;
+	rdd_count_t    off;	/* file offset of the chunk */
+	int            res;	/* bytes read or -errno */
+	unsigned char *buf;	/* registered buffer */
+} RDD_URING_SLOT;
+
+typedef struct _RDD_URING_READER {
+	int             fd;
+	int             ringfd;
+
+	/* Submission queue */
+	void           *sq_ring;
+	size_t          sq_ring_size;
+	unsigned       *sq_head;
+	unsigned       *sq_tail;
+	unsigned       *sq_mask;
+	unsigned       *sq_array;
+	struct io_uring_sqe *sqes;
+	size_t          sqes_size;
+	unsigned        nsubmit;	/* queued but not yet submitted */
+
+	/* Completion queue */
+	void           *cq_ring;
+	size_t          cq_ring_size;
+	unsigned       *cq_head;
+	unsigned       *cq_tail;
+	unsigned       *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	unsigned        nslot;
+	unsigned        chunklen;
+	RDD_ALIGNEDBUF  buffers;	/* nslot * chunklen bytes */
+	RDD_URING_SLOT *slots;
+	unsigned        head;		/* slot that holds the oldest chunk */
+	unsigned        ninflight;
+
+	rdd_count_t     pos;		/* current file position */
+	rdd_count_t     window_end;	/* offset of the next chunk to queue */
+} RDD_URING_READER;
+
+static int rdd_uring_read(RDD_READER *r, unsigned char *buf, unsigned nbyte,
+			unsigned *nread);
+static int rdd_uring_tell(RDD_READER *r, rdd_count_t *pos);
+static int rdd_uring_seek(RDD_READER *r, rdd_count_t pos);
+static int rdd_uring_close(RDD_READER *r, int recurse);
+static int rdd_uring_pread(RDD_READER *r, unsigned char *buf, unsigned nbyte,
+			rdd_count_t pos, unsigned *nread);
+
+static RDD_READ_OPS uring_read_ops = {
+	rdd_uring_read,
+	rdd_uring_tell,
+	rdd_uring_seek,
+	rdd_uring_close,
+	rdd_uring_pread
+};
+
+static int
+sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+		unsigned flags)
+{
+	return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			flags, 0, 0);
+}
+
+static int
+sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+	return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void
+unmap_rings(RDD_URING_READER *state)
+{
+	if (state->sqes != 0 && state->sqes != MAP_FAILED) {
+		munmap(state->sqes, state->sqes_size);
+	}
+	if (state->cq_ring != 0 && state->cq_ring != MAP_FAILED
+	&&  state->cq_ring != state->sq_ring) {
+		munmap(state->cq_ring, state->cq_ring_size);
+	}
+	if (state->sq_ring != 0 && state->sq_ring != MAP_FAILED) {
+		munmap(state->sq_ring, state->sq_ring_size);
+	}
+	state->sqes = 0;
+	state->cq_ring = 0;
+	state->sq_ring = 0;
+}
+
+static int
+setup_ring(RDD_URING_READER *state)
+{
+	struct io_uring_params p;
+	struct iovec *iov = 0;
+	unsigned char *sq, *cq;
+	unsigned i;
+
+	memset(&p, 0, sizeof p);
+	if ((state->ringfd = sys_io_uring_setup(state->nslot, &p)) < 0) {
+		return RDD_EOPEN;
+	}
+
+	state->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	state->cq_ring_size = p.cq_off.cqes
+				+ p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (state->cq_ring_size > state->sq_ring_size) {
+			state->sq_ring_size = state->cq_ring_size;
+		}
+		state->cq_ring_size = state->sq_ring_size;
+	}
+
+	state->sq_ring = mmap(0, state->sq_ring_size, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE, state->ringfd,
+			IORING_OFF_SQ_RING);
+	if (state->sq_ring == MAP_FAILED) {
+		return RDD_NOMEM;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		state->cq_ring = state->sq_ring;
+	} else {
+		state->cq_ring = mmap(0, state->cq_ring_size,
+				PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+				state->ringfd, IORING_OFF_CQ_RING);
+		if (state->cq_ring == MAP_FAILED) {
+			return RDD_NOMEM;
+		}
+	}
+	state->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	state->sqes = mmap(0, state->sqes_size, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE, state->ringfd,
+			IORING_OFF_SQES);
+	if (state->sqes == MAP_FAILED) {
+		return RDD_NOMEM;
+	}
+
+	sq = (unsigned char *) state->sq_ring;
+	state->sq_head = (unsigned *) (sq + p.sq_off.head);
+	state->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+	state->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+	state->sq_array = (unsigned *) (sq + p.sq_off.array);
+
+	cq = (unsigned char *) state->cq_ring;
+	state->cq_head = (unsigned *) (cq + p.cq_off.head);
+	state->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+	state->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+	state->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+	/* Register the chunk buffers and the file.
+	 */
+	if ((iov = calloc(state->nslot, sizeof(struct iovec))) == 0) {
+		return RDD_NOMEM;
+	}
+	for (i = 0; i < state->nslot; i++) {
+		iov[i].iov_base = state->slots[i].buf;
+		iov[i].iov_len = state->chunklen;
+	}
+	if (sys_io_uring_register(state->ringfd, IORING_REGISTER_BUFFERS,
+				iov, state->nslot) < 0) {
+		free(iov);
+		return RDD_EOPEN;
+	}
+	free(iov);
+
+	if (sys_io_uring_register(state->ringfd, IORING_REGISTER_FILES,
+				&state->fd, 1) < 0) {
+		return RDD_EOPEN;
+	}
+
+	return RDD_OK;
+}
+
+/* Queues a read of the chunk that follows the window into slot i.
+ * The read is submitted by the next call to io_uring_enter().
+ */
+static void
+queue_slot(RDD_URING_READER *state, unsigned i)
+{
+	RDD_URING_SLOT *slot = &state->slots[i];
+	struct io_uring_sqe *sqe;
+	unsigned tail, idx;
+
+	slot->off = state->window_end;
+	slot->res = 0;
+	slot->state = SLOT_INFLIGHT;
+	state->window_end += state->chunklen;
+
+	tail = *state->sq_tail;
+	idx = tail & *state->sq_mask;
+	sqe = &state->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READ_FIXED;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->fd = 0;		/* index in the registered-file table */
+	sqe->addr = (unsigned long) slot->buf;
+	sqe->len = state->chunklen;
+	sqe->off = slot->off;
+	sqe->buf_index = i;
+	sqe->user_data = i;
+	state->sq_array[idx] = idx;
+	__atomic_store_n(state->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	state->nsubmit++;
+	state->ninflight++;
+}
+
+static void
+reap_completions(RDD_URING_READER *state)
+{
+	struct io_uring_cqe *cqe;
+	RDD_URING_SLOT *slot;
+	unsigned head, tail;
+
+	head = *state->cq_head;
+	tail = __atomic_load_n(state->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++) {
+		cqe = &state->cqes[head & *state->cq_mask];
+		slot = &state->slots[cqe->user_data];
+		slot->res = cqe->res;
+		slot->state = cqe->res < 0 ? SLOT_FAILED : SLOT_DONE;
+		state->ninflight--;
+	}
+	__atomic_store_n(state->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Submits all queued reads and, if wait is nonzero, waits until
+ * at least one read has completed.
+ */
+static int
+enter_ring(RDD_URING_READER *state, int wait)
+{
+	unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+	int n;
+
+	while (state->nsubmit > 0 || wait) {
+		n = sys_io_uring_enter(state->ringfd, state->nsubmit,
+				wait ? 1 : 0, flags);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return RDD_EREAD;
+		}
+		state->nsubmit -= (unsigned) n < state->nsubmit ?
+					(unsigned) n : state->nsubmit;
+		break;
+	}
+
+	reap_completions(state);
+	return RDD_OK;
+}
+
+/* Waits for all reads in flight and restarts the window at pos.
+ */
+static int
+reset_window(RDD_URING_READER *state, rdd_count_t pos)
+{
+	unsigned i;
+	int rc;
+
+	while (state->ninflight > 0) {
+		if ((rc = enter_ring(state, 1)) != RDD_OK) {
+			return rc;
+		}
+	}
+
+	/* Chunks start at sector boundaries, which O_DIRECT requires.
+	 */
+	state->pos = pos;
+	state->window_end = pos - (pos % RDD_SECTOR_SIZE);
+	state->head = 0;
+	for (i = 0; i < state->nslot; i++) {
+		queue_slot(state, i);
+	}
+
+	return enter_ring(state, 0);
+}
+
+int
+rdd_open_uring_reader(RDD_READER **self, const char *path, int raw,
+		unsigned depth, unsigned chunklen)
+{
+	RDD_READER *r = 0;
+	RDD_URING_READER *state = 0;
+	int flags = O_RDONLY;
+	unsigned i;
+	int rc = RDD_OK;
+
+	if (self == 0 || path == 0 || depth == 0) {
+		return RDD_BADARG;
+	}
+	if (chunklen == 0 || (chunklen % RDD_SECTOR_SIZE) != 0) {
+		return RDD_BADARG;
+	}
+
+	rc = rdd_new_reader(&r, &uring_read_ops, sizeof(RDD_URING_READER));
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	state = (RDD_URING_READER *) r->state;
+	state->fd = -1;
+	state->ringfd = -1;
+	state->nslot = depth;
+	state->chunklen = chunklen;
+
+	if (raw) {
+		flags |= O_DIRECT;
+	}
+	if ((state->fd = open(path, flags)) < 0) {
+		rc = RDD_EOPEN;
+		goto error;
+	}
+
+	rc = rdd_new_alignedbuf(&state->buffers, depth * chunklen,
+				RDD_SECTOR_SIZE);
+	if (rc != RDD_OK) {
+		goto error;
+	}
+	if ((state->slots = calloc(depth, sizeof(RDD_URING_SLOT))) == 0) {
+		rc = RDD_NOMEM;
+		goto error;
+	}
+	for (i = 0; i < depth; i++) {
+		state->slots[i].buf = state->buffers.aligned + i * chunklen;
+		state->slots[i].state = SLOT_IDLE;
+	}
+
+	if ((rc = setup_ring(state)) != RDD_OK) {
+		goto error;
+	}
+	if ((rc = reset_window(state, 0)) != RDD_OK) {
+		goto error;
+	}
+
+	*self = r;
+	return RDD_OK;
+
+error:
+	*self = 0;
+	unmap_rings(state);
+	if (state->ringfd >= 0) close(state->ringfd);
+	if (state->fd >= 0) close(state->fd);
+	if (state->slots != 0) free(state->slots);
+	if (state->buffers.unaligned != 0) {
+		rdd_free_alignedbuf(&state->buffers);
+	}
+	free(state);
+	free(r);
+	return rc;
+}
+
+/* Reads nbyte bytes at the current position with pread().  Used for
+ * ranges that overlap the chunk in slot, whose read failed.  The range
+ * must lie within the chunk.  The read covers whole sectors and goes
+ * through the slot's buffer, as O_DIRECT requires; only the requested
+ * bytes that exist in the file are copied to buf.
+ */
+static int
+sync_read(RDD_URING_READER *state, RDD_URING_SLOT *slot,
+		unsigned char *buf, unsigned nbyte, unsigned *nread)
+{
+	unsigned skip = (unsigned) (state->pos - slot->off);
+	unsigned start = skip - skip % RDD_SECTOR_SIZE;
+	unsigned end = skip + nbyte;
+	unsigned got = start;	/* end of the bytes read so far */
+	ssize_t n;
+
+	if (end % RDD_SECTOR_SIZE != 0) {
+		end += RDD_SECTOR_SIZE - end % RDD_SECTOR_SIZE;
+	}
+
+	while (got < end) {
+		n = pread(state->fd, slot->buf + got, end - got,
+				(off_t) (slot->off + got));
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return RDD_EREAD;
+		} else if (n == 0) {
+			break;	/* end of file */
+		}
+		got += n;
+	}
+
+	*nread = 0;
+	if (got > skip) {
+		*nread = got - skip < nbyte ? got - skip : nbyte;
+		memcpy(buf, slot->buf + skip, *nread);
+		state->pos += *nread;
+	}
+	return RDD_OK;
+}
+
+/* Moves the head slot to the end of the window.
+ */
+static void
+advance_head(RDD_URING_READER *state)
+{
+	queue_slot(state, state->head);
+	state->head = (state->head + 1) % state->nslot;
+}
+
+static int
+rdd_uring_read(RDD_READER *self, unsigned char *buf, unsigned nbyte,
+		unsigned *nread)
+{
+	RDD_URING_READER *state = self->state;
+	RDD_URING_SLOT *slot;
+	rdd_count_t skip;
+	unsigned total = 0;
+	unsigned avail, n;
+	int rc;
+
+	while (total < nbyte) {
+		slot = &state->slots[state->head];
+
+		while (slot->state == SLOT_INFLIGHT) {
+			if ((rc = enter_ring(state, 1)) != RDD_OK) {
+				return rc;
+			}
+		}
+
+		if (state->pos < slot->off) {
+			/* Cannot happen: the window always covers pos. */
+			return RDD_EREAD;
+		}
+		skip = state->pos - slot->off;
+
+		if (slot->state == SLOT_FAILED) {
+			/* Read the part of this request that overlaps the
+			 * failed chunk synchronously.
+			 */
+			n = nbyte - total;
+			if (skip + n > state->chunklen) {
+				n = (unsigned) (state->chunklen - skip);
+			}
+			if ((rc = sync_read(state, slot, buf + total, n,
+						&avail)) != RDD_OK) {
+				return rc;
+			}
+			total += avail;
+			if (avail < n) {
+				break;	/* end of file */
+			}
+			if (state->pos >= slot->off + state->chunklen) {
+				advance_head(state);
+			}
+			continue;
+		}
+
+		if (skip >= (rdd_count_t) slot->res) {
+			if (slot->res == (int) state->chunklen) {
+				advance_head(state);
+				continue;
+			}
+			if (slot->res == 0 || skip > (rdd_count_t) slot->res
+			||  slot->res % RDD_SECTOR_SIZE != 0) {
+				/* End of file.  A read that ends inside a
+				 * sector can only have stopped at the end of
+				 * the file.
+				 */
+				break;
+			}
+			/* Short read of whole sectors: restart the window
+			 * after it.  The new window starts at pos, so
+			 * the next read returns data or reaches EOF.
+			 */
+			if ((rc = reset_window(state, state->pos)) != RDD_OK) {
+				return rc;
+			}
+			continue;
+		}
+
+		avail = (unsigned) (slot->res - skip);
+		n = nbyte - total < avail ? nbyte - total : avail;
+		memcpy(buf + total, slot->buf + skip, n);
+		total += n;
+		state->pos += n;
+
+		if (state->pos == slot->off + state->chunklen) {
+			advance_head(state);
+		}
+	}
+
+	if ((rc = enter_ring(state, 0)) != RDD_OK) {
+		return rc;
+	}
+
+	*nread = total;
+	return RDD_OK;
+}
+
+static int
+rdd_uring_tell(RDD_READER *self, rdd_count_t *pos)
+{
+	RDD_URING_READER *state = self->state;
+
+	*pos = state->pos;
+	return RDD_OK;
+}
+
+static int
+rdd_uring_seek(RDD_READER *self, rdd_count_t pos)
+{
+	RDD_URING_READER *state = self->state;
+	RDD_URING_SLOT *slot = &state->slots[state->head];
+	int rc;
+
+	if (pos < slot->off || pos >= state->window_end) {
+		return reset_window(state, pos);
+	}
+
+	/* The new position lies within the window: recycle the
+	 * chunks that lie entirely before it.
+	 */
+	state->pos = pos;
+	while (pos >= slot->off + state->chunklen) {
+		while (slot->state == SLOT_INFLIGHT) {
+			if ((rc = enter_ring(state, 1)) != RDD_OK) {
+				return rc;
+			}
+		}
+		advance_head(state);
+		slot = &state->slots[state->head];
+	}
+
+	return enter_ring(state, 0);
+}
+
+/* Positional reads bypass the ring; they do not disturb the
+ * read-ahead window.
+ */
+static int
+rdd_uring_pread(RDD_READER *self, unsigned char *buf, unsigned nbyte,
+		rdd_count_t pos, unsigned *nread)
+{
+	RDD_URING_READER *state = self->state;
+	ssize_t n;
+
+	*nread = 0;
+	while (nbyte > 0) {
+		n = pread(state->fd, buf, nbyte, (off_t) pos);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return RDD_EREAD;
+		} else if (n == 0) {
+			break;
+		}
+		buf += n;
+		nbyte -= n;
+		*nread += n;
+		pos += n;
+	}
+
+	return RDD_OK;
+}
+
+static int
+rdd_uring_close(RDD_READER *self, int recurse)
+{
+	RDD_URING_READER *state = self->state;
+	int rc = RDD_OK;
+
+	while (state->ninflight > 0) {
+		if (enter_ring(state, 1) != RDD_OK) {
+			break;
+		}
+	}
+
+	unmap_rings(state);
+	if (close(state->ringfd) < 0) {
+		rc = RDD_ECLOSE;
+	}
+	if (close(state->fd) < 0) {
+		rc = RDD_ECLOSE;
+	}
+	free(state->slots);
+	rdd_free_alignedbuf(&state->buffers);
+
+	return rc;
+}
+
+#else /* no io_uring */
+
+int
+rdd_open_uring_reader(RDD_READER **self, const char *path, int raw,
+		unsigned depth, unsigned chunklen)
+{
+	if (self != 0) *self = 0;
+	return RDD_EOPEN;
+}
+
+#endif
@@ -54,7 +54,6 @@ static char copyright[] =
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
-#include <zlib.h>
 
 #include "rdd.h"
 #include "rdd_internals.h"
@@ -62,6 +61,7 @@ static char copyright[] =
 #include "writer.h"
 #include "filter.h"
 #include "filterset.h"
+#include "checksum.h"
 
 
 /* State maintained by a checksum filter.
@@ -84,26 +84,26 @@ static int verify_input(RDD_FILTER *f,
 			const unsigned char *buf, unsigned nbyte);
 static int verify_block(RDD_FILTER *f, unsigned nbyte);
 static int verify_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte);
+static int verify_blocks(RDD_FILTER *f,
+			const unsigned char *buf, unsigned nblock);
 
 static RDD_FILTER_OPS verify_ops = {
 	verify_input,
 	verify_block,
 	0,	/* close */
 	verify_get_result,
-	0	/* free */
+	0,	/* free */
+	0,	/* save */
+	0,	/* restore */
+	verify_blocks
 };
 
+#define VERIFY_BATCH	1024	/* max. # checksums per fread() */
+
 static void
 reset_checksum(RDD_VERIFY_BLOCKFILTER *state)
 {
-	switch (state->algorithm) {
-	case RDD_ADLER32:
-		state->checksum = adler32(0, NULL, 0);
-		break;
-	case RDD_CRC32:
-		state->checksum = crc32(0, NULL, 0);
-		break;
-	}
+	state->checksum = rdd_checksum_init(state->algorithm);
 }
 
 static int
@@ -111,14 +111,8 @@ verify_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
 {
 	RDD_VERIFY_BLOCKFILTER *state = (RDD_VERIFY_BLOCKFILTER *) f->state;
 
-	switch (state->algorithm) {
-	case RDD_ADLER32:
-		state->checksum = adler32(state->checksum, buf, nbyte);
-		break;
-	case RDD_CRC32:
-		state->checksum = crc32(state->checksum, buf, nbyte);
-		break;
-	}
+	state->checksum = rdd_checksum_update(state->algorithm,
+				state->checksum, buf, nbyte);
 
 	return RDD_OK;
 }
@@ -188,12 +182,50 @@ verify_block(RDD_FILTER *f, unsigned pos)
 	return RDD_OK;
 }
 
+/* Verifies a run of whole blocks against checksums that are read
+ * with one fread() per batch.  If the checksum file ends inside a
+ * batch, the blocks that do have a checksum are verified before
+ * RDD_EREAD is returned, just as block-by-block verification does.
+ */
+static int
+verify_blocks(RDD_FILTER *f, const unsigned char *buf, unsigned nblock)
+{
+	RDD_VERIFY_BLOCKFILTER *state = (RDD_VERIFY_BLOCKFILTER *) f->state;
+	rdd_checksum_t stored[VERIFY_BATCH];
+	rdd_checksum_t sums[VERIFY_BATCH];
+	unsigned i, n, got;
+
+	while (nblock > 0) {
+		n = nblock < VERIFY_BATCH ? nblock : VERIFY_BATCH;
+		got = (unsigned) fread(stored, sizeof stored[0], n, state->fp);
+		rdd_checksum_blocks(state->algorithm, buf, state->blocksize,
+					got, sums);
+		for (i = 0; i < got; i++) {
+			if (state->swap) {
+				stored[i] = swap32(stored[i]);
+			}
+			state->checksum = sums[i];
+			verify_checksum(state, stored[i]);
+			state->blocknum++;
+		}
+		if (got < n) {
+			reset_checksum(state);
+			return RDD_EREAD;
+		}
+		buf += (size_t) n * state->blocksize;
+		nblock -= n;
+	}
+	reset_checksum(state);
+
+	return RDD_OK;
+}
+
 static int
 verify_get_result(RDD_FILTER *f, unsigned char *buf, unsigned nbyte)
 {
 	RDD_VERIFY_BLOCKFILTER *state = (RDD_VERIFY_BLOCKFILTER *) f->state;
 
-	if (nbyte < sizeof(unsigned)) {
+	if (nbyte < sizeof(state->num_error)) {
 		return RDD_NOMEM;
 	}
 
@@ -212,7 +244,7 @@ new_verify_checksum_blockfilter(RDD_FILTER **self,
 	int rc = RDD_OK;
 
 	if (blocksize <= 0) return RDD_BADARG;
-	if (alg != RDD_ADLER32 && alg != RDD_CRC32) return RDD_BADARG;
+	if (alg != RDD_ADLER32 && alg != RDD_CRC32 && alg != RDD_CRC32C) return RDD_BADARG;
 
 	rc = rdd_new_filter(&f, &verify_ops,
 			sizeof(RDD_VERIFY_BLOCKFILTER), blocksize);
@@ -259,3 +291,12 @@ rdd_new_verify_crc32_blockfilter(RDD_FILTER **f, FILE *fp,
 						fp, blocksize, swap,
 						err, env);
 }
+
+int
+rdd_new_verify_crc32c_blockfilter(RDD_FILTER **f, FILE *fp,
+	unsigned blocksize, int swap, rdd_fltr_error_fun err, void *env)
+{
+	return new_verify_checksum_blockfilter(f, RDD_CRC32C,
+						fp, blocksize, swap,
+						err, env);
+}
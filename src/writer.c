@@ -111,6 +111,65 @@ rdd_writer_close(RDD_WRITER *w)
 	return RDD_OK;
 }
 
+int
+rdd_writer_sync(RDD_WRITER *w)
+{
+	if (w == 0) {
+		return RDD_BADARG;
+	}
+	if (w->ops->sync == 0) {
+		return RDD_NOTFOUND;
+	}
+	return (*(w->ops->sync))(w);
+}
+
+int
+rdd_writer_truncate(RDD_WRITER *w, rdd_count_t pos)
+{
+	if (w == 0) {
+		return RDD_BADARG;
+	}
+	if (w->ops->truncate == 0) {
+		return RDD_NOTFOUND;
+	}
+	return (*(w->ops->truncate))(w, pos);
+}
+
+int
+rdd_writer_skip(RDD_WRITER *w, rdd_count_t nbyte)
+{
+	if (w == 0) {
+		return RDD_BADARG;
+	}
+	if (w->ops->skip == 0) {
+		return RDD_NOTFOUND;
+	}
+	return (*(w->ops->skip))(w, nbyte);
+}
+
+int
+rdd_writer_reserve(RDD_WRITER *w, rdd_count_t nbyte)
+{
+	if (w == 0) {
+		return RDD_BADARG;
+	}
+	if (w->ops->reserve == 0) {
+		return RDD_NOTFOUND;
+	}
+	return (*(w->ops->reserve))(w, nbyte);
+}
+
+int
+rdd_writer_stream(RDD_WRITER *w)
+{
+	if (w == 0) {
+		return RDD_BADARG;
+	}
+	if (w->ops->stream == 0) {
+		return RDD_NOTFOUND;
+	}
+	return (*(w->ops->stream))(w);
+}
 
 int
 rdd_compare_address(RDD_WRITER *w, struct addrinfo * address, int *result)
@@ -75,7 +75,8 @@ struct _RDD_WRITE_OPS;
 typedef enum _rdd_write_mode_t {
 	RDD_NO_OVERWRITE = 0,	/**< do not overwrite existing files */
 	RDD_OVERWRITE = 1,	/**< truncate and overwrite existing files */
-	RDD_OVERWRITE_ASK = 2	/**< ask before overwriting existing files */
+	RDD_OVERWRITE_ASK = 2,	/**< ask before overwriting existing files */
+	RDD_RESUME = 3		/**< reopen existing files without truncating them */
 } rdd_write_mode_t;
 
 typedef int (*rdd_wr_write_fun)(struct _RDD_WRITER *w,
@@ -85,6 +86,16 @@ typedef int (*rdd_wr_close_fun)(struct _RDD_WRITER *w);
 
 typedef int (*rdd_wr_compare_address_fun)(struct _RDD_WRITER *w, struct addrinfo *address, int *result);
 
+typedef int (*rdd_wr_sync_fun)(struct _RDD_WRITER *w);
+
+typedef int (*rdd_wr_truncate_fun)(struct _RDD_WRITER *w, rdd_count_t pos);
+
+typedef int (*rdd_wr_skip_fun)(struct _RDD_WRITER *w, rdd_count_t nbyte);
+
+typedef int (*rdd_wr_reserve_fun)(struct _RDD_WRITER *w, rdd_count_t nbyte);
+
+typedef int (*rdd_wr_stream_fun)(struct _RDD_WRITER *w);
+
 /** All writer implementations provide a structure of type \c RDD_WRITE_OPS.
  *  This structure contains pointers to the routines that implement
  *  the interface.
@@ -93,6 +104,11 @@ typedef struct _RDD_WRITE_OPS {
 	rdd_wr_write_fun write;	/**< writes data to the output channel */
 	rdd_wr_close_fun close;	/**< closes the writer */
 	rdd_wr_compare_address_fun compare_address; /**< compares the address to a given address */
+	rdd_wr_sync_fun sync;	/**< flushes written data to stable storage (optional) */
+	rdd_wr_truncate_fun truncate; /**< discards output beyond a position (optional) */
+	rdd_wr_skip_fun skip;	/**< leaves a hole of zero bytes in the output (optional) */
+	rdd_wr_reserve_fun reserve; /**< allocates disk space ahead of the output (optional) */
+	rdd_wr_stream_fun stream; /**< keeps written data out of the page cache (optional) */
 } RDD_WRITE_OPS;
 
 /** Writer object. A writer object consists of a pointer to a state
@@ -132,6 +148,128 @@ int rdd_new_writer(RDD_WRITER **w, RDD_WRITE_OPS *ops, unsigned statesize);
  */
 int rdd_open_zlib_writer(RDD_WRITER **w, RDD_WRITER *parent);
 
+/** \brief Creates a zlib writer that compresses on several threads.
+ *  \param w output value: the new writer object
+ *  \param parent: all output is written to \c parent
+ *  \param nthread the number of compression threads; 0 means one
+ *  per online processor
+ *  \return Returns \c RDD_OK on success.
+ *
+ *  A parallel zlib writer is stacked on top of a parent writer.
+ *  It splits its input into fixed-size chunks and deflates the
+ *  chunks independently on a pool of threads.  Each chunk ends
+ *  with a sync flush, and the chunks are written to the parent in
+ *  order, so the parent receives a single zlib stream that any
+ *  zlib reader can decode.  Compression is slightly less effective
+ *  than with \c rdd_open_zlib_writer().
+ */
+int rdd_open_pzlib_writer(RDD_WRITER **w, RDD_WRITER *parent,
+			unsigned nthread);
+
+/** \brief Creates a writer that compresses its output with LZ4.
+ *  \param w output value: the new writer object
+ *  \param parent: all output is written to \c parent
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_ECOMPRESS
+ *  if rdd was built without LZ4 support.
+ *
+ *  An LZ4 writer is stacked on top of a parent writer.  It writes a
+ *  single LZ4 frame, with a content checksum, to the parent.  LZ4
+ *  compresses less than zlib but is many times faster.
+ */
+int rdd_open_lz4_writer(RDD_WRITER **w, RDD_WRITER *parent);
+
+/** \brief Creates a writer that compresses its output with zstd.
+ *  \param w output value: the new writer object
+ *  \param parent: all output is written to \c parent
+ *  \param level the zstd compression level; 0 selects the default
+ *  level
+ *  \param nthread the number of zstd worker threads; 0 means that
+ *  the data is compressed in the calling thread
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_BADARG
+ *  if \c level is out of range.  Returns \c RDD_ECOMPRESS
+ *  if rdd was built without zstd support.
+ *
+ *  A zstd writer is stacked on top of a parent writer.  It writes a
+ *  single zstd frame, with a content checksum, to the parent.  If the
+ *  zstd library was built without thread support, \c nthread is
+ *  ignored.
+ */
+int rdd_open_zstd_writer(RDD_WRITER **w, RDD_WRITER *parent,
+			int level, unsigned nthread);
+
+/** \brief Creates a writer that writes to its parent in the background.
+ *  \param w output value: the new writer object
+ *  \param parent: all output is written to \c parent
+ *  \param queue_bytes the maximum number of bytes that may be
+ *  waiting to be written to \c parent
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_BADARG
+ *  if \c queue_bytes is too small.
+ *
+ *  An async writer is stacked on top of a parent writer. Data
+ *  written to the async writer is copied into a bounded queue and
+ *  the write returns immediately, unless the queue is full.
+ *  A background thread writes the queued data to the parent writer,
+ *  in order.
+ *
+ *  If a write to the parent fails, the next write to the async writer
+ *  returns the parent's error code; if no more writes follow,
+ *  \c rdd_writer_close() returns that code.  The close routine
+ *  waits until all queued data has been written.
+ */
+int rdd_open_async_writer(RDD_WRITER **w, RDD_WRITER *parent,
+			unsigned queue_bytes);
+
+/** \brief Creates a writer that writes to several children, each
+ *  in a thread of its own.
+ *  \param w output value: the new writer object
+ *  \param children the writers to which all output is written
+ *  \param nchild the number of writers in \c children
+ *  \param nbuf the number of buffers that can be queued between
+ *  the fan-out writer and its slowest child
+ *  \param bufsize the size in bytes of each buffer
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_BADARG
+ *  if \c nchild, \c nbuf, or \c bufsize is zero, or if one of
+ *  the children is a null pointer.
+ *
+ *  Data written to a fan-out writer is copied once into a bounded
+ *  ring of buffers that the children share read-only.  Each child
+ *  writes the buffers in order at its own pace, so the time to write
+ *  to all children is bounded by the slowest child rather than by
+ *  the sum of all children.  A write to the fan-out writer only
+ *  blocks when the slowest child lags \c nbuf buffers behind.
+ *
+ *  If a child fails, all children stop; the next write, sync, or
+ *  truncate returns the child's error code, as does
+ *  \c rdd_writer_close().  The fan-out writer owns its children:
+ *  the close routine waits until each child has written all
+ *  queued data and then closes all children.
+ */
+int rdd_open_fanout_writer(RDD_WRITER **w, RDD_WRITER **children,
+			unsigned nchild, unsigned nbuf, unsigned bufsize);
+
+/** \brief Creates a writer that leaves holes for runs of zero bytes.
+ *  \param w output value: the new writer object
+ *  \param parent: all nonzero output is written to \c parent
+ *  \param mappath the name of the sparse map file, or 0 for none
+ *  \param overwrite indicates what to do when \c mappath exists
+ *  \return Returns \c RDD_OK on success.
+ *
+ *  A sparse writer is stacked on top of a parent writer.  It splits
+ *  its input into blocks of \c RDD_SPARSE_BLOCKSIZE bytes (counted
+ *  from the start of the output) and passes each run of all-zero
+ *  blocks to \c rdd_writer_skip() instead of writing it, so that the
+ *  output file gets a hole.  The logical contents and size of the
+ *  output are unchanged.  If the parent does not support holes, the
+ *  zeros are written after all.
+ *
+ *  If \c mappath is not 0, the writer lists the holes in a text file
+ *  with one line per hole: its offset and its length in bytes.
+ */
+int rdd_open_sparse_writer(RDD_WRITER **w, RDD_WRITER *parent,
+			const char *mappath, rdd_write_mode_t overwrite);
+
+#define RDD_SPARSE_BLOCKSIZE	4096
+
 /** \brief Creates a writer that writes to an open file descriptor.
  *  \param w output value: the new writer object
  *  \param fd the open file descriptor that the new writer will write to
@@ -185,7 +323,11 @@ int rdd_open_safe_writer(RDD_WRITER **w, const char *path,
  *  \param maxlen maximum number of bytes that will be written
  *  \param splitlen maximum size in bytes of each output file
  *  \param overwrite indicates what to do when an output file already exists
- *  \return Returns \c RDD_OK on success.
+ *  \param prealloc if nonzero, allocate the disk space of each output
+ *  file when it is opened
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_ESPACE if
+ *  \c prealloc is set, \c maxlen is known, and the file system cannot
+ *  hold \c maxlen bytes.
  *
  *  Routine \c rdd_open_part_writer() splits the data stream it receives
  *  over a sequence of output files. The first \c splitlen bytes are
@@ -196,10 +338,20 @@ int rdd_open_safe_writer(RDD_WRITER **w, const char *path,
  *  - the output file's sequence number;
  *  - a dash;
  *  - the base name of \c basepath.
+ *
+ *  When \c maxlen is known, the next output file is opened by a helper
+ *  thread while the current one is being written, so that the copy
+ *  does not stall at file boundaries.  (Not in the \c RDD_OVERWRITE_ASK
+ *  and \c RDD_RESUME modes, which must open files one at a time, and
+ *  not for output files that already exist, which are left alone
+ *  until the copy reaches them.)
+ *  With \c prealloc, each output file gets its full size reserved with
+ *  \c rdd_writer_reserve(), which keeps the files contiguous; pass 0
+ *  for sparse output.
  */
 int rdd_open_part_writer(RDD_WRITER **w,
 	const char *basepath, rdd_count_t maxlen, rdd_count_t splitlen,
-	rdd_write_mode_t overwrite);
+	rdd_write_mode_t overwrite, int prealloc);
 
 /** \brief Creates a writer that writes ewf files.
  *  \param w a pointer to the writer object.
@@ -210,8 +362,8 @@ int rdd_open_part_writer(RDD_WRITER **w,
  *  \return Returns \c RDD_OK on success.
  *
  * Routine \c rdd_open_ewf_writer() exports the copied data into \c encase6 format.
- * Currently the only encase option which can be set on the rdd command line is 
- * the segment size (\c splitlen).
+ * Currently the only encase options which can be set on the rdd command line are
+ * the segment size (\c splitlen) and the compression.
  */
 int rdd_open_ewf_writer(RDD_WRITER **w, const char *path,
 			rdd_count_t splitlen, int compression_type, rdd_write_mode_t overwrite, RDD_HASH_CONTAINER * hashcontainer);
@@ -248,6 +400,71 @@ int rdd_writer_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte);
  */
 int rdd_writer_close(RDD_WRITER *w);
 
+/** \brief Flushes all data written so far to stable storage.
+ *  \param w a pointer to the writer object.
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOTFOUND if
+ *  the writer does not support this operation.
+ *
+ *  When \c rdd_writer_sync() returns, all data that was written to
+ *  \c w has reached the output channel and has been flushed to
+ *  stable storage.  Stacked writers pass the call on to the writers
+ *  below them.
+ */
+int rdd_writer_sync(RDD_WRITER *w);
+
+/** \brief Discards all output beyond a given position.
+ *  \param w a pointer to the writer object.
+ *  \param pos the number of output bytes to keep
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOTFOUND if
+ *  the writer does not support this operation.
+ *
+ *  After \c rdd_writer_truncate() the output consists of the first
+ *  \c pos bytes that were written, and the next write continues at
+ *  position \c pos.  Together with the \c RDD_RESUME write mode
+ *  this lets an interrupted copy continue an existing output file.
+ */
+int rdd_writer_truncate(RDD_WRITER *w, rdd_count_t pos);
+
+/** \brief Advances the output over a run of zero bytes without
+ *  writing them.
+ *  \param w a pointer to the writer object.
+ *  \param nbyte the length of the run
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOTFOUND if
+ *  the writer (or the file it writes to) does not support holes; the
+ *  output is unchanged in that case.
+ *
+ *  The effect on the output is the same as writing \c nbyte zero
+ *  bytes, but file writers seek over the run (or punch a hole in
+ *  existing data), so that no disk space is allocated for it.
+ *  The file size is fixed up when the writer is synced or closed.
+ */
+int rdd_writer_skip(RDD_WRITER *w, rdd_count_t nbyte);
+
+/** \brief Allocates disk space for output that has not been written yet.
+ *  \param w a pointer to the writer object.
+ *  \param nbyte the number of bytes to allocate, counted from the
+ *  current position
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_ESPACE if the
+ *  file system does not have enough free space.  Returns \c RDD_NOTFOUND
+ *  if the writer (or the file system) cannot allocate space in advance.
+ *
+ *  The output and its size are not changed.  Space that is still
+ *  unused when the writer is closed is released again.
+ */
+int rdd_writer_reserve(RDD_WRITER *w, rdd_count_t nbyte);
+
+/** \brief Makes the writer stream its output through the page cache.
+ *  \param w a pointer to the writer object.
+ *  \return Returns \c RDD_OK on success.  Returns \c RDD_NOTFOUND if
+ *  the writer (or the file it writes to) does not support streaming.
+ *
+ *  A streaming file writer starts writeback of the data shortly after
+ *  it has been written and drops older data from the page cache once
+ *  it is on disk.  The amount of cached output stays small, and little
+ *  is left to flush when the writer is synced or closed.
+ */
+int rdd_writer_stream(RDD_WRITER *w);
+
 /** \brief Checks if a given address equals the current writer address.
  *  \param w a pointer to the writer object.
  *  \param address a pointer to the address object.
@@ -66,17 +66,22 @@ static char copyright[] =
 
 typedef struct _RDD_WRITE_STREAM_FILTER {
 	RDD_WRITER *writer;
+	rdd_count_t nwritten;	/* # bytes written so far */
 } RDD_WRITE_STREAM_FILTER;
 
 static int write_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte);
 static int write_close(RDD_FILTER *f);
+static int write_save(RDD_FILTER *f, FILE *fp);
+static int write_restore(RDD_FILTER *f, FILE *fp);
 
 static RDD_FILTER_OPS write_ops = {
 	write_input,
 	0,
 	write_close,
 	0,
-	0
+	0,
+	write_save,
+	write_restore
 };
 
 int
@@ -103,6 +108,7 @@ write_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
 {
 	RDD_WRITE_STREAM_FILTER *state = (RDD_WRITE_STREAM_FILTER *) f->state;
 
+	state->nwritten += nbyte;
 	return rdd_writer_write(state->writer, buf, nbyte);
 }
 
@@ -111,3 +117,38 @@ write_close(RDD_FILTER *f)
 {
 	return RDD_OK;
 }
+
+/* The saved state is the output size.  The writer must be able to
+ * sync its output; restoring truncates the output to the saved size.
+ */
+static int
+write_save(RDD_FILTER *f, FILE *fp)
+{
+	RDD_WRITE_STREAM_FILTER *state = (RDD_WRITE_STREAM_FILTER *) f->state;
+	int rc;
+
+	if ((rc = rdd_writer_sync(state->writer)) != RDD_OK) {
+		return rc;
+	}
+	if (fwrite(&state->nwritten, sizeof state->nwritten, 1, fp) < 1) {
+		return RDD_EWRITE;
+	}
+	return RDD_OK;
+}
+
+static int
+write_restore(RDD_FILTER *f, FILE *fp)
+{
+	RDD_WRITE_STREAM_FILTER *state = (RDD_WRITE_STREAM_FILTER *) f->state;
+	rdd_count_t nwritten;
+	int rc;
+
+	if (fread(&nwritten, sizeof nwritten, 1, fp) < 1) {
+		return RDD_ESYNTAX;
+	}
+	if ((rc = rdd_writer_truncate(state->writer, nwritten)) != RDD_OK) {
+		return rc;
+	}
+	state->nwritten = nwritten;
+	return RDD_OK;
+}
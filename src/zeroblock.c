@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+/*
+ * Zero-block detection.  The vector loops OR several loads together
+ * and test the result once per iteration; unaligned head and tail
+ * bytes are checked one word or byte at a time.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rdd.h"
+#include "zeroblock.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define ZERO_X86_64 1
+#include <immintrin.h>
+#endif
+
+typedef int (*is_zero_fun)(const unsigned char *buf, size_t nbyte);
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static is_zero_fun    is_zero_impl;
+static const char    *is_zero_name;
+
+/* Checks the tail of a buffer, eight bytes at a time.
+ */
+static int
+word_is_zero(const unsigned char *buf, size_t nbyte)
+{
+	uint64_t acc = 0;
+	uint64_t w;
+
+	for (; nbyte >= 8; buf += 8, nbyte -= 8) {
+		memcpy(&w, buf, sizeof w);
+		acc |= w;
+	}
+	for (; nbyte > 0; buf++, nbyte--) {
+		acc |= *buf;
+	}
+	return acc == 0;
+}
+
+/* Portable version: stops at the first nonzero 64-byte chunk.
+ */
+static int
+portable_is_zero(const unsigned char *buf, size_t nbyte)
+{
+	for (; nbyte >= 64; buf += 64, nbyte -= 64) {
+		if (! word_is_zero(buf, 64)) {
+			return 0;
+		}
+	}
+	return word_is_zero(buf, nbyte);
+}
+
+#if defined(ZERO_X86_64)
+
+static int
+sse2_is_zero(const unsigned char *buf, size_t nbyte)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc;
+
+	for (; nbyte >= 64; buf += 64, nbyte -= 64) {
+		acc = _mm_or_si128(
+			_mm_or_si128(_mm_loadu_si128((const __m128i *) buf),
+				_mm_loadu_si128((const __m128i *) (buf + 16))),
+			_mm_or_si128(_mm_loadu_si128((const __m128i *) (buf + 32)),
+				_mm_loadu_si128((const __m128i *) (buf + 48))));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, zero)) != 0xffff) {
+			return 0;
+		}
+	}
+	return word_is_zero(buf, nbyte);
+}
+
+__attribute__((target("avx2")))
+static int
+avx2_is_zero(const unsigned char *buf, size_t nbyte)
+{
+	__m256i acc;
+
+	for (; nbyte >= 128; buf += 128, nbyte -= 128) {
+		acc = _mm256_or_si256(
+			_mm256_or_si256(_mm256_loadu_si256((const __m256i *) buf),
+				_mm256_loadu_si256((const __m256i *) (buf + 32))),
+			_mm256_or_si256(_mm256_loadu_si256((const __m256i *) (buf + 64)),
+				_mm256_loadu_si256((const __m256i *) (buf + 96))));
+		if (! _mm256_testz_si256(acc, acc)) {
+			return 0;
+		}
+	}
+	return sse2_is_zero(buf, nbyte);
+}
+
+#endif /* ZERO_X86_64 */
+
+static void
+init_impl(void)
+{
+	is_zero_impl = portable_is_zero;
+	is_zero_name = "64-bit words";
+
+#if defined(ZERO_X86_64)
+	__builtin_cpu_init();
+	is_zero_impl = sse2_is_zero;	/* SSE2 is part of x86-64 */
+	is_zero_name = "SSE2";
+	if (__builtin_cpu_supports("avx2")) {
+		is_zero_impl = avx2_is_zero;
+		is_zero_name = "AVX2";
+	}
+#endif
+}
+
+int
+rdd_is_zero(const unsigned char *buf, size_t nbyte)
+{
+	pthread_once(&init_once, init_impl);
+
+	return (*is_zero_impl)(buf, nbyte);
+}
+
+const char *
+rdd_is_zero_impl_name(void)
+{
+	pthread_once(&init_once, init_impl);
+
+	return is_zero_name;
+}
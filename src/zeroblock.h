@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2002 - 2006, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef __zeroblock_h__
+#define __zeroblock_h__
+
+/** @file
+ *  \brief Fast detection of all-zero data.
+ *
+ *  The sparse writer uses these routines to find runs of zero bytes
+ *  in the data it writes.  On x86-64 CPUs with AVX2 the data is
+ *  compared 128 bytes at a time; other CPUs use SSE2 or 64-bit words.
+ *  Both stop at the first nonzero byte, so ordinary data costs next
+ *  to nothing.
+ */
+
+#include <stddef.h>
+
+/** \brief Checks whether a buffer contains only zero bytes.
+ *  \param buf the data
+ *  \param nbyte the number of bytes in \c buf
+ *  \return Returns 1 if all \c nbyte bytes are zero (or if \c nbyte
+ *  is 0), and 0 otherwise.
+ */
+int rdd_is_zero(const unsigned char *buf, size_t nbyte);
+
+/** \brief Describes the code that rdd_is_zero() uses.
+ *  \return Returns a static string, for example "AVX2".
+ */
+const char *rdd_is_zero_impl_name(void);
+
+#endif /* __zeroblock_h__ */
@@ -55,9 +55,15 @@ static char copyright[] =
 
 #include "rdd.h"
 #include "writer.h"
+#include "entropy.h"
 
 #define ZBUF_SIZE 32768
 
+/* Incompressible input (see entropy.h) is deflated at this level,
+ * which emits stored blocks and costs little more than a copy.
+ */
+#define STORED_LEVEL	0
+
 #define z_inbuf_empty(z)  ((z)->avail_in <= 0)
 #define z_outbuf_full(z)  ((z)->avail_out <= 0)
 
@@ -77,6 +83,7 @@ typedef struct _RDD_ZLIB_WRITER {
 	RDD_WRITER    *parent;
 	z_stream       zstate;
 	unsigned char *zbuf;
+	int            level;		/* current compression level */
 } RDD_ZLIB_WRITER;
 
 int
@@ -106,6 +113,7 @@ rdd_open_zlib_writer(RDD_WRITER **self, RDD_WRITER *parent)
 	}
 	state->zbuf = zbuf;
 	state->parent = parent;
+	state->level = Z_DEFAULT_COMPRESSION;
 
 	memset(&state->zstate, 0, sizeof(z_stream));
 	state->zstate.zalloc = Z_NULL;
@@ -159,15 +167,56 @@ flush(RDD_ZLIB_WRITER *state)
 	return RDD_OK;
 }
 
-/* Pushes the entire input buffer into the compressor.
+/* Switches the compressor to a new level.  Data that is already in
+ * the compressor is flushed at the old level first, which may need
+ * room in the output buffer.
+ */
+static int
+set_level(RDD_ZLIB_WRITER *state, int level)
+{
+	z_stream *z = &state->zstate;
+	int rc;
+
+	while (1) {
+		if (z_outbuf_full(z)) {
+			if ((rc = flush(state)) != RDD_OK) {
+				return rc;
+			}
+		}
+		rc = deflateParams(z, level, Z_DEFAULT_STRATEGY);
+		if (rc == Z_OK) {
+			break;
+		} else if (rc != Z_BUF_ERROR) {
+			return RDD_ECOMPRESS;
+		}
+		if ((rc = flush(state)) != RDD_OK) {
+			return rc;
+		}
+	}
+	state->level = level;
+
+	return RDD_OK;
+}
+
+/* Pushes the entire input buffer into the compressor.  Buffers that
+ * look incompressible are stored rather than deflated.
  */
 static int
 zlib_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte)
 {
 	RDD_ZLIB_WRITER *state = w->state;
 	z_stream *z = &state->zstate;
+	int level;
 	int rc;
 
+	level = rdd_is_incompressible(buf, nbyte)
+		? STORED_LEVEL : Z_DEFAULT_COMPRESSION;
+	if (level != state->level) {
+		if ((rc = set_level(state, level)) != RDD_OK) {
+			return rc;
+		}
+	}
+
 	z->next_in = (unsigned char *) buf;
 	z->avail_in = nbyte;
 
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2002 - 2007, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef lint
+static char copyright[] =
+"@(#) Copyright (c) 2002-2007\n\
+	Netherlands Forensic Institute.  All rights reserved.\n";
+#endif /* not lint */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "rdd.h"
+#include "writer.h"
+
+#ifdef HAVE_LIBZSTD
+
+/* Forward declarations
+ */
+static int zstd_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte);
+static int zstd_close(RDD_WRITER *w);
+static int zstd_compare_address(RDD_WRITER *w, struct addrinfo *address, int *result);
+
+static RDD_WRITE_OPS zstd_write_ops = {
+	zstd_write,
+	zstd_close,
+	zstd_compare_address
+};
+
+typedef struct _RDD_ZSTD_WRITER {
+	RDD_WRITER    *parent;
+	ZSTD_CCtx     *cctx;
+	unsigned char *zbuf;
+	size_t         zbufsize;
+} RDD_ZSTD_WRITER;
+
+int
+rdd_open_zstd_writer(RDD_WRITER **self, RDD_WRITER *parent,
+			int level, unsigned nthread)
+{
+	RDD_WRITER *w = 0;
+	RDD_ZSTD_WRITER *state = 0;
+	int rc = RDD_OK;
+
+	if (self == 0 || parent == 0) {
+		return RDD_BADARG;
+	}
+	if (level < 0 || level > ZSTD_maxCLevel()) {
+		return RDD_BADARG;
+	}
+
+	rc = rdd_new_writer(&w, &zstd_write_ops, sizeof(RDD_ZSTD_WRITER));
+	if (rc != RDD_OK) {
+		goto error;
+	}
+	state = (RDD_ZSTD_WRITER *) w->state;
+	state->parent = parent;
+
+	state->zbufsize = ZSTD_CStreamOutSize();
+	if ((state->zbuf = malloc(state->zbufsize)) == 0) {
+		rc = RDD_NOMEM;
+		goto error;
+	}
+	if ((state->cctx = ZSTD_createCCtx()) == 0) {
+		rc = RDD_NOMEM;
+		goto error;
+	}
+
+	/* Level 0 selects zstd's default level.  A library that was
+	 * built without thread support rejects nbWorkers > 0; it then
+	 * compresses in the calling thread.
+	 */
+	if (ZSTD_isError(ZSTD_CCtx_setParameter(state->cctx,
+				ZSTD_c_compressionLevel, level))
+	||  ZSTD_isError(ZSTD_CCtx_setParameter(state->cctx,
+				ZSTD_c_checksumFlag, 1))) {
+		rc = RDD_ECOMPRESS;
+		goto error;
+	}
+	if (nthread > 0) {
+		(void) ZSTD_CCtx_setParameter(state->cctx,
+				ZSTD_c_nbWorkers, (int) nthread);
+	}
+
+	*self = w;
+	return RDD_OK;
+
+error:
+	*self = 0;
+	if (state != 0 && state->cctx != 0) ZSTD_freeCCtx(state->cctx);
+	if (state != 0 && state->zbuf != 0) free(state->zbuf);
+	if (state != 0) free(state);
+	if (w != 0) free(w);
+	return rc;
+}
+
+/* Runs the compressor in the given mode until it has consumed all
+ * input (ZSTD_e_continue) or has finished the frame (ZSTD_e_end),
+ * writing all output to the parent writer.
+ */
+static int
+compress_stream(RDD_ZSTD_WRITER *state, const unsigned char *buf,
+		unsigned nbyte, ZSTD_EndDirective mode)
+{
+	ZSTD_inBuffer in = { buf, nbyte, 0 };
+	ZSTD_outBuffer out;
+	size_t remaining;
+	int rc;
+
+	do {
+		out.dst = state->zbuf;
+		out.size = state->zbufsize;
+		out.pos = 0;
+
+		remaining = ZSTD_compressStream2(state->cctx, &out, &in, mode);
+		if (ZSTD_isError(remaining)) {
+			return RDD_ECOMPRESS;
+		}
+		if (out.pos > 0) {
+			rc = rdd_writer_write(state->parent, state->zbuf,
+						(unsigned) out.pos);
+			if (rc != RDD_OK) {
+				return rc;
+			}
+		}
+	} while (mode == ZSTD_e_end ? remaining > 0 : in.pos < in.size);
+
+	return RDD_OK;
+}
+
+static int
+zstd_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte)
+{
+	RDD_ZSTD_WRITER *state = w->state;
+
+	return compress_stream(state, buf, nbyte, ZSTD_e_continue);
+}
+
+static int
+zstd_close(RDD_WRITER *w)
+{
+	RDD_ZSTD_WRITER *state = w->state;
+	int rc;
+
+	rc = compress_stream(state, 0, 0, ZSTD_e_end);
+
+	ZSTD_freeCCtx(state->cctx);
+	state->cctx = 0;
+	free(state->zbuf);
+	state->zbuf = 0;
+	if (rc != RDD_OK) {
+		return rc;
+	}
+
+	return rdd_writer_close(state->parent);
+}
+
+static int
+zstd_compare_address(RDD_WRITER *w, struct addrinfo *address, int *result)
+{
+	RDD_ZSTD_WRITER *state = w->state;
+	return rdd_compare_address(state->parent, address, result);
+}
+
+#else /* no zstd */
+
+int
+rdd_open_zstd_writer(RDD_WRITER **self, RDD_WRITER *parent,
+			int level, unsigned nthread)
+{
+	if (self != 0) *self = 0;
+	return RDD_ECOMPRESS;
+}
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "collectfilter.h"
+
+static int collect_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte);
+static int collect_close(RDD_FILTER *f);
+static int collect_free(RDD_FILTER *f);
+
+static RDD_FILTER_OPS collect_ops = {
+	collect_input,
+	0,
+	collect_close,
+	0,
+	collect_free
+};
+
+int
+collectfilter_open(RDD_FILTER **self)
+{
+	return rdd_new_filter(self, &collect_ops, sizeof(COLLECT_STATE), 0);
+}
+
+static int
+collect_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
+{
+	COLLECT_STATE *s = (COLLECT_STATE *) f->state;
+
+	if (s->failafter > 0 && ++s->ninput > s->failafter) {
+		return RDD_EWRITE;
+	}
+
+	if (s->len + nbyte > s->size) {
+		s->size = 2 * (s->len + nbyte);
+		if ((s->data = realloc(s->data, s->size)) == 0) {
+			return RDD_NOMEM;
+		}
+	}
+	memcpy(s->data + s->len, buf, nbyte);
+	s->len += nbyte;
+
+	return RDD_OK;
+}
+
+static int
+collect_close(RDD_FILTER *f)
+{
+	COLLECT_STATE *s = (COLLECT_STATE *) f->state;
+
+	s->nclose++;
+	return RDD_OK;
+}
+
+static int
+collect_free(RDD_FILTER *f)
+{
+	COLLECT_STATE *s = (COLLECT_STATE *) f->state;
+
+	free(s->data);
+	return RDD_OK;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "collectwriter.h"
+
+static int collect_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte);
+static int collect_close(RDD_WRITER *w);
+static int collect_compare_address(RDD_WRITER *w, struct addrinfo *address, int *result);
+static int collect_sync(RDD_WRITER *w);
+
+static RDD_WRITE_OPS collect_ops = {
+	collect_write,
+	collect_close,
+	collect_compare_address,
+	collect_sync
+};
+
+/* Opens a writer that collects its data in state, which the caller
+ * owns; the writer does not free it when it is closed.
+ */
+int
+collectwriter_open(RDD_WRITER **w, COLLECT_WRITER *state, unsigned limit)
+{
+	int rc;
+
+	memset(state, 0, sizeof(*state));
+	if ((state->data = malloc(limit > 0 ? limit : 1)) == 0) {
+		return RDD_NOMEM;
+	}
+	state->limit = limit;
+
+	rc = rdd_new_writer(w, &collect_ops, sizeof(COLLECT_WRITER *));
+	if (rc != RDD_OK) {
+		return rc;
+	}
+	*(COLLECT_WRITER **) (*w)->state = state;
+	return RDD_OK;
+}
+
+void
+collectwriter_free(COLLECT_WRITER *state)
+{
+	free(state->data);
+	state->data = 0;
+}
+
+void
+collectwriter_fill_pattern(unsigned char *buf, unsigned len)
+{
+	unsigned i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = (unsigned char) ((i * 7) ^ (i >> 8));
+	}
+}
+
+/* Writes len bytes from buf in pieces of irregular size.
+ */
+int
+collectwriter_write_pieces(RDD_WRITER *w, const unsigned char *buf, unsigned len)
+{
+	unsigned sizes[] = { 1, 100, 4096, 513, 9000, 7 };
+	unsigned pos = 0, i = 0, n;
+	int rc;
+
+	while (pos < len) {
+		n = sizes[i++ % (sizeof sizes / sizeof sizes[0])];
+		if (n > len - pos) {
+			n = len - pos;
+		}
+		if ((rc = rdd_writer_write(w, buf + pos, n)) != RDD_OK) {
+			return rc;
+		}
+		pos += n;
+	}
+
+	return RDD_OK;
+}
+
+static int
+collect_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte)
+{
+	COLLECT_WRITER *state = *(COLLECT_WRITER **) w->state;
+
+	if (state->len + nbyte > state->limit) {
+		return RDD_ESPACE;
+	}
+	memcpy(state->data + state->len, buf, nbyte);
+	state->len += nbyte;
+	return RDD_OK;
+}
+
+static int
+collect_close(RDD_WRITER *w)
+{
+	COLLECT_WRITER *state = *(COLLECT_WRITER **) w->state;
+
+	state->closed++;
+	return RDD_OK;
+}
+
+static int
+collect_compare_address(RDD_WRITER *w, struct addrinfo *address, int *result)
+{
+	COLLECT_WRITER *state = *(COLLECT_WRITER **) w->state;
+
+	*result = state->address;
+	return RDD_OK;
+}
+
+static int
+collect_sync(RDD_WRITER *w)
+{
+	COLLECT_WRITER *state = *(COLLECT_WRITER **) w->state;
+
+	state->synced = state->len;
+	return RDD_OK;
+}
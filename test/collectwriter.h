@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef COLLECTWRITER_H_
+#define COLLECTWRITER_H_
+
+#include "rdd.h"
+#include "writer.h"
+
+/* A collect writer stores everything it receives in memory and
+ * fails with RDD_ESPACE once it has received more than its limit.
+ * rdd_compare_address() yields its address field.
+ */
+typedef struct _COLLECT_WRITER {
+	unsigned char *data;
+	unsigned       len;
+	unsigned       limit;
+	int            closed;
+	int            synced;	/* len at the last sync */
+	int            address;
+} COLLECT_WRITER;
+
+int
+collectwriter_open(RDD_WRITER **w, COLLECT_WRITER *state, unsigned limit);
+
+void
+collectwriter_free(COLLECT_WRITER *state);
+
+void
+collectwriter_fill_pattern(unsigned char *buf, unsigned len);
+
+int
+collectwriter_write_pieces(RDD_WRITER *w, const unsigned char *buf, unsigned len);
+
+#endif /* COLLECTWRITER_H_ */
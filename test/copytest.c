@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "collectfilter.h"
+#include "copytest.h"
+
+/* Reports a failed check the way testhelper.h does.
+ */
+#define EXPECT_OK(__func) \
+{ \
+	int __rc = __func; \
+	if (__rc != RDD_OK) { \
+		printf(#__func": expected %d instead of %d\n", RDD_OK, __rc); \
+		return 0; \
+	} \
+}
+
+#define EXPECT_EQ(__expected,__value) \
+{ \
+	unsigned long long __e = (__expected); \
+	unsigned long long __v = (__value); \
+	if (__e != __v) { \
+		printf(#__value": expected %llu instead of %llu\n", __e, __v); \
+		goto error; \
+	} \
+}
+
+void
+copytest_init_params(RDD_ROBUST_PARAMS *p, unsigned minblocklen,
+		unsigned maxblocklen)
+{
+	memset(p, 0, sizeof(*p));
+	p->minblocklen = minblocklen;
+	p->maxblocklen = maxblocklen;
+	p->nretry = 2;
+}
+
+/* Writes the fault positions for a faulty reader to path.
+ */
+int
+copytest_write_simfile(const char *path, const rdd_count_t *faults,
+		unsigned nfault)
+{
+	FILE *fp;
+	unsigned i;
+
+	if ((fp = fopen(path, "w")) == 0) {
+		return 0;
+	}
+	for (i = 0; i < nfault; i++) {
+		fprintf(fp, "%llu\n", (unsigned long long) faults[i]);
+	}
+	return fclose(fp) == 0;
+}
+
+/* Copies image with copier c, through a faulty reader if simfile is
+ * not 0, and checks that the copy returns expect.  Returns a copy of
+ * the data that reached the filters; the caller frees it.
+ */
+int
+copytest_run(RDD_COPIER *c, char *image, char *simfile,
+		int expect, RDD_COPIER_RETURN *ret,
+		unsigned char **data, rdd_count_t *len)
+{
+	RDD_FILTERSET set;
+	RDD_FILTER *f = 0;
+	RDD_READER *reader = 0;
+	COLLECT_STATE *s;
+	int rc;
+
+	EXPECT_OK(rdd_fset_init(&set));
+	EXPECT_OK(collectfilter_open(&f));
+	EXPECT_OK(rdd_fset_add(&set, "collect", f));
+
+	EXPECT_OK(rdd_open_file_reader(&reader, image, 0));
+	if (simfile != 0) {
+		EXPECT_OK(rdd_open_faulty_reader(&reader, reader, simfile));
+	}
+
+	if ((rc = rdd_copy_exec(c, reader, &set, ret)) != expect) {
+		printf("rdd_copy_exec: expected %d instead of %d\n",
+			expect, rc);
+		return 0;
+	}
+	EXPECT_OK(rdd_reader_close(reader, 1));
+
+	s = (COLLECT_STATE *) f->state;
+	if (s->nclose != (expect == RDD_OK ? 1 : 0)) {
+		printf("collect filter closed %u times\n", s->nclose);
+		return 0;
+	}
+	*data = s->data;
+	*len = s->len;
+	s->data = 0;
+
+	EXPECT_OK(rdd_fset_clear(&set));
+	return 1;
+}
+
+/* Copies image with the reference copier ref and with copier c, and
+ * checks that both deliver the same data and byte counts.  The
+ * other counters are left to the caller.
+ */
+int
+copytest_compare(RDD_COPIER *ref, RDD_COPIER *c,
+		char *image, char *simfile,
+		RDD_COPIER_RETURN *refret, RDD_COPIER_RETURN *ret)
+{
+	unsigned char *refdata = 0, *data = 0;
+	rdd_count_t reflen = 0, len = 0;
+	int ok = 0;
+
+	if (! copytest_run(ref, image, simfile, RDD_OK, refret,
+				&refdata, &reflen)) goto error;
+	if (! copytest_run(c, image, simfile, RDD_OK, ret,
+				&data, &len)) goto error;
+
+	EXPECT_EQ(reflen, len);
+	EXPECT_EQ(refret->nbyte, ret->nbyte);
+	EXPECT_EQ(refret->nlost, ret->nlost);
+	if (memcmp(refdata, data, reflen) != 0) {
+		printf("copied data differs\n");
+		goto error;
+	}
+	ok = 1;
+
+error:
+	free(refdata);
+	free(data);
+	return ok;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef COPYTEST_H_
+#define COPYTEST_H_
+
+#include "rdd.h"
+#include "reader.h"
+#include "filter.h"
+#include "filterset.h"
+#include "copier.h"
+
+/* Helpers shared by the copier tests.  They copy an image through a
+ * collecting filter (see collectfilter.h), optionally with the
+ * simulated read errors of a faulty reader.
+ */
+
+void
+copytest_init_params(RDD_ROBUST_PARAMS *p, unsigned minblocklen,
+		unsigned maxblocklen);
+
+int
+copytest_write_simfile(const char *path, const rdd_count_t *faults,
+		unsigned nfault);
+
+int
+copytest_run(RDD_COPIER *c, char *image, char *simfile,
+		int expect, RDD_COPIER_RETURN *ret,
+		unsigned char **data, rdd_count_t *len);
+
+int
+copytest_compare(RDD_COPIER *ref, RDD_COPIER *c,
+		char *image, char *simfile,
+		RDD_COPIER_RETURN *refret, RDD_COPIER_RETURN *ret);
+
+#endif /* COPYTEST_H_ */
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rdd.h"
+#include "writer.h"
+
+#include "testhelper.h"
+#include "collectwriter.h"
+
+#define QUEUE_SIZE	(8 * 1024)
+#define DATA_SIZE	(200 * 1000)
+
+static char outfile[] = "asyncoutput";
+
+static COLLECT_WRITER collected;
+
+static int
+test_open_async_writer_writer_null()
+{
+	RDD_WRITER *parent = 0;
+
+	CHECK_INT(RDD_OK, collectwriter_open(&parent, &collected, DATA_SIZE));
+	CHECK_INT(RDD_BADARG, rdd_open_async_writer(0, parent, QUEUE_SIZE));
+	CHECK_INT(RDD_OK, rdd_writer_close(parent));
+	collectwriter_free(&collected);
+
+	return 1;
+}
+
+static int
+test_open_async_writer_parent_null()
+{
+	RDD_WRITER *w;
+
+	CHECK_INT(RDD_BADARG, rdd_open_async_writer(&w, 0, QUEUE_SIZE));
+	return 1;
+}
+
+static int
+test_open_async_writer_queue_too_small()
+{
+	RDD_WRITER *parent = 0;
+	RDD_WRITER *w;
+
+	CHECK_INT(RDD_OK, collectwriter_open(&parent, &collected, DATA_SIZE));
+	CHECK_INT(RDD_BADARG, rdd_open_async_writer(&w, parent, 1));
+	CHECK_INT(RDD_OK, rdd_writer_close(parent));
+	collectwriter_free(&collected);
+
+	return 1;
+}
+
+static int
+test_async_write_in_order()
+{
+	RDD_WRITER *parent = 0, *w = 0;
+	unsigned char *data = 0;
+	int ok = 0;
+
+	CHECK_NOT_NULL(data = malloc(DATA_SIZE));
+	collectwriter_fill_pattern(data, DATA_SIZE);
+
+	CHECK_INT_GOTO(RDD_OK, collectwriter_open(&parent, &collected, DATA_SIZE));
+	CHECK_INT_GOTO(RDD_OK, rdd_open_async_writer(&w, parent, QUEUE_SIZE));
+	CHECK_INT_GOTO(RDD_OK, collectwriter_write_pieces(w, data, DATA_SIZE));
+	CHECK_INT_GOTO(RDD_OK, rdd_writer_close(w));
+
+	CHECK_UINT_GOTO(1, collected.closed);
+	CHECK_UINT_GOTO(DATA_SIZE, collected.len);
+	CHECK_UCHAR_ARRAY_GOTO(data, collected.data, DATA_SIZE);
+	ok = 1;
+
+error:
+	collectwriter_free(&collected);
+	free(data);
+	return ok;
+}
+
+static int
+test_async_write_to_file()
+{
+	RDD_WRITER *parent = 0, *w = 0;
+	unsigned char *data = 0, *copy = 0;
+	FILE *fp = 0;
+	int ok = 0;
+
+	CHECK_NOT_NULL(data = malloc(DATA_SIZE));
+	CHECK_NOT_NULL_GOTO(copy = malloc(DATA_SIZE + 1));
+	collectwriter_fill_pattern(data, DATA_SIZE);
+
+	CHECK_INT_GOTO(RDD_OK, rdd_open_file_writer(&parent, outfile));
+	CHECK_INT_GOTO(RDD_OK, rdd_open_async_writer(&w, parent, QUEUE_SIZE));
+	CHECK_INT_GOTO(RDD_OK, collectwriter_write_pieces(w, data, DATA_SIZE));
+	CHECK_INT_GOTO(RDD_OK, rdd_writer_close(w));
+
+	CHECK_NOT_NULL_GOTO(fp = fopen(outfile, "rb"));
+	CHECK_UINT_GOTO(DATA_SIZE, fread(copy, 1, DATA_SIZE + 1, fp));
+	CHECK_UCHAR_ARRAY_GOTO(data, copy, DATA_SIZE);
+	ok = 1;
+
+error:
+	if (fp != 0) fclose(fp);
+	remove(outfile);
+	free(copy);
+	free(data);
+	return ok;
+}
+
+static int
+test_async_write_error_is_reported()
+{
+	RDD_WRITER *parent = 0, *w = 0;
+	unsigned char *data = 0;
+	int rc, ok = 0;
+
+	CHECK_NOT_NULL(data = malloc(DATA_SIZE));
+	collectwriter_fill_pattern(data, DATA_SIZE);
+
+	/* The parent fails long before all data has been written.
+	 * The failure must surface in a write or in the close.
+	 */
+	CHECK_INT_GOTO(RDD_OK, collectwriter_open(&parent, &collected, DATA_SIZE / 4));
+	CHECK_INT_GOTO(RDD_OK, rdd_open_async_writer(&w, parent, QUEUE_SIZE));
+	rc = collectwriter_write_pieces(w, data, DATA_SIZE);
+	CHECK_INT_GOTO(RDD_ESPACE, rc);
+	CHECK_INT_GOTO(RDD_ESPACE, rdd_writer_close(w));
+	CHECK_UINT_GOTO(1, collected.closed);
+	CHECK_UCHAR_ARRAY_GOTO(data, collected.data, (int) collected.len);
+	ok = 1;
+
+error:
+	collectwriter_free(&collected);
+	free(data);
+	return ok;
+}
+
+static int
+test_async_close_reports_late_error()
+{
+	RDD_WRITER *parent = 0, *w = 0;
+	unsigned char *data = 0;
+	int ok = 0;
+
+	CHECK_NOT_NULL(data = malloc(QUEUE_SIZE / 2));
+	collectwriter_fill_pattern(data, QUEUE_SIZE / 2);
+
+	/* Everything fits in the queue, so the write succeeds; the
+	 * error can only be reported by the close.
+	 */
+	CHECK_INT_GOTO(RDD_OK, collectwriter_open(&parent, &collected, 10));
+	CHECK_INT_GOTO(RDD_OK, rdd_open_async_writer(&w, parent, QUEUE_SIZE));
+	CHECK_INT_GOTO(RDD_OK, rdd_writer_write(w, data, 100));
+	CHECK_INT_GOTO(RDD_ESPACE, rdd_writer_close(w));
+	ok = 1;
+
+error:
+	collectwriter_free(&collected);
+	free(data);
+	return ok;
+}
+
+static int
+test_compare_address_forwarded()
+{
+	RDD_WRITER *parent = 0, *w = 0;
+	int result = 0;
+	int ok = 0;
+
+	CHECK_INT_GOTO(RDD_OK, collectwriter_open(&parent, &collected, DATA_SIZE));
+	collected.address = 42;
+	CHECK_INT_GOTO(RDD_OK, rdd_open_async_writer(&w, parent, QUEUE_SIZE));
+	CHECK_INT_GOTO(RDD_OK, rdd_compare_address(w, 0, &result));
+	CHECK_INT_GOTO(42, result);
+	CHECK_INT_GOTO(RDD_OK, rdd_writer_close(w));
+	ok = 1;
+
+error:
+	collectwriter_free(&collected);
+	return ok;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	TEST(test_open_async_writer_writer_null);
+	TEST(test_open_async_writer_parent_null);
+	TEST(test_open_async_writer_queue_too_small);
+	TEST(test_async_write_in_order);
+	TEST(test_async_write_to_file);
+	TEST(test_async_write_error_is_reported);
+	TEST(test_async_close_reports_late_error);
+	TEST(test_compare_address_forwarded);
+
+	return result;
+}
+
+TEST_MAIN
+;
@@ -114,6 +114,50 @@ test_atomic_read_succes_small_buffer()
 	return 1;
 }
 
+static int
+test_atomic_read_twice_tells_once()
+{
+	unsigned char test_buf[7] = { 0, 1, 2, 3, 4, 5, 6 };
+	unsigned char buf[7];
+	unsigned nread;
+	rdd_count_t pos;
+
+	mockreader_stub_tell(mock_reader, 42, RDD_OK);
+
+	mockreader_stub_read(mock_reader, test_buf, 7, RDD_OK);
+
+	CHECK_UINT(RDD_OK, rdd_reader_read(atomic_reader, buf, 7, &nread));
+	CHECK_UINT(RDD_OK, rdd_reader_read(atomic_reader, buf, 7, &nread));
+	CHECK_UINT(RDD_OK, rdd_reader_tell(atomic_reader, &pos));
+
+	CHECK_UINT64(56ULL, pos);
+	CHECK_TRUE(mockreader_verify_tell(mock_reader, 1));
+	CHECK_TRUE(mockreader_verify_read(mock_reader, 2, 7, 7));
+
+	return 1;
+}
+
+static int
+test_atomic_seek_then_read_does_not_tell()
+{
+	unsigned char test_buf[7] = { 0, 1, 2, 3, 4, 5, 6 };
+	unsigned char buf[7];
+	unsigned nread;
+	rdd_count_t pos;
+
+	mockreader_stub_seek(mock_reader, RDD_OK);
+	mockreader_stub_read(mock_reader, test_buf, 7, RDD_OK);
+
+	CHECK_UINT(RDD_OK, rdd_reader_seek(atomic_reader, 100));
+	CHECK_UINT(RDD_OK, rdd_reader_read(atomic_reader, buf, 7, &nread));
+	CHECK_UINT(RDD_OK, rdd_reader_tell(atomic_reader, &pos));
+
+	CHECK_UINT64(107ULL, pos);
+	CHECK_TRUE(mockreader_verify_tell(mock_reader, 0));
+
+	return 1;
+}
+
 static int
 test_atomic_read_failed()
 {
@@ -277,6 +321,8 @@ call_tests(void)
 	TEST(test_open_atomic_reader_parent_reader_null);
 	SAFE_TEST(test_atomic_read_success);
 	SAFE_TEST(test_atomic_read_succes_small_buffer);
+	SAFE_TEST(test_atomic_read_twice_tells_once);
+	SAFE_TEST(test_atomic_seek_then_read_does_not_tell);
 	SAFE_TEST(test_atomic_read_failed);
 	SAFE_TEST(test_atomic_read_save_position_failed);
 	SAFE_TEST(test_atomic_read_restore_position_failed);
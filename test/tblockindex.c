@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rdd.h"
+#include "hashengine.h"
+#include "blockindex.h"
+#include "writer.h"
+#include "filter.h"
+#include "filterset.h"
+#include "checksum.h"
+
+#include "testhelper.h"
+
+#define BLOCK_SIZE	4096
+#define NBLOCK		9
+#define TAIL_SIZE	1000
+#define DATA_SIZE	(NBLOCK * BLOCK_SIZE + TAIL_SIZE)
+
+static unsigned char *buf;
+static char index_path[] = "../test/tblockindex_test.idx";
+static char state_path[] = "../test/tblockindex_state.bin";
+static char crc32_path[] = "../test/tblockindex_test.crc";
+
+static int
+setup()
+{
+	unsigned i;
+
+	if ((buf = malloc(DATA_SIZE)) == 0) {
+		return 0;
+	}
+	srandom(17);
+	for (i = 0; i < DATA_SIZE; i++) {
+		buf[i] = (unsigned char) random();
+	}
+	return 1;
+}
+
+static int
+teardown()
+{
+	rdd_hash_set_engine(RDD_HASH_ENGINE_AUTO);
+	unlink(index_path);
+	unlink(state_path);
+	unlink(crc32_path);
+	free(buf);
+	buf = 0;
+	return 1;
+}
+
+static void
+digest(rdd_hash_alg_t alg, const unsigned char *p, unsigned n,
+		unsigned char *md)
+{
+	RDD_HASH h;
+
+	rdd_hash_init(&h, alg);
+	rdd_hash_update(&h, p, n);
+	rdd_hash_final(&h, md);
+	rdd_hash_free(&h);
+}
+
+/* Writes an index of the test data, pushing it in pieces of
+ * varying size.
+ */
+static int
+write_index(rdd_hash_alg_t alg)
+{
+	unsigned pieces[] = {1, 3 * BLOCK_SIZE, BLOCK_SIZE - 1, 2 * BLOCK_SIZE + 2};
+	RDD_FILTER *f = 0;
+	unsigned i, pos, n;
+
+	unlink(index_path);
+	CHECK_UINT(RDD_OK, rdd_new_blockindex_filter(&f, alg, BLOCK_SIZE, 512,
+				index_path, RDD_OVERWRITE));
+	for (pos = 0, i = 0; pos < DATA_SIZE; pos += n, i++) {
+		n = pieces[i % 4];
+		if (n > DATA_SIZE - pos) n = DATA_SIZE - pos;
+		CHECK_UINT(RDD_OK, rdd_filter_push(f, buf + pos, n));
+	}
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	return 1;
+}
+
+static int
+check_index(rdd_hash_alg_t alg)
+{
+	const RDD_BLOCKINDEX_HEADER *hdr;
+	RDD_BLOCKINDEX *idx = 0;
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned mdsize = rdd_hash_size(alg);
+	unsigned i, n;
+
+	CHECK_UINT(RDD_OK, rdd_open_blockindex(&idx, index_path));
+	hdr = rdd_blockindex_header(idx);
+	CHECK_TRUE(hdr != 0);
+	CHECK_UINT(RDD_BLOCKINDEX_MAGIC, hdr->magic);
+	CHECK_UINT(alg, hdr->algorithm);
+	CHECK_UINT(mdsize, hdr->digestsize);
+	CHECK_UINT(BLOCK_SIZE, hdr->blocksize);
+	CHECK_UINT(512, (unsigned) hdr->offset);
+	CHECK_UINT(DATA_SIZE, (unsigned) hdr->imagesize);
+	CHECK_UINT(NBLOCK + 1, (unsigned) hdr->nblock);
+
+	for (i = 0; i <= NBLOCK; i++) {
+		n = i < NBLOCK ? BLOCK_SIZE : TAIL_SIZE;
+		CHECK_UINT(n, rdd_blockindex_blocksize(idx, i));
+		digest(alg, buf + i * BLOCK_SIZE, n, md);
+		CHECK_TRUE(memcmp(md, rdd_blockindex_digest(idx, i), mdsize) == 0);
+	}
+	CHECK_TRUE(rdd_blockindex_digest(idx, NBLOCK + 1) == 0);
+	CHECK_UINT(0, rdd_blockindex_blocksize(idx, NBLOCK + 1));
+	CHECK_UINT(RDD_OK, rdd_close_blockindex(idx));
+
+	return 1;
+}
+
+static int
+test_blockindex_write()
+{
+	if (! write_index(RDD_HASH_SHA256)) return 0;
+	if (! check_index(RDD_HASH_SHA256)) return 0;
+	if (! write_index(RDD_HASH_MD5)) return 0;
+	if (! check_index(RDD_HASH_MD5)) return 0;
+
+	return 1;
+}
+
+static void
+count_error(rdd_count_t blocknum, const unsigned char *expected,
+		const unsigned char *computed, unsigned mdsize, void *env)
+{
+	((rdd_count_t *) env)[0]++;
+	((rdd_count_t *) env)[1] = blocknum;
+}
+
+static int
+verify_range(RDD_BLOCKINDEX *idx, rdd_count_t first, rdd_count_t count,
+		const unsigned char *data, unsigned nbyte, rdd_count_t *nerror,
+		rdd_count_t *calls)
+{
+	RDD_FILTER *f = 0;
+
+	calls[0] = calls[1] = 0;
+	CHECK_UINT(RDD_OK, rdd_new_verify_blockindex_filter(&f, idx,
+				first, count, count_error, calls));
+	CHECK_UINT(RDD_OK, rdd_filter_push(f, data, nbyte));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_get_result(f, (unsigned char *) nerror,
+				sizeof *nerror));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	return 1;
+}
+
+static int
+test_blockindex_verify()
+{
+	RDD_BLOCKINDEX *idx = 0;
+	rdd_count_t calls[2];
+	rdd_count_t nerror;
+
+	if (! write_index(RDD_HASH_SHA1)) return 0;
+	CHECK_UINT(RDD_OK, rdd_open_blockindex(&idx, index_path));
+
+	if (! verify_range(idx, 0, 0, buf, DATA_SIZE, &nerror, calls)) return 0;
+	CHECK_UINT(0, (unsigned) nerror);
+	CHECK_UINT(0, (unsigned) calls[0]);
+
+	/* One corrupted block. */
+	buf[5 * BLOCK_SIZE + 7] ^= 0x80;
+	if (! verify_range(idx, 0, 0, buf, DATA_SIZE, &nerror, calls)) return 0;
+	CHECK_UINT(1, (unsigned) nerror);
+	CHECK_UINT(1, (unsigned) calls[0]);
+	CHECK_UINT(5, (unsigned) calls[1]);
+
+	/* A range that avoids the bad block, and one that includes it. */
+	if (! verify_range(idx, 1, 3, buf + BLOCK_SIZE, 3 * BLOCK_SIZE,
+				&nerror, calls)) return 0;
+	CHECK_UINT(0, (unsigned) nerror);
+	if (! verify_range(idx, 4, 2, buf + 4 * BLOCK_SIZE, 2 * BLOCK_SIZE,
+				&nerror, calls)) return 0;
+	CHECK_UINT(1, (unsigned) nerror);
+	CHECK_UINT(5, (unsigned) calls[1]);
+	buf[5 * BLOCK_SIZE + 7] ^= 0x80;
+
+	/* Up to the end, including the short last block. */
+	if (! verify_range(idx, 6, 0, buf + 6 * BLOCK_SIZE,
+				DATA_SIZE - 6 * BLOCK_SIZE, &nerror, calls)) return 0;
+	CHECK_UINT(0, (unsigned) nerror);
+
+	/* Truncated input: the last two blocks are missing. */
+	if (! verify_range(idx, 0, 0, buf, (NBLOCK - 1) * BLOCK_SIZE,
+				&nerror, calls)) return 0;
+	CHECK_UINT(2, (unsigned) nerror);
+
+	CHECK_UINT(RDD_OK, rdd_close_blockindex(idx));
+
+	return 1;
+}
+
+/* Pushes the test data through a block-index verification filter and
+ * a CRC-32 verification filter in one filter set, as rdd-verify does,
+ * and fetches both error counts.
+ */
+static int
+verify_with_checksum(RDD_BLOCKINDEX *idx, rdd_count_t *idxerr,
+		rdd_count_t *crcerr)
+{
+	RDD_FILTERSET fset;
+	RDD_CHECKSUM_FILE_HEADER header;
+	RDD_FILTER *f = 0;
+	unsigned small;
+	FILE *fp;
+
+	CHECK_NOT_NULL(fp = fopen(crc32_path, "r"));
+	CHECK_TRUE(fread(&header, sizeof header, 1, fp) == 1);
+
+	CHECK_UINT(RDD_OK, rdd_fset_init(&fset));
+	CHECK_UINT(RDD_OK, rdd_new_verify_blockindex_filter(&f, idx, 0, 0,
+				0, 0));
+	CHECK_UINT(RDD_OK, rdd_fset_add(&fset, "block index", f));
+	CHECK_UINT(RDD_OK, rdd_new_verify_crc32_blockfilter(&f, fp,
+				BLOCK_SIZE, 0, 0, 0));
+	CHECK_UINT(RDD_OK, rdd_fset_add(&fset, "crc32", f));
+	CHECK_UINT(RDD_OK, rdd_fset_push(&fset, buf, DATA_SIZE));
+	CHECK_UINT(RDD_OK, rdd_fset_close(&fset));
+
+	/* The error counts do not fit in an unsigned. */
+	CHECK_UINT(RDD_OK, rdd_fset_get(&fset, "crc32", &f));
+	CHECK_UINT(RDD_NOMEM, rdd_filter_get_result(f,
+				(unsigned char *) &small, sizeof small));
+	CHECK_UINT(RDD_OK, rdd_filter_get_result(f,
+				(unsigned char *) crcerr, sizeof *crcerr));
+	CHECK_UINT(RDD_OK, rdd_fset_get(&fset, "block index", &f));
+	CHECK_UINT(RDD_NOMEM, rdd_filter_get_result(f,
+				(unsigned char *) &small, sizeof small));
+	CHECK_UINT(RDD_OK, rdd_filter_get_result(f,
+				(unsigned char *) idxerr, sizeof *idxerr));
+
+	CHECK_UINT(RDD_OK, rdd_fset_clear(&fset));
+	fclose(fp);
+
+	return 1;
+}
+
+static int
+test_blockindex_verify_with_checksum()
+{
+	RDD_BLOCKINDEX *idx = 0;
+	RDD_FILTER *f = 0;
+	rdd_count_t idxerr, crcerr;
+
+	if (! write_index(RDD_HASH_SHA256)) return 0;
+	CHECK_UINT(RDD_OK, rdd_new_crc32_blockfilter(&f, BLOCK_SIZE,
+				crc32_path, RDD_OVERWRITE));
+	CHECK_UINT(RDD_OK, rdd_filter_push(f, buf, DATA_SIZE));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+	CHECK_UINT(RDD_OK, rdd_open_blockindex(&idx, index_path));
+
+	if (! verify_with_checksum(idx, &idxerr, &crcerr)) return 0;
+	CHECK_UINT(0, (unsigned) idxerr);
+	CHECK_UINT(0, (unsigned) crcerr);
+
+	buf[3 * BLOCK_SIZE + 11] ^= 0x04;
+	if (! verify_with_checksum(idx, &idxerr, &crcerr)) return 0;
+	buf[3 * BLOCK_SIZE + 11] ^= 0x04;
+	CHECK_UINT(1, (unsigned) idxerr);
+	CHECK_UINT(1, (unsigned) crcerr);
+
+	CHECK_UINT(RDD_OK, rdd_close_blockindex(idx));
+
+	return 1;
+}
+
+static int
+test_blockindex_bad_file()
+{
+	RDD_BLOCKINDEX *idx = 0;
+	unsigned char zero[RDD_BLOCKINDEX_HDRSIZE];
+	FILE *fp;
+
+	CHECK_UINT(RDD_EOPEN, rdd_open_blockindex(&idx, "../test/no-such.idx"));
+
+	/* Truncated index */
+	if (! write_index(RDD_HASH_SHA256)) return 0;
+	CHECK_TRUE(truncate(index_path, RDD_BLOCKINDEX_HDRSIZE + 100) == 0);
+	CHECK_UINT(RDD_ESYNTAX, rdd_open_blockindex(&idx, index_path));
+
+	/* Bad magic */
+	unlink(index_path);
+	memset(zero, 0, sizeof zero);
+	CHECK_NOT_NULL(fp = fopen(index_path, "w"));
+	CHECK_TRUE(fwrite(zero, sizeof zero, 1, fp) == 1);
+	CHECK_TRUE(fclose(fp) == 0);
+	CHECK_UINT(RDD_ESYNTAX, rdd_open_blockindex(&idx, index_path));
+
+	return 1;
+}
+
+/* Save the filter state half-way, restore it into a filter that
+ * reopens the same file, and compare the result with an index
+ * written in one go.
+ */
+static int
+test_blockindex_save_restore()
+{
+	unsigned half = 4 * BLOCK_SIZE + 333;
+	RDD_FILTER *f = 0;
+	FILE *fp;
+
+	rdd_hash_set_engine(RDD_HASH_ENGINE_LEGACY);
+
+	unlink(index_path);
+	CHECK_UINT(RDD_OK, rdd_new_blockindex_filter(&f, RDD_HASH_SHA256,
+				BLOCK_SIZE, 512, index_path, RDD_OVERWRITE));
+	CHECK_UINT(RDD_OK, rdd_filter_push(f, buf, half));
+	CHECK_NOT_NULL(fp = fopen(state_path, "w"));
+	CHECK_UINT(RDD_OK, rdd_filter_save(f, fp));
+	CHECK_TRUE(fclose(fp) == 0);
+	/* Simulate a crash: more data gets written but is never saved. */
+	CHECK_UINT(RDD_OK, rdd_filter_push(f, buf + half, 2 * BLOCK_SIZE));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	CHECK_UINT(RDD_OK, rdd_new_blockindex_filter(&f, RDD_HASH_SHA256,
+				BLOCK_SIZE, 512, index_path, RDD_RESUME));
+	CHECK_NOT_NULL(fp = fopen(state_path, "r"));
+	CHECK_UINT(RDD_OK, rdd_filter_restore(f, fp));
+	CHECK_TRUE(fclose(fp) == 0);
+	CHECK_UINT(RDD_OK, rdd_filter_push(f, buf + half, DATA_SIZE - half));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	return check_index(RDD_HASH_SHA256);
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_blockindex_write);
+	SAFE_TEST(test_blockindex_verify);
+	SAFE_TEST(test_blockindex_verify_with_checksum);
+	SAFE_TEST(test_blockindex_bad_file);
+	SAFE_TEST(test_blockindex_save_restore);
+
+	return result;
+}
+
+TEST_MAIN
+;
@@ -0,0 +1,449 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/md5.h>
+#include <openssl/sha.h>
+
+#include "rdd.h"
+#include "reader.h"
+#include "writer.h"
+#include "filter.h"
+#include "filterset.h"
+#include "copier.h"
+#include "checkpoint.h"
+#include "hashengine.h"
+
+#include "testhelper.h"
+
+#define BLOCK_SIZE	65536
+#define MIN_BLOCK_SIZE	512
+#define CHECKPOINT_LEN	(4 * BLOCK_SIZE)
+#define FILTER_NBUF	4
+
+static char image[] = "../test/image.img";
+static char ckptfile[] = "copy.ckpt";
+static char outfile[] = "copy.out";
+static char adlerfile[] = "copy.adler";
+static char refoutfile[] = "ref.out";
+static char refadlerfile[] = "ref.adler";
+
+/* Checkpoint callback state: saves \c nsave checkpoints and then
+ * aborts the copy at the next checkpoint.
+ */
+typedef struct _CKPT_ENV {
+	RDD_FILTERSET *fset;
+	unsigned       nsave;
+	rdd_count_t    offset;
+	rdd_count_t    count;
+} CKPT_ENV;
+
+static int
+save_then_abort(RDD_COPIER_RETURN *state, void *env)
+{
+	CKPT_ENV *e = (CKPT_ENV *) env;
+	RDD_CHECKPOINT cp;
+	int rc;
+
+	if (e->nsave == 0) {
+		return RDD_ABORTED;
+	}
+	e->nsave--;
+
+	cp.offset = e->offset;
+	cp.count = e->count;
+	cp.copied = *state;
+	if ((rc = rdd_checkpoint_save(ckptfile, &cp, e->fset)) != RDD_OK) {
+		return rc;
+	}
+	return RDD_OK;
+}
+
+/* A filter without save and restore routines.
+ */
+static int
+null_input(RDD_FILTER *f, const unsigned char *buf, unsigned nbyte)
+{
+	return RDD_OK;
+}
+
+static RDD_FILTER_OPS null_ops = {
+	null_input,
+	0,
+	0,
+	0,
+	0
+};
+
+static int
+setup()
+{
+	/* Only the low-level hash engine can save its state. */
+	rdd_hash_set_engine(RDD_HASH_ENGINE_LEGACY);
+
+	remove(ckptfile);
+	remove(outfile);
+	remove(adlerfile);
+	remove(refoutfile);
+	remove(refadlerfile);
+	return 1;
+}
+
+static int
+teardown()
+{
+	rdd_hash_set_engine(RDD_HASH_ENGINE_AUTO);
+
+	remove(ckptfile);
+	remove(outfile);
+	remove(adlerfile);
+	remove(refoutfile);
+	remove(refadlerfile);
+	return 1;
+}
+
+/* Installs a write filter, two hash filters, and an Adler32 block
+ * filter.  With mode RDD_RESUME, existing output files are reused.
+ */
+static int
+build_fset(RDD_FILTERSET *fset, RDD_WRITER **w, const char *out,
+		const char *adler, rdd_write_mode_t mode, int parallel)
+{
+	RDD_FILTER *f = 0;
+
+	CHECK_UINT(RDD_OK, rdd_fset_init(fset));
+
+	CHECK_UINT(RDD_OK, rdd_open_safe_writer(w, out, mode));
+	CHECK_UINT(RDD_OK, rdd_new_write_streamfilter(&f, *w));
+	CHECK_UINT(RDD_OK, rdd_fset_add(fset, "writer_0", f));
+
+	CHECK_UINT(RDD_OK, rdd_new_md5_streamfilter(&f));
+	CHECK_UINT(RDD_OK, rdd_fset_add(fset, "MD5 stream", f));
+
+	CHECK_UINT(RDD_OK, rdd_new_sha1_streamfilter(&f));
+	CHECK_UINT(RDD_OK, rdd_fset_add(fset, "SHA-1 stream", f));
+
+	CHECK_UINT(RDD_OK, rdd_new_adler32_blockfilter(&f, 32768, adler,
+				mode == RDD_RESUME ? RDD_RESUME : 1));
+	CHECK_UINT(RDD_OK, rdd_fset_add(fset, "Adler32 block", f));
+
+	if (parallel) {
+		CHECK_UINT(RDD_OK, rdd_fset_set_parallel(fset, FILTER_NBUF,
+					BLOCK_SIZE));
+	}
+	return 1;
+}
+
+static int
+new_copier(RDD_COPIER **c, rdd_count_t offset, rdd_count_t count,
+		int pipelined, CKPT_ENV *env)
+{
+	RDD_ROBUST_PARAMS p;
+
+	memset(&p, 0, sizeof p);
+	p.minblocklen = MIN_BLOCK_SIZE;
+	p.maxblocklen = BLOCK_SIZE;
+	p.nretry = 1;
+	if (env != 0) {
+		p.checkpointfun = save_then_abort;
+		p.checkpointenv = env;
+		p.checkpointlen = CHECKPOINT_LEN;
+	}
+
+	if (pipelined) {
+		CHECK_UINT(RDD_OK, rdd_new_pipelined_copier(c, offset, count,
+					&p, FILTER_NBUF));
+	} else {
+		CHECK_UINT(RDD_OK, rdd_new_robust_copier(c, offset, count, &p));
+	}
+	return 1;
+}
+
+/* Runs a copier over the test image.
+ */
+static int
+run_copy(RDD_COPIER *c, RDD_FILTERSET *fset, int expect,
+		RDD_COPIER_RETURN *ret)
+{
+	RDD_READER *reader = 0;
+
+	CHECK_UINT(RDD_OK, rdd_open_file_reader(&reader, image, 0));
+	CHECK_UINT(expect, rdd_copy_exec(c, reader, fset, ret));
+	CHECK_UINT(RDD_OK, rdd_reader_close(reader, 1));
+	CHECK_UINT(RDD_OK, rdd_copy_free(c));
+	return 1;
+}
+
+static int
+get_digests(RDD_FILTERSET *fset, unsigned char *md5, unsigned char *sha1)
+{
+	RDD_FILTER *f = 0;
+
+	CHECK_UINT(RDD_OK, rdd_fset_get(fset, "MD5 stream", &f));
+	CHECK_UINT(RDD_OK, rdd_filter_get_result(f, md5, MD5_DIGEST_LENGTH));
+	CHECK_UINT(RDD_OK, rdd_fset_get(fset, "SHA-1 stream", &f));
+	CHECK_UINT(RDD_OK, rdd_filter_get_result(f, sha1, SHA_DIGEST_LENGTH));
+	return 1;
+}
+
+/* Returns 1 if both files exist and have the same contents.
+ */
+static int
+same_file(const char *path1, const char *path2)
+{
+	FILE *fp1, *fp2;
+	int c1, c2;
+	int same = 0;
+
+	if ((fp1 = fopen(path1, "rb")) == 0) {
+		return 0;
+	}
+	if ((fp2 = fopen(path2, "rb")) == 0) {
+		fclose(fp1);
+		return 0;
+	}
+	do {
+		c1 = getc(fp1);
+		c2 = getc(fp2);
+	} while (c1 == c2 && c1 != EOF);
+	same = (c1 == c2);
+
+	fclose(fp1);
+	fclose(fp2);
+	return same;
+}
+
+/* Copies the whole image without interruption.  Output goes to the
+ * reference files.
+ */
+static int
+reference_copy(unsigned char *md5, unsigned char *sha1,
+		rdd_count_t offset, rdd_count_t count)
+{
+	RDD_FILTERSET fset;
+	RDD_WRITER *w = 0;
+	RDD_COPIER *c = 0;
+	RDD_COPIER_RETURN ret;
+
+	CHECK_TRUE(build_fset(&fset, &w, refoutfile, refadlerfile,
+				RDD_NO_OVERWRITE, 0));
+	CHECK_TRUE(new_copier(&c, offset, count, 0, 0));
+	CHECK_TRUE(run_copy(c, &fset, RDD_OK, &ret));
+	CHECK_TRUE(get_digests(&fset, md5, sha1));
+	CHECK_UINT(RDD_OK, rdd_writer_close(w));
+	CHECK_UINT(RDD_OK, rdd_fset_clear(&fset));
+	return 1;
+}
+
+/* Interrupts a copy after \c nsave checkpoints, resumes it from the
+ * last checkpoint, and compares the result with an uninterrupted copy.
+ */
+static int
+interrupt_and_resume(unsigned nsave, int parallel, int pipelined,
+		rdd_count_t offset, rdd_count_t count)
+{
+	unsigned char refmd5[MD5_DIGEST_LENGTH], md5[MD5_DIGEST_LENGTH];
+	unsigned char refsha1[SHA_DIGEST_LENGTH], sha1[SHA_DIGEST_LENGTH];
+	RDD_FILTERSET fset;
+	RDD_WRITER *w = 0;
+	RDD_COPIER *c = 0;
+	RDD_COPIER_RETURN ret;
+	RDD_CHECKPOINT cp;
+	CKPT_ENV env;
+
+	CHECK_TRUE(reference_copy(refmd5, refsha1, offset, count));
+
+	/* First run: abort after nsave checkpoints.  The outputs then
+	 * contain data beyond the last checkpoint.
+	 */
+	CHECK_TRUE(build_fset(&fset, &w, outfile, adlerfile,
+				RDD_NO_OVERWRITE, parallel));
+	env.fset = &fset;
+	env.nsave = nsave;
+	env.offset = offset;
+	env.count = count;
+	CHECK_TRUE(new_copier(&c, offset, count, pipelined, &env));
+	CHECK_TRUE(run_copy(c, &fset, RDD_ABORTED, &ret));
+	CHECK_UINT(RDD_OK, rdd_fset_close(&fset));
+	CHECK_UINT(RDD_OK, rdd_writer_close(w));
+	CHECK_UINT(RDD_OK, rdd_fset_clear(&fset));
+
+	/* Second run: restore and copy the rest.
+	 */
+	CHECK_TRUE(build_fset(&fset, &w, outfile, adlerfile,
+				RDD_RESUME, parallel));
+	CHECK_UINT(RDD_OK, rdd_checkpoint_load(ckptfile, &cp, &fset));
+	CHECK_UINT64((unsigned long long) offset, cp.offset);
+	CHECK_UINT64((unsigned long long) count, cp.count);
+	CHECK_UINT64((unsigned long long) nsave * CHECKPOINT_LEN, cp.copied.nbyte);
+	CHECK_UINT64(0ULL, cp.copied.nlost);
+
+	CHECK_TRUE(new_copier(&c, offset + cp.copied.nbyte,
+				count - cp.copied.nbyte, pipelined, 0));
+	CHECK_TRUE(run_copy(c, &fset, RDD_OK, &ret));
+	CHECK_UINT64((unsigned long long) (count - cp.copied.nbyte), ret.nbyte);
+	CHECK_TRUE(get_digests(&fset, md5, sha1));
+	CHECK_UINT(RDD_OK, rdd_writer_close(w));
+	CHECK_UINT(RDD_OK, rdd_fset_clear(&fset));
+
+	CHECK_TRUE(memcmp(md5, refmd5, sizeof md5) == 0);
+	CHECK_TRUE(memcmp(sha1, refsha1, sizeof sha1) == 0);
+	CHECK_TRUE(same_file(outfile, refoutfile));
+	CHECK_TRUE(same_file(adlerfile, refadlerfile));
+
+	return 1;
+}
+
+static int
+test_checkpoint_bad_args()
+{
+	RDD_FILTERSET fset;
+	RDD_CHECKPOINT cp;
+
+	memset(&cp, 0, sizeof cp);
+	CHECK_UINT(RDD_OK, rdd_fset_init(&fset));
+
+	CHECK_UINT(RDD_BADARG, rdd_checkpoint_save(0, &cp, &fset));
+	CHECK_UINT(RDD_BADARG, rdd_checkpoint_save(ckptfile, 0, &fset));
+	CHECK_UINT(RDD_BADARG, rdd_checkpoint_save(ckptfile, &cp, 0));
+	CHECK_UINT(RDD_BADARG, rdd_checkpoint_load(0, &cp, &fset));
+	CHECK_UINT(RDD_NOTFOUND, rdd_checkpoint_load(ckptfile, &cp, &fset));
+
+	CHECK_UINT(RDD_OK, rdd_fset_clear(&fset));
+	return 1;
+}
+
+static int
+test_checkpoint_resume()
+{
+	return interrupt_and_resume(2, 0, 0, 0, 1572864);
+}
+
+static int
+test_checkpoint_resume_segment()
+{
+	return interrupt_and_resume(1, 0, 0, 100000, 1000000);
+}
+
+static int
+test_checkpoint_resume_pipelined()
+{
+	return interrupt_and_resume(3, 1, 1, 0, 1572864);
+}
+
+static int
+test_checkpoint_filter_mismatch()
+{
+	RDD_FILTERSET fset;
+	RDD_WRITER *w = 0;
+	RDD_FILTER *f = 0;
+	RDD_CHECKPOINT cp;
+
+	memset(&cp, 0, sizeof cp);
+	CHECK_TRUE(build_fset(&fset, &w, outfile, adlerfile,
+				RDD_NO_OVERWRITE, 0));
+	CHECK_UINT(RDD_OK, rdd_checkpoint_save(ckptfile, &cp, &fset));
+	CHECK_UINT(RDD_OK, rdd_fset_close(&fset));
+	CHECK_UINT(RDD_OK, rdd_writer_close(w));
+	CHECK_UINT(RDD_OK, rdd_fset_clear(&fset));
+
+	/* A filter set with fewer filters. */
+	CHECK_UINT(RDD_OK, rdd_fset_init(&fset));
+	CHECK_UINT(RDD_OK, rdd_new_md5_streamfilter(&f));
+	CHECK_UINT(RDD_OK, rdd_fset_add(&fset, "MD5 stream", f));
+	CHECK_UINT(RDD_ESYNTAX, rdd_checkpoint_load(ckptfile, &cp, &fset));
+	CHECK_UINT(RDD_OK, rdd_fset_clear(&fset));
+
+	return 1;
+}
+
+static int
+test_checkpoint_no_save()
+{
+	RDD_FILTERSET fset;
+	RDD_FILTER *f = 0;
+	RDD_CHECKPOINT cp;
+
+	memset(&cp, 0, sizeof cp);
+	CHECK_UINT(RDD_OK, rdd_fset_init(&fset));
+	CHECK_UINT(RDD_OK, rdd_new_filter(&f, &null_ops, 0, 0));
+	CHECK_UINT(RDD_OK, rdd_fset_add(&fset, "null", f));
+
+	CHECK_UINT(RDD_NOTFOUND, rdd_checkpoint_save(ckptfile, &cp, &fset));
+	CHECK_TRUE(access(ckptfile, F_OK) != 0);
+
+	CHECK_UINT(RDD_OK, rdd_fset_clear(&fset));
+	return 1;
+}
+
+static int
+test_checkpoint_bad_file()
+{
+	RDD_FILTERSET fset;
+	RDD_CHECKPOINT cp;
+	FILE *fp;
+
+	CHECK_TRUE((fp = fopen(ckptfile, "w")) != 0);
+	fprintf(fp, "not a checkpoint\n");
+	fclose(fp);
+
+	CHECK_UINT(RDD_OK, rdd_fset_init(&fset));
+	CHECK_UINT(RDD_ESYNTAX, rdd_checkpoint_load(ckptfile, &cp, &fset));
+	CHECK_UINT(RDD_OK, rdd_fset_clear(&fset));
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_checkpoint_bad_args);
+	SAFE_TEST(test_checkpoint_resume);
+	SAFE_TEST(test_checkpoint_resume_segment);
+	SAFE_TEST(test_checkpoint_resume_pipelined);
+	SAFE_TEST(test_checkpoint_filter_mismatch);
+	SAFE_TEST(test_checkpoint_no_save);
+	SAFE_TEST(test_checkpoint_bad_file);
+
+	return result;
+}
+
+TEST_MAIN
+;
@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "rdd.h"
+#include "checksum.h"
+#include "filter.h"
+
+#include "testhelper.h"
+
+#define BUF_SIZE	(1024 * 1024 + 77)
+#define BLOCK_SIZE	4096
+#define NBLOCK		5
+
+static unsigned char *buf;
+static char crc32c_path[] = "../test/tcrc32c_test.txt";
+
+static int
+setup()
+{
+	unsigned i;
+
+	if ((buf = malloc(BUF_SIZE)) == 0) {
+		return 0;
+	}
+	srandom(13);
+	for (i = 0; i < BUF_SIZE; i++) {
+		buf[i] = (unsigned char) random();
+	}
+	return 1;
+}
+
+static int
+teardown()
+{
+	rdd_checksum_use_simd(1);
+	unlink(crc32c_path);
+	free(buf);
+	buf = 0;
+	return 1;
+}
+
+static rdd_checksum_t
+checksum(rdd_checksum_algorithm_t alg, const unsigned char *p, size_t n)
+{
+	return rdd_checksum_update(alg, rdd_checksum_init(alg), p, n);
+}
+
+/* Bitwise CRC32C, independent of the table and SSE4.2 kernels.
+ */
+static rdd_checksum_t
+slow_crc32c(const unsigned char *p, size_t n)
+{
+	uint32_t crc = 0xffffffff;
+	unsigned k;
+
+	while (n-- > 0) {
+		crc ^= *p++;
+		for (k = 0; k < 8; k++) {
+			crc = (crc & 1) ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+		}
+	}
+	return ~crc;
+}
+
+static int
+check_values(void)
+{
+	const unsigned char *s = (const unsigned char *) "123456789";
+
+	CHECK_UINT(0xcbf43926, checksum(RDD_CRC32, s, 9));
+	CHECK_UINT(0xe3069283, checksum(RDD_CRC32C, s, 9));
+	CHECK_UINT(0x091e01de, checksum(RDD_ADLER32, s, 9));
+	CHECK_UINT(0, checksum(RDD_CRC32, s, 0));
+	CHECK_UINT(0, checksum(RDD_CRC32C, s, 0));
+	CHECK_UINT(1, checksum(RDD_ADLER32, s, 0));
+
+	return 1;
+}
+
+static int
+test_checksum_check_values()
+{
+	rdd_checksum_use_simd(0);
+	if (! check_values()) return 0;
+	rdd_checksum_use_simd(1);
+	if (! check_values()) return 0;
+
+	return 1;
+}
+
+/* Compare the dispatched kernels with zlib and with a bitwise CRC32C
+ * for every alignment and for lengths around the SIMD block sizes.
+ */
+static int
+test_checksum_matches_reference()
+{
+	unsigned off, len;
+
+	for (off = 0; off < 16; off++) {
+		for (len = 0; len <= 300; len++) {
+			CHECK_UINT((unsigned) crc32(0, buf + off, len),
+				checksum(RDD_CRC32, buf + off, len));
+			CHECK_UINT((unsigned) adler32(1, buf + off, len),
+				checksum(RDD_ADLER32, buf + off, len));
+			CHECK_UINT(slow_crc32c(buf + off, len),
+				checksum(RDD_CRC32C, buf + off, len));
+		}
+	}
+
+	CHECK_UINT((unsigned) crc32(0, buf + 3, BUF_SIZE - 3),
+		checksum(RDD_CRC32, buf + 3, BUF_SIZE - 3));
+	CHECK_UINT((unsigned) adler32(1, buf + 3, BUF_SIZE - 3),
+		checksum(RDD_ADLER32, buf + 3, BUF_SIZE - 3));
+	CHECK_UINT(slow_crc32c(buf + 3, BUF_SIZE - 3),
+		checksum(RDD_CRC32C, buf + 3, BUF_SIZE - 3));
+
+	rdd_checksum_use_simd(0);
+	CHECK_UINT(slow_crc32c(buf + 3, BUF_SIZE - 3),
+		checksum(RDD_CRC32C, buf + 3, BUF_SIZE - 3));
+
+	/* All-ones data maximizes the Adler32 sums between reductions. */
+	rdd_checksum_use_simd(1);
+	memset(buf, 0xff, BUF_SIZE);
+	CHECK_UINT((unsigned) adler32(1, buf, BUF_SIZE), checksum(RDD_ADLER32, buf, BUF_SIZE));
+
+	return 1;
+}
+
+static int
+test_checksum_incremental()
+{
+	rdd_checksum_algorithm_t algs[] = {RDD_ADLER32, RDD_CRC32, RDD_CRC32C};
+	rdd_checksum_t sum;
+	unsigned i, pos, n;
+
+	for (i = 0; i < sizeof algs / sizeof algs[0]; i++) {
+		sum = rdd_checksum_init(algs[i]);
+		for (pos = 0, n = 1; pos < BUF_SIZE; pos += n, n = n * 3 + 1) {
+			if (n > BUF_SIZE - pos) n = BUF_SIZE - pos;
+			sum = rdd_checksum_update(algs[i], sum, buf + pos, n);
+		}
+		CHECK_UINT(checksum(algs[i], buf, BUF_SIZE), sum);
+	}
+
+	return 1;
+}
+
+static int
+test_checksum_blocks()
+{
+	rdd_checksum_algorithm_t algs[] = {RDD_ADLER32, RDD_CRC32, RDD_CRC32C};
+	unsigned sizes[] = {1, 7, 64, 512, 4096, 5000};
+	rdd_checksum_t sums[10];
+	unsigned i, j, k, simd;
+
+	for (simd = 0; simd < 2; simd++) {
+		rdd_checksum_use_simd(simd);
+		for (i = 0; i < sizeof algs / sizeof algs[0]; i++) {
+			for (j = 0; j < sizeof sizes / sizeof sizes[0]; j++) {
+				rdd_checksum_blocks(algs[i], buf + 1, sizes[j],
+						10, sums);
+				for (k = 0; k < 10; k++) {
+					CHECK_UINT(checksum(algs[i],
+						buf + 1 + k * sizes[j], sizes[j]),
+						sums[k]);
+				}
+			}
+		}
+	}
+
+	return 1;
+}
+
+static void
+count_error(rdd_count_t pos, rdd_checksum_t expected,
+		rdd_checksum_t computed, void *env)
+{
+	(*(unsigned *) env)++;
+}
+
+static int
+test_crc32c_blockfilter()
+{
+	RDD_CHECKSUM_FILE_HEADER header;
+	RDD_FILTER *f = 0;
+	rdd_checksum_t sums[NBLOCK];
+	rdd_count_t nerror = 0;
+	unsigned ncallback = 0;
+	unsigned i;
+	FILE *fp;
+
+	CHECK_UINT(RDD_OK, rdd_new_crc32c_blockfilter(&f, BLOCK_SIZE, crc32c_path, 1));
+	CHECK_UINT(RDD_OK, rdd_filter_push(f, buf, NBLOCK * BLOCK_SIZE));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	CHECK_NOT_NULL(fp = fopen(crc32c_path, "r"));
+	CHECK_TRUE(fread(&header, sizeof header, 1, fp) == 1);
+	CHECK_TRUE(fread(sums, sizeof sums[0], NBLOCK, fp) == NBLOCK);
+	CHECK_UINT(RDD_CHECKSUM_MAGIC, header.magic);
+	CHECK_UINT(RDD_CRC32C, header.flags);
+	CHECK_UINT(BLOCK_SIZE, header.blocksize);
+	for (i = 0; i < NBLOCK; i++) {
+		CHECK_UINT(slow_crc32c(buf + i * BLOCK_SIZE, BLOCK_SIZE), sums[i]);
+	}
+
+	/* Verify the file against the data, with one corrupted block. */
+	buf[2 * BLOCK_SIZE + 100] ^= 0x01;
+	CHECK_TRUE(fseek(fp, sizeof header, SEEK_SET) == 0);
+	CHECK_UINT(RDD_OK, rdd_new_verify_crc32c_blockfilter(&f, fp, BLOCK_SIZE,
+				0, count_error, &ncallback));
+	CHECK_UINT(RDD_OK, rdd_filter_push(f, buf, NBLOCK * BLOCK_SIZE));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_get_result(f, (unsigned char *) &nerror,
+				sizeof nerror));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+	CHECK_TRUE(fclose(fp) == 0);
+
+	CHECK_UINT(1, (unsigned) nerror);
+	CHECK_UINT(1, ncallback);
+
+	return 1;
+}
+
+/* Whole blocks go through the filter's blocks() routine and partial
+ * blocks through input() and block(); both must give the same file.
+ */
+static int
+test_crc32c_blockfilter_pieces()
+{
+	unsigned nbyte = NBLOCK * BLOCK_SIZE + 1234;
+	unsigned pieces[] = {1, 3 * BLOCK_SIZE, BLOCK_SIZE - 1, 2 * BLOCK_SIZE + 2};
+	rdd_checksum_t whole[NBLOCK + 1], pieced[NBLOCK + 1];
+	RDD_FILTER *f = 0;
+	unsigned i, pos, n;
+	FILE *fp;
+
+	CHECK_UINT(RDD_OK, rdd_new_crc32c_blockfilter(&f, BLOCK_SIZE, crc32c_path, 1));
+	CHECK_UINT(RDD_OK, rdd_filter_push(f, buf, nbyte));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+	CHECK_NOT_NULL(fp = fopen(crc32c_path, "r"));
+	CHECK_TRUE(fseek(fp, sizeof(RDD_CHECKSUM_FILE_HEADER), SEEK_SET) == 0);
+	CHECK_TRUE(fread(whole, sizeof whole, 1, fp) == 1);
+	CHECK_TRUE(fgetc(fp) == EOF);
+	fclose(fp);
+
+	CHECK_UINT(RDD_OK, rdd_new_crc32c_blockfilter(&f, BLOCK_SIZE, crc32c_path, 1));
+	for (pos = 0, i = 0; pos < nbyte; pos += n, i++) {
+		n = pieces[i % 4];
+		if (n > nbyte - pos) n = nbyte - pos;
+		CHECK_UINT(RDD_OK, rdd_filter_push(f, buf + pos, n));
+	}
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+	CHECK_NOT_NULL(fp = fopen(crc32c_path, "r"));
+	CHECK_TRUE(fseek(fp, sizeof(RDD_CHECKSUM_FILE_HEADER), SEEK_SET) == 0);
+	CHECK_TRUE(fread(pieced, sizeof pieced, 1, fp) == 1);
+	CHECK_TRUE(fgetc(fp) == EOF);
+	fclose(fp);
+
+	CHECK_TRUE(memcmp(whole, pieced, sizeof whole) == 0);
+	CHECK_UINT(slow_crc32c(buf + NBLOCK * BLOCK_SIZE, 1234), whole[NBLOCK]);
+
+	return 1;
+}
+
+/* A checksum file that ends inside a batch of whole blocks: the
+ * blocks that do have a checksum are still verified.
+ */
+static int
+test_crc32c_blockfilter_short_file()
+{
+	RDD_FILTER *f = 0;
+	unsigned ncallback = 0;
+	FILE *fp;
+
+	CHECK_UINT(RDD_OK, rdd_new_crc32c_blockfilter(&f, BLOCK_SIZE, crc32c_path, 1));
+	CHECK_UINT(RDD_OK, rdd_filter_push(f, buf, NBLOCK * BLOCK_SIZE));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+	CHECK_TRUE(truncate(crc32c_path, sizeof(RDD_CHECKSUM_FILE_HEADER)
+			+ (NBLOCK - 2) * sizeof(rdd_checksum_t)) == 0);
+
+	/* Corrupt a block that still has a checksum. */
+	buf[BLOCK_SIZE + 7] ^= 0x01;
+	CHECK_NOT_NULL(fp = fopen(crc32c_path, "r"));
+	CHECK_TRUE(fseek(fp, sizeof(RDD_CHECKSUM_FILE_HEADER), SEEK_SET) == 0);
+	CHECK_UINT(RDD_OK, rdd_new_verify_crc32c_blockfilter(&f, fp, BLOCK_SIZE,
+				0, count_error, &ncallback));
+	CHECK_UINT(RDD_EREAD, rdd_filter_push(f, buf, NBLOCK * BLOCK_SIZE));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+	CHECK_TRUE(fclose(fp) == 0);
+	buf[BLOCK_SIZE + 7] ^= 0x01;
+
+	CHECK_UINT(1, ncallback);
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_checksum_check_values);
+	SAFE_TEST(test_checksum_matches_reference);
+	SAFE_TEST(test_checksum_incremental);
+	SAFE_TEST(test_checksum_blocks);
+	SAFE_TEST(test_crc32c_blockfilter);
+	SAFE_TEST(test_crc32c_blockfilter_pieces);
+	SAFE_TEST(test_crc32c_blockfilter_short_file);
+
+	return result;
+}
+
+TEST_MAIN
+;
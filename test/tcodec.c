@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rdd.h"
+#include "writer.h"
+#include "reader.h"
+
+#include "testhelper.h"
+
+#if defined(HAVE_LIBLZ4) || defined(HAVE_LIBZSTD)
+
+#define DATA_SIZE	(1000 * 1000 + 17)
+
+typedef enum _codec_t { CODEC_LZ4, CODEC_ZSTD } codec_t;
+
+static char outfile[] = "codecoutput";
+
+/* Half random bytes, half a repeating pattern, so that the data
+ * compresses, but not to nothing.
+ */
+static void
+fill_data(unsigned char *buf, unsigned len)
+{
+	unsigned i;
+
+	srandom(11);
+	for (i = 0; i < len; i++) {
+		if ((i / 5000) % 2 == 0) {
+			buf[i] = (unsigned char) random();
+		} else {
+			buf[i] = (unsigned char) ("forensic copy "[i % 14]);
+		}
+	}
+}
+
+/* Writes len bytes from buf in pieces of irregular size.
+ */
+static int
+write_pieces(RDD_WRITER *w, const unsigned char *buf, unsigned len)
+{
+	unsigned sizes[] = { 1, 100, 65536, 513, 700000, 7 };
+	unsigned pos = 0, i = 0, n;
+	int rc;
+
+	while (pos < len) {
+		n = sizes[i++ % (sizeof sizes / sizeof sizes[0])];
+		if (n > len - pos) {
+			n = len - pos;
+		}
+		if ((rc = rdd_writer_write(w, buf + pos, n)) != RDD_OK) {
+			return rc;
+		}
+		pos += n;
+	}
+
+	return RDD_OK;
+}
+
+static int
+open_writer(RDD_WRITER **w, RDD_WRITER *parent, codec_t codec)
+{
+	if (codec == CODEC_LZ4) {
+		return rdd_open_lz4_writer(w, parent);
+	} else {
+		return rdd_open_zstd_writer(w, parent, 3, 2);
+	}
+}
+
+static int
+open_reader(RDD_READER **r, RDD_READER *parent, codec_t codec)
+{
+	if (codec == CODEC_LZ4) {
+		return rdd_open_lz4_reader(r, parent);
+	} else {
+		return rdd_open_zstd_reader(r, parent);
+	}
+}
+
+/* Compresses len bytes into outfile.
+ */
+static int
+compress_file(const unsigned char *data, unsigned len, codec_t codec)
+{
+	RDD_WRITER *parent = 0, *w = 0;
+
+	CHECK_INT(RDD_OK, rdd_open_file_writer(&parent, outfile));
+	CHECK_INT(RDD_OK, open_writer(&w, parent, codec));
+	CHECK_INT(RDD_OK, write_pieces(w, data, len));
+	CHECK_INT(RDD_OK, rdd_writer_close(w));
+	return 1;
+}
+
+/* Decompresses outfile, reading at most len + 1 bytes in reads of
+ * irregular size.  Sets *rc to the first error.
+ */
+static int
+decompress_file(unsigned char *copy, unsigned len, codec_t codec,
+		unsigned *nread, int *rc)
+{
+	unsigned sizes[] = { 3, 4096, 100000, 1 };
+	RDD_READER *file = 0, *r = 0;
+	unsigned i = 0, n;
+
+	CHECK_INT(RDD_OK, rdd_open_file_reader(&file, outfile, 0));
+	CHECK_INT(RDD_OK, open_reader(&r, file, codec));
+
+	*nread = 0;
+	do {
+		n = sizes[i++ % (sizeof sizes / sizeof sizes[0])];
+		if (n > len + 1 - *nread) {
+			n = len + 1 - *nread;
+		}
+		*rc = rdd_reader_read(r, copy + *nread, n, &n);
+		*nread += n;
+	} while (*rc == RDD_OK && n > 0 && *nread <= len);
+
+	CHECK_INT(RDD_OK, rdd_reader_close(r, 1));
+	return 1;
+}
+
+static int
+roundtrip(codec_t codec)
+{
+	unsigned char *data = 0, *copy = 0;
+	unsigned nread = 0;
+	int rc = RDD_OK;
+	int ok = 0;
+
+	CHECK_NOT_NULL(data = malloc(DATA_SIZE));
+	CHECK_NOT_NULL_GOTO(copy = malloc(DATA_SIZE + 1));
+	fill_data(data, DATA_SIZE);
+
+	if (! compress_file(data, DATA_SIZE, codec)) goto error;
+	if (! decompress_file(copy, DATA_SIZE, codec, &nread, &rc)) goto error;
+	CHECK_INT_GOTO(RDD_OK, rc);
+	CHECK_UINT_GOTO(DATA_SIZE, nread);
+	CHECK_UCHAR_ARRAY_GOTO(data, copy, DATA_SIZE);
+	ok = 1;
+
+error:
+	remove(outfile);
+	free(copy);
+	free(data);
+	return ok;
+}
+
+/* A stream that ends in the middle of a frame must not look like
+ * a shorter, valid stream.
+ */
+static int
+truncated(codec_t codec)
+{
+	unsigned char *data = 0, *copy = 0;
+	unsigned nread = 0;
+	int rc = RDD_OK;
+	int ok = 0;
+	FILE *fp;
+	long size;
+
+	CHECK_NOT_NULL(data = malloc(DATA_SIZE));
+	CHECK_NOT_NULL_GOTO(copy = malloc(DATA_SIZE + 1));
+	fill_data(data, DATA_SIZE);
+
+	if (! compress_file(data, DATA_SIZE, codec)) goto error;
+	CHECK_NOT_NULL_GOTO(fp = fopen(outfile, "r"));
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fclose(fp);
+	CHECK_INT_GOTO(0, truncate(outfile, size - 10));
+
+	if (! decompress_file(copy, DATA_SIZE, codec, &nread, &rc)) goto error;
+	CHECK_INT_GOTO(RDD_ECOMPRESS, rc);
+	ok = 1;
+
+error:
+	remove(outfile);
+	free(copy);
+	free(data);
+	return ok;
+}
+
+#endif
+
+#if defined(HAVE_LIBLZ4)
+
+static int
+test_lz4_roundtrip()
+{
+	return roundtrip(CODEC_LZ4);
+}
+
+static int
+test_lz4_truncated()
+{
+	return truncated(CODEC_LZ4);
+}
+
+#endif
+
+#if defined(HAVE_LIBZSTD)
+
+static int
+test_zstd_roundtrip()
+{
+	return roundtrip(CODEC_ZSTD);
+}
+
+static int
+test_zstd_truncated()
+{
+	return truncated(CODEC_ZSTD);
+}
+
+static int
+test_zstd_bad_level()
+{
+	RDD_WRITER *parent = 0, *w = 0;
+
+	CHECK_INT(RDD_OK, rdd_open_file_writer(&parent, outfile));
+	CHECK_INT(RDD_BADARG, rdd_open_zstd_writer(&w, parent, 1000, 0));
+	CHECK_INT(RDD_BADARG, rdd_open_zstd_writer(&w, parent, -1, 0));
+	CHECK_INT(RDD_OK, rdd_writer_close(parent));
+	remove(outfile);
+	return 1;
+}
+
+#endif
+
+static int
+test_codec_parent_null()
+{
+	RDD_WRITER *w;
+	RDD_READER *r;
+
+#if defined(HAVE_LIBLZ4)
+	CHECK_INT(RDD_BADARG, rdd_open_lz4_writer(&w, 0));
+	CHECK_INT(RDD_BADARG, rdd_open_lz4_reader(&r, 0));
+#else
+	CHECK_INT(RDD_ECOMPRESS, rdd_open_lz4_writer(&w, 0));
+	CHECK_INT(RDD_ECOMPRESS, rdd_open_lz4_reader(&r, 0));
+#endif
+#if defined(HAVE_LIBZSTD)
+	CHECK_INT(RDD_BADARG, rdd_open_zstd_writer(&w, 0, 0, 0));
+	CHECK_INT(RDD_BADARG, rdd_open_zstd_reader(&r, 0));
+#else
+	CHECK_INT(RDD_ECOMPRESS, rdd_open_zstd_writer(&w, 0, 0, 0));
+	CHECK_INT(RDD_ECOMPRESS, rdd_open_zstd_reader(&r, 0));
+#endif
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	TEST(test_codec_parent_null);
+#if defined(HAVE_LIBLZ4)
+	TEST(test_lz4_roundtrip);
+	TEST(test_lz4_truncated);
+#endif
+#if defined(HAVE_LIBZSTD)
+	TEST(test_zstd_roundtrip);
+	TEST(test_zstd_truncated);
+	TEST(test_zstd_bad_level);
+#endif
+
+	return result;
+}
+
+TEST_MAIN
+;
@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rdd.h"
+#include "writer.h"
+#include "reader.h"
+#include "filter.h"
+#include "dedup.h"
+
+#include "testhelper.h"
+
+#define BLOCK_SIZE	512
+#define NDISTINCT	20
+#define NBLOCK		300
+#define TAIL_SIZE	100
+#define DATA_SIZE	(NBLOCK * BLOCK_SIZE + TAIL_SIZE)
+
+static unsigned char *data;
+static unsigned char *copy;
+static char index_path[] = "tdedup_test.idx";
+static char data_path[] = "tdedup_test.dat";
+static char map_path[] = "tdedup_test.map";
+
+/* NBLOCK blocks, each a copy of one of NDISTINCT random blocks, in
+ * random order, followed by a short tail.  Block i < NDISTINCT is
+ * distinct block i, so all distinct blocks occur.
+ */
+static int
+setup()
+{
+	unsigned char distinct[NDISTINCT][BLOCK_SIZE];
+	unsigned i, j;
+
+	if ((data = malloc(DATA_SIZE)) == 0
+	||  (copy = malloc(DATA_SIZE)) == 0) {
+		return 0;
+	}
+	srandom(23);
+	for (i = 0; i < NDISTINCT; i++) {
+		for (j = 0; j < BLOCK_SIZE; j++) {
+			distinct[i][j] = (unsigned char) random();
+		}
+	}
+	for (i = 0; i < NBLOCK; i++) {
+		j = i < NDISTINCT ? i : (unsigned) random() % NDISTINCT;
+		memcpy(data + i * BLOCK_SIZE, distinct[j], BLOCK_SIZE);
+	}
+	for (i = 0; i < TAIL_SIZE; i++) {
+		data[NBLOCK * BLOCK_SIZE + i] = (unsigned char) random();
+	}
+	return 1;
+}
+
+static void
+remove_files(void)
+{
+	unlink(index_path);
+	unlink(data_path);
+	unlink(map_path);
+}
+
+static int
+teardown()
+{
+	remove_files();
+	free(data);
+	free(copy);
+	return 1;
+}
+
+static int
+run_filter(rdd_count_t memsize, const char *indexpath,
+		const char *datapath, const char *mappath,
+		const unsigned char *buf, unsigned nbyte, RDD_DEDUP_STATS *stats)
+{
+	unsigned pieces[] = {1, 3 * BLOCK_SIZE, BLOCK_SIZE - 1, 700};
+	RDD_FILTER *f = 0;
+	unsigned i, pos, n;
+
+	CHECK_UINT(RDD_OK, rdd_new_dedup_blockfilter(&f, BLOCK_SIZE, memsize,
+				indexpath, datapath, mappath, RDD_OVERWRITE));
+	for (pos = 0, i = 0; pos < nbyte; pos += n, i++) {
+		n = pieces[i % 4];
+		if (n > nbyte - pos) n = nbyte - pos;
+		CHECK_UINT(RDD_OK, rdd_filter_push(f, buf + pos, n));
+	}
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_get_result(f, (unsigned char *) stats,
+				sizeof *stats));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	return 1;
+}
+
+/* Rebuilds the image from the data and map files.
+ */
+static int
+rebuild(unsigned char *buf, rdd_count_t *imagesize)
+{
+	RDD_DEDUP_MAP_HEADER hdr;
+	uint64_t ref;
+	rdd_count_t i;
+	unsigned n;
+	FILE *map, *dat;
+
+	CHECK_NOT_NULL(map = fopen(map_path, "r"));
+	CHECK_NOT_NULL(dat = fopen(data_path, "r"));
+	CHECK_TRUE(fread(&hdr, sizeof hdr, 1, map) == 1);
+	CHECK_UINT(RDD_DEDUP_MAP_MAGIC, hdr.magic);
+	CHECK_UINT(BLOCK_SIZE, hdr.blocksize);
+	for (i = 0; i < hdr.nblock; i++) {
+		CHECK_TRUE(fread(&ref, sizeof ref, 1, map) == 1);
+		CHECK_TRUE(ref < hdr.nunique);
+		n = i + 1 < hdr.nblock ? BLOCK_SIZE
+			: (unsigned) (hdr.imagesize - i * BLOCK_SIZE);
+		CHECK_TRUE(fseek(dat, (long) (ref * BLOCK_SIZE), SEEK_SET) == 0);
+		CHECK_TRUE(fread(buf + i * BLOCK_SIZE, n, 1, dat) == 1);
+	}
+	CHECK_TRUE(fgetc(map) == EOF);
+	fclose(map);
+	fclose(dat);
+
+	*imagesize = hdr.imagesize;
+	return 1;
+}
+
+static int
+test_dedup_image()
+{
+	RDD_DEDUP_STATS stats;
+	rdd_count_t imagesize = 0;
+
+	remove_files();
+	if (! run_filter(1024 * 1024, 0, data_path, map_path,
+				data, DATA_SIZE, &stats)) return 0;
+
+	CHECK_UINT(NBLOCK + 1, (unsigned) stats.nblock);
+	CHECK_UINT(NDISTINCT + 1, (unsigned) stats.nunique);
+	CHECK_UINT(NBLOCK - NDISTINCT, (unsigned) stats.nduplicate);
+	CHECK_UINT(0, (unsigned) stats.nknown);
+	CHECK_UINT(0, (unsigned) stats.nuntracked);
+
+	memset(copy, 0, DATA_SIZE);
+	if (! rebuild(copy, &imagesize)) return 0;
+	CHECK_UINT(DATA_SIZE, (unsigned) imagesize);
+	CHECK_TRUE(memcmp(data, copy, DATA_SIZE) == 0);
+
+	return 1;
+}
+
+/* A second run over the same data finds every whole block in the
+ * index that the first run wrote.
+ */
+static int
+test_dedup_index()
+{
+	RDD_DEDUP_STATS stats;
+	FILE *fp;
+
+	remove_files();
+	if (! run_filter(1024 * 1024, index_path, 0, 0,
+				data, DATA_SIZE, &stats)) return 0;
+	CHECK_UINT(0, (unsigned) stats.nknown);
+	CHECK_UINT(NDISTINCT, (unsigned) stats.ntable);
+
+	if (! run_filter(1024 * 1024, index_path, 0, 0,
+				data, DATA_SIZE, &stats)) return 0;
+	CHECK_UINT(NDISTINCT, (unsigned) stats.nknown);
+	CHECK_UINT(NBLOCK - NDISTINCT, (unsigned) stats.nduplicate);
+	CHECK_UINT(NDISTINCT, (unsigned) stats.ntable);
+
+	/* Not an index */
+	unlink(index_path);
+	CHECK_NOT_NULL(fp = fopen(index_path, "w"));
+	CHECK_TRUE(fwrite(data, 100, 1, fp) == 1);
+	fclose(fp);
+	{
+		RDD_FILTER *f = 0;
+
+		CHECK_UINT(RDD_ESYNTAX, rdd_new_dedup_blockfilter(&f,
+				BLOCK_SIZE, 1024 * 1024, index_path, 0, 0,
+				RDD_OVERWRITE));
+	}
+
+	return 1;
+}
+
+/* With a table that holds 12 keys, the remaining distinct blocks are
+ * not tracked; the image must still be complete.
+ */
+static int
+test_dedup_table_full()
+{
+	RDD_DEDUP_STATS stats;
+	rdd_count_t imagesize = 0;
+
+	remove_files();
+	if (! run_filter(16 * 24, 0, data_path, map_path,
+				data, DATA_SIZE, &stats)) return 0;
+	CHECK_UINT(12, (unsigned) stats.capacity);
+	CHECK_UINT(12, (unsigned) stats.ntable);
+	CHECK_TRUE(stats.nuntracked >= NDISTINCT - 12);
+	CHECK_UINT(NBLOCK + 1, (unsigned) (stats.nunique + stats.nduplicate));
+
+	if (! rebuild(copy, &imagesize)) return 0;
+	CHECK_TRUE(memcmp(data, copy, DATA_SIZE) == 0);
+
+	return 1;
+}
+
+/* Restores an image through a dedup reader.  The second run finds
+ * every whole block in the index; those blocks must still be stored
+ * in the data file.
+ */
+static int
+test_dedup_reader()
+{
+	RDD_DEDUP_STATS stats;
+	RDD_READER *r = 0;
+	unsigned char buf[3 * BLOCK_SIZE];
+	unsigned pos, nread;
+	FILE *fp;
+
+	remove_files();
+	if (! run_filter(1024 * 1024, index_path, 0, 0,
+				data, DATA_SIZE, &stats)) return 0;
+	if (! run_filter(1024 * 1024, index_path, data_path, map_path,
+				data, DATA_SIZE, &stats)) return 0;
+	CHECK_UINT(NDISTINCT, (unsigned) stats.nknown);
+	CHECK_UINT(NDISTINCT + 1, (unsigned) stats.nunique);
+
+	/* Sequential reads that straddle block boundaries */
+	memset(copy, 0, DATA_SIZE);
+	CHECK_UINT(RDD_OK, rdd_open_dedup_reader(&r, data_path, map_path));
+	for (pos = 0; ; pos += nread) {
+		CHECK_UINT(RDD_OK, rdd_reader_read(r, copy + pos,
+				pos + 700 > DATA_SIZE ? DATA_SIZE - pos : 700,
+				&nread));
+		if (nread == 0) break;
+	}
+	CHECK_UINT(DATA_SIZE, pos);
+	CHECK_TRUE(memcmp(data, copy, DATA_SIZE) == 0);
+	CHECK_UINT(RDD_OK, rdd_reader_read(r, buf, sizeof buf, &nread));
+	CHECK_UINT(0, nread);
+
+	/* Positional reads, including one into the short last block */
+	CHECK_UINT(RDD_OK, rdd_reader_pread(r, buf, sizeof buf,
+				7 * BLOCK_SIZE + 3, &nread));
+	CHECK_UINT(3 * BLOCK_SIZE, nread);
+	CHECK_TRUE(memcmp(data + 7 * BLOCK_SIZE + 3, buf, sizeof buf) == 0);
+	CHECK_UINT(RDD_OK, rdd_reader_pread(r, buf, sizeof buf,
+				DATA_SIZE - BLOCK_SIZE - 10, &nread));
+	CHECK_UINT(BLOCK_SIZE + 10, nread);
+	CHECK_TRUE(memcmp(data + DATA_SIZE - BLOCK_SIZE - 10, buf,
+				BLOCK_SIZE + 10) == 0);
+	CHECK_UINT(RDD_OK, rdd_reader_close(r, 1));
+
+	/* A truncated data file */
+	CHECK_TRUE(truncate(data_path, NDISTINCT * BLOCK_SIZE) == 0);
+	CHECK_UINT(RDD_OK, rdd_open_dedup_reader(&r, data_path, map_path));
+	CHECK_UINT(RDD_EREAD, rdd_reader_pread(r, buf, BLOCK_SIZE,
+				DATA_SIZE - 1, &nread));
+	CHECK_UINT(RDD_OK, rdd_reader_close(r, 1));
+
+	/* Not a map file */
+	CHECK_NOT_NULL(fp = fopen(map_path, "w"));
+	CHECK_TRUE(fwrite(data, 100, 1, fp) == 1);
+	fclose(fp);
+	CHECK_UINT(RDD_ESYNTAX, rdd_open_dedup_reader(&r, data_path,
+				map_path));
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_dedup_image);
+	SAFE_TEST(test_dedup_index);
+	SAFE_TEST(test_dedup_table_full);
+	SAFE_TEST(test_dedup_reader);
+
+	return result;
+}
+
+TEST_MAIN
+;
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "rdd.h"
+#include "writer.h"
+#include "reader.h"
+#include "entropy.h"
+
+#include "testhelper.h"
+
+#define BLOCK_SIZE	(128 * 1024)
+
+static char outfile[] = "entropyoutput";
+
+static void
+fill_random(unsigned char *buf, unsigned len)
+{
+	unsigned i;
+
+	srandom(3);
+	for (i = 0; i < len; i++) {
+		buf[i] = (unsigned char) random();
+	}
+}
+
+static void
+fill_text(unsigned char *buf, unsigned len)
+{
+	static const char text[] = "The quick brown fox jumps over the lazy dog. ";
+	unsigned i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = (unsigned char) text[i % (sizeof text - 1)];
+	}
+}
+
+static int
+test_entropy_empty()
+{
+	unsigned char buf[1] = { 0 };
+
+	CHECK_TRUE(rdd_estimate_entropy(buf, 0) == 0.0);
+	CHECK_UINT(0, rdd_is_incompressible(buf, 0));
+	return 1;
+}
+
+static int
+test_entropy_zero()
+{
+	unsigned char *buf;
+
+	CHECK_NOT_NULL(buf = calloc(1, BLOCK_SIZE));
+	CHECK_TRUE(rdd_estimate_entropy(buf, BLOCK_SIZE) == 0.0);
+	CHECK_UINT(0, rdd_is_incompressible(buf, BLOCK_SIZE));
+	free(buf);
+	return 1;
+}
+
+static int
+test_entropy_random()
+{
+	unsigned char *buf;
+	double e;
+
+	CHECK_NOT_NULL(buf = malloc(BLOCK_SIZE));
+	fill_random(buf, BLOCK_SIZE);
+	e = rdd_estimate_entropy(buf, BLOCK_SIZE);
+	CHECK_TRUE(e > 7.9 && e <= 8.0);
+	CHECK_UINT(1, rdd_is_incompressible(buf, BLOCK_SIZE));
+
+	/* Too little data to tell. */
+	CHECK_UINT(0, rdd_is_incompressible(buf, RDD_ENTROPY_MIN_SIZE - 1));
+	free(buf);
+	return 1;
+}
+
+static int
+test_entropy_text()
+{
+	unsigned char *buf;
+	double e;
+
+	CHECK_NOT_NULL(buf = malloc(BLOCK_SIZE));
+	fill_text(buf, BLOCK_SIZE);
+	e = rdd_estimate_entropy(buf, BLOCK_SIZE);
+	CHECK_TRUE(e > 3.0 && e < 5.0);
+	CHECK_UINT(0, rdd_is_incompressible(buf, BLOCK_SIZE));
+	free(buf);
+	return 1;
+}
+
+/* Alternating random and text blocks make the zlib writer switch
+ * between storing and deflating; the stream must still decode, and
+ * the random blocks must not grow by more than the stored block
+ * headers.
+ */
+static int
+test_zlib_writer_mixed()
+{
+	RDD_WRITER *parent = 0, *w = 0;
+	RDD_READER *file = 0, *r = 0;
+	unsigned char *data = 0, *copy = 0;
+	unsigned len = 8 * BLOCK_SIZE;
+	unsigned nread = 0;
+	unsigned i;
+	struct stat info;
+	int ok = 0;
+
+	CHECK_NOT_NULL(data = malloc(len));
+	CHECK_NOT_NULL_GOTO(copy = malloc(len + 1));
+	fill_random(data, len);
+	for (i = 1; i < 8; i += 2) {
+		fill_text(data + i * BLOCK_SIZE, BLOCK_SIZE);
+	}
+
+	CHECK_INT_GOTO(RDD_OK, rdd_open_file_writer(&parent, outfile));
+	CHECK_INT_GOTO(RDD_OK, rdd_open_zlib_writer(&w, parent));
+	for (i = 0; i < 8; i++) {
+		CHECK_INT_GOTO(RDD_OK, rdd_writer_write(w, data + i * BLOCK_SIZE, BLOCK_SIZE));
+	}
+	CHECK_INT_GOTO(RDD_OK, rdd_writer_close(w));
+
+	CHECK_INT_GOTO(0, stat(outfile, &info));
+	CHECK_INT_GOTO(1, info.st_size < 4 * BLOCK_SIZE + 4 * BLOCK_SIZE / 100);
+
+	CHECK_INT_GOTO(RDD_OK, rdd_open_file_reader(&file, outfile, 0));
+	CHECK_INT_GOTO(RDD_OK, rdd_open_zlib_reader(&r, file));
+	CHECK_INT_GOTO(RDD_OK, rdd_reader_read(r, copy, len + 1, &nread));
+	CHECK_UINT_GOTO(len, nread);
+	CHECK_UCHAR_ARRAY_GOTO(data, copy, (int) len);
+	ok = 1;
+
+error:
+	if (r != 0) rdd_reader_close(r, 1);
+	remove(outfile);
+	free(copy);
+	free(data);
+	return ok;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	TEST(test_entropy_empty);
+	TEST(test_entropy_zero);
+	TEST(test_entropy_random);
+	TEST(test_entropy_text);
+	TEST(test_zlib_writer_mixed);
+
+	return result;
+}
+
+TEST_MAIN
+;
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rdd.h"
+#include "writer.h"
+
+#include "testhelper.h"
+#include "collectwriter.h"
+
+#define NBUF		4
+#define BUF_SIZE	(4 * 1024)
+#define DATA_SIZE	(200 * 1000)
+#define NCHILD		3
+
+static COLLECT_WRITER collected[NCHILD];
+
+/* Opens NCHILD collect writers; child i fails after limits[i] bytes.
+ * Only the address of the last child matches.
+ */
+static int
+open_collect_writers(RDD_WRITER **w, const unsigned *limits)
+{
+	int i, rc;
+
+	for (i = 0; i < NCHILD; i++) {
+		rc = collectwriter_open(&w[i], &collected[i], limits[i]);
+		if (rc != RDD_OK) {
+			return rc;
+		}
+	}
+	collected[NCHILD - 1].address = 1;
+	return RDD_OK;
+}
+
+static void
+free_collected(void)
+{
+	int i;
+
+	for (i = 0; i < NCHILD; i++) {
+		collectwriter_free(&collected[i]);
+	}
+}
+
+static unsigned all_data[NCHILD] = { DATA_SIZE, DATA_SIZE, DATA_SIZE };
+
+static int
+test_open_fanout_writer_bad_args()
+{
+	RDD_WRITER *children[NCHILD];
+	RDD_WRITER *none[1] = { 0 };
+	RDD_WRITER *w;
+	int i;
+
+	CHECK_INT(RDD_OK, open_collect_writers(children, all_data));
+	CHECK_INT(RDD_BADARG, rdd_open_fanout_writer(0, children, NCHILD, NBUF, BUF_SIZE));
+	CHECK_INT(RDD_BADARG, rdd_open_fanout_writer(&w, 0, NCHILD, NBUF, BUF_SIZE));
+	CHECK_INT(RDD_BADARG, rdd_open_fanout_writer(&w, children, 0, NBUF, BUF_SIZE));
+	CHECK_INT(RDD_BADARG, rdd_open_fanout_writer(&w, children, NCHILD, 0, BUF_SIZE));
+	CHECK_INT(RDD_BADARG, rdd_open_fanout_writer(&w, children, NCHILD, NBUF, 0));
+	CHECK_INT(RDD_BADARG, rdd_open_fanout_writer(&w, none, 1, NBUF, BUF_SIZE));
+	for (i = 0; i < NCHILD; i++) {
+		CHECK_INT(RDD_OK, rdd_writer_close(children[i]));
+	}
+	free_collected();
+
+	return 1;
+}
+
+static int
+test_fanout_write_in_order()
+{
+	RDD_WRITER *children[NCHILD];
+	RDD_WRITER *w = 0;
+	unsigned char *data = 0;
+	int i, ok = 0;
+
+	CHECK_NOT_NULL(data = malloc(DATA_SIZE));
+	collectwriter_fill_pattern(data, DATA_SIZE);
+
+	CHECK_INT_GOTO(RDD_OK, open_collect_writers(children, all_data));
+	CHECK_INT_GOTO(RDD_OK, rdd_open_fanout_writer(&w, children, NCHILD, NBUF, BUF_SIZE));
+	CHECK_INT_GOTO(RDD_OK, collectwriter_write_pieces(w, data, DATA_SIZE));
+	CHECK_INT_GOTO(RDD_OK, rdd_writer_close(w));
+
+	for (i = 0; i < NCHILD; i++) {
+		CHECK_UINT_GOTO(1, collected[i].closed);
+		CHECK_UINT_GOTO(DATA_SIZE, collected[i].len);
+		CHECK_UCHAR_ARRAY_GOTO(data, collected[i].data, DATA_SIZE);
+	}
+	ok = 1;
+
+error:
+	free_collected();
+	free(data);
+	return ok;
+}
+
+static int
+test_fanout_sync_flushes_queue()
+{
+	RDD_WRITER *children[NCHILD];
+	RDD_WRITER *w = 0;
+	unsigned char *data = 0;
+	int i, ok = 0;
+
+	CHECK_NOT_NULL(data = malloc(DATA_SIZE));
+	collectwriter_fill_pattern(data, DATA_SIZE);
+
+	/* After a sync, every child has received everything written
+	 * so far, including a partially filled buffer.
+	 */
+	CHECK_INT_GOTO(RDD_OK, open_collect_writers(children, all_data));
+	CHECK_INT_GOTO(RDD_OK, rdd_open_fanout_writer(&w, children, NCHILD, NBUF, BUF_SIZE));
+	CHECK_INT_GOTO(RDD_OK, collectwriter_write_pieces(w, data, 3 * BUF_SIZE + 10));
+	CHECK_INT_GOTO(RDD_OK, rdd_writer_sync(w));
+	for (i = 0; i < NCHILD; i++) {
+		CHECK_UINT_GOTO(3 * BUF_SIZE + 10, collected[i].synced);
+	}
+	CHECK_INT_GOTO(RDD_OK, rdd_writer_close(w));
+	ok = 1;
+
+error:
+	free_collected();
+	free(data);
+	return ok;
+}
+
+static int
+test_fanout_write_error_is_reported()
+{
+	RDD_WRITER *children[NCHILD];
+	RDD_WRITER *w = 0;
+	unsigned char *data = 0;
+	unsigned limits[NCHILD] = { DATA_SIZE, DATA_SIZE / 4, DATA_SIZE };
+	int i, ok = 0;
+
+	CHECK_NOT_NULL(data = malloc(DATA_SIZE));
+	collectwriter_fill_pattern(data, DATA_SIZE);
+
+	/* The second child fails long before all data has been written.
+	 * The failure must surface in a write and in the close, and
+	 * all children must still be closed.
+	 */
+	CHECK_INT_GOTO(RDD_OK, open_collect_writers(children, limits));
+	CHECK_INT_GOTO(RDD_OK, rdd_open_fanout_writer(&w, children, NCHILD, NBUF, BUF_SIZE));
+	CHECK_INT_GOTO(RDD_ESPACE, collectwriter_write_pieces(w, data, DATA_SIZE));
+	CHECK_INT_GOTO(RDD_ESPACE, rdd_writer_close(w));
+	for (i = 0; i < NCHILD; i++) {
+		CHECK_UINT_GOTO(1, collected[i].closed);
+		CHECK_UCHAR_ARRAY_GOTO(data, collected[i].data, (int) collected[i].len);
+	}
+	ok = 1;
+
+error:
+	free_collected();
+	free(data);
+	return ok;
+}
+
+static int
+test_fanout_compare_address()
+{
+	RDD_WRITER *children[NCHILD];
+	RDD_WRITER *w = 0;
+	int result = 0;
+	int ok = 0;
+
+	/* Only the last child matches. */
+	CHECK_INT_GOTO(RDD_OK, open_collect_writers(children, all_data));
+	CHECK_INT_GOTO(RDD_OK, rdd_open_fanout_writer(&w, children, NCHILD, NBUF, BUF_SIZE));
+	CHECK_INT_GOTO(RDD_OK, rdd_compare_address(w, 0, &result));
+	CHECK_INT_GOTO(1, result);
+	CHECK_INT_GOTO(RDD_OK, rdd_writer_close(w));
+	ok = 1;
+
+error:
+	free_collected();
+	return ok;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	TEST(test_open_fanout_writer_bad_args);
+	TEST(test_fanout_write_in_order);
+	TEST(test_fanout_sync_flushes_queue);
+	TEST(test_fanout_write_error_is_reported);
+	TEST(test_fanout_compare_address);
+
+	return result;
+}
+
+TEST_MAIN
+;
@@ -37,12 +37,15 @@
 #include "config.h"
 #endif
 
+#define _GNU_SOURCE	/* as in fdwriter.c, which is included below */
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <string.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 
 #include "rdd.h"
@@ -63,6 +66,57 @@ static int test_open_fd_writer_fd_negative()
 	return 1;
 }
 
+static int test_fd_writer_stream()
+{
+	static unsigned char buf[1024 * 1024];
+	RDD_WRITER * writer;
+	RDD_FD_WRITER *state;
+	struct stat info;
+	int fd;
+	int i;
+
+	memset(buf, 0xa5, sizeof buf);
+	fd = open("testoutput", O_WRONLY|O_CREAT|O_TRUNC, 0600);
+	CHECK_UINT(1, (fd > 0));
+	CHECK_UINT(RDD_OK, rdd_open_fd_writer(&writer, fd));
+	state = writer->state;
+
+	CHECK_UINT_GOTO(RDD_OK, rdd_writer_stream(writer));
+	for (i = 0; i < 20; i++) {
+		CHECK_UINT_GOTO(RDD_OK, rdd_writer_write(writer, buf, sizeof buf));
+	}
+
+	/* Writeback has been started for two windows; the first one
+	 * has been dropped from the page cache.
+	 */
+	CHECK_UINT64_GOTO(2ULL * STREAM_WINDOW, state->flushed);
+	CHECK_UINT64_GOTO(1ULL * STREAM_WINDOW, state->dropped);
+
+	CHECK_UINT_GOTO(RDD_OK, rdd_writer_close(writer));
+	CHECK_INT_GOTO(0, stat("testoutput", &info));
+	CHECK_UINT64_GOTO(20ULL * sizeof buf, (rdd_count_t) info.st_size);
+	CHECK_INT(0, remove("testoutput"));
+	return 1;
+error:
+	remove("testoutput");
+	return 0;
+}
+
+static int test_fd_writer_stream_pipe()
+{
+	RDD_WRITER * writer;
+	int p[2];
+
+	CHECK_INT(0, pipe(p));
+	CHECK_UINT_GOTO(RDD_OK, rdd_open_fd_writer(&writer, p[1]));
+	CHECK_UINT_GOTO(RDD_NOTFOUND, rdd_writer_stream(writer));
+	CHECK_UINT_GOTO(RDD_OK, rdd_writer_close(writer));
+	close(p[0]);
+	return 1;
+error:
+	close(p[0]);
+	return 0;
+}
 
 // TODO: tests with actual fd writer
 
@@ -136,6 +190,8 @@ call_tests(void)
 	int result = 1;
 	TEST(test_open_fd_writer_writer_null);
 	TEST(test_open_fd_writer_fd_negative);
+	TEST(test_fd_writer_stream);
+	TEST(test_fd_writer_stream_pipe);
 
 	TEST(test_compare_address_address_null);
 	TEST(test_compare_address_result_null);
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* A unit-test for filter sets in parallel mode.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <openssl/evp.h>
+#include <openssl/md5.h>
+
+#include "rdd.h"
+#include "writer.h"
+#include "filter.h"
+#include "filterset.h"
+
+#include "testhelper.h"
+#include "collectfilter.h"
+
+#define NFILTER   4
+#define DATA_SIZE (1024 * 1024 + 17)
+#define PUSH_SIZE 10000
+
+static RDD_FILTERSET fset;
+static RDD_FILTER *collectors[NFILTER];
+static RDD_FILTER *md5filter;
+static unsigned char *data;
+
+static int
+setup()
+{
+	char name[32];
+	unsigned i;
+
+	CHECK_NOT_NULL(data = malloc(DATA_SIZE));
+	for (i = 0; i < DATA_SIZE; i++) {
+		data[i] = (unsigned char) (i * 7 + (i >> 11));
+	}
+
+	CHECK_UINT(RDD_OK, rdd_fset_init(&fset));
+	for (i = 0; i < NFILTER; i++) {
+		CHECK_UINT(RDD_OK, collectfilter_open(&collectors[i]));
+		snprintf(name, sizeof name, "collect_%u", i);
+		CHECK_UINT(RDD_OK, rdd_fset_add(&fset, name, collectors[i]));
+	}
+	CHECK_UINT(RDD_OK, rdd_new_md5_streamfilter(&md5filter));
+	CHECK_UINT(RDD_OK, rdd_fset_add(&fset, "MD5 stream", md5filter));
+
+	return 1;
+}
+
+static int
+teardown()
+{
+	CHECK_UINT(RDD_OK, rdd_fset_clear(&fset));
+	free(data);
+
+	return 1;
+}
+
+static int
+push_all(void)
+{
+	unsigned pos, n;
+	int rc;
+
+	for (pos = 0; pos < DATA_SIZE; pos += n) {
+		n = DATA_SIZE - pos < PUSH_SIZE ? DATA_SIZE - pos : PUSH_SIZE;
+		if ((rc = rdd_fset_push(&fset, data + pos, n)) != RDD_OK) {
+			return rc;
+		}
+	}
+	return RDD_OK;
+}
+
+static int
+test_set_parallel_bad_args()
+{
+	CHECK_UINT(RDD_BADARG, rdd_fset_set_parallel(&fset, 0, 4096));
+	CHECK_UINT(RDD_BADARG, rdd_fset_set_parallel(&fset, 4, 0));
+
+	return 1;
+}
+
+static int
+test_set_parallel_twice()
+{
+	CHECK_UINT(RDD_OK, rdd_fset_set_parallel(&fset, 4, 4096));
+	CHECK_UINT(RDD_BADARG, rdd_fset_set_parallel(&fset, 4, 4096));
+
+	return 1;
+}
+
+static int
+test_add_after_set_parallel()
+{
+	RDD_FILTER *f = 0;
+
+	CHECK_UINT(RDD_OK, rdd_fset_set_parallel(&fset, 4, 4096));
+	CHECK_UINT(RDD_OK, collectfilter_open(&f));
+	CHECK_UINT(RDD_BADARG, rdd_fset_add(&fset, "late", f));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	return 1;
+}
+
+/* Every filter must see the whole stream, in order, and the stream
+ * must be split differently from how it was pushed (the buffer
+ * size is smaller than the push size).
+ */
+static int
+test_parallel_push()
+{
+	unsigned char expected[MD5_DIGEST_LENGTH];
+	unsigned char md[MD5_DIGEST_LENGTH];
+	COLLECT_STATE *s;
+	unsigned i;
+
+	CHECK_UINT(RDD_OK, rdd_fset_set_parallel(&fset, 3, 4096));
+	CHECK_UINT(RDD_OK, push_all());
+	CHECK_UINT(RDD_OK, rdd_fset_close(&fset));
+
+	for (i = 0; i < NFILTER; i++) {
+		s = (COLLECT_STATE *) collectors[i]->state;
+		CHECK_UINT(1, s->nclose);
+		CHECK_UINT64((unsigned long long) DATA_SIZE, s->len);
+		CHECK_TRUE(memcmp(data, s->data, DATA_SIZE) == 0);
+	}
+
+	CHECK_INT(1, EVP_Digest(data, DATA_SIZE, expected, 0, EVP_md5(), 0));
+	CHECK_UINT(RDD_OK, rdd_filter_get_result(md5filter, md, sizeof md));
+	CHECK_UCHAR_ARRAY(expected, md, MD5_DIGEST_LENGTH);
+
+	return 1;
+}
+
+static int
+test_parallel_filter_error()
+{
+	COLLECT_STATE *s = (COLLECT_STATE *) collectors[2]->state;
+	int rc;
+
+	s->failafter = 5;
+
+	CHECK_UINT(RDD_OK, rdd_fset_set_parallel(&fset, 2, PUSH_SIZE / 2));
+
+	/* The error surfaces either during a push or at close time.
+	 */
+	rc = push_all();
+	if (rc == RDD_OK) {
+		rc = rdd_fset_close(&fset);
+	}
+	CHECK_UINT(RDD_EWRITE, rc);
+	CHECK_UINT64(5ULL * (PUSH_SIZE / 2), s->len);
+	CHECK_UINT(0, s->nclose);
+
+	return 1;
+}
+
+/* Clearing a filter set that was never closed must stop its threads.
+ */
+static int
+test_parallel_clear_without_close()
+{
+	CHECK_UINT(RDD_OK, rdd_fset_set_parallel(&fset, 2, 4096));
+	CHECK_UINT(RDD_OK, rdd_fset_push(&fset, data, PUSH_SIZE));
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_set_parallel_bad_args);
+	SAFE_TEST(test_set_parallel_twice);
+	SAFE_TEST(test_add_after_set_parallel);
+	SAFE_TEST(test_parallel_push);
+	SAFE_TEST(test_parallel_filter_error);
+	SAFE_TEST(test_parallel_clear_without_close);
+
+	return result;
+}
+
+TEST_MAIN
+;
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* Hash throughput benchmark.  Hashes the same data with the EVP
+ * engine and with the low-level MD5_/SHA*_ routines and reports the
+ * speed of each.  Not part of the test suite.
+ *
+ * Usage: thashbench [megabytes [blocksize]]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rdd.h"
+#include "rdd_internals.h"
+#include "hashengine.h"
+
+#define DEFAULT_MEGABYTES	256
+#define DEFAULT_BLOCKSIZE	(1 << 20)
+
+static const char *alg_name[RDD_HASH_NALG] = {
+	"MD5", "SHA-1", "SHA-256", "SHA-384", "SHA-512", "BLAKE2b-512",
+	"BLAKE2s-256"
+};
+
+/* Returns the speed of an engine in MB/s.
+ */
+static double
+run(rdd_hash_alg_t alg, rdd_hash_engine_t engine,
+	const unsigned char *buf, unsigned blocksize, rdd_count_t total)
+{
+	unsigned char md[64];
+	rdd_count_t done;
+	RDD_HASH h;
+	double start, secs;
+
+	rdd_hash_set_engine(engine);
+	if (rdd_hash_init(&h, alg) != RDD_OK) {
+		return 0.0;
+	}
+	start = rdd_gettime();
+	for (done = 0; done < total; done += blocksize) {
+		rdd_hash_update(&h, buf, blocksize);
+	}
+	rdd_hash_final(&h, md);
+	secs = rdd_gettime() - start;
+	rdd_hash_free(&h);
+
+	return secs > 0.0 ? (double) total / (secs * (1 << 20)) : 0.0;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned megabytes = DEFAULT_MEGABYTES;
+	unsigned blocksize = DEFAULT_BLOCKSIZE;
+	rdd_count_t total;
+	unsigned char *buf;
+	rdd_hash_alg_t alg;
+	double evp, legacy;
+	unsigned i;
+
+	if (argc > 1) megabytes = (unsigned) atoi(argv[1]);
+	if (argc > 2) blocksize = (unsigned) atoi(argv[2]);
+	if (megabytes == 0 || blocksize == 0) {
+		fprintf(stderr, "usage: %s [megabytes [blocksize]]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	total = (rdd_count_t) megabytes << 20;
+
+	if ((buf = malloc(blocksize)) == 0) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	srand(1);
+	for (i = 0; i < blocksize; i++) {
+		buf[i] = (unsigned char) rand();
+	}
+
+	printf("%u MB in blocks of %u bytes\n", megabytes, blocksize);
+	printf("%-8s %12s %12s  %s\n", "digest", "EVP MB/s", "low MB/s",
+		"auto choice");
+	for (alg = 0; alg < RDD_HASH_NALG; alg++) {
+		evp = run(alg, RDD_HASH_ENGINE_EVP, buf, blocksize, total);
+		legacy = run(alg, RDD_HASH_ENGINE_LEGACY, buf, blocksize, total);
+		rdd_hash_set_engine(RDD_HASH_ENGINE_AUTO);
+		printf("%-8s %12.1f %12.1f  %s\n", alg_name[alg], evp, legacy,
+			rdd_hash_engine_name(alg));
+	}
+
+	free(buf);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rdd.h"
+#include "rdd_internals.h"
+#include "writer.h"
+#include "filter.h"
+#include "hashengine.h"
+
+#include "testhelper.h"
+
+#define DATA_SIZE	300000
+#define BLOCK_SIZE	4096
+
+static unsigned char data[DATA_SIZE];
+
+/* Push sizes; chosen to straddle block boundaries. */
+static unsigned pieces[] = { 1, 4095, 4097, 16384, 7, 100000 };
+
+#define NPIECE	(sizeof pieces / sizeof pieces[0])
+
+static char outfile[] = "hashblock.out";
+static char reffile[] = "hashblock.ref";
+static char statefile[] = "hashblock.state";
+
+static int
+setup()
+{
+	unsigned i;
+
+	srand(29);
+	for (i = 0; i < DATA_SIZE; i++) {
+		data[i] = (unsigned char) rand();
+	}
+	return 1;
+}
+
+static int
+teardown()
+{
+	rdd_hash_set_engine(RDD_HASH_ENGINE_AUTO);
+	remove(outfile);
+	remove(reffile);
+	remove(statefile);
+	return 1;
+}
+
+/* Pushes data[start..start+len) into f in pieces of varying size.
+ */
+static int
+push_pieces(RDD_FILTER *f, rdd_count_t start, rdd_count_t len)
+{
+	rdd_count_t pos = start;
+	unsigned i = 0;
+	unsigned n;
+
+	while (pos < start + len) {
+		n = pieces[i++ % NPIECE];
+		if (pos + n > start + len) {
+			n = (unsigned) (start + len - pos);
+		}
+		CHECK_UINT(RDD_OK, rdd_filter_push(f, data + pos, n));
+		pos += n;
+	}
+	return 1;
+}
+
+/* Writes the expected output for data[0..len) to reffile.
+ */
+static int
+write_reference(rdd_hash_alg_t alg, rdd_count_t len, unsigned blocksize)
+{
+	unsigned char md[64];
+	char hex[129];
+	rdd_count_t pos, blocknum = 0;
+	unsigned n;
+	RDD_HASH h;
+	FILE *fp;
+
+	CHECK_TRUE((fp = fopen(reffile, "w")) != 0);
+	CHECK_UINT(RDD_OK, rdd_hash_init(&h, alg));
+	for (pos = 0; pos < len; pos += n) {
+		n = (len - pos) < blocksize ? (unsigned) (len - pos) : blocksize;
+		CHECK_UINT(RDD_OK, rdd_hash_reset(&h));
+		CHECK_UINT(RDD_OK, rdd_hash_update(&h, data + pos, n));
+		CHECK_UINT(RDD_OK, rdd_hash_final(&h, md));
+		CHECK_UINT(RDD_OK, rdd_buf2hex(md, rdd_hash_size(alg),
+					hex, sizeof hex));
+		fprintf(fp, "%llu\t%s\n", (unsigned long long) blocknum++, hex);
+	}
+	CHECK_UINT(RDD_OK, rdd_hash_free(&h));
+	CHECK_TRUE(fclose(fp) == 0);
+	return 1;
+}
+
+static int
+same_files(const char *path1, const char *path2)
+{
+	FILE *fp1, *fp2;
+	int c1, c2;
+
+	CHECK_TRUE((fp1 = fopen(path1, "r")) != 0);
+	CHECK_TRUE((fp2 = fopen(path2, "r")) != 0);
+	do {
+		c1 = fgetc(fp1);
+		c2 = fgetc(fp2);
+	} while (c1 == c2 && c1 != EOF);
+	fclose(fp1);
+	fclose(fp2);
+	CHECK_TRUE(c1 == c2);
+	return 1;
+}
+
+/* Block-hashes data[0..len) and compares the output to the reference.
+ */
+static int
+check_block_hash(rdd_hash_alg_t alg, rdd_count_t len, unsigned blocksize,
+		unsigned nthread)
+{
+	RDD_FILTER *f = 0;
+
+	CHECK_UINT(RDD_OK, rdd_new_hash_blockfilter(&f, alg, blocksize,
+				nthread, outfile, RDD_OVERWRITE));
+	CHECK_TRUE(push_pieces(f, 0, len));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	CHECK_TRUE(write_reference(alg, len, blocksize));
+	CHECK_TRUE(same_files(outfile, reffile));
+	return 1;
+}
+
+static int
+test_hashblock_bad_args()
+{
+	RDD_FILTER *f = 0;
+
+	CHECK_UINT(RDD_BADARG, rdd_new_hash_blockfilter(0, RDD_HASH_SHA256,
+				BLOCK_SIZE, 1, outfile, RDD_OVERWRITE));
+	CHECK_UINT(RDD_BADARG, rdd_new_hash_blockfilter(&f, RDD_HASH_NALG,
+				BLOCK_SIZE, 1, outfile, RDD_OVERWRITE));
+	CHECK_UINT(RDD_BADARG, rdd_new_hash_blockfilter(&f, RDD_HASH_SHA256,
+				0, 1, outfile, RDD_OVERWRITE));
+	CHECK_UINT(RDD_BADARG, rdd_new_hash_blockfilter(&f, RDD_HASH_SHA256,
+				BLOCK_SIZE, 1, 0, RDD_OVERWRITE));
+
+	return 1;
+}
+
+static int
+test_hashblock_all_algorithms()
+{
+	rdd_hash_alg_t alg;
+
+	for (alg = 0; alg < RDD_HASH_NALG; alg++) {
+		CHECK_TRUE(check_block_hash(alg, DATA_SIZE, BLOCK_SIZE, 4));
+	}
+	return 1;
+}
+
+static int
+test_hashblock_sizes()
+{
+	CHECK_TRUE(check_block_hash(RDD_HASH_SHA256, 0, BLOCK_SIZE, 2));
+	CHECK_TRUE(check_block_hash(RDD_HASH_SHA256, 1, BLOCK_SIZE, 2));
+	CHECK_TRUE(check_block_hash(RDD_HASH_SHA256, BLOCK_SIZE, BLOCK_SIZE, 2));
+	CHECK_TRUE(check_block_hash(RDD_HASH_SHA256, DATA_SIZE, BLOCK_SIZE, 1));
+	CHECK_TRUE(check_block_hash(RDD_HASH_SHA1, DATA_SIZE, 1000, 3));
+
+	return 1;
+}
+
+/* The MD5 output is identical to that of the MD5 block filter. */
+static int
+test_hashblock_md5_compatible()
+{
+	RDD_FILTER *f = 0;
+
+	CHECK_TRUE(check_block_hash(RDD_HASH_MD5, DATA_SIZE, BLOCK_SIZE, 4));
+
+	CHECK_UINT(RDD_OK, rdd_new_md5_blockfilter(&f, BLOCK_SIZE, reffile,
+				RDD_OVERWRITE));
+	CHECK_TRUE(push_pieces(f, 0, DATA_SIZE));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+	CHECK_TRUE(same_files(outfile, reffile));
+
+	return 1;
+}
+
+static int
+test_hashblock_save_restore()
+{
+	rdd_count_t half = 37 * BLOCK_SIZE + 5;
+	RDD_FILTER *f = 0;
+	FILE *fp;
+
+	CHECK_UINT(RDD_OK, rdd_new_hash_blockfilter(&f, RDD_HASH_SHA256,
+				BLOCK_SIZE, 4, outfile, RDD_OVERWRITE));
+	CHECK_TRUE(push_pieces(f, 0, half));
+	CHECK_TRUE((fp = fopen(statefile, "wb")) != 0);
+	CHECK_UINT(RDD_OK, rdd_filter_save(f, fp));
+	fclose(fp);
+
+	/* Output written after the checkpoint is discarded on restore. */
+	CHECK_TRUE(push_pieces(f, half, 10 * BLOCK_SIZE));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	/* The algorithm must match. */
+	CHECK_UINT(RDD_OK, rdd_new_hash_blockfilter(&f, RDD_HASH_SHA1,
+				BLOCK_SIZE, 4, outfile, RDD_RESUME));
+	CHECK_TRUE((fp = fopen(statefile, "rb")) != 0);
+	CHECK_UINT(RDD_ESYNTAX, rdd_filter_restore(f, fp));
+	fclose(fp);
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	CHECK_UINT(RDD_OK, rdd_new_hash_blockfilter(&f, RDD_HASH_SHA256,
+				BLOCK_SIZE, 2, outfile, RDD_RESUME));
+	CHECK_TRUE((fp = fopen(statefile, "rb")) != 0);
+	CHECK_UINT(RDD_OK, rdd_filter_restore(f, fp));
+	fclose(fp);
+	CHECK_TRUE(push_pieces(f, half, DATA_SIZE - half));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	CHECK_TRUE(write_reference(RDD_HASH_SHA256, DATA_SIZE, BLOCK_SIZE));
+	CHECK_TRUE(same_files(outfile, reffile));
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_hashblock_bad_args);
+	SAFE_TEST(test_hashblock_all_algorithms);
+	SAFE_TEST(test_hashblock_sizes);
+	SAFE_TEST(test_hashblock_md5_compatible);
+	SAFE_TEST(test_hashblock_save_restore);
+
+	return result;
+}
+
+TEST_MAIN
+;
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rdd.h"
+#include "rdd_internals.h"
+#include "hashengine.h"
+
+#include "testhelper.h"
+
+static char statefile[] = "hashengine.state";
+
+/* Digests of "abc" (FIPS 180-2, RFC 1321, and RFC 7693 test vectors). */
+static const char *abc_digest[RDD_HASH_NALG] = {
+	"900150983cd24fb0d6963f7d28e17f72",
+	"a9993e364706816aba3e25717850c26c9cd0d89d",
+	"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+	"cb00753f45a35e8bb5a03d699ac65007272c32ab0eded163"
+	"1a8b605a43ff5bed8086072ba1e7cc2358baeca134c825a7",
+	"ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+	"2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f",
+	"ba80a53f981c4d0d6a2797b69f12f6e94c212f14685ac4b74b12bb6fdbffa2d1"
+	"7d87c5392aab792dc252d5de4533cc9518d38aa8dbf1925ab92386edd4009923",
+	"508c5e8c327c14e2e1a72ba34eeb452f37458b209ed63a294d999b4c86675982"
+};
+
+static int
+setup()
+{
+	return 1;
+}
+
+static int
+teardown()
+{
+	rdd_hash_set_engine(RDD_HASH_ENGINE_AUTO);
+	remove(statefile);
+	return 1;
+}
+
+/* Hashes "abc" in two pieces and checks the digest.
+ */
+static int
+check_abc(RDD_HASH *h, rdd_hash_alg_t alg)
+{
+	unsigned char md[64];
+	char hex[129];
+
+	CHECK_UINT(RDD_OK, rdd_hash_update(h, (const unsigned char *) "a", 1));
+	CHECK_UINT(RDD_OK, rdd_hash_update(h, (const unsigned char *) "bc", 2));
+	CHECK_UINT(RDD_OK, rdd_hash_final(h, md));
+	CHECK_UINT(RDD_OK, rdd_buf2hex(md, rdd_hash_size(alg), hex, sizeof hex));
+	CHECK_TRUE(strcmp(hex, abc_digest[alg]) == 0);
+	return 1;
+}
+
+static int
+check_engine(rdd_hash_engine_t engine)
+{
+	rdd_hash_alg_t alg;
+	RDD_HASH h;
+
+	CHECK_UINT(RDD_OK, rdd_hash_set_engine(engine));
+	for (alg = 0; alg < RDD_HASH_NALG; alg++) {
+		CHECK_UINT(RDD_OK, rdd_hash_init(&h, alg));
+		if (!rdd_hash_has_legacy(alg)) {
+			CHECK_UINT(RDD_HASH_ENGINE_EVP, h.engine);
+		} else if (engine != RDD_HASH_ENGINE_AUTO) {
+			CHECK_UINT(engine, h.engine);
+		}
+		CHECK_TRUE(check_abc(&h, alg));
+
+		/* A reset digest starts from scratch. */
+		CHECK_UINT(RDD_OK, rdd_hash_reset(&h));
+		CHECK_TRUE(check_abc(&h, alg));
+		CHECK_UINT(RDD_OK, rdd_hash_free(&h));
+	}
+	return 1;
+}
+
+static int
+test_hash_bad_args()
+{
+	RDD_HASH h;
+
+	CHECK_UINT(RDD_BADARG, rdd_hash_init(0, RDD_HASH_MD5));
+	CHECK_UINT(RDD_BADARG, rdd_hash_init(&h, RDD_HASH_NALG));
+	CHECK_UINT(RDD_BADARG, rdd_hash_set_engine((rdd_hash_engine_t) 17));
+	CHECK_UINT(0, rdd_hash_size(RDD_HASH_NALG));
+	CHECK_UINT(0, rdd_hash_has_legacy(RDD_HASH_NALG));
+
+	return 1;
+}
+
+static int
+test_hash_evp_engine()
+{
+	rdd_hash_alg_t alg;
+
+	CHECK_TRUE(check_engine(RDD_HASH_ENGINE_EVP));
+	for (alg = 0; alg < RDD_HASH_NALG; alg++) {
+		CHECK_TRUE(strncmp(rdd_hash_engine_name(alg), "EVP", 3) == 0);
+	}
+	return 1;
+}
+
+static int
+test_hash_legacy_engine()
+{
+	rdd_hash_alg_t alg;
+
+	CHECK_TRUE(check_engine(RDD_HASH_ENGINE_LEGACY));
+	for (alg = 0; alg < RDD_HASH_NALG; alg++) {
+		if (rdd_hash_has_legacy(alg)) {
+			CHECK_TRUE(strcmp(rdd_hash_engine_name(alg), "low-level") == 0);
+		} else {
+			CHECK_TRUE(strncmp(rdd_hash_engine_name(alg), "EVP", 3) == 0);
+		}
+	}
+	return 1;
+}
+
+static int
+test_hash_auto_engine()
+{
+	rdd_hash_alg_t alg;
+	rdd_hash_engine_t engine;
+
+	CHECK_TRUE(check_engine(RDD_HASH_ENGINE_AUTO));
+
+	/* The choice is made once per algorithm. */
+	for (alg = 0; alg < RDD_HASH_NALG; alg++) {
+		engine = rdd_hash_get_engine(alg);
+		CHECK_TRUE(engine == RDD_HASH_ENGINE_EVP
+			|| engine == RDD_HASH_ENGINE_LEGACY);
+		CHECK_UINT(engine, rdd_hash_get_engine(alg));
+	}
+	return 1;
+}
+
+static int
+test_hash_lookup()
+{
+	rdd_hash_alg_t alg;
+
+	CHECK_UINT(RDD_OK, rdd_hash_lookup("sha-256", &alg));
+	CHECK_UINT(RDD_HASH_SHA256, alg);
+	CHECK_UINT(RDD_OK, rdd_hash_lookup("MD5", &alg));
+	CHECK_UINT(RDD_HASH_MD5, alg);
+	CHECK_UINT(RDD_OK, rdd_hash_lookup("blake2b512", &alg));
+	CHECK_UINT(RDD_HASH_BLAKE2B512, alg);
+	CHECK_UINT(RDD_NOTFOUND, rdd_hash_lookup("sha3", &alg));
+	CHECK_UINT(RDD_NOTFOUND, rdd_hash_lookup("sha", &alg));
+	CHECK_UINT(RDD_BADARG, rdd_hash_lookup(0, &alg));
+
+	for (alg = 0; alg < RDD_HASH_NALG; alg++) {
+		rdd_hash_alg_t found;
+
+		CHECK_UINT(RDD_OK, rdd_hash_lookup(rdd_hash_name(alg), &found));
+		CHECK_UINT(alg, found);
+	}
+	return 1;
+}
+
+static int
+test_hash_save_restore()
+{
+	unsigned char md[SHA256_DIGEST_LENGTH];
+	char hex[2*SHA256_DIGEST_LENGTH + 1];
+	RDD_HASH h;
+	FILE *fp;
+
+	/* The EVP engine cannot export its state. */
+	CHECK_UINT(RDD_OK, rdd_hash_set_engine(RDD_HASH_ENGINE_EVP));
+	CHECK_UINT(RDD_OK, rdd_hash_init(&h, RDD_HASH_SHA256));
+	CHECK_TRUE((fp = fopen(statefile, "wb")) != 0);
+	CHECK_UINT(RDD_NOTFOUND, rdd_hash_save(&h, fp));
+	fclose(fp);
+	CHECK_UINT(RDD_OK, rdd_hash_free(&h));
+
+	CHECK_UINT(RDD_OK, rdd_hash_set_engine(RDD_HASH_ENGINE_LEGACY));
+	CHECK_UINT(RDD_OK, rdd_hash_init(&h, RDD_HASH_SHA256));
+	CHECK_UINT(RDD_OK, rdd_hash_update(&h, (const unsigned char *) "a", 1));
+	CHECK_TRUE((fp = fopen(statefile, "wb")) != 0);
+	CHECK_UINT(RDD_OK, rdd_hash_save(&h, fp));
+	fclose(fp);
+	CHECK_UINT(RDD_OK, rdd_hash_free(&h));
+
+	/* Wrong algorithm. */
+	CHECK_UINT(RDD_OK, rdd_hash_init(&h, RDD_HASH_SHA1));
+	CHECK_TRUE((fp = fopen(statefile, "rb")) != 0);
+	CHECK_UINT(RDD_ESYNTAX, rdd_hash_restore(&h, fp));
+	fclose(fp);
+	CHECK_UINT(RDD_OK, rdd_hash_free(&h));
+
+	CHECK_UINT(RDD_OK, rdd_hash_init(&h, RDD_HASH_SHA256));
+	CHECK_TRUE((fp = fopen(statefile, "rb")) != 0);
+	CHECK_UINT(RDD_OK, rdd_hash_restore(&h, fp));
+	fclose(fp);
+	CHECK_UINT(RDD_OK, rdd_hash_update(&h, (const unsigned char *) "bc", 2));
+	CHECK_UINT(RDD_OK, rdd_hash_final(&h, md));
+	CHECK_UINT(RDD_OK, rdd_buf2hex(md, sizeof md, hex, sizeof hex));
+	CHECK_TRUE(strcmp(hex, abc_digest[RDD_HASH_SHA256]) == 0);
+	CHECK_UINT(RDD_OK, rdd_hash_free(&h));
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_hash_bad_args);
+	SAFE_TEST(test_hash_evp_engine);
+	SAFE_TEST(test_hash_legacy_engine);
+	SAFE_TEST(test_hash_auto_engine);
+	SAFE_TEST(test_hash_lookup);
+	SAFE_TEST(test_hash_save_restore);
+
+	return result;
+}
+
+TEST_MAIN
+;
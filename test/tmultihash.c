@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <openssl/md5.h>
+#include <openssl/sha.h>
+
+#include "rdd.h"
+#include "writer.h"
+#include "filter.h"
+#include "hashengine.h"
+
+#include "testhelper.h"
+
+#define DATA_SIZE	300000
+#define ALL_ALGS	(RDD_MULTIHASH_MD5|RDD_MULTIHASH_SHA1|RDD_MULTIHASH_SHA256 \
+			|RDD_MULTIHASH_SHA384|RDD_MULTIHASH_SHA512)
+
+static unsigned char data[DATA_SIZE];
+
+/* Push sizes; chosen to straddle the filter's internal chunk size. */
+static unsigned pieces[] = { 1, 16383, 16385, 65536, 7, 100000 };
+
+#define NPIECE	(sizeof pieces / sizeof pieces[0])
+
+static char statefile[] = "multihash.state";
+
+static int
+setup()
+{
+	unsigned i;
+
+	srand(17);
+	for (i = 0; i < DATA_SIZE; i++) {
+		data[i] = (unsigned char) rand();
+	}
+	return 1;
+}
+
+static int
+teardown()
+{
+	rdd_hash_set_engine(RDD_HASH_ENGINE_AUTO);
+	remove(statefile);
+	return 1;
+}
+
+/* Pushes data[0..len) into f in pieces of varying size.
+ */
+static int
+push_pieces(RDD_FILTER *f, rdd_count_t start, rdd_count_t len)
+{
+	rdd_count_t pos = start;
+	unsigned i = 0;
+	unsigned n;
+
+	while (pos < start + len) {
+		n = pieces[i++ % NPIECE];
+		if (pos + n > start + len) {
+			n = (unsigned) (start + len - pos);
+		}
+		CHECK_UINT(RDD_OK, rdd_filter_push(f, data + pos, n));
+		pos += n;
+	}
+	return 1;
+}
+
+/* Computes a digest with one of the single-digest stream filters.
+ */
+static int
+single_digest(unsigned alg, unsigned char *md, unsigned mdlen)
+{
+	RDD_FILTER *f = 0;
+	int rc = RDD_BADARG;
+
+	switch (alg) {
+	case RDD_MULTIHASH_MD5:    rc = rdd_new_md5_streamfilter(&f); break;
+	case RDD_MULTIHASH_SHA1:   rc = rdd_new_sha1_streamfilter(&f); break;
+	case RDD_MULTIHASH_SHA256: rc = rdd_new_sha256_streamfilter(&f); break;
+	case RDD_MULTIHASH_SHA384: rc = rdd_new_sha384_streamfilter(&f); break;
+	case RDD_MULTIHASH_SHA512: rc = rdd_new_sha512_streamfilter(&f); break;
+	}
+	CHECK_UINT(RDD_OK, rc);
+	CHECK_UINT(RDD_OK, rdd_filter_push(f, data, DATA_SIZE));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_get_result(f, md, mdlen));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+	return 1;
+}
+
+static unsigned
+digest_length(unsigned alg)
+{
+	switch (alg) {
+	case RDD_MULTIHASH_MD5:    return MD5_DIGEST_LENGTH;
+	case RDD_MULTIHASH_SHA1:   return SHA_DIGEST_LENGTH;
+	case RDD_MULTIHASH_SHA256: return SHA256_DIGEST_LENGTH;
+	case RDD_MULTIHASH_SHA384: return SHA384_DIGEST_LENGTH;
+	default:                   return SHA512_DIGEST_LENGTH;
+	}
+}
+
+/* Checks every digest of a closed multihash filter against the
+ * single-digest filters.
+ */
+static int
+check_digests(RDD_FILTER *f, unsigned algs)
+{
+	unsigned char md[SHA512_DIGEST_LENGTH];
+	unsigned char ref[SHA512_DIGEST_LENGTH];
+	unsigned alg, len;
+
+	for (alg = RDD_MULTIHASH_MD5; alg <= RDD_MULTIHASH_SHA512; alg <<= 1) {
+		len = digest_length(alg);
+		if ((algs & alg) == 0) {
+			CHECK_UINT(RDD_NOTFOUND,
+				rdd_multihash_get_digest(f, alg, md, len));
+			continue;
+		}
+		CHECK_TRUE(single_digest(alg, ref, len));
+		CHECK_UINT(RDD_OK, rdd_multihash_get_digest(f, alg, md, len));
+		CHECK_TRUE(memcmp(md, ref, len) == 0);
+	}
+	return 1;
+}
+
+static int
+test_multihash_bad_args()
+{
+	RDD_FILTER *f = 0;
+	unsigned char md[MD5_DIGEST_LENGTH];
+
+	CHECK_UINT(RDD_BADARG, rdd_new_multihash_streamfilter(0, ALL_ALGS));
+	CHECK_UINT(RDD_BADARG, rdd_new_multihash_streamfilter(&f, 0));
+	CHECK_UINT(RDD_BADARG, rdd_new_multihash_streamfilter(&f, 0x20));
+
+	/* Not a multihash filter. */
+	CHECK_UINT(RDD_OK, rdd_new_md5_streamfilter(&f));
+	CHECK_UINT(RDD_BADARG, rdd_multihash_get_digest(f,
+				RDD_MULTIHASH_MD5, md, sizeof md));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	/* Not a single digest. */
+	CHECK_UINT(RDD_OK, rdd_new_multihash_streamfilter(&f, ALL_ALGS));
+	CHECK_UINT(RDD_BADARG, rdd_multihash_get_digest(f,
+				RDD_MULTIHASH_MD5|RDD_MULTIHASH_SHA1,
+				md, sizeof md));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	return 1;
+}
+
+static int
+test_multihash_all_digests()
+{
+	RDD_FILTER *f = 0;
+
+	CHECK_UINT(RDD_OK, rdd_new_multihash_streamfilter(&f, ALL_ALGS));
+	CHECK_TRUE(push_pieces(f, 0, DATA_SIZE));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_TRUE(check_digests(f, ALL_ALGS));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	return 1;
+}
+
+static int
+test_multihash_subset()
+{
+	unsigned algs = RDD_MULTIHASH_MD5|RDD_MULTIHASH_SHA256;
+	unsigned char result[MD5_DIGEST_LENGTH + SHA256_DIGEST_LENGTH];
+	unsigned char ref[SHA256_DIGEST_LENGTH];
+	RDD_FILTER *f = 0;
+
+	CHECK_UINT(RDD_OK, rdd_new_multihash_streamfilter(&f, algs));
+	CHECK_TRUE(push_pieces(f, 0, DATA_SIZE));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_TRUE(check_digests(f, algs));
+
+	/* The filter's result is the concatenation of its digests. */
+	CHECK_UINT(RDD_ESPACE, rdd_filter_get_result(f, result,
+				sizeof result - 1));
+	CHECK_UINT(RDD_OK, rdd_filter_get_result(f, result, sizeof result));
+	CHECK_TRUE(single_digest(RDD_MULTIHASH_MD5, ref, MD5_DIGEST_LENGTH));
+	CHECK_TRUE(memcmp(result, ref, MD5_DIGEST_LENGTH) == 0);
+	CHECK_TRUE(single_digest(RDD_MULTIHASH_SHA256, ref,
+				SHA256_DIGEST_LENGTH));
+	CHECK_TRUE(memcmp(result + MD5_DIGEST_LENGTH, ref,
+				SHA256_DIGEST_LENGTH) == 0);
+
+	CHECK_UINT(RDD_ESPACE, rdd_multihash_get_digest(f,
+				RDD_MULTIHASH_SHA256, ref, MD5_DIGEST_LENGTH));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	return 1;
+}
+
+static int
+test_multihash_save_restore()
+{
+	rdd_count_t half = DATA_SIZE / 2 + 3;
+	RDD_FILTER *f = 0;
+	FILE *fp;
+
+	CHECK_UINT(RDD_OK, rdd_hash_set_engine(RDD_HASH_ENGINE_LEGACY));
+	CHECK_UINT(RDD_OK, rdd_new_multihash_streamfilter(&f, ALL_ALGS));
+	CHECK_TRUE(push_pieces(f, 0, half));
+	CHECK_TRUE((fp = fopen(statefile, "wb")) != 0);
+	CHECK_UINT(RDD_OK, rdd_filter_save(f, fp));
+	fclose(fp);
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	/* A filter with other digests cannot take over the state. */
+	CHECK_UINT(RDD_OK, rdd_new_multihash_streamfilter(&f,
+				RDD_MULTIHASH_MD5));
+	CHECK_TRUE((fp = fopen(statefile, "rb")) != 0);
+	CHECK_UINT(RDD_ESYNTAX, rdd_filter_restore(f, fp));
+	fclose(fp);
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	CHECK_UINT(RDD_OK, rdd_new_multihash_streamfilter(&f, ALL_ALGS));
+	CHECK_TRUE((fp = fopen(statefile, "rb")) != 0);
+	CHECK_UINT(RDD_OK, rdd_filter_restore(f, fp));
+	fclose(fp);
+	CHECK_TRUE(push_pieces(f, half, DATA_SIZE - half));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_TRUE(check_digests(f, ALL_ALGS));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_multihash_bad_args);
+	SAFE_TEST(test_multihash_all_digests);
+	SAFE_TEST(test_multihash_subset);
+	SAFE_TEST(test_multihash_save_restore);
+
+	return result;
+}
+
+TEST_MAIN
+;
@@ -53,7 +53,7 @@ rdd_test_get_writer(int argc, char **argv)
 	splitlen = 10 * 1024;
 
 	rc = rdd_open_part_writer(&fw, outfile, maxlen, splitlen,
-					RDD_NO_OVERWRITE);
+					RDD_NO_OVERWRITE, 1);
 	if (rc != RDD_OK) {
 		rdd_test_error(rc, "cannot open %s", outfile);
 	}
@@ -42,6 +42,7 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <string.h>
+#include <sys/stat.h>
 
 
 
@@ -52,31 +53,206 @@
 
 static int test_open_part_writer_writer_null()
 {
-	CHECK_UINT(RDD_BADARG, rdd_open_part_writer(0, "path", 1000, 100, 0));
+	CHECK_UINT(RDD_BADARG, rdd_open_part_writer(0, "path", 1000, 100, 0, 1));
 	return 1;
 }
 
 static int test_open_part_writer_path_null()
 {
 	RDD_WRITER * writer;
-	CHECK_UINT(RDD_BADARG, rdd_open_part_writer(&writer, 0, 1000, 100, 0));
+	CHECK_UINT(RDD_BADARG, rdd_open_part_writer(&writer, 0, 1000, 100, 0, 1));
 	return 1;
 }
 
 static int test_open_part_writer_empty_path()
 {
 	RDD_WRITER * writer;
-	CHECK_UINT(RDD_BADARG, rdd_open_part_writer(&writer, "", 1000, 100, 0));
+	CHECK_UINT(RDD_BADARG, rdd_open_part_writer(&writer, "", 1000, 100, 0, 1));
 	return 1;
 }
 
-// TODO: tests with actual part writer
+#define NPART 10
+#define PARTLEN 100
+
+static void
+remove_parts(void)
+{
+	char name[32];
+	int i;
+
+	for (i = 0; i < NPART; i++) {
+		snprintf(name, sizeof name, "%02d-testoutput", i);
+		remove(name);
+	}
+}
+
+static int
+check_part(int i, unsigned nbyte)
+{
+	unsigned char buf[PARTLEN];
+	unsigned char expected[PARTLEN];
+	char name[32];
+	FILE *fp;
+	unsigned j;
+
+	snprintf(name, sizeof name, "%02d-testoutput", i);
+	if ((fp = fopen(name, "rb")) == NULL) {
+		printf("cannot open %s\n", name);
+		return 0;
+	}
+	for (j = 0; j < nbyte; j++) {
+		expected[j] = (unsigned char) ((i * PARTLEN + j) & 0xff);
+	}
+	CHECK_UINT_GOTO(nbyte, fread(buf, 1, sizeof buf, fp));
+	CHECK_UCHAR_ARRAY_GOTO(expected, buf, nbyte);
+	fclose(fp);
+	return 1;
+error:
+	fclose(fp);
+	return 0;
+}
+
+static int
+write_pattern(RDD_WRITER *writer, unsigned nbyte)
+{
+	unsigned char buf[37];	// odd size, so writes straddle parts
+	unsigned pos = 0;
+	unsigned n;
+	unsigned j;
+
+	while (pos < nbyte) {
+		n = nbyte - pos < sizeof buf ? nbyte - pos : sizeof buf;
+		for (j = 0; j < n; j++) {
+			buf[j] = (unsigned char) ((pos + j) & 0xff);
+		}
+		CHECK_UINT(RDD_OK, rdd_writer_write(writer, buf, n));
+		pos += n;
+	}
+	return 1;
+}
+
+static int test_part_writer_split_prealloc()
+{
+	RDD_WRITER * writer;
+	int i;
+
+	remove_parts();
+	CHECK_UINT_GOTO(RDD_OK, rdd_open_part_writer(&writer, "testoutput", NPART * PARTLEN, PARTLEN, RDD_OVERWRITE, 1));
+	if (! write_pattern(writer, NPART * PARTLEN)) goto error;
+	CHECK_UINT_GOTO(RDD_OK, rdd_writer_close(writer));
+
+	for (i = 0; i < NPART; i++) {
+		if (! check_part(i, PARTLEN)) goto error;
+	}
+	remove_parts();
+	return 1;
+error:
+	remove_parts();
+	return 0;
+}
+
+static int test_part_writer_short_input()
+{
+	RDD_WRITER * writer;
+	struct stat st;
+
+	remove_parts();
+	CHECK_UINT_GOTO(RDD_OK, rdd_open_part_writer(&writer, "testoutput", NPART * PARTLEN, PARTLEN, RDD_OVERWRITE, 1));
+	if (! write_pattern(writer, 2 * PARTLEN + PARTLEN / 2)) goto error;
+	CHECK_UINT_GOTO(RDD_OK, rdd_writer_close(writer));
+
+	if (! check_part(0, PARTLEN)) goto error;
+	if (! check_part(1, PARTLEN)) goto error;
+	if (! check_part(2, PARTLEN / 2)) goto error;
+
+	/* The part opened ahead of time must not survive the close. */
+	CHECK_INT_GOTO(-1, stat("03-testoutput", &st));
+	remove_parts();
+	return 1;
+error:
+	remove_parts();
+	return 0;
+}
+
+/* A part that already exists past the end of the input must be left
+ * alone in overwrite mode, even though the copy was told it needs it.
+ */
+static int test_part_writer_short_input_existing_part()
+{
+	RDD_WRITER * writer;
+	unsigned char old[] = "old part";
+	unsigned char buf[sizeof old];
+	FILE *fp;
+
+	remove_parts();
+	CHECK_NOT_NULL_GOTO(fp = fopen("02-testoutput", "wb"));
+	CHECK_UINT_GOTO(1, (unsigned) fwrite(old, sizeof old, 1, fp));
+	fclose(fp);
+
+	CHECK_UINT_GOTO(RDD_OK, rdd_open_part_writer(&writer, "testoutput", NPART * PARTLEN, PARTLEN, RDD_OVERWRITE, 1));
+	if (! write_pattern(writer, PARTLEN + PARTLEN / 2)) goto error;
+	CHECK_UINT_GOTO(RDD_OK, rdd_writer_close(writer));
+
+	if (! check_part(0, PARTLEN)) goto error;
+	if (! check_part(1, PARTLEN / 2)) goto error;
+
+	CHECK_NOT_NULL_GOTO(fp = fopen("02-testoutput", "rb"));
+	CHECK_UINT_GOTO((unsigned) sizeof old, (unsigned) fread(buf, 1, sizeof buf, fp));
+	fclose(fp);
+	CHECK_UCHAR_ARRAY_GOTO(old, buf, sizeof old);
+	remove_parts();
+	return 1;
+error:
+	remove_parts();
+	return 0;
+}
+
+/* An existing part is still overwritten once the copy reaches it.
+ */
+static int test_part_writer_existing_part()
+{
+	RDD_WRITER * writer;
+	FILE *fp;
+	int i;
+
+	remove_parts();
+	CHECK_NOT_NULL_GOTO(fp = fopen("02-testoutput", "wb"));
+	CHECK_UINT_GOTO(1, (unsigned) fwrite("old part", 8, 1, fp));
+	fclose(fp);
+
+	CHECK_UINT_GOTO(RDD_OK, rdd_open_part_writer(&writer, "testoutput", NPART * PARTLEN, PARTLEN, RDD_OVERWRITE, 1));
+	if (! write_pattern(writer, NPART * PARTLEN)) goto error;
+	CHECK_UINT_GOTO(RDD_OK, rdd_writer_close(writer));
+
+	for (i = 0; i < NPART; i++) {
+		if (! check_part(i, PARTLEN)) goto error;
+	}
+	remove_parts();
+	return 1;
+error:
+	remove_parts();
+	return 0;
+}
+
+static int test_part_writer_no_space()
+{
+	RDD_WRITER * writer;
+	struct stat st;
+
+	remove_parts();
+	CHECK_UINT_GOTO(RDD_ESPACE, rdd_open_part_writer(&writer, "testoutput", ((rdd_count_t) 1) << 62, ((rdd_count_t) 1) << 60, RDD_OVERWRITE, 1));
+	CHECK_INT_GOTO(-1, stat("0-testoutput", &st));
+	return 1;
+error:
+	remove_parts();
+	return 0;
+}
 
 static int test_compare_address_address_null()
 {
 	RDD_WRITER * writer;
 	int result;
-	CHECK_UINT_GOTO(RDD_OK, rdd_open_part_writer(&writer, "testoutput", 1000, 100, 0));
+	CHECK_UINT_GOTO(RDD_OK, rdd_open_part_writer(&writer, "testoutput", 1000, 100, 0, 1));
 
 	CHECK_UINT_GOTO(RDD_OK, rdd_compare_address(writer, 0, &result));
 	CHECK_INT_GOTO(1, result);
@@ -93,7 +269,7 @@ static int test_compare_address_result_null()
 {
 	RDD_WRITER * writer;
 	struct addrinfo address;	// contents are irrelevant for this test
-	CHECK_UINT_GOTO(RDD_OK, rdd_open_part_writer(&writer, "testoutput", 1000, 100, 0));
+	CHECK_UINT_GOTO(RDD_OK, rdd_open_part_writer(&writer, "testoutput", 1000, 100, 0, 1));
 
 	CHECK_UINT_GOTO(RDD_BADARG, rdd_compare_address(writer, &address, 0));
 
@@ -110,7 +286,7 @@ static int test_compare_address_address_not_null()
 	RDD_WRITER * writer;
 	struct addrinfo address;	// contents are irrelevant for this test
 	int result;
-	CHECK_UINT_GOTO(RDD_OK, rdd_open_part_writer(&writer, "testoutput", 1000, 100, 0));
+	CHECK_UINT_GOTO(RDD_OK, rdd_open_part_writer(&writer, "testoutput", 1000, 100, 0, 1));
 
 	CHECK_UINT_GOTO(RDD_OK, rdd_compare_address(writer, &address, &result));
 	CHECK_INT_GOTO(0, result);
@@ -131,6 +307,11 @@ call_tests(void)
 	TEST(test_open_part_writer_writer_null);
 	TEST(test_open_part_writer_path_null);
 	TEST(test_open_part_writer_empty_path);
+	TEST(test_part_writer_split_prealloc);
+	TEST(test_part_writer_short_input);
+	TEST(test_part_writer_short_input_existing_part);
+	TEST(test_part_writer_existing_part);
+	TEST(test_part_writer_no_space);
 
 	TEST(test_compare_address_address_null);
 	TEST(test_compare_address_result_null);
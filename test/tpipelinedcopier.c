@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* A unit-test for the pipelined copier.  The pipelined copier must
+ * deliver exactly the same byte stream and counters as the robust
+ * copier, with and without read errors.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rdd.h"
+#include "reader.h"
+#include "filter.h"
+#include "filterset.h"
+#include "copier.h"
+
+#include "testhelper.h"
+#include "collectfilter.h"
+#include "copytest.h"
+
+#define BLOCK_SIZE     65536
+#define MIN_BLOCK_SIZE  4096
+
+static char image[] = "../test/image.img";
+static char simfile[] = "../test/simfile.txt";
+
+static RDD_FILTERSET fset;
+static RDD_FILTER *collector;
+
+static int
+setup()
+{
+	CHECK_UINT(RDD_OK, rdd_fset_init(&fset));
+	CHECK_UINT(RDD_OK, collectfilter_open(&collector));
+	CHECK_UINT(RDD_OK, rdd_fset_add(&fset, "collect", collector));
+
+	return 1;
+}
+
+static int
+teardown()
+{
+	CHECK_UINT(RDD_OK, rdd_fset_clear(&fset));
+
+	return 1;
+}
+
+static int
+compare_copiers(int faulty, rdd_count_t offset, rdd_count_t count)
+{
+	RDD_ROBUST_PARAMS p;
+	RDD_COPIER *robust = 0;
+	RDD_COPIER *pipelined = 0;
+	RDD_COPIER_RETURN rret, pret;
+	int ok = 0;
+
+	copytest_init_params(&p, MIN_BLOCK_SIZE, BLOCK_SIZE);
+	CHECK_UINT(RDD_OK, rdd_new_robust_copier(&robust, offset, count, &p));
+	CHECK_UINT(RDD_OK, rdd_new_pipelined_copier(&pipelined,
+				offset, count, &p, 4));
+
+	if (! copytest_compare(robust, pipelined, image,
+				faulty ? simfile : 0, &rret, &pret)) goto error;
+	CHECK_UINT64_GOTO((unsigned long long) rret.nread_err, pret.nread_err);
+	CHECK_UINT64_GOTO((unsigned long long) rret.nsubst, pret.nsubst);
+	if (faulty && pret.nsubst == 0) {
+		printf("pret.nsubst: expected substitutions\n");
+		goto error;
+	}
+	ok = 1;
+
+error:
+	rdd_copy_free(robust);
+	rdd_copy_free(pipelined);
+	return ok;
+}
+
+static int
+test_new_pipelined_copier_nbuf_too_small()
+{
+	RDD_ROBUST_PARAMS p;
+	RDD_COPIER *c = 0;
+
+	copytest_init_params(&p, MIN_BLOCK_SIZE, BLOCK_SIZE);
+	CHECK_UINT(RDD_BADARG, rdd_new_pipelined_copier(&c, 0,
+				RDD_WHOLE_FILE, &p, 1));
+
+	return 1;
+}
+
+static int
+test_pipelined_copy_whole_file()
+{
+	return compare_copiers(0, 0, RDD_WHOLE_FILE);
+}
+
+static int
+test_pipelined_copy_segment()
+{
+	return compare_copiers(0, 1000, 500000);
+}
+
+static int
+test_pipelined_copy_read_errors()
+{
+	return compare_copiers(1, 0, RDD_WHOLE_FILE);
+}
+
+static int
+test_pipelined_copy_filter_error()
+{
+	RDD_ROBUST_PARAMS p;
+	RDD_COPIER *c = 0;
+	RDD_READER *reader = 0;
+	RDD_COPIER_RETURN ret;
+	COLLECT_STATE *s = (COLLECT_STATE *) collector->state;
+
+	s->failafter = 3;
+
+	copytest_init_params(&p, MIN_BLOCK_SIZE, BLOCK_SIZE);
+	CHECK_UINT(RDD_OK, rdd_new_pipelined_copier(&c, 0, RDD_WHOLE_FILE,
+				&p, 2));
+	CHECK_UINT(RDD_OK, rdd_open_file_reader(&reader, image, 0));
+	CHECK_UINT(RDD_EWRITE, rdd_copy_exec(c, reader, &fset, &ret));
+	CHECK_UINT(RDD_OK, rdd_reader_close(reader, 1));
+	CHECK_UINT(RDD_OK, rdd_copy_free(c));
+
+	CHECK_UINT64(3ULL * BLOCK_SIZE, s->len);
+	CHECK_UINT(0, s->nclose);
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_new_pipelined_copier_nbuf_too_small);
+	SAFE_TEST(test_pipelined_copy_whole_file);
+	SAFE_TEST(test_pipelined_copy_segment);
+	SAFE_TEST(test_pipelined_copy_read_errors);
+	SAFE_TEST(test_pipelined_copy_filter_error);
+
+	return result;
+}
+
+TEST_MAIN
+;
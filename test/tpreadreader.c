@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "rdd.h"
+#include "reader.h"
+
+#include "testhelper.h"
+
+static char image[] = "../test/image.img";
+
+static RDD_READER *reader;
+static int fd = -1;
+
+static int
+setup()
+{
+	CHECK_TRUE((fd = open(image, O_RDONLY)) >= 0);
+	CHECK_UINT(RDD_OK, rdd_open_pread_reader(&reader, fd));
+
+	return 1;
+}
+
+static int
+teardown()
+{
+	if (reader != NULL) {
+		CHECK_UINT(RDD_OK, rdd_reader_close(reader, 0));
+		reader = NULL;
+	}
+	fd = -1;
+
+	return 1;
+}
+
+/* Reads nbyte bytes at pos from the image with ordinary I/O.
+ */
+static int
+expected_data(rdd_count_t pos, unsigned char *buf, unsigned nbyte)
+{
+	FILE *fp;
+	size_t n;
+
+	if ((fp = fopen(image, "rb")) == 0) {
+		return 0;
+	}
+	fseek(fp, (long) pos, SEEK_SET);
+	n = fread(buf, 1, nbyte, fp);
+	fclose(fp);
+	return n == nbyte;
+}
+
+static int
+test_open_pread_reader_pipe()
+{
+	RDD_READER *r = 0;
+	int p[2];
+
+	CHECK_TRUE(pipe(p) == 0);
+	CHECK_UINT(RDD_ESEEK, rdd_open_pread_reader(&r, p[0]));
+	close(p[0]);
+	close(p[1]);
+
+	return 1;
+}
+
+static int
+test_pread_read_tell()
+{
+	unsigned char buf[1000], expected[1000];
+	unsigned nread;
+	rdd_count_t pos;
+
+	CHECK_UINT(RDD_OK, rdd_reader_read(reader, buf, sizeof buf, &nread));
+	CHECK_UINT((unsigned) sizeof buf, nread);
+	CHECK_UINT(RDD_OK, rdd_reader_read(reader, buf, sizeof buf, &nread));
+	CHECK_UINT(RDD_OK, rdd_reader_tell(reader, &pos));
+	CHECK_UINT64(2000ULL, pos);
+
+	CHECK_TRUE(expected_data(1000, expected, sizeof expected));
+	CHECK_UCHAR_ARRAY(expected, buf, (int) sizeof buf);
+
+	/* The descriptor's file pointer has not moved. */
+	CHECK_TRUE(lseek(fd, 0, SEEK_CUR) == 0);
+
+	return 1;
+}
+
+static int
+test_pread_seek()
+{
+	unsigned char buf[512], expected[512];
+	unsigned nread;
+	rdd_count_t pos;
+
+	CHECK_UINT(RDD_OK, rdd_reader_seek(reader, 12345));
+	CHECK_UINT(RDD_OK, rdd_reader_tell(reader, &pos));
+	CHECK_UINT64(12345ULL, pos);
+	CHECK_UINT(RDD_OK, rdd_reader_read(reader, buf, sizeof buf, &nread));
+	CHECK_UINT((unsigned) sizeof buf, nread);
+
+	CHECK_TRUE(expected_data(12345, expected, sizeof expected));
+	CHECK_UCHAR_ARRAY(expected, buf, (int) sizeof buf);
+
+	return 1;
+}
+
+static int
+test_pread_positional()
+{
+	unsigned char buf[512], expected[512];
+	unsigned nread;
+	rdd_count_t pos;
+
+	CHECK_UINT(RDD_OK, rdd_reader_seek(reader, 100));
+	CHECK_UINT(RDD_OK, rdd_reader_pread(reader, buf, sizeof buf, 50000,
+						&nread));
+	CHECK_UINT((unsigned) sizeof buf, nread);
+	CHECK_TRUE(expected_data(50000, expected, sizeof expected));
+	CHECK_UCHAR_ARRAY(expected, buf, (int) sizeof buf);
+
+	/* A positional read does not change the position. */
+	CHECK_UINT(RDD_OK, rdd_reader_tell(reader, &pos));
+	CHECK_UINT64(100ULL, pos);
+
+	return 1;
+}
+
+static int
+test_pread_eof()
+{
+	unsigned char buf[512];
+	unsigned nread;
+
+	/* image.img is 1572864 bytes long. */
+	CHECK_UINT(RDD_OK, rdd_reader_seek(reader, 1572864 - 100));
+	CHECK_UINT(RDD_OK, rdd_reader_read(reader, buf, sizeof buf, &nread));
+	CHECK_UINT(100, nread);
+	CHECK_UINT(RDD_OK, rdd_reader_read(reader, buf, sizeof buf, &nread));
+	CHECK_UINT(0, nread);
+
+	return 1;
+}
+
+static int
+test_file_reader_is_positional()
+{
+	RDD_READER *r = 0;
+	unsigned char buf[16];
+	unsigned nread;
+
+	CHECK_UINT(RDD_OK, rdd_open_file_reader(&r, image, 0));
+	CHECK_UINT(RDD_OK, rdd_reader_pread(r, buf, sizeof buf, 0, &nread));
+	CHECK_UINT((unsigned) sizeof buf, nread);
+	CHECK_UINT(RDD_OK, rdd_reader_close(r, 0));
+
+	return 1;
+}
+
+static int
+test_pread_stream()
+{
+	unsigned char buf[1000], expected[1000];
+	unsigned nread;
+
+	CHECK_UINT(RDD_OK, rdd_reader_stream(reader));
+	CHECK_UINT(RDD_OK, rdd_reader_pread(reader, buf, sizeof buf, 4096,
+						&nread));
+	CHECK_UINT((unsigned) sizeof buf, nread);
+	CHECK_TRUE(expected_data(4096, expected, sizeof expected));
+	CHECK_UCHAR_ARRAY(expected, buf, (int) sizeof buf);
+
+	return 1;
+}
+
+static int
+test_fd_reader_stream_pipe()
+{
+	RDD_READER *r = 0;
+	int p[2];
+
+	CHECK_TRUE(pipe(p) == 0);
+	CHECK_UINT(RDD_OK, rdd_open_fd_reader(&r, p[0]));
+	CHECK_UINT(RDD_NOTFOUND, rdd_reader_stream(r));
+	CHECK_UINT(RDD_OK, rdd_reader_close(r, 0));
+	close(p[1]);
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	TEST(test_open_pread_reader_pipe);
+	SAFE_TEST(test_pread_read_tell);
+	SAFE_TEST(test_pread_seek);
+	SAFE_TEST(test_pread_positional);
+	SAFE_TEST(test_pread_eof);
+	SAFE_TEST(test_pread_stream);
+	TEST(test_fd_reader_stream_pipe);
+	TEST(test_file_reader_is_positional);
+
+	return result;
+}
+
+TEST_MAIN
+;
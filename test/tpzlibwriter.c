@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rdd.h"
+#include "writer.h"
+#include "reader.h"
+
+#include "testhelper.h"
+
+#define DATA_SIZE	(1000 * 1000 + 17)
+
+static char outfile[] = "pzliboutput";
+
+/* Half random bytes, half a repeating pattern, so that the data
+ * compresses, but not to nothing.
+ */
+static void
+fill_data(unsigned char *buf, unsigned len)
+{
+	unsigned i;
+
+	srandom(7);
+	for (i = 0; i < len; i++) {
+		if ((i / 5000) % 2 == 0) {
+			buf[i] = (unsigned char) random();
+		} else {
+			buf[i] = (unsigned char) ("forensic copy "[i % 14]);
+		}
+	}
+}
+
+/* Writes len bytes from buf in pieces of irregular size.
+ */
+static int
+write_pieces(RDD_WRITER *w, const unsigned char *buf, unsigned len)
+{
+	unsigned sizes[] = { 1, 100, 65536, 513, 200000, 7 };
+	unsigned pos = 0, i = 0, n;
+	int rc;
+
+	while (pos < len) {
+		n = sizes[i++ % (sizeof sizes / sizeof sizes[0])];
+		if (n > len - pos) {
+			n = len - pos;
+		}
+		if ((rc = rdd_writer_write(w, buf + pos, n)) != RDD_OK) {
+			return rc;
+		}
+		pos += n;
+	}
+
+	return RDD_OK;
+}
+
+/* Compresses len bytes with nthread threads and decompresses them
+ * again with a zlib reader.
+ */
+static int
+roundtrip(const unsigned char *data, unsigned len, unsigned nthread)
+{
+	RDD_WRITER *parent = 0, *w = 0;
+	RDD_READER *file = 0, *r = 0;
+	unsigned char *copy = 0;
+	unsigned nread = 0;
+	int ok = 0;
+
+	CHECK_NOT_NULL(copy = malloc(len + 1));
+
+	CHECK_INT_GOTO(RDD_OK, rdd_open_file_writer(&parent, outfile));
+	CHECK_INT_GOTO(RDD_OK, rdd_open_pzlib_writer(&w, parent, nthread));
+	CHECK_INT_GOTO(RDD_OK, write_pieces(w, data, len));
+	CHECK_INT_GOTO(RDD_OK, rdd_writer_close(w));
+
+	CHECK_INT_GOTO(RDD_OK, rdd_open_file_reader(&file, outfile, 0));
+	CHECK_INT_GOTO(RDD_OK, rdd_open_zlib_reader(&r, file));
+	CHECK_INT_GOTO(RDD_OK, rdd_reader_read(r, copy, len + 1, &nread));
+	CHECK_UINT_GOTO(len, nread);
+	CHECK_UCHAR_ARRAY_GOTO(data, copy, (int) len);
+	ok = 1;
+
+error:
+	if (r != 0) rdd_reader_close(r, 1);
+	remove(outfile);
+	free(copy);
+	return ok;
+}
+
+static int
+test_open_pzlib_writer_writer_null()
+{
+	RDD_WRITER *parent;
+
+	CHECK_INT(RDD_OK, rdd_open_file_writer(&parent, outfile));
+	CHECK_INT(RDD_BADARG, rdd_open_pzlib_writer(0, parent, 2));
+	CHECK_INT(RDD_OK, rdd_writer_close(parent));
+	CHECK_INT(0, remove(outfile));
+	return 1;
+}
+
+static int
+test_open_pzlib_writer_parent_null()
+{
+	RDD_WRITER *w;
+
+	CHECK_INT(RDD_BADARG, rdd_open_pzlib_writer(&w, 0, 2));
+	return 1;
+}
+
+static int
+test_pzlib_empty()
+{
+	unsigned char dummy = 0;
+
+	return roundtrip(&dummy, 0, 2);
+}
+
+static int
+test_pzlib_one_chunk()
+{
+	unsigned char *data;
+	int ok;
+
+	CHECK_NOT_NULL(data = malloc(128 * 1024));
+	fill_data(data, 128 * 1024);
+	ok = roundtrip(data, 128 * 1024, 2);
+	free(data);
+	return ok;
+}
+
+static int
+test_pzlib_threads()
+{
+	unsigned nthreads[] = { 1, 2, 4, 0 };
+	unsigned char *data;
+	unsigned i;
+	int ok = 1;
+
+	CHECK_NOT_NULL(data = malloc(DATA_SIZE));
+	fill_data(data, DATA_SIZE);
+	for (i = 0; ok && i < sizeof nthreads / sizeof nthreads[0]; i++) {
+		ok = roundtrip(data, DATA_SIZE, nthreads[i]);
+	}
+	free(data);
+	return ok;
+}
+
+/* Random chunks are stored rather than deflated; the stream must
+ * still decode when stored and deflated chunks alternate.
+ */
+static int
+test_pzlib_incompressible()
+{
+	unsigned char *data;
+	unsigned i;
+	int ok;
+
+	CHECK_NOT_NULL(data = malloc(DATA_SIZE));
+	fill_data(data, DATA_SIZE);
+	srandom(13);
+	for (i = 0; i < DATA_SIZE; i++) {
+		if ((i / (128 * 1024)) % 2 == 0) {
+			data[i] = (unsigned char) random();
+		}
+	}
+	ok = roundtrip(data, DATA_SIZE, 2);
+	free(data);
+	return ok;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	TEST(test_open_pzlib_writer_writer_null);
+	TEST(test_open_pzlib_writer_parent_null);
+	TEST(test_pzlib_empty);
+	TEST(test_pzlib_one_chunk);
+	TEST(test_pzlib_threads);
+	TEST(test_pzlib_incompressible);
+
+	return result;
+}
+
+TEST_MAIN
+;
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+
+#include "rdd.h"
+#include "reader.h"
+#include "filter.h"
+#include "filterset.h"
+#include "copier.h"
+
+#include "testhelper.h"
+#include "collectfilter.h"
+#include "copytest.h"
+
+#define BLOCK_SIZE	65536
+#define MIN_BLOCK_SIZE	512
+#define STRIPE_SIZE	(4 * BLOCK_SIZE)
+#define IMAGE_SIZE	1572864
+#define MAX_EVENTS	64
+
+static char image[] = "../test/image.img";
+static char simfile[] = "regionsim.txt";
+
+/* Fault positions; they lie in different stripes. */
+static rdd_count_t faults[] = { 3, 300000, 1000005 };
+
+#define NFAULT	(sizeof faults / sizeof faults[0])
+
+/* Read-error and substitution events reported by a copier.
+ */
+typedef struct _EVENTS {
+	rdd_count_t offset[MAX_EVENTS];
+	unsigned    nbyte[MAX_EVENTS];
+	unsigned    n;
+} EVENTS;
+
+static EVENTS readerrs, substs;
+
+static void
+record_event(rdd_count_t offset, unsigned nbyte, void *env)
+{
+	EVENTS *e = (EVENTS *) env;
+
+	if (e->n < MAX_EVENTS) {
+		e->offset[e->n] = offset;
+		e->nbyte[e->n] = nbyte;
+		e->n++;
+	}
+}
+
+static int
+event_compare(const void *p1, const void *p2)
+{
+	rdd_count_t a = *(const rdd_count_t *) p1;
+	rdd_count_t b = *(const rdd_count_t *) p2;
+
+	return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static RDD_FILTERSET fset;
+static RDD_FILTER *collector;
+
+static int
+setup()
+{
+	CHECK_UINT(RDD_OK, rdd_fset_init(&fset));
+	CHECK_UINT(RDD_OK, collectfilter_open(&collector));
+	CHECK_UINT(RDD_OK, rdd_fset_add(&fset, "collect", collector));
+	CHECK_TRUE(copytest_write_simfile(simfile, faults, NFAULT));
+
+	return 1;
+}
+
+static int
+teardown()
+{
+	CHECK_UINT(RDD_OK, rdd_fset_clear(&fset));
+	remove(simfile);
+
+	return 1;
+}
+
+/* Records the substitutions of a copy in subst.
+ */
+static void
+init_params(RDD_ROBUST_PARAMS *p, EVENTS *subst)
+{
+	copytest_init_params(p, MIN_BLOCK_SIZE, BLOCK_SIZE);
+	p->readerrfun = record_event;
+	p->readerrenv = &readerrs;
+	p->substfun = record_event;
+	p->substenv = subst;
+}
+
+static int
+compare_copiers(int faulty, rdd_count_t offset, rdd_count_t count,
+		unsigned nworker)
+{
+	RDD_ROBUST_PARAMS rp, gp;
+	RDD_COPIER *robust = 0;
+	RDD_COPIER *region = 0;
+	RDD_COPIER_RETURN rret, gret;
+	EVENTS rsubst, gsubst;
+	unsigned i;
+	int ok = 0;
+
+	memset(&readerrs, 0, sizeof readerrs);
+	memset(&rsubst, 0, sizeof rsubst);
+	memset(&gsubst, 0, sizeof gsubst);
+
+	init_params(&rp, &rsubst);
+	init_params(&gp, &gsubst);
+	CHECK_UINT(RDD_OK, rdd_new_robust_copier(&robust, offset, count, &rp));
+	CHECK_UINT(RDD_OK, rdd_new_region_copier(&region,
+				offset, count, &gp, nworker, STRIPE_SIZE));
+
+	if (! copytest_compare(robust, region, image,
+				faulty ? simfile : 0, &rret, &gret)) goto error;
+	CHECK_UINT64_GOTO((unsigned long long) rret.nsubst, gret.nsubst);
+
+	/* Substitutions are reported at the same absolute offsets. */
+	qsort(rsubst.offset, rsubst.n, sizeof(rdd_count_t), event_compare);
+	qsort(gsubst.offset, gsubst.n, sizeof(rdd_count_t), event_compare);
+	CHECK_UINT_GOTO(rsubst.n, gsubst.n);
+	for (i = 0; i < rsubst.n; i++) {
+		CHECK_UINT64_GOTO((unsigned long long) rsubst.offset[i], gsubst.offset[i]);
+	}
+	if (faulty) {
+		CHECK_UINT_GOTO((unsigned) NFAULT, gsubst.n);
+		for (i = 0; i < gsubst.n; i++) {
+			CHECK_TRUE(gsubst.offset[i] <= faults[i]);
+			CHECK_TRUE(faults[i] < gsubst.offset[i] + MIN_BLOCK_SIZE);
+		}
+	}
+	ok = 1;
+
+error:
+	rdd_copy_free(robust);
+	rdd_copy_free(region);
+	return ok;
+}
+
+static int
+test_new_region_copier_bad_args()
+{
+	RDD_ROBUST_PARAMS p;
+	RDD_COPIER *c = 0;
+
+	init_params(&p, &substs);
+	CHECK_UINT(RDD_BADARG, rdd_new_region_copier(&c, 0,
+				RDD_WHOLE_FILE, &p, 2, STRIPE_SIZE));
+	CHECK_UINT(RDD_BADARG, rdd_new_region_copier(&c, 0,
+				IMAGE_SIZE, &p, 0, STRIPE_SIZE));
+	CHECK_UINT(RDD_BADARG, rdd_new_region_copier(&c, 0,
+				IMAGE_SIZE, &p, 2, 0));
+
+	return 1;
+}
+
+static int
+test_region_copy_whole_file()
+{
+	return compare_copiers(0, 0, IMAGE_SIZE, 3);
+}
+
+static int
+test_region_copy_single_worker()
+{
+	return compare_copiers(0, 0, IMAGE_SIZE, 1);
+}
+
+static int
+test_region_copy_segment()
+{
+	return compare_copiers(0, 1000, 500000, 4);
+}
+
+static int
+test_region_copy_read_errors()
+{
+	return compare_copiers(1, 0, IMAGE_SIZE, 3);
+}
+
+static int
+test_region_copy_filter_error()
+{
+	RDD_ROBUST_PARAMS p;
+	RDD_COPIER *c = 0;
+	RDD_READER *reader = 0;
+	RDD_COPIER_RETURN ret;
+	COLLECT_STATE *s = (COLLECT_STATE *) collector->state;
+
+	s->failafter = 2;
+
+	init_params(&p, &substs);
+	CHECK_UINT(RDD_OK, rdd_new_region_copier(&c, 0, IMAGE_SIZE,
+				&p, 2, STRIPE_SIZE));
+	CHECK_UINT(RDD_OK, rdd_open_file_reader(&reader, image, 0));
+	CHECK_UINT(RDD_EWRITE, rdd_copy_exec(c, reader, &fset, &ret));
+	CHECK_UINT(RDD_OK, rdd_reader_close(reader, 1));
+	CHECK_UINT(RDD_OK, rdd_copy_free(c));
+
+	CHECK_UINT64((unsigned long long) (2 * STRIPE_SIZE), s->len);
+	CHECK_UINT(0, s->nclose);
+
+	return 1;
+}
+
+static int
+test_region_copy_needs_pread()
+{
+	RDD_ROBUST_PARAMS p;
+	RDD_COPIER *c = 0;
+	RDD_READER *reader = 0;
+	RDD_COPIER_RETURN ret;
+	int fd;
+
+	/* An fd reader does not implement positional reads. */
+	CHECK_TRUE((fd = open(image, O_RDONLY)) >= 0);
+	CHECK_UINT(RDD_OK, rdd_open_fd_reader(&reader, fd));
+
+	init_params(&p, &substs);
+	CHECK_UINT(RDD_OK, rdd_new_region_copier(&c, 0, IMAGE_SIZE,
+				&p, 2, STRIPE_SIZE));
+	CHECK_UINT(RDD_BADARG, rdd_copy_exec(c, reader, &fset, &ret));
+	CHECK_UINT(RDD_OK, rdd_copy_free(c));
+	CHECK_UINT(RDD_OK, rdd_reader_close(reader, 1));
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_new_region_copier_bad_args);
+	SAFE_TEST(test_region_copy_whole_file);
+	SAFE_TEST(test_region_copy_single_worker);
+	SAFE_TEST(test_region_copy_segment);
+	SAFE_TEST(test_region_copy_read_errors);
+	SAFE_TEST(test_region_copy_filter_error);
+	SAFE_TEST(test_region_copy_needs_pread);
+
+	return result;
+}
+
+TEST_MAIN
+;
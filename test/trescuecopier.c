@@ -0,0 +1,471 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rdd.h"
+#include "reader.h"
+#include "filter.h"
+#include "filterset.h"
+#include "copier.h"
+
+#include "testhelper.h"
+#include "collectfilter.h"
+#include "copytest.h"
+
+#define BLOCK_SIZE	65536
+#define MIN_BLOCK_SIZE	512
+#define IMAGE_SIZE	1572864
+#define MAX_EVENTS	64
+#define MAX_EXTENTS	64
+
+static char image[] = "../test/image.img";
+static char simfile[] = "rescuesim.txt";
+static char mapfile[] = "rescue.map";
+static char datafile[] = "rescue.map.data";
+
+/* Fault positions; the second and third lie in adjacent blocks. */
+static rdd_count_t faults[] = { 3, 300000, 330000, 1000005 };
+
+#define NFAULT	(sizeof faults / sizeof faults[0])
+
+/* Substitution events reported by a copier.
+ */
+typedef struct _EVENTS {
+	rdd_count_t offset[MAX_EVENTS];
+	unsigned    nbyte[MAX_EVENTS];
+	unsigned    n;
+} EVENTS;
+
+static EVENTS substs;
+static unsigned nreaderr;
+static rdd_count_t nrescue_err;	/* read errors reported by the rescue */
+
+static void
+record_event(rdd_count_t offset, unsigned nbyte, void *env)
+{
+	EVENTS *e = (EVENTS *) env;
+
+	if (e->n < MAX_EVENTS) {
+		e->offset[e->n] = offset;
+		e->nbyte[e->n] = nbyte;
+		e->n++;
+	}
+}
+
+static void
+count_readerr(rdd_count_t offset, unsigned nbyte, void *env)
+{
+	nreaderr++;
+}
+
+/* A progress callback that aborts the copy after a number of calls.
+ */
+static int
+abort_progress(rdd_count_t ncopied, rdd_count_t nbad, void *env)
+{
+	unsigned *ncall = (unsigned *) env;
+
+	if (*ncall == 0) {
+		return RDD_ABORTED;
+	}
+	(*ncall)--;
+	return RDD_OK;
+}
+
+/* A map extent as read back from the map file.
+ */
+typedef struct _EXTENT {
+	rdd_count_t pos;
+	rdd_count_t size;
+	char        status;
+} EXTENT;
+
+static int
+read_map(unsigned *pass, EXTENT *ext, unsigned *next)
+{
+	char line[128];
+	unsigned long long a, b;
+	int header = 0;
+	char c;
+	FILE *fp;
+
+	*next = 0;
+	if ((fp = fopen(mapfile, "r")) == 0) {
+		return 0;
+	}
+	while (fgets(line, sizeof line, fp) != 0) {
+		if (line[0] == '#') {
+			continue;
+		}
+		if (!header) {
+			if (sscanf(line, "%llu %llu %u", &a, &b, pass) != 3) {
+				break;
+			}
+			header = 1;
+		} else if (*next < MAX_EXTENTS
+		       &&  sscanf(line, "%llu %llu %c", &a, &b, &c) == 3) {
+			ext[*next].pos = a;
+			ext[*next].size = b;
+			ext[*next].status = c;
+			(*next)++;
+		}
+	}
+	fclose(fp);
+	return header;
+}
+
+static int
+setup()
+{
+	remove(mapfile);
+	remove(datafile);
+	CHECK_TRUE(copytest_write_simfile(simfile, faults, NFAULT));
+
+	return 1;
+}
+
+static int
+teardown()
+{
+	remove(simfile);
+	remove(mapfile);
+	remove(datafile);
+
+	return 1;
+}
+
+static void
+init_params(RDD_ROBUST_PARAMS *p)
+{
+	copytest_init_params(p, MIN_BLOCK_SIZE, BLOCK_SIZE);
+	p->readerrfun = count_readerr;
+	p->substfun = record_event;
+	p->substenv = &substs;
+}
+
+/* Checks that a rescue copier delivers the same data stream as a
+ * robust copier.  Only the rescue reports its read errors and
+ * substitutions.
+ */
+static int
+compare_with_robust(int faulty, rdd_count_t offset, rdd_count_t count)
+{
+	RDD_ROBUST_PARAMS rp, p;
+	RDD_COPIER *robust = 0;
+	RDD_COPIER *rescue = 0;
+	RDD_COPIER_RETURN rret, sret;
+	int ok = 0;
+
+	memset(&substs, 0, sizeof substs);
+	nreaderr = 0;
+
+	copytest_init_params(&rp, MIN_BLOCK_SIZE, BLOCK_SIZE);
+	init_params(&p);
+	CHECK_UINT(RDD_OK, rdd_new_robust_copier(&robust, offset, count, &rp));
+	CHECK_UINT(RDD_OK, rdd_new_rescue_copier(&rescue, offset, count,
+				&p, mapfile));
+
+	if (! copytest_compare(robust, rescue, image,
+				faulty ? simfile : 0, &rret, &sret)) goto error;
+	CHECK_UINT64_GOTO((unsigned long long) count, sret.nbyte);
+	nrescue_err = sret.nread_err;
+	ok = 1;
+
+error:
+	rdd_copy_free(robust);
+	rdd_copy_free(rescue);
+	return ok;
+}
+
+/* A completed rescue leaves neither its map nor its working image.
+ */
+static int
+state_removed(void)
+{
+	CHECK_TRUE(access(mapfile, F_OK) < 0);
+	CHECK_TRUE(access(datafile, F_OK) < 0);
+
+	return 1;
+}
+
+static int
+test_new_rescue_copier_bad_args()
+{
+	RDD_ROBUST_PARAMS p;
+	RDD_COPIER *c = 0;
+
+	init_params(&p);
+	CHECK_UINT(RDD_BADARG, rdd_new_rescue_copier(&c, 0,
+				RDD_WHOLE_FILE, &p, mapfile));
+	CHECK_UINT(RDD_BADARG, rdd_new_rescue_copier(&c, 0,
+				IMAGE_SIZE, &p, 0));
+	p.minblocklen = 2 * BLOCK_SIZE;
+	CHECK_UINT(RDD_BADARG, rdd_new_rescue_copier(&c, 0,
+				IMAGE_SIZE, &p, mapfile));
+
+	return 1;
+}
+
+static int
+test_rescue_copy_whole_file()
+{
+	CHECK_TRUE(compare_with_robust(0, 0, IMAGE_SIZE));
+
+	CHECK_TRUE(state_removed());
+	CHECK_UINT(0, substs.n);
+
+	return 1;
+}
+
+static int
+test_rescue_copy_segment()
+{
+	return compare_with_robust(0, 1000, 500000);
+}
+
+static int
+test_rescue_copy_read_errors()
+{
+	unsigned i;
+
+	CHECK_TRUE(compare_with_robust(1, 0, IMAGE_SIZE));
+
+	/* Only the sectors that contain a fault are lost. */
+	CHECK_UINT((unsigned) NFAULT, substs.n);
+	for (i = 0; i < substs.n; i++) {
+		CHECK_UINT(MIN_BLOCK_SIZE, substs.nbyte[i]);
+		CHECK_TRUE(substs.offset[i] <= faults[i]);
+		CHECK_TRUE(faults[i] < substs.offset[i] + MIN_BLOCK_SIZE);
+	}
+
+	CHECK_TRUE(state_removed());
+
+	/* Every bad sector is read once during the copy, split, and
+	 * trim passes, and once during each retry pass, except the one
+	 * at 330000: the copy pass skips its block.
+	 */
+	CHECK_UINT((unsigned) (NFAULT * 5 - 1), nreaderr);
+	CHECK_UINT((unsigned) (NFAULT * 5 - 1), (unsigned) nrescue_err);
+
+	return 1;
+}
+
+static int
+test_rescue_copy_resume()
+{
+	RDD_ROBUST_PARAMS p;
+	RDD_COPIER *c = 0;
+	RDD_COPIER_RETURN ret;
+	EXTENT ext[MAX_EXTENTS];
+	unsigned char *data = 0;
+	rdd_count_t len;
+	unsigned pass, next, ncall = 5;
+
+	/* Interrupt the rescue during the copy pass. */
+	init_params(&p);
+	p.progressfun = abort_progress;
+	p.progressenv = &ncall;
+	CHECK_UINT(RDD_OK, rdd_new_rescue_copier(&c, 0, IMAGE_SIZE,
+				&p, mapfile));
+	CHECK_TRUE(copytest_run(c, image, simfile, RDD_ABORTED, &ret, &data, &len));
+	CHECK_UINT(RDD_OK, rdd_copy_free(c));
+	CHECK_UINT64(0ULL, len);
+	free(data);
+
+	CHECK_TRUE(read_map(&pass, ext, &next));
+	CHECK_UINT(1, pass);
+	CHECK_INT('*', ext[0].status);
+	CHECK_INT('?', ext[next - 1].status);
+
+	/* Resume it; the result equals that of an uninterrupted rescue,
+	 * and the read errors of the interrupted run are counted too.
+	 */
+	CHECK_TRUE(compare_with_robust(1, 0, IMAGE_SIZE));
+	CHECK_UINT((unsigned) (NFAULT * 5 - 1), (unsigned) nrescue_err);
+	CHECK_TRUE(state_removed());
+
+	return 1;
+}
+
+/* Interrupts a rescue during the copy pass, so that a map and a
+ * working image are left behind.
+ */
+static int
+interrupt_rescue(void)
+{
+	RDD_ROBUST_PARAMS p;
+	RDD_COPIER *c = 0;
+	RDD_COPIER_RETURN ret;
+	unsigned char *data = 0;
+	rdd_count_t len;
+	unsigned ncall = 5;
+
+	init_params(&p);
+	p.progressfun = abort_progress;
+	p.progressenv = &ncall;
+	CHECK_UINT(RDD_OK, rdd_new_rescue_copier(&c, 0, IMAGE_SIZE,
+				&p, mapfile));
+	CHECK_TRUE(copytest_run(c, image, simfile, RDD_ABORTED, &ret, &data, &len));
+	CHECK_UINT(RDD_OK, rdd_copy_free(c));
+	free(data);
+
+	return 1;
+}
+
+/* Resumes the rescue that interrupt_rescue() left behind and expects
+ * it to fail with error code expect.
+ */
+static int
+resume_rescue(int expect)
+{
+	RDD_ROBUST_PARAMS p;
+	RDD_COPIER *c = 0;
+	RDD_COPIER_RETURN ret;
+	unsigned char *data = 0;
+	rdd_count_t len;
+
+	init_params(&p);
+	CHECK_UINT(RDD_OK, rdd_new_rescue_copier(&c, 0, IMAGE_SIZE,
+				&p, mapfile));
+	CHECK_TRUE(copytest_run(c, image, simfile, expect, &ret, &data, &len));
+	CHECK_UINT(RDD_OK, rdd_copy_free(c));
+	CHECK_UINT64(0ULL, len);
+	free(data);
+
+	return 1;
+}
+
+static int
+test_rescue_copy_resume_image_missing()
+{
+	CHECK_TRUE(interrupt_rescue());
+	CHECK_INT(0, remove(datafile));
+
+	/* The rescued data is gone; do not resume with zeroes. */
+	CHECK_TRUE(resume_rescue(RDD_EOPEN));
+
+	return 1;
+}
+
+static int
+test_rescue_copy_resume_image_truncated()
+{
+	CHECK_TRUE(interrupt_rescue());
+	CHECK_INT(0, truncate(datafile, 1000));
+
+	CHECK_TRUE(resume_rescue(RDD_BADARG));
+
+	return 1;
+}
+
+static int
+test_rescue_copy_map_mismatch()
+{
+	RDD_ROBUST_PARAMS p;
+	RDD_COPIER *c = 0;
+	RDD_COPIER_RETURN ret;
+	unsigned char *data = 0;
+	rdd_count_t len;
+
+	CHECK_TRUE(interrupt_rescue());
+
+	/* The map describes a different input range. */
+	init_params(&p);
+	CHECK_UINT(RDD_OK, rdd_new_rescue_copier(&c, 0, 500000,
+				&p, mapfile));
+	CHECK_TRUE(copytest_run(c, image, 0, RDD_BADARG, &ret, &data, &len));
+	CHECK_UINT(RDD_OK, rdd_copy_free(c));
+	free(data);
+
+	return 1;
+}
+
+static int
+test_rescue_copy_max_subst()
+{
+	RDD_ROBUST_PARAMS p;
+	RDD_COPIER *c = 0;
+	RDD_COPIER_RETURN ret;
+	unsigned char *data = 0;
+	rdd_count_t len;
+
+	/* Each bad sector is one substituted block; like the robust
+	 * copier, the rescue gives up when it reaches the limit.
+	 */
+	init_params(&p);
+	p.maxsubst = NFAULT;
+	CHECK_UINT(RDD_OK, rdd_new_rescue_copier(&c, 0, IMAGE_SIZE,
+				&p, mapfile));
+	CHECK_TRUE(copytest_run(c, image, simfile, RDD_ABORTED, &ret, &data, &len));
+	CHECK_UINT(RDD_OK, rdd_copy_free(c));
+	CHECK_UINT64(0ULL, len);
+	free(data);
+
+	/* The failed run left its map; the limit is not reached. */
+	p.maxsubst = NFAULT + 1;
+	CHECK_UINT(RDD_OK, rdd_new_rescue_copier(&c, 0, IMAGE_SIZE,
+				&p, mapfile));
+	CHECK_TRUE(copytest_run(c, image, simfile, RDD_OK, &ret, &data, &len));
+	CHECK_UINT(RDD_OK, rdd_copy_free(c));
+	CHECK_UINT64((unsigned long long) IMAGE_SIZE, len);
+	CHECK_UINT64((unsigned long long) NFAULT, ret.nsubst);
+	free(data);
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_new_rescue_copier_bad_args);
+	SAFE_TEST(test_rescue_copy_whole_file);
+	SAFE_TEST(test_rescue_copy_segment);
+	SAFE_TEST(test_rescue_copy_read_errors);
+	SAFE_TEST(test_rescue_copy_resume);
+	SAFE_TEST(test_rescue_copy_resume_image_missing);
+	SAFE_TEST(test_rescue_copy_resume_image_truncated);
+	SAFE_TEST(test_rescue_copy_map_mismatch);
+	SAFE_TEST(test_rescue_copy_max_subst);
+
+	return result;
+}
+
+TEST_MAIN
+;
@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "rdd.h"
+#include "writer.h"
+#include "zeroblock.h"
+
+#include "testhelper.h"
+
+#define DATA_SIZE	(4 * 1024 * 1024)
+#define SPLIT_SIZE	(1024 * 1024)
+
+static unsigned char *data;
+static unsigned char *copy;
+static char out_path[] = "tsparse_test.img";
+static char map_path[] = "tsparse_test.map";
+
+/* The test data: zeros, with nonzero bytes at a few places, some of
+ * which are not block aligned.
+ */
+static int
+setup()
+{
+	unsigned i;
+
+	if ((data = calloc(1, DATA_SIZE)) == 0
+	||  (copy = malloc(DATA_SIZE)) == 0) {
+		return 0;
+	}
+	srandom(19);
+	for (i = 100; i < 5000; i++) {
+		data[i] = (unsigned char) (random() | 1);
+	}
+	for (i = 2 * SPLIT_SIZE + 7; i < 2 * SPLIT_SIZE + 9000; i++) {
+		data[i] = (unsigned char) (random() | 1);
+	}
+	data[DATA_SIZE - 3] = 0x42;
+	return 1;
+}
+
+static int
+teardown()
+{
+	unlink(out_path);
+	unlink(map_path);
+	free(data);
+	free(copy);
+	return 1;
+}
+
+static int
+read_file(const char *path, unsigned char *buf, unsigned nbyte)
+{
+	FILE *fp;
+	size_t n;
+
+	if ((fp = fopen(path, "r")) == 0) {
+		return -1;
+	}
+	n = fread(buf, 1, nbyte, fp);
+	if (fgetc(fp) != EOF) {
+		n++;
+	}
+	fclose(fp);
+	return (int) n;
+}
+
+/* Writes the test data in pieces of varying size.
+ */
+static int
+write_pieces(RDD_WRITER *w)
+{
+	unsigned pieces[] = {1, 3 * RDD_SPARSE_BLOCKSIZE, 1000, 65536 + 17};
+	unsigned i, pos, n;
+
+	for (pos = 0, i = 0; pos < DATA_SIZE; pos += n, i++) {
+		n = pieces[i % 4];
+		if (n > DATA_SIZE - pos) n = DATA_SIZE - pos;
+		CHECK_UINT(RDD_OK, rdd_writer_write(w, data + pos, n));
+	}
+	return 1;
+}
+
+static int
+test_is_zero()
+{
+	unsigned char buf[1000];
+	unsigned off, len;
+
+	memset(buf, 0, sizeof buf);
+	CHECK_TRUE(rdd_is_zero(buf, 0));
+	for (off = 0; off < 16; off++) {
+		for (len = 1; off + len <= 600; len++) {
+			CHECK_TRUE(rdd_is_zero(buf + off, len));
+			buf[off + len - 1] = 1;
+			CHECK_TRUE(! rdd_is_zero(buf + off, len));
+			buf[off + len - 1] = 0;
+			buf[off] = 0x80;
+			CHECK_TRUE(! rdd_is_zero(buf + off, len));
+			buf[off] = 0;
+		}
+	}
+	return 1;
+}
+
+static int
+test_sparse_file()
+{
+	RDD_WRITER *w = 0;
+	struct stat info;
+	unsigned long long start, len;
+	unsigned nhole = 0;
+	FILE *fp;
+
+	unlink(out_path);
+	unlink(map_path);
+	CHECK_UINT(RDD_OK, rdd_open_safe_writer(&w, out_path, RDD_OVERWRITE));
+	CHECK_UINT(RDD_OK, rdd_open_sparse_writer(&w, w, map_path, RDD_OVERWRITE));
+	if (! write_pieces(w)) return 0;
+	CHECK_UINT(RDD_OK, rdd_writer_close(w));
+
+	CHECK_INT(DATA_SIZE, read_file(out_path, copy, DATA_SIZE));
+	CHECK_TRUE(memcmp(data, copy, DATA_SIZE) == 0);
+	CHECK_TRUE(stat(out_path, &info) == 0);
+	CHECK_TRUE((unsigned long long) info.st_blocks * 512 < DATA_SIZE / 4);
+
+	/* Each listed hole must be zero and block aligned. */
+	CHECK_NOT_NULL(fp = fopen(map_path, "r"));
+	while (fscanf(fp, "%llu %llu", &start, &len) == 2) {
+		CHECK_UINT(0, (unsigned) (start & (RDD_SPARSE_BLOCKSIZE - 1)));
+		CHECK_TRUE(start + len <= DATA_SIZE);
+		CHECK_TRUE(rdd_is_zero(data + start, len));
+		nhole++;
+	}
+	fclose(fp);
+	CHECK_UINT(2, nhole);
+
+	return 1;
+}
+
+static int
+test_sparse_parts()
+{
+	RDD_WRITER *w = 0;
+	char part[64];
+	unsigned i;
+
+	CHECK_UINT(RDD_OK, rdd_open_part_writer(&w, out_path, DATA_SIZE,
+				SPLIT_SIZE, RDD_OVERWRITE, 0));
+	CHECK_UINT(RDD_OK, rdd_open_sparse_writer(&w, w, 0, RDD_OVERWRITE));
+	if (! write_pieces(w)) return 0;
+	CHECK_UINT(RDD_OK, rdd_writer_close(w));
+
+	/* Part 1 is all zeros, but must still have the full size. */
+	for (i = 0; i < DATA_SIZE / SPLIT_SIZE; i++) {
+		snprintf(part, sizeof part, "%u-%s", i, out_path);
+		CHECK_INT(SPLIT_SIZE, read_file(part, copy, SPLIT_SIZE));
+		CHECK_TRUE(memcmp(data + i * SPLIT_SIZE, copy, SPLIT_SIZE) == 0);
+		unlink(part);
+	}
+	return 1;
+}
+
+/* A parent without a skip routine gets the zeros written out.
+ */
+typedef struct _MEM_WRITER {
+	unsigned char *buf;
+	unsigned       pos;
+} MEM_WRITER;
+
+static int
+mem_write(RDD_WRITER *w, const unsigned char *buf, unsigned nbyte)
+{
+	MEM_WRITER *state = w->state;
+
+	if (state->pos + nbyte > DATA_SIZE) {
+		return RDD_EWRITE;
+	}
+	memcpy(state->buf + state->pos, buf, nbyte);
+	state->pos += nbyte;
+	return RDD_OK;
+}
+
+static int
+mem_close(RDD_WRITER *w)
+{
+	return RDD_OK;
+}
+
+static RDD_WRITE_OPS mem_write_ops = {
+	mem_write,
+	mem_close
+};
+
+static int
+test_sparse_no_holes()
+{
+	RDD_WRITER *parent = 0;
+	RDD_WRITER *w = 0;
+	unsigned pos;
+
+	CHECK_UINT(RDD_OK, rdd_new_writer(&parent, &mem_write_ops,
+				sizeof(MEM_WRITER)));
+	((MEM_WRITER *) parent->state)->buf = copy;
+	memset(copy, 0xff, DATA_SIZE);
+
+	CHECK_UINT(RDD_OK, rdd_open_sparse_writer(&w, parent, 0, RDD_OVERWRITE));
+	if (! write_pieces(w)) return 0;
+	pos = ((MEM_WRITER *) parent->state)->pos;
+	CHECK_UINT(RDD_OK, rdd_writer_close(w));
+
+	CHECK_UINT(DATA_SIZE, pos);
+	CHECK_TRUE(memcmp(data, copy, DATA_SIZE) == 0);
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_is_zero);
+	SAFE_TEST(test_sparse_file);
+	SAFE_TEST(test_sparse_parts);
+	SAFE_TEST(test_sparse_no_holes);
+
+	return result;
+}
+
+TEST_MAIN
+;
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rdd.h"
+#include "rdd_internals.h"
+#include "writer.h"
+#include "filter.h"
+
+#include "testhelper.h"
+
+#define DATA_SIZE	200000
+#define BLOCK_SIZE	4096
+
+static unsigned char data[DATA_SIZE];
+
+/* Push sizes; chosen to straddle block boundaries. */
+static unsigned pieces[] = { 1, 4095, 4097, 7, 16384, 13 };
+
+#define NPIECE	(sizeof pieces / sizeof pieces[0])
+
+static char outfile[] = "stats.out";
+static char statefile[] = "stats.state";
+
+/* Random data, a zero-filled run, a run of one non-zero byte value,
+ * and text-like data with a narrow range of byte values.
+ */
+static int
+setup()
+{
+	unsigned i;
+
+	srand(31);
+	for (i = 0; i < DATA_SIZE; i++) {
+		data[i] = (unsigned char) rand();
+	}
+	memset(data + 10000, 0, 50000);
+	memset(data + 60000, 0xe5, 20000);
+	for (i = 80000; i < 120000; i++) {
+		data[i] = (unsigned char) ('a' + rand() % 26);
+	}
+	return 1;
+}
+
+static int
+teardown()
+{
+	remove(outfile);
+	remove(statefile);
+	return 1;
+}
+
+static int
+push_pieces(RDD_FILTER *f, unsigned start, unsigned len)
+{
+	unsigned pos = start;
+	unsigned i = 0;
+	unsigned n;
+
+	while (pos < start + len) {
+		n = pieces[i++ % NPIECE];
+		if (pos + n > start + len) {
+			n = start + len - pos;
+		}
+		CHECK_UINT(RDD_OK, rdd_filter_push(f, data + pos, n));
+		pos += n;
+	}
+	return 1;
+}
+
+/* Checks every output line against statistics computed directly
+ * from the data, one byte and one log() at a time.
+ */
+static int
+check_output(unsigned len, unsigned blocksize)
+{
+	unsigned long long blocknum;
+	unsigned minb, maxb, modus, fmodus;
+	unsigned hist[256];
+	unsigned pos, n, i, nblock = 0;
+	unsigned emin, emax, emodus;
+	double entropy, eent, p;
+	int nfield;
+	FILE *fp;
+
+	CHECK_TRUE((fp = fopen(outfile, "r")) != 0);
+	for (pos = 0; pos < len; pos += n, nblock++) {
+		n = len - pos < blocksize ? len - pos : blocksize;
+
+		memset(hist, 0, sizeof hist);
+		emin = 255;
+		emax = 0;
+		for (i = pos; i < pos + n; i++) {
+			hist[data[i]]++;
+			if (data[i] < emin) emin = data[i];
+			if (data[i] > emax) emax = data[i];
+		}
+		emodus = 0;
+		eent = 0.0;
+		for (i = 0; i < 256; i++) {
+			if (hist[i] > hist[emodus]) emodus = i;
+			if (hist[i] > 0) {
+				p = (double) hist[i] / n;
+				eent -= p * log(p) / log(2.0);
+			}
+		}
+
+		nfield = fscanf(fp, "%llu\t%u\t%u\t%u\t%u\t%lf",
+			&blocknum, &minb, &maxb, &modus, &fmodus, &entropy);
+		CHECK_INT(6, nfield);
+		CHECK_UINT(nblock, (unsigned) blocknum);
+		CHECK_UINT(emin, minb);
+		CHECK_UINT(emax, maxb);
+		CHECK_UINT(emodus, modus);
+		CHECK_UINT(hist[emodus], fmodus);
+		CHECK_TRUE(fabs(entropy - eent) < 1e-5);
+	}
+	nfield = fscanf(fp, "%llu", &blocknum);
+	CHECK_INT(EOF, nfield);
+	fclose(fp);
+
+	return 1;
+}
+
+static int
+test_stats_values()
+{
+	unsigned sizes[] = { 512, BLOCK_SIZE, 5000, 65536 };
+	RDD_FILTER *f = 0;
+	unsigned i;
+
+	for (i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+		CHECK_UINT(RDD_OK, rdd_new_stats_blockfilter(&f, sizes[i],
+					outfile, RDD_OVERWRITE));
+		CHECK_TRUE(push_pieces(f, 0, DATA_SIZE));
+		CHECK_UINT(RDD_OK, rdd_filter_close(f));
+		CHECK_UINT(RDD_OK, rdd_filter_free(f));
+		CHECK_TRUE(check_output(DATA_SIZE, sizes[i]));
+	}
+
+	return 1;
+}
+
+static int
+test_stats_save_restore()
+{
+	unsigned half = 17 * BLOCK_SIZE + 1001;
+	RDD_FILTER *f = 0;
+	FILE *fp;
+
+	CHECK_UINT(RDD_OK, rdd_new_stats_blockfilter(&f, BLOCK_SIZE,
+				outfile, RDD_OVERWRITE));
+	CHECK_TRUE(push_pieces(f, 0, half));
+	CHECK_TRUE((fp = fopen(statefile, "wb")) != 0);
+	CHECK_UINT(RDD_OK, rdd_filter_save(f, fp));
+	fclose(fp);
+
+	/* Output written after the checkpoint is discarded on restore. */
+	CHECK_TRUE(push_pieces(f, half, 10 * BLOCK_SIZE));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	CHECK_UINT(RDD_OK, rdd_new_stats_blockfilter(&f, BLOCK_SIZE,
+				outfile, RDD_RESUME));
+	CHECK_TRUE((fp = fopen(statefile, "rb")) != 0);
+	CHECK_UINT(RDD_OK, rdd_filter_restore(f, fp));
+	fclose(fp);
+	CHECK_TRUE(push_pieces(f, half, DATA_SIZE - half));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	CHECK_TRUE(check_output(DATA_SIZE, BLOCK_SIZE));
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_stats_values);
+	SAFE_TEST(test_stats_save_restore);
+
+	return result;
+}
+
+TEST_MAIN
+;
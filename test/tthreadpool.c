@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rdd.h"
+#include "threadpool.h"
+
+#include "testhelper.h"
+
+#define NTASK	1000
+
+static unsigned done[NTASK];
+
+static int
+setup()
+{
+	memset(done, 0, sizeof done);
+	return 1;
+}
+
+static int
+teardown()
+{
+	return 1;
+}
+
+static int
+mark_done(void *arg)
+{
+	unsigned *flag = (unsigned *) arg;
+
+	(*flag)++;
+	return RDD_OK;
+}
+
+static int
+fail_odd(void *arg)
+{
+	unsigned *flag = (unsigned *) arg;
+
+	(*flag)++;
+	return ((flag - done) % 2) != 0 ? RDD_EREAD : RDD_OK;
+}
+
+static int
+test_threadpool_bad_args()
+{
+	RDD_THREADPOOL *pool = 0;
+
+	CHECK_UINT(RDD_BADARG, rdd_new_threadpool(0, 1, 1));
+	CHECK_UINT(RDD_BADARG, rdd_new_threadpool(&pool, 1, 0));
+
+	CHECK_UINT(RDD_OK, rdd_new_threadpool(&pool, 1, 1));
+	CHECK_UINT(RDD_BADARG, rdd_threadpool_submit(pool, 0, 0));
+	CHECK_UINT(RDD_OK, rdd_free_threadpool(pool));
+
+	return 1;
+}
+
+static int
+test_threadpool_default_size()
+{
+	RDD_THREADPOOL *pool = 0;
+
+	CHECK_TRUE(rdd_ncpu() >= 1);
+	CHECK_UINT(RDD_OK, rdd_new_threadpool(&pool, 0, 4));
+	CHECK_UINT(rdd_ncpu(), rdd_threadpool_nthread(pool));
+	CHECK_UINT(RDD_OK, rdd_free_threadpool(pool));
+
+	return 1;
+}
+
+/* More tasks than queue entries: submit must block rather than drop
+ * tasks, and every task must run exactly once.
+ */
+static int
+test_threadpool_run_all()
+{
+	RDD_THREADPOOL *pool = 0;
+	unsigned i;
+
+	CHECK_UINT(RDD_OK, rdd_new_threadpool(&pool, 4, 3));
+	for (i = 0; i < NTASK; i++) {
+		CHECK_UINT(RDD_OK, rdd_threadpool_submit(pool, mark_done, &done[i]));
+	}
+	CHECK_UINT(RDD_OK, rdd_threadpool_wait(pool));
+	for (i = 0; i < NTASK; i++) {
+		CHECK_UINT(1, done[i]);
+	}
+
+	/* The pool can be reused after a wait. */
+	for (i = 0; i < NTASK; i++) {
+		CHECK_UINT(RDD_OK, rdd_threadpool_submit(pool, mark_done, &done[i]));
+	}
+	CHECK_UINT(RDD_OK, rdd_free_threadpool(pool));
+	for (i = 0; i < NTASK; i++) {
+		CHECK_UINT(2, done[i]);
+	}
+
+	return 1;
+}
+
+static int
+test_threadpool_error()
+{
+	RDD_THREADPOOL *pool = 0;
+	unsigned i;
+
+	CHECK_UINT(RDD_OK, rdd_new_threadpool(&pool, 2, 8));
+	for (i = 0; i < 10; i++) {
+		CHECK_UINT(RDD_OK, rdd_threadpool_submit(pool, fail_odd, &done[i]));
+	}
+	CHECK_UINT(RDD_EREAD, rdd_threadpool_wait(pool));
+
+	/* A failing task does not stop the others. */
+	for (i = 0; i < 10; i++) {
+		CHECK_UINT(1, done[i]);
+	}
+	CHECK_UINT(RDD_OK, rdd_free_threadpool(pool));
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_threadpool_bad_args);
+	SAFE_TEST(test_threadpool_default_size);
+	SAFE_TEST(test_threadpool_run_all);
+	SAFE_TEST(test_threadpool_error);
+
+	return result;
+}
+
+TEST_MAIN
+;
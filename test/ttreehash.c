@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include "rdd.h"
+#include "writer.h"
+#include "filter.h"
+#include "hashengine.h"
+
+#include "testhelper.h"
+
+#define DATA_SIZE	300000
+#define LEAF_SIZE	4096
+
+static unsigned char data[DATA_SIZE];
+
+/* Push sizes; chosen to straddle leaf boundaries. */
+static unsigned pieces[] = { 1, 4095, 4097, 16384, 7, 100000 };
+
+#define NPIECE	(sizeof pieces / sizeof pieces[0])
+
+static char statefile[] = "treehash.state";
+
+static int
+setup()
+{
+	unsigned i;
+
+	srand(23);
+	for (i = 0; i < DATA_SIZE; i++) {
+		data[i] = (unsigned char) rand();
+	}
+	return 1;
+}
+
+static int
+teardown()
+{
+	rdd_hash_set_engine(RDD_HASH_ENGINE_AUTO);
+	remove(statefile);
+	return 1;
+}
+
+/* Reference implementation: the RFC 6962 Merkle tree hash of the
+ * leaves of buf[0..len), computed recursively.  It uses EVP directly,
+ * so it does not depend on the hash engine under test.
+ */
+static void
+ref_tree_hash(const unsigned char *buf, rdd_count_t len,
+		unsigned leafsize, unsigned char *md)
+{
+	unsigned char l[SHA256_DIGEST_LENGTH], r[SHA256_DIGEST_LENGTH];
+	unsigned char prefix;
+	rdd_count_t nleaf = (len + leafsize - 1) / leafsize;
+	rdd_count_t k;
+	EVP_MD_CTX *ctx;
+
+	if (nleaf > 1) {
+		for (k = 1; 2 * k < nleaf; k *= 2) {
+			/* k is the largest power of two smaller than nleaf */
+		}
+		ref_tree_hash(buf, k * leafsize, leafsize, l);
+		ref_tree_hash(buf + k * leafsize, len - k * leafsize,
+				leafsize, r);
+	}
+
+	ctx = EVP_MD_CTX_new();
+	EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+	if (nleaf > 1) {
+		prefix = 0x01;
+		EVP_DigestUpdate(ctx, &prefix, 1);
+		EVP_DigestUpdate(ctx, l, sizeof l);
+		EVP_DigestUpdate(ctx, r, sizeof r);
+	} else if (len > 0) {
+		prefix = 0x00;
+		EVP_DigestUpdate(ctx, &prefix, 1);
+		EVP_DigestUpdate(ctx, buf, len);
+	}
+	EVP_DigestFinal_ex(ctx, md, NULL);
+	EVP_MD_CTX_free(ctx);
+}
+
+/* Pushes data[start..start+len) into f in pieces of varying size.
+ */
+static int
+push_pieces(RDD_FILTER *f, rdd_count_t start, rdd_count_t len)
+{
+	rdd_count_t pos = start;
+	unsigned i = 0;
+	unsigned n;
+
+	while (pos < start + len) {
+		n = pieces[i++ % NPIECE];
+		if (pos + n > start + len) {
+			n = (unsigned) (start + len - pos);
+		}
+		CHECK_UINT(RDD_OK, rdd_filter_push(f, data + pos, n));
+		pos += n;
+	}
+	return 1;
+}
+
+/* Tree-hashes data[0..len) and compares the result to the reference.
+ */
+static int
+check_tree_hash(rdd_count_t len, unsigned leafsize, unsigned nthread)
+{
+	unsigned char md[SHA256_DIGEST_LENGTH];
+	unsigned char ref[SHA256_DIGEST_LENGTH];
+	RDD_FILTER *f = 0;
+
+	CHECK_UINT(RDD_OK, rdd_new_treehash_streamfilter(&f, leafsize, nthread));
+	CHECK_TRUE(push_pieces(f, 0, len));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_ESPACE, rdd_filter_get_result(f, md, sizeof md - 1));
+	CHECK_UINT(RDD_OK, rdd_filter_get_result(f, md, sizeof md));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	ref_tree_hash(data, len, leafsize, ref);
+	CHECK_TRUE(memcmp(md, ref, sizeof md) == 0);
+
+	return 1;
+}
+
+static int
+test_treehash_bad_args()
+{
+	RDD_FILTER *f = 0;
+
+	CHECK_UINT(RDD_BADARG, rdd_new_treehash_streamfilter(0, LEAF_SIZE, 1));
+	CHECK_UINT(RDD_BADARG, rdd_new_treehash_streamfilter(&f, 0, 1));
+
+	return 1;
+}
+
+static int
+test_treehash_small()
+{
+	CHECK_TRUE(check_tree_hash(0, LEAF_SIZE, 2));		/* empty tree */
+	CHECK_TRUE(check_tree_hash(1, LEAF_SIZE, 2));		/* one short leaf */
+	CHECK_TRUE(check_tree_hash(LEAF_SIZE, LEAF_SIZE, 2));	/* one leaf */
+	CHECK_TRUE(check_tree_hash(2 * LEAF_SIZE, LEAF_SIZE, 2));
+	CHECK_TRUE(check_tree_hash(5 * LEAF_SIZE, LEAF_SIZE, 2));
+	CHECK_TRUE(check_tree_hash(7 * LEAF_SIZE + 100, LEAF_SIZE, 2));
+
+	return 1;
+}
+
+/* Many more leaves than slots, so slots are recycled. */
+static int
+test_treehash_large()
+{
+	CHECK_TRUE(check_tree_hash(DATA_SIZE, LEAF_SIZE, 1));
+	CHECK_TRUE(check_tree_hash(DATA_SIZE, LEAF_SIZE, 4));
+	CHECK_TRUE(check_tree_hash(DATA_SIZE, 1000, 3));
+	CHECK_TRUE(check_tree_hash(64 * LEAF_SIZE, LEAF_SIZE, 4));
+
+	return 1;
+}
+
+static int
+test_treehash_save_restore()
+{
+	rdd_count_t half = 37 * LEAF_SIZE + 5;
+	unsigned char md[SHA256_DIGEST_LENGTH];
+	unsigned char ref[SHA256_DIGEST_LENGTH];
+	RDD_FILTER *f = 0;
+	FILE *fp;
+
+	CHECK_UINT(RDD_OK, rdd_hash_set_engine(RDD_HASH_ENGINE_LEGACY));
+	CHECK_UINT(RDD_OK, rdd_new_treehash_streamfilter(&f, LEAF_SIZE, 4));
+	CHECK_TRUE(push_pieces(f, 0, half));
+	CHECK_TRUE((fp = fopen(statefile, "wb")) != 0);
+	CHECK_UINT(RDD_OK, rdd_filter_save(f, fp));
+	fclose(fp);
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	/* The leaf size must match. */
+	CHECK_UINT(RDD_OK, rdd_new_treehash_streamfilter(&f, 2 * LEAF_SIZE, 4));
+	CHECK_TRUE((fp = fopen(statefile, "rb")) != 0);
+	CHECK_UINT(RDD_ESYNTAX, rdd_filter_restore(f, fp));
+	fclose(fp);
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	/* The number of threads need not match. */
+	CHECK_UINT(RDD_OK, rdd_new_treehash_streamfilter(&f, LEAF_SIZE, 3));
+	CHECK_TRUE(push_pieces(f, 0, 1000));	/* discarded by restore */
+	CHECK_TRUE((fp = fopen(statefile, "rb")) != 0);
+	CHECK_UINT(RDD_OK, rdd_filter_restore(f, fp));
+	fclose(fp);
+	CHECK_TRUE(push_pieces(f, half, DATA_SIZE - half));
+	CHECK_UINT(RDD_OK, rdd_filter_close(f));
+	CHECK_UINT(RDD_OK, rdd_filter_get_result(f, md, sizeof md));
+	CHECK_UINT(RDD_OK, rdd_filter_free(f));
+
+	ref_tree_hash(data, DATA_SIZE, LEAF_SIZE, ref);
+	CHECK_TRUE(memcmp(md, ref, sizeof md) == 0);
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_treehash_bad_args);
+	SAFE_TEST(test_treehash_small);
+	SAFE_TEST(test_treehash_large);
+	SAFE_TEST(test_treehash_save_restore);
+
+	return result;
+}
+
+TEST_MAIN
+;
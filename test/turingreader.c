@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2002 - 2010, Netherlands Forensic Institute
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rdd.h"
+#include "reader.h"
+
+#include "testhelper.h"
+
+#define CHUNK_LEN	4096
+#define DEPTH		4
+
+static char image[] = "../test/image.img";
+
+static RDD_READER *uring_reader, *file_reader;
+static int have_uring;
+
+static int
+setup()
+{
+	int rc;
+
+	rc = rdd_open_uring_reader(&uring_reader, image, 0, DEPTH, CHUNK_LEN);
+	if (rc == RDD_EOPEN) {
+		/* No io_uring support in this kernel or build. */
+		uring_reader = NULL;
+		have_uring = 0;
+	} else {
+		CHECK_UINT(RDD_OK, rc);
+		have_uring = 1;
+	}
+	CHECK_UINT(RDD_OK, rdd_open_file_reader(&file_reader, image, 0));
+
+	return 1;
+}
+
+static int
+teardown()
+{
+	if (uring_reader != NULL) {
+		CHECK_UINT(RDD_OK, rdd_reader_close(uring_reader, 0));
+		uring_reader = NULL;
+	}
+	if (file_reader != NULL) {
+		CHECK_UINT(RDD_OK, rdd_reader_close(file_reader, 0));
+		file_reader = NULL;
+	}
+
+	return 1;
+}
+
+/* Reads nbyte bytes from both readers and compares the results.
+ */
+static int
+compare_read(unsigned nbyte)
+{
+	unsigned char *ubuf = 0, *fbuf = 0;
+	unsigned unread, fnread;
+	int ok = 0;
+
+	CHECK_NOT_NULL_GOTO(ubuf = malloc(nbyte));
+	CHECK_NOT_NULL_GOTO(fbuf = malloc(nbyte));
+
+	CHECK_UINT_GOTO(RDD_OK,
+		rdd_reader_read(uring_reader, ubuf, nbyte, &unread));
+	CHECK_UINT_GOTO(RDD_OK,
+		rdd_reader_read(file_reader, fbuf, nbyte, &fnread));
+	CHECK_UINT_GOTO(fnread, unread);
+	CHECK_UCHAR_ARRAY_GOTO(fbuf, ubuf, (int) fnread);
+	ok = 1;
+
+error:
+	free(ubuf);
+	free(fbuf);
+	return ok;
+}
+
+static int
+compare_seek(rdd_count_t pos)
+{
+	rdd_count_t upos;
+
+	CHECK_UINT(RDD_OK, rdd_reader_seek(uring_reader, pos));
+	CHECK_UINT(RDD_OK, rdd_reader_seek(file_reader, pos));
+	CHECK_UINT(RDD_OK, rdd_reader_tell(uring_reader, &upos));
+	CHECK_UINT64((unsigned long long) pos, upos);
+
+	return 1;
+}
+
+static int
+test_open_bad_args()
+{
+	RDD_READER *r = 0;
+
+	if (!have_uring) return 1;
+
+	CHECK_UINT(RDD_BADARG, rdd_open_uring_reader(&r, image, 0, 0, CHUNK_LEN));
+	CHECK_UINT(RDD_BADARG, rdd_open_uring_reader(&r, image, 0, DEPTH, 0));
+	CHECK_UINT(RDD_BADARG, rdd_open_uring_reader(&r, image, 0, DEPTH, 1000));
+
+	return 1;
+}
+
+static int
+test_open_nonexistent_file()
+{
+	RDD_READER *r = 0;
+
+	CHECK_UINT(RDD_EOPEN, rdd_open_uring_reader(&r, "nonexistent.img",
+						0, DEPTH, CHUNK_LEN));
+	CHECK_NULL(r);
+
+	return 1;
+}
+
+static int
+test_read_whole_file()
+{
+	rdd_count_t pos;
+	unsigned char buf[CHUNK_LEN];
+	unsigned nread;
+	unsigned i;
+
+	if (!have_uring) return 1;
+
+	/* image.img holds 384 blocks of 4096 bytes. */
+	for (i = 0; i < 384; i++) {
+		CHECK_TRUE(compare_read(CHUNK_LEN));
+	}
+	CHECK_UINT(RDD_OK, rdd_reader_tell(uring_reader, &pos));
+	CHECK_UINT64(384ULL * CHUNK_LEN, pos);
+
+	CHECK_UINT(RDD_OK, rdd_reader_read(uring_reader, buf, CHUNK_LEN, &nread));
+	CHECK_UINT(0, nread);
+
+	return 1;
+}
+
+static int
+test_read_odd_sizes()
+{
+	unsigned sizes[] = { 1, 511, 513, 4095, 4097, 3 * CHUNK_LEN + 7,
+				10 * CHUNK_LEN + 1 };
+	unsigned i, k;
+
+	if (!have_uring) return 1;
+
+	for (k = 0; k < 20; k++) {
+		for (i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+			CHECK_TRUE(compare_read(sizes[i]));
+		}
+	}
+
+	return 1;
+}
+
+static int
+test_seek_within_window()
+{
+	if (!have_uring) return 1;
+
+	CHECK_TRUE(compare_read(100));
+	CHECK_TRUE(compare_seek(2 * CHUNK_LEN + 17));
+	CHECK_TRUE(compare_read(CHUNK_LEN));
+	CHECK_TRUE(compare_seek(3 * CHUNK_LEN));
+	CHECK_TRUE(compare_read(5 * CHUNK_LEN));
+
+	return 1;
+}
+
+static int
+test_seek_outside_window()
+{
+	if (!have_uring) return 1;
+
+	CHECK_TRUE(compare_seek(1000000));
+	CHECK_TRUE(compare_read(12345));
+	CHECK_TRUE(compare_seek(777));
+	CHECK_TRUE(compare_read(CHUNK_LEN));
+	CHECK_TRUE(compare_seek(0));
+	CHECK_TRUE(compare_read(3 * CHUNK_LEN));
+
+	return 1;
+}
+
+static int
+test_read_past_end()
+{
+	if (!have_uring) return 1;
+
+	CHECK_TRUE(compare_seek(384 * CHUNK_LEN - 100));
+	CHECK_TRUE(compare_read(CHUNK_LEN));
+	CHECK_TRUE(compare_read(CHUNK_LEN));
+	CHECK_TRUE(compare_seek(384 * CHUNK_LEN + 5000));
+	CHECK_TRUE(compare_read(CHUNK_LEN));
+
+	return 1;
+}
+
+/* Writes a file of nbyte bytes, reads it back through a uring reader
+ * in reads of readlen bytes, and compares the data.  Files whose size
+ * is not a multiple of the sector size end in a short chunk.
+ */
+static int
+read_file_of_size(unsigned nbyte, unsigned readlen, int raw)
+{
+	static const char path[] = "turingreader.tmp";
+	RDD_READER *r = 0;
+	unsigned char *data = 0, *buf = 0;
+	unsigned total = 0, nread;
+	FILE *fp;
+	unsigned i;
+	int rc;
+	int ok = 0;
+
+	CHECK_NOT_NULL_GOTO(data = malloc(nbyte));
+	CHECK_NOT_NULL_GOTO(buf = malloc(nbyte + readlen));
+	for (i = 0; i < nbyte; i++) {
+		data[i] = (unsigned char) (i * 7 + 3);
+	}
+	CHECK_NOT_NULL_GOTO(fp = fopen(path, "wb"));
+	CHECK_UINT_GOTO(nbyte, (unsigned) fwrite(data, 1, nbyte, fp));
+	fclose(fp);
+
+	rc = rdd_open_uring_reader(&r, path, raw, DEPTH, CHUNK_LEN);
+	if (rc == RDD_EOPEN && raw) {
+		ok = 1;		/* no O_DIRECT on this file system */
+		goto error;
+	}
+	CHECK_UINT_GOTO(RDD_OK, rc);
+
+	do {
+		CHECK_UINT_GOTO(RDD_OK,
+			rdd_reader_read(r, buf + total, readlen, &nread));
+		total += nread;
+		CHECK_INT_GOTO(1, total <= nbyte);
+	} while (nread == readlen);
+
+	CHECK_UINT_GOTO(nbyte, total);
+	CHECK_UCHAR_ARRAY_GOTO(data, buf, (int) nbyte);
+
+	/* Reading at the end of the file keeps returning nothing. */
+	CHECK_UINT_GOTO(RDD_OK, rdd_reader_read(r, buf, readlen, &nread));
+	CHECK_UINT_GOTO(0, nread);
+	ok = 1;
+
+error:
+	if (r != 0) {
+		rdd_reader_close(r, 0);
+	}
+	remove(path);
+	free(data);
+	free(buf);
+	return ok;
+}
+
+static int
+test_read_odd_file_sizes()
+{
+	unsigned sizes[] = { 1, 100, 511, 5000, 8192, 10000,
+				DEPTH * CHUNK_LEN + 1 };
+	unsigned i;
+
+	if (!have_uring) return 1;
+
+	for (i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+		CHECK_TRUE(read_file_of_size(sizes[i], CHUNK_LEN, 0));
+		CHECK_TRUE(read_file_of_size(sizes[i], 1000, 0));
+		CHECK_TRUE(read_file_of_size(sizes[i], 1, 0));
+	}
+
+	return 1;
+}
+
+static int
+test_read_odd_file_sizes_raw()
+{
+	unsigned sizes[] = { 1, 100, 5000, 10000, DEPTH * CHUNK_LEN + 1 };
+	unsigned i;
+
+	if (!have_uring) return 1;
+
+	for (i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+		CHECK_TRUE(read_file_of_size(sizes[i], 512, 1));
+		CHECK_TRUE(read_file_of_size(sizes[i], CHUNK_LEN, 1));
+	}
+
+	return 1;
+}
+
+static int
+call_tests(void)
+{
+	int result = 1;
+
+	SAFE_TEST(test_open_bad_args);
+	TEST(test_open_nonexistent_file);
+	SAFE_TEST(test_read_whole_file);
+	SAFE_TEST(test_read_odd_sizes);
+	SAFE_TEST(test_seek_within_window);
+	SAFE_TEST(test_seek_outside_window);
+	SAFE_TEST(test_read_past_end);
+	SAFE_TEST(test_read_odd_file_sizes);
+	SAFE_TEST(test_read_odd_file_sizes_raw);
+
+	if (!have_uring) {
+		printf("io_uring is not available; only open tests were run\n");
+	}
+
+	return result;
+}
+
+TEST_MAIN
+;